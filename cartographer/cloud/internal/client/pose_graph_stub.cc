@@ -209,6 +209,19 @@ PoseGraphStub::constraints() const {
   return mapping::FromProto(client.response().constraints());
 }
 
+std::shared_ptr<const mapping::PoseGraphInterface::Snapshot>
+PoseGraphStub::GetSnapshot() const {
+  // The server does not publish snapshots, so one is assembled from the
+  // individual requests. Submap data is not available remotely.
+  auto snapshot = std::make_shared<Snapshot>();
+  snapshot->trajectory_node_poses = GetTrajectoryNodePoses();
+  snapshot->submap_poses = GetAllSubmapPoses();
+  snapshot->constraints = constraints();
+  snapshot->landmark_poses = GetLandmarkPoses();
+  snapshot->trajectory_states = GetTrajectoryStates();
+  return snapshot;
+}
+
 mapping::proto::PoseGraph PoseGraphStub::ToProto(
     bool include_unfinished_submaps) const {
   LOG(FATAL) << "Not implemented";
@@ -54,6 +54,7 @@ class PoseGraphStub : public ::cartographer::mapping::PoseGraphInterface {
   std::map<int, mapping::PoseGraphInterface::TrajectoryData> GetTrajectoryData()
       const override;
   std::vector<Constraint> constraints() const override;
+  std::shared_ptr<const Snapshot> GetSnapshot() const override;
   mapping::proto::PoseGraph ToProto(
       bool include_unfinished_submaps) const override;
   void SetGlobalSlamOptimizationCallback(
@@ -88,6 +88,14 @@ void TrajectoryBuilderStub::AddSensorData(
   add_rangefinder_client_->Write(request);
 }
 
+void TrajectoryBuilderStub::AddSensorData(
+    const std::string& sensor_id,
+    const sensor::OrganizedPointCloudData& organized_point_cloud_data) {
+  // Only missing returns are dropped, the server filters by range.
+  AddSensorData(sensor_id, sensor::ToTimedPointCloudData(
+                               organized_point_cloud_data, 0.f));
+}
+
 void TrajectoryBuilderStub::AddSensorData(const std::string& sensor_id,
                                           const sensor::ImuData& imu_data) {
   if (!add_imu_client_) {
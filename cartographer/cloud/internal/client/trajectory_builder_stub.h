@@ -47,6 +47,9 @@ class TrajectoryBuilderStub : public mapping::TrajectoryBuilderInterface {
   void AddSensorData(
       const std::string& sensor_id,
       const sensor::TimedPointCloudData& timed_point_cloud_data) override;
+  void AddSensorData(const std::string& sensor_id,
+                     const sensor::OrganizedPointCloudData&
+                         organized_point_cloud_data) override;
   void AddSensorData(const std::string& sensor_id,
                      const sensor::ImuData& imu_data) override;
   void AddSensorData(const std::string& sensor_id,
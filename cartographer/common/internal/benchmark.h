@@ -0,0 +1,66 @@
+/*
+ * Copyright 2018 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_COMMON_INTERNAL_BENCHMARK_H_
+#define CARTOGRAPHER_COMMON_INTERNAL_BENCHMARK_H_
+
+#include <chrono>
+#include <string>
+
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+namespace cartographer {
+namespace common {
+
+// Sets up logging to stderr and parses the command line flags of a benchmark
+// binary, which prints 'usage' for --help.
+inline void InitBenchmark(const std::string& usage, int* argc, char*** argv) {
+  google::InitGoogleLogging((*argv)[0]);
+  FLAGS_logtostderr = true;
+  google::SetUsageMessage(usage);
+  google::ParseCommandLineFlags(argc, argv, true);
+}
+
+// Returns the wall time in seconds which passed since 'start'.
+inline double SecondsSince(const std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+// Calls 'function' with the iterations 0 to 'num_iterations' - 1 and logs the
+// wall time per item, where every call processes 'num_items' 'item_name's,
+// e.g. points. The values returned by 'function' are summed into the logged
+// checksum, so that the work cannot be optimized away.
+template <typename Function>
+void RunBenchmark(const std::string& name, const int num_iterations,
+                  const int num_items, const std::string& item_name,
+                  Function function) {
+  const auto start = std::chrono::steady_clock::now();
+  double checksum = 0.;
+  for (int i = 0; i < num_iterations; ++i) {
+    checksum += function(i);
+  }
+  const double seconds = SecondsSince(start);
+  LOG(INFO) << name << ": " << 1e9 * seconds / num_iterations / num_items
+            << " ns per " << item_name << " (checksum " << checksum << ")";
+}
+
+}  // namespace common
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_COMMON_INTERNAL_BENCHMARK_H_
@@ -0,0 +1,90 @@
+/*
+ * Copyright 2018 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/common/internal/parallel_for.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+#include "absl/memory/memory.h"
+#include "absl/synchronization/mutex.h"
+#include "cartographer/common/task.h"
+
+namespace cartographer {
+namespace common {
+namespace {
+
+// Shared by the calling thread and the tasks helping it. A task may only start
+// after 'ParallelFor()' has returned, so the tasks own it together with the
+// caller.
+struct ParallelForState {
+  ParallelForState(const size_t size,
+                   const std::function<void(size_t)>* const function)
+      : size(size), function(function) {}
+
+  const size_t size;
+  // Only valid until all calls have returned, which is before any index at or
+  // beyond 'size' is handed out.
+  const std::function<void(size_t)>* const function;
+  std::atomic<size_t> next_index{0};
+  absl::Mutex mutex;
+  size_t num_calls_returned GUARDED_BY(mutex) = 0;
+};
+
+// Work is handed out index by index, since the calls may take very different
+// amounts of time.
+void Work(ParallelForState* const state) {
+  for (size_t i = state->next_index++; i < state->size;
+       i = state->next_index++) {
+    (*state->function)(i);
+    absl::MutexLock locker(&state->mutex);
+    ++state->num_calls_returned;
+  }
+}
+
+}  // namespace
+
+void ParallelFor(const size_t size, const int num_threads,
+                 ThreadPoolInterface* const thread_pool,
+                 const std::function<void(size_t)>& function) {
+  const size_t num_helpers =
+      thread_pool == nullptr
+          ? 0
+          : std::min<size_t>(std::max(num_threads, 1) - 1,
+                             size == 0 ? 0 : size - 1);
+  if (num_helpers == 0) {
+    for (size_t i = 0; i != size; ++i) {
+      function(i);
+    }
+    return;
+  }
+  const auto state = std::make_shared<ParallelForState>(size, &function);
+  for (size_t i = 0; i != num_helpers; ++i) {
+    auto task = absl::make_unique<Task>();
+    task->SetWorkItem([state]() { Work(state.get()); });
+    thread_pool->Schedule(std::move(task));
+  }
+  Work(state.get());
+  const auto predicate = [&state]() EXCLUSIVE_LOCKS_REQUIRED(state->mutex) {
+    return state->num_calls_returned == state->size;
+  };
+  absl::MutexLock locker(&state->mutex);
+  state->mutex.Await(absl::Condition(&predicate));
+}
+
+}  // namespace common
+}  // namespace cartographer
@@ -0,0 +1,41 @@
+/*
+ * Copyright 2018 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_COMMON_INTERNAL_PARALLEL_FOR_H_
+#define CARTOGRAPHER_COMMON_INTERNAL_PARALLEL_FOR_H_
+
+#include <cstddef>
+#include <functional>
+
+#include "cartographer/common/thread_pool.h"
+
+namespace cartographer {
+namespace common {
+
+// Calls 'function' for each index in [0, 'size'), and returns once all calls
+// have returned. The calling thread works through the indices itself, helped by
+// up to 'num_threads' - 1 tasks scheduled on 'thread_pool' unless it is
+// nullptr. The calling thread never waits for these tasks to start, so this
+// may be called from a task running on 'thread_pool', even if all its threads
+// are busy.
+void ParallelFor(size_t size, int num_threads,
+                 ThreadPoolInterface* thread_pool,
+                 const std::function<void(size_t)>& function);
+
+}  // namespace common
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_COMMON_INTERNAL_PARALLEL_FOR_H_
@@ -0,0 +1,75 @@
+/*
+ * Copyright 2018 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/common/internal/parallel_for.h"
+
+#include <atomic>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/synchronization/notification.h"
+#include "cartographer/common/thread_pool.h"
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace common {
+namespace {
+
+void ExpectEachIndexCalledOnce(ThreadPoolInterface* const thread_pool) {
+  for (const int num_threads : {1, 4}) {
+    std::vector<std::atomic<int>> calls(100);
+    for (auto& count : calls) {
+      count = 0;
+    }
+    ParallelFor(calls.size(), num_threads, thread_pool,
+                [&calls](const size_t i) { ++calls[i]; });
+    for (const auto& count : calls) {
+      EXPECT_EQ(count, 1);
+    }
+  }
+}
+
+TEST(ParallelForTest, CallsEachIndexOnce) {
+  ExpectEachIndexCalledOnce(nullptr);
+  ThreadPool thread_pool(3);
+  ExpectEachIndexCalledOnce(&thread_pool);
+}
+
+TEST(ParallelForTest, HandlesNoWork) {
+  ThreadPool thread_pool(1);
+  ParallelFor(0, 4, &thread_pool, [](const size_t) { FAIL(); });
+}
+
+TEST(ParallelForTest, RunsInsideTaskOfBusyThreadPool) {
+  ThreadPool thread_pool(1);
+  std::atomic<int> num_calls(0);
+  absl::Notification done;
+  auto task = absl::make_unique<Task>();
+  task->SetWorkItem([&thread_pool, &num_calls, &done]() {
+    // The only thread of 'thread_pool' is running this task, so the helpers
+    // cannot start before all calls have returned.
+    ParallelFor(10, 4, &thread_pool,
+                [&num_calls](const size_t) { ++num_calls; });
+    done.Notify();
+  });
+  thread_pool.Schedule(std::move(task));
+  done.WaitForNotification();
+  EXPECT_EQ(num_calls, 10);
+}
+
+}  // namespace
+}  // namespace common
+}  // namespace cartographer
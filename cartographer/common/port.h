@@ -45,6 +45,15 @@ inline int64 RoundToInt64(const float x) { return std::lround(x); }
 
 inline int64 RoundToInt64(const double x) { return std::lround(x); }
 
+// Same as RoundToInt(), but branch-free such that loops calling it can be
+// vectorized. The fraction is computed exactly, so results are identical for
+// values representable as int32.
+inline int32 FastRoundToInt32(const float x) {
+  const int32 truncated = static_cast<int32>(x);
+  const float fraction = x - static_cast<float>(truncated);
+  return truncated + (fraction >= 0.5f) - (fraction <= -0.5f);
+}
+
 inline void FastGzipString(const std::string& uncompressed,
                            std::string* compressed) {
   boost::iostreams::filtering_ostream out;
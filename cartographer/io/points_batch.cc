@@ -16,8 +16,24 @@
 
 #include "cartographer/io/points_batch.h"
 
+#include <string>
+
+#include "glog/logging.h"
+
 namespace cartographer {
 namespace io {
+namespace {
+
+template <typename T>
+void SetCustomField(const sensor::PointAttributes& attributes,
+                    const std::string& name, std::vector<T>* field) {
+  const std::vector<T>* const values = attributes.Find<T>(name);
+  if (values != nullptr) {
+    *field = *values;
+  }
+}
+
+}  // namespace
 
 void RemovePoints(absl::flat_hash_set<int> to_remove, PointsBatch* batch) {
   const int new_num_points = batch->points.size() - to_remove.size();
@@ -49,5 +65,18 @@ void RemovePoints(absl::flat_hash_set<int> to_remove, PointsBatch* batch) {
   batch->colors = std::move(colors);
 }
 
+void SetCustomFields(const sensor::PointAttributes& attributes,
+                     PointsBatch* const batch) {
+  CHECK(attributes.empty() ||
+        attributes.num_points() == batch->points.size());
+  SetCustomField(attributes, sensor::kReflectivityAttribute,
+                 &batch->reflectivities);
+  SetCustomField(attributes, sensor::kRingAttribute, &batch->rings);
+  SetCustomField(attributes, sensor::kAmbientAttribute, &batch->ambients);
+  SetCustomField(attributes, sensor::kRangeAttribute, &batch->ranges);
+  SetCustomField(attributes, sensor::kClassificationAttribute,
+                 &batch->classifications);
+}
+
 }  // namespace io
 }  // namespace cartographer
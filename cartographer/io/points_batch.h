@@ -25,6 +25,7 @@
 #include "absl/container/flat_hash_set.h"
 #include "cartographer/common/time.h"
 #include "cartographer/io/color.h"
+#include "cartographer/sensor/point_attributes.h"
 #include "cartographer/sensor/rangefinder_point.h"
 
 namespace cartographer {
@@ -77,6 +78,12 @@ struct PointsBatch {
 // Removes the indices in 'to_remove' from 'batch'.
 void RemovePoints(absl::flat_hash_set<int> to_remove, PointsBatch* batch);
 
+// Fills the custom fields of 'batch' from the columns of 'attributes' of the
+// expected types, e.g. 'reflectivities' from sensor::kReflectivityAttribute.
+// Other fields are left unchanged.
+void SetCustomFields(const sensor::PointAttributes& attributes,
+                     PointsBatch* batch);
+
 }  // namespace io
 }  // namespace cartographer
 
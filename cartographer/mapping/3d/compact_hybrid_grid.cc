@@ -0,0 +1,156 @@
+/*
+ * Copyright 2016 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/3d/compact_hybrid_grid.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "cartographer/mapping/3d/hybrid_grid.h"
+
+namespace cartographer {
+namespace mapping {
+
+CompactHybridGrid::CompactHybridGrid(const HybridGrid& hybrid_grid) {
+  CHECK(!hybrid_grid.frozen());
+  // The iterator visits the cells of each 8x8x8 block of the hybrid grid
+  // consecutively, so blocks can be compacted one at a time.
+  std::array<uint16, kBlockVolume> values;
+  values.fill(0);
+  Eigen::Array3i current_block_index;
+  bool has_current_block = false;
+  for (auto it = HybridGrid::Iterator(hybrid_grid); !it.Done(); it.Next()) {
+    const Eigen::Array3i cell_index = it.GetCellIndex();
+    const Eigen::Array3i block_index(cell_index.x() >> kBlockBits,
+                                     cell_index.y() >> kBlockBits,
+                                     cell_index.z() >> kBlockBits);
+    if (!has_current_block || (block_index != current_block_index).any()) {
+      if (has_current_block) {
+        AddBlock(current_block_index, values);
+        values.fill(0);
+      }
+      current_block_index = block_index;
+      has_current_block = true;
+    }
+    values[ToCellInBlock(cell_index)] = it.GetValue();
+  }
+  if (has_current_block) {
+    AddBlock(current_block_index, values);
+  }
+  blocks_.shrink_to_fit();
+  data_.shrink_to_fit();
+}
+
+void CompactHybridGrid::AddBlock(
+    const Eigen::Array3i& block_index,
+    const std::array<uint16, kBlockVolume>& values) {
+  Block block;
+  block.block_index = block_index;
+  block.known.fill(0);
+  std::vector<uint16> packed_values;
+  for (int cell = 0; cell != kBlockVolume; ++cell) {
+    if (cell % 64 == 0) {
+      block.rank[cell >> 6] = packed_values.size();
+    }
+    if (values[cell] != 0) {
+      block.known[cell >> 6] |= uint64{1} << (cell & 63);
+      packed_values.push_back(values[cell]);
+    }
+  }
+  if (packed_values.empty()) {
+    return;
+  }
+
+  std::vector<uint16> palette = packed_values;
+  std::sort(palette.begin(), palette.end());
+  palette.erase(std::unique(palette.begin(), palette.end()), palette.end());
+  CHECK_LE(data_.size(), std::numeric_limits<uint32>::max());
+  block.data_offset = data_.size();
+  // A palette needs 2 bytes per entry and 1 byte per known cell instead of 2.
+  if (palette.size() <= 256 && 2 * palette.size() < packed_values.size()) {
+    block.palette_size = palette.size();
+    for (const uint16 value : palette) {
+      data_.push_back(value & 0xff);
+      data_.push_back(value >> 8);
+    }
+    for (const uint16 value : packed_values) {
+      data_.push_back(
+          std::lower_bound(palette.begin(), palette.end(), value) -
+          palette.begin());
+    }
+  } else {
+    block.palette_size = 0;
+    for (const uint16 value : packed_values) {
+      data_.push_back(value & 0xff);
+      data_.push_back(value >> 8);
+    }
+  }
+  block_numbers_.emplace(ToBlockKey(block_index * kBlockSize), blocks_.size());
+  blocks_.push_back(block);
+}
+
+size_t CompactHybridGrid::MemoryUsage() const {
+  return sizeof(*this) + blocks_.capacity() * sizeof(Block) +
+         data_.capacity() * sizeof(uint8) +
+         block_numbers_.capacity() *
+             (sizeof(std::pair<const int64, uint32>) + 1);
+}
+
+CompactHybridGrid::Iterator::Iterator(const CompactHybridGrid& compact_grid)
+    : compact_grid_(&compact_grid), block_(0), cell_(0), rank_(0) {
+  AdvanceToKnownCell();
+}
+
+void CompactHybridGrid::Iterator::Next() {
+  DCHECK(!Done());
+  ++cell_;
+  ++rank_;
+  AdvanceToKnownCell();
+}
+
+Eigen::Array3i CompactHybridGrid::Iterator::GetCellIndex() const {
+  DCHECK(!Done());
+  return compact_grid_->blocks_[block_].block_index * kBlockSize +
+         To3DIndex(cell_, kBlockBits);
+}
+
+uint16 CompactHybridGrid::Iterator::GetValue() const {
+  DCHECK(!Done());
+  return compact_grid_->GetPackedValue(compact_grid_->blocks_[block_], rank_);
+}
+
+void CompactHybridGrid::Iterator::AdvanceToKnownCell() {
+  for (; !Done(); ++block_, cell_ = 0, rank_ = 0) {
+    const Block& block = compact_grid_->blocks_[block_];
+    while (cell_ != kBlockVolume) {
+      const uint64 remaining_bits =
+          block.known[cell_ >> 6] & (~uint64{0} << (cell_ & 63));
+      if (remaining_bits != 0) {
+        // Move to the lowest remaining known cell of this word.
+        int bit = cell_ & 63;
+        while ((remaining_bits & (uint64{1} << bit)) == 0) {
+          ++bit;
+        }
+        cell_ = (cell_ & ~63) + bit;
+        return;
+      }
+      cell_ = (cell_ & ~63) + 64;
+    }
+  }
+}
+
+}  // namespace mapping
+}  // namespace cartographer
@@ -0,0 +1,149 @@
+/*
+ * Copyright 2016 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_MAPPING_3D_COMPACT_HYBRID_GRID_H_
+#define CARTOGRAPHER_MAPPING_3D_COMPACT_HYBRID_GRID_H_
+
+#include <array>
+#include <bitset>
+#include <cstring>
+#include <vector>
+
+#include "Eigen/Core"
+#include "absl/container/flat_hash_map.h"
+#include "cartographer/common/port.h"
+#include "glog/logging.h"
+
+namespace cartographer {
+namespace mapping {
+
+class HybridGrid;
+
+// A read-only, compact copy of the values of a HybridGrid.
+//
+// Only the 8x8x8 blocks containing known cells are kept. Each block stores a
+// bit mask of its known cells and the values of these cells packed in z-major
+// order. Blocks with few distinct values store 8-bit indices into a per-block
+// palette instead of 16-bit values. The representation is lossless.
+class CompactHybridGrid {
+ public:
+  // 'hybrid_grid' must not be frozen.
+  explicit CompactHybridGrid(const HybridGrid& hybrid_grid);
+
+  CompactHybridGrid(const CompactHybridGrid&) = delete;
+  CompactHybridGrid& operator=(const CompactHybridGrid&) = delete;
+
+  // Returns the value stored at 'index', 0 if the cell is unknown.
+  uint16 value(const Eigen::Array3i& index) const {
+    const auto it = block_numbers_.find(ToBlockKey(index));
+    if (it == block_numbers_.end()) {
+      return 0;
+    }
+    const Block& block = blocks_[it->second];
+    const int cell = ToCellInBlock(index);
+    const uint64 word = block.known[cell >> 6];
+    const uint64 bit = uint64{1} << (cell & 63);
+    if ((word & bit) == 0) {
+      return 0;
+    }
+    return GetPackedValue(block, block.rank[cell >> 6] +
+                                     std::bitset<64>(word & (bit - 1)).count());
+  }
+
+  // Returns the approximate number of bytes used by this grid.
+  size_t MemoryUsage() const;
+
+  // An iterator for iterating over all known cells.
+  class Iterator {
+   public:
+    explicit Iterator(const CompactHybridGrid& compact_grid);
+
+    void Next();
+    bool Done() const { return block_ == compact_grid_->blocks_.size(); }
+    Eigen::Array3i GetCellIndex() const;
+    uint16 GetValue() const;
+
+   private:
+    void AdvanceToKnownCell();
+
+    const CompactHybridGrid* compact_grid_;
+    size_t block_;
+    int cell_;
+    int rank_;
+  };
+
+ private:
+  static constexpr int kBlockBits = 3;
+  static constexpr int kBlockSize = 1 << kBlockBits;
+  static constexpr int kBlockVolume = kBlockSize * kBlockSize * kBlockSize;
+
+  struct Block {
+    Eigen::Array3i block_index;
+    // Bit i is set if the cell with z-major index i in this block is known.
+    std::array<uint64, kBlockVolume / 64> known;
+    // Number of known cells in the words of 'known' before each word.
+    std::array<uint16, kBlockVolume / 64> rank;
+    // Offset of this block's data in 'data_'.
+    uint32 data_offset;
+    // Number of palette entries, 0 if the values are stored as 16-bit.
+    uint16 palette_size;
+  };
+
+  static int64 ToBlockKey(const Eigen::Array3i& index) {
+    // Cell indices are limited to +/- 8192 around the origin, so 21 bits per
+    // dimension are plenty for block indices.
+    constexpr int64 kMask = (int64{1} << 21) - 1;
+    return ((int64{index.x() >> kBlockBits} & kMask) << 42) |
+           ((int64{index.y() >> kBlockBits} & kMask) << 21) |
+           (int64{index.z() >> kBlockBits} & kMask);
+  }
+
+  static int ToCellInBlock(const Eigen::Array3i& index) {
+    constexpr int kMask = kBlockSize - 1;
+    return (((index.z() & kMask) << kBlockBits | (index.y() & kMask))
+            << kBlockBits) |
+           (index.x() & kMask);
+  }
+
+  uint16 GetUint16(const size_t offset) const {
+    uint16 value;
+    std::memcpy(&value, data_.data() + offset, sizeof(value));
+    return value;
+  }
+
+  // Returns the value of the known cell 'rank' of 'block'.
+  uint16 GetPackedValue(const Block& block, const int rank) const {
+    if (block.palette_size == 0) {
+      return GetUint16(block.data_offset + 2 * rank);
+    }
+    const uint8 palette_index =
+        data_[block.data_offset + 2 * block.palette_size + rank];
+    return GetUint16(block.data_offset + 2 * palette_index);
+  }
+
+  // Appends a block with the cells 'values', 0 meaning unknown.
+  void AddBlock(const Eigen::Array3i& block_index,
+                const std::array<uint16, kBlockVolume>& values);
+
+  absl::flat_hash_map<int64, uint32> block_numbers_;
+  std::vector<Block> blocks_;
+  std::vector<uint8> data_;
+};
+
+}  // namespace mapping
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_MAPPING_3D_COMPACT_HYBRID_GRID_H_
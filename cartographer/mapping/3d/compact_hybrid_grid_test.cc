@@ -0,0 +1,128 @@
+/*
+ * Copyright 2016 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/3d/compact_hybrid_grid.h"
+
+#include <map>
+#include <memory>
+#include <random>
+#include <tuple>
+
+#include "cartographer/mapping/3d/hybrid_grid.h"
+#include "gmock/gmock.h"
+
+namespace cartographer {
+namespace mapping {
+namespace {
+
+class CompactHybridGridTest : public ::testing::Test {
+ protected:
+  CompactHybridGridTest() : hybrid_grid_(0.1f) {
+    std::mt19937 prng(42);
+    // A sparse region with arbitrary values, stored as 16-bit values.
+    std::uniform_int_distribution<int> xyz_distribution(-100, 99);
+    std::uniform_int_distribution<int> value_distribution(1, 32767);
+    for (int i = 0; i < 5000; ++i) {
+      const Eigen::Array3i index(xyz_distribution(prng),
+                                 xyz_distribution(prng),
+                                 xyz_distribution(prng));
+      *hybrid_grid_.mutable_value(index) = value_distribution(prng);
+    }
+    // A dense region with few distinct values, stored using palettes.
+    for (int z = 200; z != 216; ++z) {
+      for (int y = -8; y != 8; ++y) {
+        for (int x = -8; x != 8; ++x) {
+          *hybrid_grid_.mutable_value(Eigen::Array3i(x, y, z)) =
+              1000 + (x + y + z) % 3;
+        }
+      }
+    }
+  }
+
+  HybridGrid hybrid_grid_;
+};
+
+TEST_F(CompactHybridGridTest, SameValues) {
+  const CompactHybridGrid compact_grid(hybrid_grid_);
+  for (int z = -104; z != 220; ++z) {
+    for (int y = -104; y != 104; ++y) {
+      for (int x = -104; x != 104; ++x) {
+        const Eigen::Array3i index(x, y, z);
+        ASSERT_EQ(hybrid_grid_.value(index), compact_grid.value(index))
+            << index;
+      }
+    }
+  }
+  EXPECT_LT(compact_grid.MemoryUsage(), hybrid_grid_.MemoryUsage());
+}
+
+TEST_F(CompactHybridGridTest, Iteration) {
+  std::map<std::tuple<int, int, int>, uint16> expected;
+  for (const auto& cell : hybrid_grid_) {
+    expected[std::make_tuple(cell.first.x(), cell.first.y(),
+                             cell.first.z())] = cell.second;
+  }
+  std::map<std::tuple<int, int, int>, uint16> actual;
+  const CompactHybridGrid compact_grid(hybrid_grid_);
+  for (auto it = CompactHybridGrid::Iterator(compact_grid); !it.Done();
+       it.Next()) {
+    const Eigen::Array3i index = it.GetCellIndex();
+    EXPECT_TRUE(
+        actual.emplace(std::make_tuple(index.x(), index.y(), index.z()),
+                       it.GetValue())
+            .second);
+  }
+  EXPECT_EQ(expected, actual);
+}
+
+std::map<std::tuple<int, int, int>, uint16> ToMap(
+    const proto::HybridGrid& proto) {
+  std::map<std::tuple<int, int, int>, uint16> result;
+  for (int i = 0; i != proto.values_size(); ++i) {
+    result[std::make_tuple(proto.x_indices(i), proto.y_indices(i),
+                           proto.z_indices(i))] = proto.values(i);
+  }
+  return result;
+}
+
+TEST_F(CompactHybridGridTest, FreezeHybridGrid) {
+  const auto expected = ToMap(hybrid_grid_.ToProto());
+  const size_t memory_usage = hybrid_grid_.MemoryUsage();
+  const int grid_size = hybrid_grid_.grid_size();
+  const std::unique_ptr<HybridGrid> frozen_grid =
+      hybrid_grid_.CreateFrozenCopy();
+  EXPECT_TRUE(frozen_grid->frozen());
+  EXPECT_EQ(grid_size, frozen_grid->grid_size());
+  EXPECT_LT(frozen_grid->MemoryUsage(), memory_usage);
+  EXPECT_EQ(expected, ToMap(frozen_grid->ToProto()));
+  for (const auto& entry : expected) {
+    const Eigen::Array3i index(std::get<0>(entry.first),
+                               std::get<1>(entry.first),
+                               std::get<2>(entry.first));
+    EXPECT_EQ(entry.second, frozen_grid->value(index));
+    EXPECT_EQ(ValueToProbability(entry.second),
+              frozen_grid->GetProbability(index));
+  }
+  EXPECT_FALSE(frozen_grid->IsKnown(Eigen::Array3i(1000, 1000, 1000)));
+  // The original grid is left untouched.
+  EXPECT_FALSE(hybrid_grid_.frozen());
+  EXPECT_EQ(memory_usage, hybrid_grid_.MemoryUsage());
+  EXPECT_EQ(expected, ToMap(hybrid_grid_.ToProto()));
+}
+
+}  // namespace
+}  // namespace mapping
+}  // namespace cartographer
@@ -20,13 +20,16 @@
 #include <array>
 #include <cmath>
 #include <limits>
+#include <memory>
 #include <utility>
 #include <vector>
 
 #include "Eigen/Core"
 #include "absl/memory/memory.h"
+#include "absl/types/optional.h"
 #include "cartographer/common/math.h"
 #include "cartographer/common/port.h"
+#include "cartographer/mapping/3d/compact_hybrid_grid.h"
 #include "cartographer/mapping/probability_values.h"
 #include "cartographer/mapping/proto/hybrid_grid.pb.h"
 #include "cartographer/transform/transform.h"
@@ -94,6 +97,9 @@ class FlatGrid {
     return &cells_[ToFlatIndex(index, kBits)];
   }
 
+  // Returns the number of bytes used by this grid.
+  size_t MemoryUsage() const { return sizeof(*this); }
+
   // An iterator for iterating over all values not comparing equal to the
   // default constructed value.
   class Iterator {
@@ -176,6 +182,17 @@ class NestedGrid {
     return meta_cell->mutable_value(inner_index);
   }
 
+  // Returns the number of bytes used by this grid and its wrapped grids.
+  size_t MemoryUsage() const {
+    size_t result = sizeof(*this);
+    for (const auto& meta_cell : meta_cells_) {
+      if (meta_cell != nullptr) {
+        result += meta_cell->MemoryUsage();
+      }
+    }
+    return result;
+  }
+
   // An iterator for iterating over all values not comparing equal to the
   // default constructed value.
   class Iterator {
@@ -299,6 +316,18 @@ class DynamicGrid {
     return meta_cell->mutable_value(inner_index);
   }
 
+  // Returns the number of bytes used by this grid and its wrapped grids.
+  size_t MemoryUsage() const {
+    size_t result =
+        sizeof(*this) + meta_cells_.capacity() * sizeof(meta_cells_[0]);
+    for (const auto& meta_cell : meta_cells_) {
+      if (meta_cell != nullptr) {
+        result += meta_cell->MemoryUsage();
+      }
+    }
+    return result;
+  }
+
   // An iterator for iterating over all values not comparing equal to the
   // default constructed value.
   class Iterator {
@@ -465,8 +494,18 @@ class HybridGridBase : public GridBase<ValueType> {
 // require the grid to grow dynamically. For centimeter resolution, points
 // can only be tens of meters from the origin.
 // The hard limit of cell indexes is +/- 8192 around the origin.
-class HybridGrid : public HybridGridBase<uint16> {
+//
+// Once no more updates are expected, a compact, read-only copy of the grid
+// with the same values can be created. The storage of the base class is empty
+// in such a frozen copy, so it is inherited privately and only accessed through
+// the members below, which read the frozen values.
+class HybridGrid : private HybridGridBase<uint16> {
  public:
+  using HybridGridBase<uint16>::GetCellIndex;
+  using HybridGridBase<uint16>::GetCenterOfCell;
+  using HybridGridBase<uint16>::GetOctant;
+  using HybridGridBase<uint16>::resolution;
+
   explicit HybridGrid(const float resolution)
       : HybridGridBase<uint16>(resolution) {}
 
@@ -485,9 +524,17 @@ class HybridGrid : public HybridGridBase<uint16> {
 
   // Sets the probability of the cell at 'index' to the given 'probability'.
   void SetProbability(const Eigen::Array3i& index, const float probability) {
+    CHECK(!frozen());
     *mutable_value(index) = ProbabilityToValue(probability);
   }
 
+  // Returns a pointer to the value at 'index' to change it. The grid must not
+  // be frozen.
+  ValueType* mutable_value(const Eigen::Array3i& index) {
+    DCHECK(!frozen());
+    return HybridGridBase<uint16>::mutable_value(index);
+  }
+
   // Finishes the update sequence.
   void FinishUpdate() {
     while (!update_indices_.empty()) {
@@ -507,6 +554,7 @@ class HybridGrid : public HybridGridBase<uint16> {
   bool ApplyLookupTable(const Eigen::Array3i& index,
                         const std::vector<uint16>& table) {
     DCHECK_EQ(table.size(), kUpdateMarker);
+    DCHECK(!frozen());
     uint16* const cell = mutable_value(index);
     if (*cell >= kUpdateMarker) {
       return false;
@@ -517,6 +565,39 @@ class HybridGrid : public HybridGridBase<uint16> {
     return true;
   }
 
+  // Returns a compact, read-only copy of this grid, which can be read and
+  // iterated like this one, but not be changed. This grid is left untouched,
+  // so it may be read by other threads meanwhile. It must not be frozen.
+  std::unique_ptr<HybridGrid> CreateFrozenCopy() const {
+    CHECK(update_indices_.empty()) << "Freezing a grid during an update is "
+                                      "not supported. Finish the update first.";
+    CHECK(!frozen());
+    return std::unique_ptr<HybridGrid>(new HybridGrid(
+        resolution(), absl::make_unique<CompactHybridGrid>(*this),
+        HybridGridBase<uint16>::grid_size()));
+  }
+
+  // Returns true if this grid was created by CreateFrozenCopy().
+  bool frozen() const { return compact_grid_ != nullptr; }
+
+  // Returns the edge length of the grid in cells. The grid is centered at the
+  // origin and contains all cells with known values.
+  int grid_size() const {
+    return frozen() ? frozen_grid_size_ : HybridGridBase<uint16>::grid_size();
+  }
+
+  // Returns the approximate number of bytes used by the values of this grid.
+  size_t MemoryUsage() const {
+    return frozen() ? compact_grid_->MemoryUsage()
+                    : GridBase<uint16>::MemoryUsage();
+  }
+
+  // Returns the value stored at 'index'.
+  ValueType value(const Eigen::Array3i& index) const {
+    return frozen() ? compact_grid_->value(index)
+                    : GridBase<uint16>::value(index);
+  }
+
   // Returns the probability of the cell with 'index'.
   float GetProbability(const Eigen::Array3i& index) const {
     return ValueToProbability(value(index));
@@ -539,9 +620,87 @@ class HybridGrid : public HybridGridBase<uint16> {
     return result;
   }
 
+  // An iterator for iterating over all known cells, frozen or not.
+  class Iterator {
+   public:
+    explicit Iterator(const HybridGrid& hybrid_grid)
+        : iterator_(hybrid_grid) {
+      if (hybrid_grid.frozen()) {
+        compact_iterator_.emplace(*hybrid_grid.compact_grid_);
+      }
+    }
+
+    void Next() {
+      if (compact_iterator_.has_value()) {
+        compact_iterator_->Next();
+      } else {
+        iterator_.Next();
+      }
+    }
+
+    bool Done() const {
+      return compact_iterator_.has_value() ? compact_iterator_->Done()
+                                          : iterator_.Done();
+    }
+
+    Eigen::Array3i GetCellIndex() const {
+      return compact_iterator_.has_value() ? compact_iterator_->GetCellIndex()
+                                          : iterator_.GetCellIndex();
+    }
+
+    uint16 GetValue() const {
+      return compact_iterator_.has_value() ? compact_iterator_->GetValue()
+                                          : iterator_.GetValue();
+    }
+
+    const std::pair<Eigen::Array3i, uint16> operator*() const {
+      return std::pair<Eigen::Array3i, uint16>(GetCellIndex(), GetValue());
+    }
+
+    Iterator& operator++() {
+      Next();
+      return *this;
+    }
+
+    // Only meant for comparing against end().
+    bool operator!=(const Iterator& it) const { return Done() != it.Done(); }
+
+   private:
+    friend class HybridGrid;
+
+    void AdvanceToEnd() {
+      iterator_.AdvanceToEnd();
+      compact_iterator_.reset();
+    }
+
+    HybridGridBase<uint16>::Iterator iterator_;
+    absl::optional<CompactHybridGrid::Iterator> compact_iterator_;
+  };
+
+  // Iterator functions for range-based for loops.
+  Iterator begin() const { return Iterator(*this); }
+
+  Iterator end() const {
+    Iterator it(*this);
+    it.AdvanceToEnd();
+    return it;
+  }
+
  private:
+  // Creates a frozen grid with the values of 'compact_grid'.
+  HybridGrid(const float resolution,
+             std::unique_ptr<const CompactHybridGrid> compact_grid,
+             const int frozen_grid_size)
+      : HybridGridBase<uint16>(resolution),
+        compact_grid_(std::move(compact_grid)),
+        frozen_grid_size_(frozen_grid_size) {}
+
   // Markers at changed cells.
   std::vector<ValueType*> update_indices_;
+  // Only set in a frozen grid, replacing the storage of the base class.
+  std::unique_ptr<const CompactHybridGrid> compact_grid_;
+  // The grid size of the grid this frozen grid was copied from.
+  int frozen_grid_size_ = 0;
 };
 
 struct AverageIntensityData {
@@ -107,11 +107,18 @@ void RangeDataInserter3D::Insert(
   InsertMissesIntoGrid(miss_table_, range_data.origin, range_data.returns,
                        hybrid_grid, options_.num_free_space_voxels());
   if (intensity_hybrid_grid != nullptr) {
-    InsertIntensitiesIntoGrid(range_data.returns, intensity_hybrid_grid,
-                              options_.intensity_threshold());
+    InsertIntensities(range_data, intensity_hybrid_grid);
   }
   hybrid_grid->FinishUpdate();
 }
 
+void RangeDataInserter3D::InsertIntensities(
+    const sensor::RangeData& range_data,
+    IntensityHybridGrid* const intensity_hybrid_grid) const {
+  CHECK_NOTNULL(intensity_hybrid_grid);
+  InsertIntensitiesIntoGrid(range_data.returns, intensity_hybrid_grid,
+                            options_.intensity_threshold());
+}
+
 }  // namespace mapping
 }  // namespace cartographer
@@ -41,6 +41,12 @@ class RangeDataInserter3D {
   void Insert(const sensor::RangeData& range_data, HybridGrid* hybrid_grid,
               IntensityHybridGrid* intensity_hybrid_grid) const;
 
+  // Inserts only the intensities of 'range_data' into
+  // 'intensity_hybrid_grid'. This is independent of the insertion into the
+  // probability grid and may run concurrently with it.
+  void InsertIntensities(const sensor::RangeData& range_data,
+                         IntensityHybridGrid* intensity_hybrid_grid) const;
+
  private:
   const proto::RangeDataInserterOptions3D options_;
   const std::vector<uint16> hit_table_;
@@ -18,14 +18,22 @@
 
 #include <cmath>
 #include <limits>
+#include <utility>
 
+#include "absl/synchronization/blocking_counter.h"
 #include "cartographer/common/math.h"
+#include "cartographer/mapping/internal/3d/scan_matching/precomputation_grid_3d.h"
 #include "cartographer/mapping/internal/3d/scan_matching/rotational_scan_matcher.h"
+#include "cartographer/metrics/counter.h"
 #include "cartographer/sensor/range_data.h"
 #include "glog/logging.h"
 
 namespace cartographer {
 namespace mapping {
+
+static auto* kFrozenHybridGridBytesBeforeMetric = metrics::Counter::Null();
+static auto* kFrozenHybridGridBytesAfterMetric = metrics::Counter::Null();
+
 namespace {
 
 struct PixelData {
@@ -187,6 +195,8 @@ proto::SubmapsOptions3D CreateSubmapsOptions3D(
   options.set_low_resolution(parameter_dictionary->GetDouble("low_resolution"));
   options.set_num_range_data(
       parameter_dictionary->GetNonNegativeInt("num_range_data"));
+  options.set_num_insertion_threads(
+      parameter_dictionary->GetNonNegativeInt("num_insertion_threads"));
   *options.mutable_range_data_inserter_options() =
       CreateRangeDataInserterOptions3D(
           parameter_dictionary->GetDictionary("range_data_inserter").get());
@@ -199,9 +209,8 @@ Submap3D::Submap3D(const float high_resolution, const float low_resolution,
                    const Eigen::VectorXf& rotational_scan_matcher_histogram)
     : Submap(local_submap_pose),
       high_resolution_hybrid_grid_(
-          absl::make_unique<HybridGrid>(high_resolution)),
-      low_resolution_hybrid_grid_(
-          absl::make_unique<HybridGrid>(low_resolution)),
+          std::make_shared<HybridGrid>(high_resolution)),
+      low_resolution_hybrid_grid_(std::make_shared<HybridGrid>(low_resolution)),
       high_resolution_intensity_hybrid_grid_(
           absl::make_unique<IntensityHybridGrid>(high_resolution)),
       rotational_scan_matcher_histogram_(rotational_scan_matcher_histogram) {}
@@ -220,9 +229,13 @@ proto::Submap Submap3D::ToProto(
   submap_3d->set_finished(insertion_finished());
   if (include_probability_grid_data) {
     *submap_3d->mutable_high_resolution_hybrid_grid() =
-        high_resolution_hybrid_grid().ToProto();
+        high_resolution_hybrid_grid()->ToProto();
     *submap_3d->mutable_low_resolution_hybrid_grid() =
-        low_resolution_hybrid_grid().ToProto();
+        low_resolution_hybrid_grid()->ToProto();
+    const auto stack = precomputation_grid_stack();
+    if (stack != nullptr) {
+      *submap_3d->mutable_precomputation_grid_stack() = stack->ToProto();
+    }
   }
   for (Eigen::VectorXf::Index i = 0;
        i != rotational_scan_matcher_histogram_.size(); ++i) {
@@ -241,12 +254,26 @@ void Submap3D::UpdateFromProto(const proto::Submap3D& submap_3d) {
   set_num_range_data(submap_3d.num_range_data());
   set_insertion_finished(submap_3d.finished());
   if (submap_3d.has_high_resolution_hybrid_grid()) {
-    high_resolution_hybrid_grid_ =
-        absl::make_unique<HybridGrid>(submap_3d.high_resolution_hybrid_grid());
+    auto high_resolution_hybrid_grid =
+        std::make_shared<HybridGrid>(submap_3d.high_resolution_hybrid_grid());
+    {
+      absl::MutexLock locker(&mutex_);
+      high_resolution_hybrid_grid_ = std::move(high_resolution_hybrid_grid);
+    }
+    SetPrecomputationGridStack(
+        submap_3d.has_precomputation_grid_stack()
+            ? std::make_shared<const scan_matching::PrecomputationGridStack3D>(
+                  submap_3d.precomputation_grid_stack())
+            : nullptr);
   }
   if (submap_3d.has_low_resolution_hybrid_grid()) {
-    low_resolution_hybrid_grid_ =
-        absl::make_unique<HybridGrid>(submap_3d.low_resolution_hybrid_grid());
+    auto low_resolution_hybrid_grid =
+        std::make_shared<HybridGrid>(submap_3d.low_resolution_hybrid_grid());
+    absl::MutexLock locker(&mutex_);
+    low_resolution_hybrid_grid_ = std::move(low_resolution_hybrid_grid);
+  }
+  if (insertion_finished()) {
+    FreezeHybridGrids();
   }
   rotational_scan_matcher_histogram_ =
       Eigen::VectorXf::Zero(submap_3d.rotational_scan_matcher_histogram_size());
@@ -257,14 +284,38 @@ void Submap3D::UpdateFromProto(const proto::Submap3D& submap_3d) {
   }
 }
 
+std::shared_ptr<const HybridGrid> Submap3D::high_resolution_hybrid_grid()
+    const {
+  absl::MutexLock locker(&mutex_);
+  return high_resolution_hybrid_grid_;
+}
+
+std::shared_ptr<const HybridGrid> Submap3D::low_resolution_hybrid_grid() const {
+  absl::MutexLock locker(&mutex_);
+  return low_resolution_hybrid_grid_;
+}
+
+std::shared_ptr<const scan_matching::PrecomputationGridStack3D>
+Submap3D::precomputation_grid_stack() const {
+  absl::MutexLock locker(&mutex_);
+  return precomputation_grid_stack_;
+}
+
+void Submap3D::SetPrecomputationGridStack(
+    std::shared_ptr<const scan_matching::PrecomputationGridStack3D>
+        precomputation_grid_stack) const {
+  absl::MutexLock locker(&mutex_);
+  precomputation_grid_stack_ = std::move(precomputation_grid_stack);
+}
+
 void Submap3D::ToResponseProto(
     const transform::Rigid3d& global_submap_pose,
     proto::SubmapQuery::Response* const response) const {
   response->set_submap_version(num_range_data());
 
-  AddToTextureProto(*high_resolution_hybrid_grid_, global_submap_pose,
+  AddToTextureProto(*high_resolution_hybrid_grid(), global_submap_pose,
                     response->add_textures());
-  AddToTextureProto(*low_resolution_hybrid_grid_, global_submap_pose,
+  AddToTextureProto(*low_resolution_hybrid_grid(), global_submap_pose,
                     response->add_textures());
 }
 
@@ -273,34 +324,121 @@ void Submap3D::InsertData(const sensor::RangeData& range_data_in_local,
                           const float high_resolution_max_range,
                           const Eigen::Quaterniond& local_from_gravity_aligned,
                           const Eigen::VectorXf& scan_histogram_in_gravity) {
+  for (const auto& work_item : InsertDataDeferred(
+           range_data_in_local, range_data_inserter, high_resolution_max_range,
+           local_from_gravity_aligned, scan_histogram_in_gravity)) {
+    work_item();
+  }
+}
+
+std::vector<std::function<void()>> Submap3D::InsertDataDeferred(
+    const sensor::RangeData& range_data_in_local,
+    const RangeDataInserter3D& range_data_inserter,
+    const float high_resolution_max_range,
+    const Eigen::Quaterniond& local_from_gravity_aligned,
+    const Eigen::VectorXf& scan_histogram_in_gravity) {
   CHECK(!insertion_finished());
   // Transform range data into submap frame.
-  const sensor::RangeData transformed_range_data = sensor::TransformRangeData(
-      range_data_in_local, local_pose().inverse().cast<float>());
-  range_data_inserter.Insert(
-      FilterRangeDataByMaxRange(transformed_range_data,
-                                high_resolution_max_range),
-      high_resolution_hybrid_grid_.get(),
-      high_resolution_intensity_hybrid_grid_.get());
-  range_data_inserter.Insert(transformed_range_data,
-                             low_resolution_hybrid_grid_.get(),
-                             /*intensity_hybrid_grid=*/nullptr);
+  const auto transformed_range_data =
+      std::make_shared<const sensor::RangeData>(sensor::TransformRangeData(
+          range_data_in_local, local_pose().inverse().cast<float>()));
+  const auto high_resolution_range_data =
+      std::make_shared<const sensor::RangeData>(FilterRangeDataByMaxRange(
+          *transformed_range_data, high_resolution_max_range));
   set_num_range_data(num_range_data() + 1);
   const float yaw_in_submap_from_gravity = transform::GetYaw(
       local_pose().inverse().rotation() * local_from_gravity_aligned);
   rotational_scan_matcher_histogram_ +=
       scan_matching::RotationalScanMatcher::RotateHistogram(
           scan_histogram_in_gravity, yaw_in_submap_from_gravity);
+
+  const RangeDataInserter3D* const inserter = &range_data_inserter;
+  std::vector<std::function<void()>> work_items;
+  HybridGrid* high_resolution_hybrid_grid;
+  HybridGrid* low_resolution_hybrid_grid;
+  {
+    absl::MutexLock locker(&mutex_);
+    high_resolution_hybrid_grid = high_resolution_hybrid_grid_.get();
+    low_resolution_hybrid_grid = low_resolution_hybrid_grid_.get();
+  }
+  work_items.push_back([inserter, high_resolution_range_data,
+                        high_resolution_hybrid_grid]() {
+    inserter->Insert(*high_resolution_range_data, high_resolution_hybrid_grid,
+                     /*intensity_hybrid_grid=*/nullptr);
+  });
+  IntensityHybridGrid* const intensity_hybrid_grid =
+      high_resolution_intensity_hybrid_grid_.get();
+  if (intensity_hybrid_grid != nullptr) {
+    work_items.push_back(
+        [inserter, high_resolution_range_data, intensity_hybrid_grid]() {
+          inserter->InsertIntensities(*high_resolution_range_data,
+                                      intensity_hybrid_grid);
+        });
+  }
+  work_items.push_back(
+      [inserter, transformed_range_data, low_resolution_hybrid_grid]() {
+        inserter->Insert(*transformed_range_data, low_resolution_hybrid_grid,
+                         /*intensity_hybrid_grid=*/nullptr);
+      });
+  return work_items;
 }
 
 void Submap3D::Finish() {
   CHECK(!insertion_finished());
+  // Freeze before marking the submap as finished, so that the constraint
+  // builder only ever reads the frozen grids of finished submaps.
+  FreezeHybridGrids();
   set_insertion_finished(true);
 }
 
+void Submap3D::RegisterMetrics(metrics::FamilyFactory* family_factory) {
+  auto* frozen_bytes = family_factory->NewCounterFamily(
+      "mapping_3d_submap_frozen_hybrid_grid_bytes",
+      "Bytes used by the hybrid grids of finished submaps before and after "
+      "freezing them");
+  kFrozenHybridGridBytesBeforeMetric = frozen_bytes->Add({{"state", "before"}});
+  kFrozenHybridGridBytesAfterMetric = frozen_bytes->Add({{"state", "after"}});
+}
+
+void Submap3D::FreezeHybridGrids() {
+  std::shared_ptr<HybridGrid> high_resolution_hybrid_grid;
+  std::shared_ptr<HybridGrid> low_resolution_hybrid_grid;
+  {
+    absl::MutexLock locker(&mutex_);
+    high_resolution_hybrid_grid = high_resolution_hybrid_grid_;
+    low_resolution_hybrid_grid = low_resolution_hybrid_grid_;
+  }
+  // The frozen copies are built while other threads may still read the grids,
+  // and then published at once. Readers keep the old grids alive as needed.
+  size_t bytes_before = 0;
+  size_t bytes_after = 0;
+  for (std::shared_ptr<HybridGrid>* const hybrid_grid :
+       {&high_resolution_hybrid_grid, &low_resolution_hybrid_grid}) {
+    if (*hybrid_grid == nullptr || (*hybrid_grid)->frozen()) {
+      continue;
+    }
+    bytes_before += (*hybrid_grid)->MemoryUsage();
+    *hybrid_grid = (*hybrid_grid)->CreateFrozenCopy();
+    bytes_after += (*hybrid_grid)->MemoryUsage();
+  }
+  {
+    absl::MutexLock locker(&mutex_);
+    high_resolution_hybrid_grid_ = std::move(high_resolution_hybrid_grid);
+    low_resolution_hybrid_grid_ = std::move(low_resolution_hybrid_grid);
+  }
+  kFrozenHybridGridBytesBeforeMetric->Increment(bytes_before);
+  kFrozenHybridGridBytesAfterMetric->Increment(bytes_after);
+}
+
 ActiveSubmaps3D::ActiveSubmaps3D(const proto::SubmapsOptions3D& options)
     : options_(options),
-      range_data_inserter_(options.range_data_inserter_options()) {}
+      range_data_inserter_(options.range_data_inserter_options()) {
+  if (options_.num_insertion_threads() > 1) {
+    // The calling thread also runs work items, so one thread less is needed.
+    insertion_thread_pool_ = absl::make_unique<common::ThreadPool>(
+        options_.num_insertion_threads() - 1);
+  }
+}
 
 std::vector<std::shared_ptr<const Submap3D>> ActiveSubmaps3D::submaps() const {
   return std::vector<std::shared_ptr<const Submap3D>>(submaps_.begin(),
@@ -317,11 +455,24 @@ std::vector<std::shared_ptr<const Submap3D>> ActiveSubmaps3D::InsertData(
                                  local_from_gravity_aligned),
               rotational_scan_matcher_histogram_in_gravity.size());
   }
-  for (auto& submap : submaps_) {
-    submap->InsertData(range_data, range_data_inserter_,
-                       options_.high_resolution_max_range(),
-                       local_from_gravity_aligned,
-                       rotational_scan_matcher_histogram_in_gravity);
+  if (insertion_thread_pool_ == nullptr) {
+    for (auto& submap : submaps_) {
+      submap->InsertData(range_data, range_data_inserter_,
+                         options_.high_resolution_max_range(),
+                         local_from_gravity_aligned,
+                         rotational_scan_matcher_histogram_in_gravity);
+    }
+  } else {
+    std::vector<std::function<void()>> work_items;
+    for (auto& submap : submaps_) {
+      for (auto& work_item : submap->InsertDataDeferred(
+               range_data, range_data_inserter_,
+               options_.high_resolution_max_range(), local_from_gravity_aligned,
+               rotational_scan_matcher_histogram_in_gravity)) {
+        work_items.push_back(std::move(work_item));
+      }
+    }
+    RunConcurrently(work_items);
   }
   if (submaps_.front()->num_range_data() == 2 * options_.num_range_data()) {
     submaps_.front()->Finish();
@@ -329,6 +480,25 @@ std::vector<std::shared_ptr<const Submap3D>> ActiveSubmaps3D::InsertData(
   return submaps();
 }
 
+void ActiveSubmaps3D::RunConcurrently(
+    const std::vector<std::function<void()>>& work_items) {
+  if (work_items.empty()) {
+    return;
+  }
+  absl::BlockingCounter pending_work_items(work_items.size() - 1);
+  for (size_t i = 1; i < work_items.size(); ++i) {
+    auto task = absl::make_unique<common::Task>();
+    const std::function<void()>* const work_item = &work_items[i];
+    task->SetWorkItem([work_item, &pending_work_items]() {
+      (*work_item)();
+      pending_work_items.DecrementCount();
+    });
+    insertion_thread_pool_->Schedule(std::move(task));
+  }
+  work_items.front()();
+  pending_work_items.Wait();
+}
+
 void ActiveSubmaps3D::AddSubmap(
     const transform::Rigid3d& local_submap_pose,
     const int rotational_scan_matcher_histogram_size) {
@@ -17,12 +17,15 @@
 #ifndef CARTOGRAPHER_MAPPING_3D_SUBMAP_3D_H_
 #define CARTOGRAPHER_MAPPING_3D_SUBMAP_3D_H_
 
+#include <functional>
 #include <memory>
 #include <string>
 #include <vector>
 
 #include "Eigen/Geometry"
+#include "absl/synchronization/mutex.h"
 #include "cartographer/common/port.h"
+#include "cartographer/common/thread_pool.h"
 #include "cartographer/mapping/3d/hybrid_grid.h"
 #include "cartographer/mapping/3d/range_data_inserter_3d.h"
 #include "cartographer/mapping/id.h"
@@ -30,6 +33,7 @@
 #include "cartographer/mapping/proto/submap_visualization.pb.h"
 #include "cartographer/mapping/proto/submaps_options_3d.pb.h"
 #include "cartographer/mapping/submaps.h"
+#include "cartographer/metrics/family_factory.h"
 #include "cartographer/sensor/range_data.h"
 #include "cartographer/transform/rigid_transform.h"
 #include "cartographer/transform/transform.h"
@@ -37,6 +41,10 @@
 namespace cartographer {
 namespace mapping {
 
+namespace scan_matching {
+class PrecomputationGridStack3D;
+}  // namespace scan_matching
+
 proto::SubmapsOptions3D CreateSubmapsOptions3D(
     common::LuaParameterDictionary* parameter_dictionary);
 
@@ -54,12 +62,13 @@ class Submap3D : public Submap {
   void ToResponseProto(const transform::Rigid3d& global_submap_pose,
                        proto::SubmapQuery::Response* response) const override;
 
-  const HybridGrid& high_resolution_hybrid_grid() const {
-    return *high_resolution_hybrid_grid_;
-  }
-  const HybridGrid& low_resolution_hybrid_grid() const {
-    return *low_resolution_hybrid_grid_;
-  }
+  // The hybrid grids are replaced by frozen copies when the submap is
+  // finished. Threads other than the one inserting into the submap must keep
+  // the returned pointer while they read the grid.
+  std::shared_ptr<const HybridGrid> high_resolution_hybrid_grid() const
+      LOCKS_EXCLUDED(mutex_);
+  std::shared_ptr<const HybridGrid> low_resolution_hybrid_grid() const
+      LOCKS_EXCLUDED(mutex_);
   const IntensityHybridGrid& high_resolution_intensity_hybrid_grid() const {
     CHECK(high_resolution_intensity_hybrid_grid_ != nullptr);
     return *high_resolution_intensity_hybrid_grid_;
@@ -72,6 +81,18 @@ class Submap3D : public Submap {
     return rotational_scan_matcher_histogram_;
   }
 
+  // Returns the precomputation grids of the 3D fast correlative scan matcher
+  // kept with this submap, or nullptr.
+  std::shared_ptr<const scan_matching::PrecomputationGridStack3D>
+  precomputation_grid_stack() const LOCKS_EXCLUDED(mutex_);
+
+  // Keeps the precomputation grids computed for the high resolution grid of
+  // this finished submap, so that they are serialized with it. They are
+  // derived data, hence this is allowed on a const submap.
+  void SetPrecomputationGridStack(
+      std::shared_ptr<const scan_matching::PrecomputationGridStack3D>
+          precomputation_grid_stack) const LOCKS_EXCLUDED(mutex_);
+
   // Insert 'range_data' into this submap using 'range_data_inserter'. The
   // submap must not be finished yet.
   void InsertData(const sensor::RangeData& range_data,
@@ -80,15 +101,35 @@ class Submap3D : public Submap {
                   const Eigen::Quaterniond& local_from_gravity_aligned,
                   const Eigen::VectorXf& scan_histogram_in_gravity);
 
+  // Like InsertData(), but returns the updates of the individual grids as work
+  // items instead of running them. The work items are independent of each
+  // other and may run concurrently, but all of them must have run before this
+  // submap is used again. 'range_data_inserter' must outlive them.
+  std::vector<std::function<void()>> InsertDataDeferred(
+      const sensor::RangeData& range_data,
+      const RangeDataInserter3D& range_data_inserter,
+      float high_resolution_max_range,
+      const Eigen::Quaterniond& local_from_gravity_aligned,
+      const Eigen::VectorXf& scan_histogram_in_gravity);
+
+  // Marks the submap as finished and replaces its hybrid grids by compact,
+  // read-only copies. Readers of the old grids are not affected.
   void Finish();
 
+  static void RegisterMetrics(metrics::FamilyFactory* family_factory);
+
  private:
   void UpdateFromProto(const proto::Submap3D& submap_3d);
+  void FreezeHybridGrids() LOCKS_EXCLUDED(mutex_);
 
-  std::unique_ptr<HybridGrid> high_resolution_hybrid_grid_;
-  std::unique_ptr<HybridGrid> low_resolution_hybrid_grid_;
+  mutable absl::Mutex mutex_;
+  // Replaced by frozen copies in 'Finish()'.
+  std::shared_ptr<HybridGrid> high_resolution_hybrid_grid_ GUARDED_BY(mutex_);
+  std::shared_ptr<HybridGrid> low_resolution_hybrid_grid_ GUARDED_BY(mutex_);
   std::unique_ptr<IntensityHybridGrid> high_resolution_intensity_hybrid_grid_;
   Eigen::VectorXf rotational_scan_matcher_histogram_;
+  mutable std::shared_ptr<const scan_matching::PrecomputationGridStack3D>
+      precomputation_grid_stack_ GUARDED_BY(mutex_);
 };
 
 // The first active submap will be created on the insertion of the first range
@@ -124,9 +165,14 @@ class ActiveSubmaps3D {
   void AddSubmap(const transform::Rigid3d& local_submap_pose,
                  int rotational_scan_matcher_histogram_size);
 
+  // Runs 'work_items' on the calling thread and the insertion thread pool and
+  // returns once all of them completed.
+  void RunConcurrently(const std::vector<std::function<void()>>& work_items);
+
   const proto::SubmapsOptions3D options_;
   std::vector<std::shared_ptr<Submap3D>> submaps_;
   RangeDataInserter3D range_data_inserter_;
+  std::unique_ptr<common::ThreadPool> insertion_thread_pool_;
 };
 
 }  // namespace mapping
@@ -16,6 +16,11 @@
 
 #include "cartographer/mapping/3d/submap_3d.h"
 
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "cartographer/mapping/internal/3d/scan_matching/precomputation_grid_3d.h"
 #include "cartographer/transform/transform.h"
 #include "gmock/gmock.h"
 
@@ -35,19 +40,147 @@ TEST(SubmapsTest, ToFromProto) {
       expected.ToProto(true /* include_probability_grid_data */);
   EXPECT_FALSE(proto.has_submap_2d());
   EXPECT_TRUE(proto.has_submap_3d());
-  const auto actual = Submap3D(proto.submap_3d());
+  const Submap3D actual(proto.submap_3d());
   EXPECT_TRUE(expected.local_pose().translation().isApprox(
       actual.local_pose().translation(), 1e-6));
   EXPECT_TRUE(expected.local_pose().rotation().isApprox(
       actual.local_pose().rotation(), 1e-6));
   EXPECT_EQ(expected.num_range_data(), actual.num_range_data());
   EXPECT_EQ(expected.insertion_finished(), actual.insertion_finished());
-  EXPECT_NEAR(expected.high_resolution_hybrid_grid().resolution(), 0.05, 1e-6);
-  EXPECT_NEAR(expected.low_resolution_hybrid_grid().resolution(), 0.25, 1e-6);
+  EXPECT_NEAR(expected.high_resolution_hybrid_grid()->resolution(), 0.05, 1e-6);
+  EXPECT_NEAR(expected.low_resolution_hybrid_grid()->resolution(), 0.25, 1e-6);
   EXPECT_TRUE(expected.rotational_scan_matcher_histogram().isApprox(
       actual.rotational_scan_matcher_histogram(), 1e-6));
 }
 
+TEST(SubmapsTest, ToFromProtoWithPrecomputationGridStack) {
+  const Submap3D expected(0.05, 0.25, transform::Rigid3d::Identity(),
+                          Eigen::VectorXf::Zero(2));
+  EXPECT_EQ(expected.precomputation_grid_stack(), nullptr);
+  EXPECT_FALSE(expected.ToProto(true /* include_probability_grid_data */)
+                   .submap_3d()
+                   .has_precomputation_grid_stack());
+
+  scan_matching::proto::FastCorrelativeScanMatcherOptions3D options;
+  options.set_branch_and_bound_depth(3);
+  options.set_full_resolution_depth(2);
+  expected.SetPrecomputationGridStack(
+      std::make_shared<const scan_matching::PrecomputationGridStack3D>(
+          *expected.high_resolution_hybrid_grid(), options));
+  const proto::Submap proto =
+      expected.ToProto(true /* include_probability_grid_data */);
+  EXPECT_TRUE(proto.submap_3d().has_precomputation_grid_stack());
+  const Submap3D actual(proto.submap_3d());
+  ASSERT_NE(actual.precomputation_grid_stack(), nullptr);
+  EXPECT_TRUE(actual.precomputation_grid_stack()->IsCompatible(options));
+}
+
+proto::SubmapsOptions3D CreateSubmapsOptions(const int num_insertion_threads) {
+  proto::SubmapsOptions3D options;
+  options.set_high_resolution(0.1);
+  options.set_high_resolution_max_range(5.);
+  options.set_low_resolution(0.4);
+  options.set_num_range_data(3);
+  options.set_num_insertion_threads(num_insertion_threads);
+  auto* const range_data_inserter_options =
+      options.mutable_range_data_inserter_options();
+  range_data_inserter_options->set_hit_probability(0.7);
+  range_data_inserter_options->set_miss_probability(0.4);
+  range_data_inserter_options->set_num_free_space_voxels(5);
+  range_data_inserter_options->set_intensity_threshold(100.f);
+  return options;
+}
+
+TEST(ActiveSubmaps3DTest, ConcurrentInsertionMatchesSequentialInsertion) {
+  ActiveSubmaps3D sequential_submaps(CreateSubmapsOptions(1));
+  ActiveSubmaps3D concurrent_submaps(CreateSubmapsOptions(4));
+  std::mt19937 prng(42);
+  std::uniform_real_distribution<float> distribution(-8.f, 8.f);
+  for (int i = 0; i != 10; ++i) {
+    sensor::RangeData range_data{Eigen::Vector3f::Zero(), {}, {}};
+    std::vector<sensor::RangefinderPoint> returns;
+    std::vector<float> intensities;
+    for (int j = 0; j != 500; ++j) {
+      returns.push_back({Eigen::Vector3f(distribution(prng),
+                                         distribution(prng),
+                                         distribution(prng))});
+      intensities.push_back(distribution(prng) + 10.f);
+    }
+    range_data.returns = sensor::PointCloud(returns, intensities);
+    const auto sequential_result = sequential_submaps.InsertData(
+        range_data, Eigen::Quaterniond::Identity(), Eigen::VectorXf::Zero(4));
+    const auto concurrent_result = concurrent_submaps.InsertData(
+        range_data, Eigen::Quaterniond::Identity(), Eigen::VectorXf::Zero(4));
+    ASSERT_EQ(sequential_result.size(), concurrent_result.size());
+    for (size_t j = 0; j != sequential_result.size(); ++j) {
+      EXPECT_EQ(sequential_result[j]
+                    ->ToProto(true /* include_probability_grid_data */)
+                    .SerializeAsString(),
+                concurrent_result[j]
+                    ->ToProto(true /* include_probability_grid_data */)
+                    .SerializeAsString());
+      const IntensityHybridGrid& expected_intensities =
+          sequential_result[j]->high_resolution_intensity_hybrid_grid();
+      const IntensityHybridGrid& actual_intensities =
+          concurrent_result[j]->high_resolution_intensity_hybrid_grid();
+      for (const sensor::RangefinderPoint& point : range_data.returns) {
+        const Eigen::Array3i index =
+            expected_intensities.GetCellIndex(point.position);
+        EXPECT_EQ(expected_intensities.GetIntensity(index),
+                  actual_intensities.GetIntensity(index));
+      }
+    }
+  }
+}
+
+TEST(ActiveSubmaps3DTest, FinishingKeepsGridsOfReaders) {
+  ActiveSubmaps3D active_submaps(CreateSubmapsOptions(1));
+  std::mt19937 prng(42);
+  std::uniform_real_distribution<float> distribution(-8.f, 8.f);
+  std::shared_ptr<const Submap3D> first_submap;
+  std::shared_ptr<const HybridGrid> high_resolution_hybrid_grid;
+  std::shared_ptr<const HybridGrid> low_resolution_hybrid_grid;
+  while (first_submap == nullptr || !first_submap->insertion_finished()) {
+    if (first_submap != nullptr) {
+      // Like a reader on another thread, keep the grids before the submap is
+      // finished.
+      high_resolution_hybrid_grid = first_submap->high_resolution_hybrid_grid();
+      low_resolution_hybrid_grid = first_submap->low_resolution_hybrid_grid();
+    }
+    std::vector<sensor::RangefinderPoint> returns;
+    for (int j = 0; j != 100; ++j) {
+      returns.push_back({Eigen::Vector3f(distribution(prng),
+                                         distribution(prng),
+                                         distribution(prng))});
+    }
+    const auto submaps = active_submaps.InsertData(
+        sensor::RangeData{Eigen::Vector3f::Zero(), sensor::PointCloud(returns),
+                          {}},
+        Eigen::Quaterniond::Identity(), Eigen::VectorXf::Zero(4));
+    if (first_submap == nullptr) {
+      first_submap = submaps.front();
+    }
+  }
+
+  // The kept grids are still valid, and the submap now has frozen copies
+  // with the same values.
+  for (const auto& grids :
+       {std::make_pair(high_resolution_hybrid_grid,
+                       first_submap->high_resolution_hybrid_grid()),
+        std::make_pair(low_resolution_hybrid_grid,
+                       first_submap->low_resolution_hybrid_grid())}) {
+    ASSERT_NE(grids.first, nullptr);
+    EXPECT_FALSE(grids.first->frozen());
+    EXPECT_TRUE(grids.second->frozen());
+    int num_known_cells = 0;
+    for (const auto& cell : *grids.first) {
+      EXPECT_EQ(cell.second, grids.second->value(cell.first));
+      ++num_known_cells;
+    }
+    EXPECT_GT(num_known_cells, 0);
+  }
+}
+
 }  // namespace
 }  // namespace mapping
 }  // namespace cartographer
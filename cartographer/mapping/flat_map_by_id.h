@@ -0,0 +1,406 @@
+/*
+ * Copyright 2018 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_MAPPING_FLAT_MAP_BY_ID_H_
+#define CARTOGRAPHER_MAPPING_FLAT_MAP_BY_ID_H_
+
+#include <iterator>
+#include <limits>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "absl/types/optional.h"
+#include "cartographer/common/port.h"
+#include "cartographer/common/time.h"
+#include "cartographer/mapping/id.h"
+#include "glog/logging.h"
+
+namespace cartographer {
+namespace mapping {
+
+// Drop-in variant of 'MapById' with the same interface and iteration order,
+// which stores the data of each trajectory in a vector indexed by node or
+// submap index. Trimmed entries leave tombstones behind, so iterating and
+// looking up IDs does not chase pointers through trees. This is fast for the
+// dense indices produced by 'Append()', but sparse indices waste memory.
+// Note: Unlike for 'MapById', 'Append()', 'Insert()' and 'Trim()' invalidate
+// iterators and references into the modified trajectory.
+template <typename IdType, typename DataType>
+class FlatMapById {
+ private:
+  struct Trajectory;
+
+ public:
+  struct IdDataReference {
+    IdType id;
+    const DataType& data;
+  };
+
+  class ConstIterator {
+   public:
+    // Allows 'it->data' without allocating, unlike returning a pointer.
+    class ArrowProxy {
+     public:
+      explicit ArrowProxy(const IdDataReference& reference)
+          : reference_(reference) {}
+      const IdDataReference* operator->() const { return &reference_; }
+
+     private:
+      const IdDataReference reference_;
+    };
+
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = IdDataReference;
+    using difference_type = int64;
+    using pointer = ArrowProxy;
+    using reference = const IdDataReference&;
+
+    explicit ConstIterator(const FlatMapById& map_by_id,
+                           const int trajectory_id)
+        : current_trajectory_(
+              map_by_id.trajectories_.lower_bound(trajectory_id)),
+          end_trajectory_(map_by_id.trajectories_.end()) {
+      if (current_trajectory_ != end_trajectory_) {
+        current_slot_ = current_trajectory_->second.first_slot;
+      }
+    }
+
+    explicit ConstIterator(const FlatMapById& map_by_id, const IdType& id)
+        : current_trajectory_(map_by_id.trajectories_.find(id.trajectory_id)),
+          end_trajectory_(map_by_id.trajectories_.end()) {
+      if (current_trajectory_ != end_trajectory_) {
+        const int64 slot = current_trajectory_->second.GetSlot(GetIndex(id));
+        if (slot < 0) {
+          current_trajectory_ = end_trajectory_;
+        } else {
+          current_slot_ = slot;
+        }
+      }
+    }
+
+    IdDataReference operator*() const {
+      CHECK(current_trajectory_ != end_trajectory_);
+      const Trajectory& trajectory = current_trajectory_->second;
+      return IdDataReference{
+          IdType{current_trajectory_->first,
+                 trajectory.first_index + static_cast<int>(current_slot_)},
+          *trajectory.slots[current_slot_]};
+    }
+
+    ArrowProxy operator->() const { return ArrowProxy(this->operator*()); }
+
+    ConstIterator& operator++() {
+      CHECK(current_trajectory_ != end_trajectory_);
+      const auto& slots = current_trajectory_->second.slots;
+      // The last slot of a trajectory is never a tombstone.
+      do {
+        ++current_slot_;
+      } while (current_slot_ < slots.size() && !slots[current_slot_]);
+      if (current_slot_ == slots.size()) {
+        ++current_trajectory_;
+        if (current_trajectory_ != end_trajectory_) {
+          current_slot_ = current_trajectory_->second.first_slot;
+        }
+      }
+      return *this;
+    }
+
+    ConstIterator& operator--() {
+      if (current_trajectory_ == end_trajectory_ ||
+          current_slot_ == current_trajectory_->second.first_slot) {
+        --current_trajectory_;
+        current_slot_ = current_trajectory_->second.slots.size();
+      }
+      const auto& slots = current_trajectory_->second.slots;
+      do {
+        --current_slot_;
+      } while (!slots[current_slot_]);
+      return *this;
+    }
+
+    bool operator==(const ConstIterator& it) const {
+      if (current_trajectory_ == end_trajectory_ ||
+          it.current_trajectory_ == it.end_trajectory_) {
+        return current_trajectory_ == it.current_trajectory_;
+      }
+      return current_trajectory_ == it.current_trajectory_ &&
+             current_slot_ == it.current_slot_;
+    }
+
+    bool operator!=(const ConstIterator& it) const { return !operator==(it); }
+
+   private:
+    typename std::map<int, Trajectory>::const_iterator current_trajectory_;
+    typename std::map<int, Trajectory>::const_iterator end_trajectory_;
+    size_t current_slot_ = 0;
+  };
+
+  class ConstTrajectoryIterator {
+   public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = int;
+    using difference_type = int64;
+    using pointer = const int*;
+    using reference = const int&;
+
+    explicit ConstTrajectoryIterator(
+        typename std::map<int, Trajectory>::const_iterator current_trajectory)
+        : current_trajectory_(current_trajectory) {}
+
+    int operator*() const { return current_trajectory_->first; }
+
+    ConstTrajectoryIterator& operator++() {
+      ++current_trajectory_;
+      return *this;
+    }
+
+    ConstTrajectoryIterator& operator--() {
+      --current_trajectory_;
+      return *this;
+    }
+
+    bool operator==(const ConstTrajectoryIterator& it) const {
+      return current_trajectory_ == it.current_trajectory_;
+    }
+
+    bool operator!=(const ConstTrajectoryIterator& it) const {
+      return !operator==(it);
+    }
+
+   private:
+    typename std::map<int, Trajectory>::const_iterator current_trajectory_;
+  };
+
+  // Appends data to a 'trajectory_id', creating trajectories as needed.
+  IdType Append(const int trajectory_id, const DataType& data) {
+    CHECK_GE(trajectory_id, 0);
+    auto& trajectory = trajectories_[trajectory_id];
+    CHECK(trajectory.can_append);
+    const int index =
+        trajectory.first_index + static_cast<int>(trajectory.slots.size());
+    trajectory.slots.emplace_back(data);
+    ++trajectory.size;
+    ++size_;
+    return IdType{trajectory_id, index};
+  }
+
+  // Returns an iterator to the element at 'id' or the end iterator if it does
+  // not exist.
+  ConstIterator find(const IdType& id) const {
+    return ConstIterator(*this, id);
+  }
+
+  // Inserts data (which must not exist already) into a trajectory.
+  void Insert(const IdType& id, const DataType& data) {
+    CHECK_GE(id.trajectory_id, 0);
+    const int index = GetIndex(id);
+    CHECK_GE(index, 0);
+    auto& trajectory = trajectories_[id.trajectory_id];
+    trajectory.can_append = false;
+    if (trajectory.size == 0) {
+      trajectory.first_index = index;
+    } else if (index < trajectory.first_index) {
+      trajectory.Rebuild(trajectory.first_index - index, 0);
+      trajectory.first_index = index;
+    }
+    const size_t slot = index - trajectory.first_index;
+    if (slot >= trajectory.slots.size()) {
+      trajectory.slots.resize(slot + 1);
+    }
+    CHECK(!trajectory.slots[slot]) << id;
+    trajectory.slots[slot].emplace(data);
+    if (trajectory.size == 0 || slot < trajectory.first_slot) {
+      trajectory.first_slot = slot;
+    }
+    ++trajectory.size;
+    ++size_;
+  }
+
+  // Removes the data for 'id' which must exist.
+  void Trim(const IdType& id) {
+    auto& trajectory = trajectories_.at(id.trajectory_id);
+    const int64 slot = trajectory.GetSlot(GetIndex(id));
+    CHECK_GE(slot, 0) << id;
+    if (static_cast<size_t>(slot) + 1 == trajectory.slots.size()) {
+      // We are removing the data with the highest index from this trajectory.
+      // We assume that we will never append to it anymore. If we did, we would
+      // have to make sure that gaps in indices are properly chosen to maintain
+      // correct connectivity.
+      trajectory.can_append = false;
+    }
+    trajectory.slots[slot].reset();
+    --trajectory.size;
+    --size_;
+    if (trajectory.size == 0) {
+      trajectories_.erase(id.trajectory_id);
+      return;
+    }
+    while (!trajectory.slots.back()) {
+      trajectory.slots.pop_back();
+    }
+    while (!trajectory.slots[trajectory.first_slot]) {
+      ++trajectory.first_slot;
+    }
+    // Dropping the leading tombstones only once they are half of the slots
+    // keeps trimming from the front, e.g. by trimmers, amortized constant.
+    if (2 * trajectory.first_slot >= trajectory.slots.size()) {
+      trajectory.first_index += trajectory.first_slot;
+      trajectory.Rebuild(0, trajectory.first_slot);
+    }
+  }
+
+  bool Contains(const IdType& id) const {
+    const auto it = trajectories_.find(id.trajectory_id);
+    return it != trajectories_.end() && it->second.GetSlot(GetIndex(id)) >= 0;
+  }
+
+  const DataType& at(const IdType& id) const {
+    const Trajectory& trajectory = trajectories_.at(id.trajectory_id);
+    const int64 slot = trajectory.GetSlot(GetIndex(id));
+    CHECK_GE(slot, 0) << id;
+    return *trajectory.slots[slot];
+  }
+
+  DataType& at(const IdType& id) {
+    Trajectory& trajectory = trajectories_.at(id.trajectory_id);
+    const int64 slot = trajectory.GetSlot(GetIndex(id));
+    CHECK_GE(slot, 0) << id;
+    return *trajectory.slots[slot];
+  }
+
+  // Support querying by trajectory.
+  ConstIterator BeginOfTrajectory(const int trajectory_id) const {
+    return ConstIterator(*this, trajectory_id);
+  }
+  ConstIterator EndOfTrajectory(const int trajectory_id) const {
+    return BeginOfTrajectory(trajectory_id + 1);
+  }
+
+  // Returns 0 if 'trajectory_id' does not exist.
+  size_t SizeOfTrajectoryOrZero(const int trajectory_id) const {
+    const auto it = trajectories_.find(trajectory_id);
+    return it != trajectories_.end() ? it->second.size : 0;
+  }
+
+  // Returns count of all elements.
+  size_t size() const { return size_; }
+
+  // Returns Range object for range-based loops over the nodes of a trajectory.
+  Range<ConstIterator> trajectory(const int trajectory_id) const {
+    return Range<ConstIterator>(BeginOfTrajectory(trajectory_id),
+                                EndOfTrajectory(trajectory_id));
+  }
+
+  // Returns Range object for range-based loops over the trajectory IDs.
+  Range<ConstTrajectoryIterator> trajectory_ids() const {
+    return Range<ConstTrajectoryIterator>(
+        ConstTrajectoryIterator(trajectories_.begin()),
+        ConstTrajectoryIterator(trajectories_.end()));
+  }
+
+  ConstIterator begin() const { return BeginOfTrajectory(0); }
+  ConstIterator end() const {
+    return BeginOfTrajectory(std::numeric_limits<int>::max());
+  }
+
+  bool empty() const { return size_ == 0; }
+
+  // Returns an iterator to the first element in the container belonging to
+  // trajectory 'trajectory_id' whose time is not considered to go before
+  // 'time', or EndOfTrajectory(trajectory_id) if all keys are considered to go
+  // before 'time'.
+  ConstIterator lower_bound(const int trajectory_id,
+                            const common::Time time) const {
+    const auto it = trajectories_.find(trajectory_id);
+    if (it == trajectories_.end()) {
+      return EndOfTrajectory(trajectory_id);
+    }
+    const auto& slots = it->second.slots;
+    if (internal::GetTime(*slots.back()) < time) {
+      return EndOfTrajectory(trajectory_id);
+    }
+
+    // 'left' and 'right' are never tombstones.
+    size_t left = it->second.first_slot;
+    size_t right = slots.size() - 1;
+    while (left != right) {
+      // This is never 'right' which is important to guarantee progress. In
+      // the presence of tombstones, use the previous element instead.
+      size_t middle = left + (right - left) / 2;
+      while (!slots[middle]) {
+        --middle;
+      }
+      if (internal::GetTime(*slots[middle]) < time) {
+        do {
+          ++middle;
+        } while (!slots[middle]);
+        left = middle;
+      } else {
+        right = middle;
+      }
+    }
+
+    return ConstIterator(
+        *this,
+        IdType{trajectory_id, it->second.first_index + static_cast<int>(left)});
+  }
+
+ private:
+  struct Trajectory {
+    // Returns the slot of 'index', or -1 if there is no data for it.
+    int64 GetSlot(const int index) const {
+      const int64 slot = static_cast<int64>(index) - first_index;
+      if (slot < 0 || slot >= static_cast<int64>(slots.size()) ||
+          !slots[slot]) {
+        return -1;
+      }
+      return slot;
+    }
+
+    // Moves the slots into a new vector, dropping the first 'num_dropped'
+    // slots and adding 'num_prepended' tombstones in front.
+    void Rebuild(const size_t num_prepended, const size_t num_dropped) {
+      std::vector<absl::optional<DataType>> new_slots;
+      new_slots.reserve(slots.size() + num_prepended - num_dropped);
+      new_slots.resize(num_prepended);
+      for (size_t i = num_dropped; i < slots.size(); ++i) {
+        new_slots.push_back(std::move(slots[i]));
+      }
+      slots = std::move(new_slots);
+      first_slot = first_slot + num_prepended - num_dropped;
+    }
+
+    bool can_append = true;
+    // Index of the data in 'slots[0]'.
+    int first_index = 0;
+    // Slot of the first data. It and the last slot are never tombstones.
+    size_t first_slot = 0;
+    size_t size = 0;
+    std::vector<absl::optional<DataType>> slots;
+  };
+
+  static int GetIndex(const NodeId& id) { return id.node_index; }
+  static int GetIndex(const SubmapId& id) { return id.submap_index; }
+
+  std::map<int, Trajectory> trajectories_;
+  size_t size_ = 0;
+};
+
+}  // namespace mapping
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_MAPPING_FLAT_MAP_BY_ID_H_
@@ -0,0 +1,170 @@
+/*
+ * Copyright 2018 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/flat_map_by_id.h"
+
+#include <algorithm>
+#include <iterator>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "cartographer/common/time.h"
+#include "cartographer/mapping/id.h"
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace mapping {
+namespace {
+
+common::Time CreateTime(const int milliseconds) {
+  return common::Time(common::FromMilliseconds(milliseconds));
+}
+
+struct Data {
+  common::Time time;
+  int value;
+};
+
+template <typename MapType>
+std::vector<std::pair<NodeId, int>> ToVector(const MapType& map_by_id) {
+  std::vector<std::pair<NodeId, int>> result;
+  for (const auto& id_data : map_by_id) {
+    result.emplace_back(id_data.id, id_data.data.value);
+  }
+  return result;
+}
+
+template <typename MapType>
+std::vector<std::pair<NodeId, int>> ToReversedVector(
+    const MapType& map_by_id) {
+  std::vector<std::pair<NodeId, int>> result;
+  for (auto it = map_by_id.end(); it != map_by_id.begin();) {
+    --it;
+    result.emplace_back(it->id, it->data.value);
+  }
+  return result;
+}
+
+TEST(FlatMapByIdTest, EmptyMap) {
+  FlatMapById<NodeId, int> map_by_id;
+  EXPECT_TRUE(map_by_id.empty());
+  EXPECT_EQ(map_by_id.trajectory_ids().begin(),
+            map_by_id.trajectory_ids().end());
+  EXPECT_EQ(map_by_id.trajectory(3).begin(), map_by_id.trajectory(3).end());
+  const NodeId id = map_by_id.Append(42, 42);
+  EXPECT_FALSE(map_by_id.empty());
+  map_by_id.Trim(id);
+  EXPECT_TRUE(map_by_id.empty());
+  EXPECT_EQ(0, map_by_id.size());
+}
+
+TEST(FlatMapByIdTest, IteratesLikeMapById) {
+  FlatMapById<SubmapId, int> map_by_id;
+  map_by_id.Append(7, 2);
+  map_by_id.Append(42, 3);
+  map_by_id.Append(0, 0);
+  map_by_id.Append(0, 1);
+  EXPECT_EQ(4, map_by_id.size());
+  EXPECT_EQ(2, map_by_id.BeginOfTrajectory(7)->data);
+  EXPECT_TRUE(std::next(map_by_id.BeginOfTrajectory(7)) ==
+              map_by_id.EndOfTrajectory(7));
+  EXPECT_EQ(1, std::prev(map_by_id.EndOfTrajectory(0))->data);
+  EXPECT_EQ((SubmapId{42, 0}), std::prev(map_by_id.end())->id);
+  std::vector<int> trajectory_ids;
+  for (const int trajectory_id : map_by_id.trajectory_ids()) {
+    trajectory_ids.push_back(trajectory_id);
+  }
+  EXPECT_EQ((std::vector<int>{0, 7, 42}), trajectory_ids);
+  EXPECT_TRUE(map_by_id.find(SubmapId{0, 2}) == map_by_id.end());
+  EXPECT_EQ(1, map_by_id.find(SubmapId{0, 1})->data);
+}
+
+TEST(FlatMapByIdTest, InsertsWithGapsAndTrims) {
+  FlatMapById<NodeId, int> map_by_id;
+  map_by_id.Insert(NodeId{3, 5}, 5);
+  map_by_id.Insert(NodeId{3, 9}, 9);
+  map_by_id.Insert(NodeId{3, 2}, 2);
+  EXPECT_EQ(3, map_by_id.SizeOfTrajectoryOrZero(3));
+  EXPECT_FALSE(map_by_id.Contains(NodeId{3, 4}));
+  EXPECT_FALSE(map_by_id.Contains(NodeId{3, 10}));
+  EXPECT_EQ(2, map_by_id.BeginOfTrajectory(3)->data);
+  EXPECT_EQ(9, std::prev(map_by_id.EndOfTrajectory(3))->data);
+  map_by_id.Trim(NodeId{3, 9});
+  map_by_id.Trim(NodeId{3, 2});
+  EXPECT_EQ(1, map_by_id.size());
+  EXPECT_EQ((NodeId{3, 5}), map_by_id.begin()->id);
+  EXPECT_TRUE(std::next(map_by_id.begin()) == map_by_id.end());
+  map_by_id.at(NodeId{3, 5}) = 6;
+  EXPECT_EQ(6, map_by_id.at(NodeId{3, 5}));
+}
+
+TEST(FlatMapByIdTest, MatchesMapByIdFuzz) {
+  constexpr int kNumTrajectories = 3;
+  constexpr int kNumNodesPerTrajectory = 200;
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<int> dt_dist(1, 20);
+  std::uniform_real_distribution<double> trim_dist(0., 1.);
+  MapById<NodeId, Data> map_by_id;
+  FlatMapById<NodeId, Data> flat_map_by_id;
+  for (int trajectory_id = 0; trajectory_id < kNumTrajectories;
+       ++trajectory_id) {
+    int t = 0;
+    for (int i = 0; i < kNumNodesPerTrajectory; ++i) {
+      t += dt_dist(rng);
+      const Data data{CreateTime(t), trajectory_id * 1000 + i};
+      EXPECT_EQ(map_by_id.Append(trajectory_id, data),
+                flat_map_by_id.Append(trajectory_id, data));
+    }
+  }
+  // Trims mostly from the front, like trimmers do, and randomly elsewhere.
+  std::vector<NodeId> ids;
+  for (const auto& id_data : map_by_id) {
+    ids.push_back(id_data.id);
+  }
+  for (const NodeId& id : ids) {
+    const double threshold = id.node_index < 100 ? 0.8 : 0.3;
+    if (trim_dist(rng) < threshold) {
+      map_by_id.Trim(id);
+      flat_map_by_id.Trim(id);
+    }
+  }
+  ASSERT_EQ(map_by_id.size(), flat_map_by_id.size());
+  EXPECT_EQ(ToVector(map_by_id), ToVector(flat_map_by_id));
+  EXPECT_EQ(ToReversedVector(map_by_id), ToReversedVector(flat_map_by_id));
+  for (const NodeId& id : ids) {
+    ASSERT_EQ(map_by_id.Contains(id), flat_map_by_id.Contains(id)) << id;
+  }
+  for (int trajectory_id = 0; trajectory_id <= kNumTrajectories;
+       ++trajectory_id) {
+    EXPECT_EQ(map_by_id.SizeOfTrajectoryOrZero(trajectory_id),
+              flat_map_by_id.SizeOfTrajectoryOrZero(trajectory_id));
+    for (int t = 0; t < 20 * kNumNodesPerTrajectory + 20; t += 7) {
+      const auto it = map_by_id.lower_bound(trajectory_id, CreateTime(t));
+      const auto flat_it =
+          flat_map_by_id.lower_bound(trajectory_id, CreateTime(t));
+      ASSERT_EQ(it == map_by_id.EndOfTrajectory(trajectory_id),
+                flat_it == flat_map_by_id.EndOfTrajectory(trajectory_id));
+      if (it != map_by_id.EndOfTrajectory(trajectory_id)) {
+        EXPECT_EQ(it->id, flat_it->id);
+      }
+    }
+  }
+}
+
+}  // namespace
+}  // namespace mapping
+}  // namespace cartographer
@@ -25,6 +25,7 @@
 #include <memory>
 #include <ostream>
 #include <tuple>
+#include <utility>
 #include <vector>
 
 #include "absl/memory/memory.h"
@@ -77,6 +78,11 @@ struct NodeId {
     proto->set_trajectory_id(trajectory_id);
     proto->set_node_index(node_index);
   }
+
+  template <typename H>
+  friend H AbslHashValue(H hash_state, const NodeId& id) {
+    return H::combine(std::move(hash_state), id.trajectory_id, id.node_index);
+  }
 };
 
 inline std::ostream& operator<<(std::ostream& os, const NodeId& v) {
@@ -108,6 +114,11 @@ struct SubmapId {
     proto->set_trajectory_id(trajectory_id);
     proto->set_submap_index(submap_index);
   }
+
+  template <typename H>
+  friend H AbslHashValue(H hash_state, const SubmapId& id) {
+    return H::combine(std::move(hash_state), id.trajectory_id, id.submap_index);
+  }
 };
 
 inline std::ostream& operator<<(std::ostream& os, const SubmapId& v) {
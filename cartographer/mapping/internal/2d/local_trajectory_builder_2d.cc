@@ -44,6 +44,8 @@ LocalTrajectoryBuilder2D::LocalTrajectoryBuilder2D(
       real_time_correlative_scan_matcher_(
           options_.real_time_correlative_scan_matcher_options()),
       ceres_scan_matcher_(options_.ceres_scan_matcher_options()),
+      range_data_unwarper_(
+          common::FromSeconds(options_.max_unwarping_pose_interval())),
       range_data_collator_(expected_range_sensor_ids) {}
 
 LocalTrajectoryBuilder2D::~LocalTrajectoryBuilder2D() {}
@@ -101,12 +103,22 @@ std::unique_ptr<transform::Rigid2d> LocalTrajectoryBuilder2D::ScanMatch(
   return pose_observation;
 }
 
+std::unique_ptr<LocalTrajectoryBuilder2D::MatchingResult>
+LocalTrajectoryBuilder2D::AddRangeData(
+    const std::string& sensor_id,
+    const sensor::OrganizedPointCloudData& range_data) {
+  return AddRangeData(sensor_id, sensor::ToTimedPointCloudData(
+                                     range_data, options_.min_range()));
+}
+
 std::unique_ptr<LocalTrajectoryBuilder2D::MatchingResult>
 LocalTrajectoryBuilder2D::AddRangeData(
     const std::string& sensor_id,
     const sensor::TimedPointCloudData& unsynchronized_data) {
-  auto synchronized_data =
-      range_data_collator_.AddRangeData(sensor_id, unsynchronized_data);
+  range_data_collator_.AddRangeData(sensor_id, unsynchronized_data,
+                                    &synchronized_data_);
+  const sensor::TimedPointCloudOriginData& synchronized_data =
+      synchronized_data_;
   if (synchronized_data.ranges.empty()) {
     LOG(INFO) << "Range data collator filling buffer.";
     return nullptr;
@@ -136,23 +148,26 @@ LocalTrajectoryBuilder2D::AddRangeData(
     return nullptr;
   }
 
-  std::vector<transform::Rigid3f> range_data_poses;
-  range_data_poses.reserve(synchronized_data.ranges.size());
+  std::vector<common::Time> time_points;
+  time_points.reserve(synchronized_data.ranges.size());
+  common::Time prev_time_point = extrapolator_->GetLastExtrapolatedTime();
   bool warned = false;
   for (const auto& range : synchronized_data.ranges) {
     common::Time time_point = time + common::FromSeconds(range.point_time.time);
-    if (time_point < extrapolator_->GetLastExtrapolatedTime()) {
+    if (time_point < prev_time_point) {
       if (!warned) {
         LOG(ERROR)
             << "Timestamp of individual range data point jumps backwards from "
-            << extrapolator_->GetLastExtrapolatedTime() << " to " << time_point;
+            << prev_time_point << " to " << time_point;
         warned = true;
       }
-      time_point = extrapolator_->GetLastExtrapolatedTime();
+      time_point = prev_time_point;
     }
-    range_data_poses.push_back(
-        extrapolator_->ExtrapolatePose(time_point).cast<float>());
+    time_points.push_back(time_point);
+    prev_time_point = time_point;
   }
+  const std::vector<transform::Rigid3f>& range_data_poses =
+      range_data_unwarper_.ExtrapolatePoses(time_points, extrapolator_.get());
 
   if (num_accumulated_ == 0) {
     // 'accumulated_range_data_.origin' is uninitialized until the last
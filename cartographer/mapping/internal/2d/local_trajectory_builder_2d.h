@@ -26,12 +26,14 @@
 #include "cartographer/mapping/internal/2d/scan_matching/real_time_correlative_scan_matcher_2d.h"
 #include "cartographer/mapping/internal/motion_filter.h"
 #include "cartographer/mapping/internal/range_data_collator.h"
+#include "cartographer/mapping/internal/range_data_unwarper.h"
 #include "cartographer/mapping/pose_extrapolator.h"
 #include "cartographer/mapping/proto/local_trajectory_builder_options_2d.pb.h"
 #include "cartographer/metrics/family_factory.h"
 #include "cartographer/sensor/imu_data.h"
 #include "cartographer/sensor/internal/voxel_filter.h"
 #include "cartographer/sensor/odometry_data.h"
+#include "cartographer/sensor/organized_point_cloud.h"
 #include "cartographer/sensor/range_data.h"
 #include "cartographer/transform/rigid_transform.h"
 
@@ -71,6 +73,11 @@ class LocalTrajectoryBuilder2D {
   std::unique_ptr<MatchingResult> AddRangeData(
       const std::string& sensor_id,
       const sensor::TimedPointCloudData& range_data);
+  // Like above, but for an organized scan. Points closer than 'min_range' are
+  // dropped on the range image before anything else is done.
+  std::unique_ptr<MatchingResult> AddRangeData(
+      const std::string& sensor_id,
+      const sensor::OrganizedPointCloudData& range_data);
   void AddImuData(const sensor::ImuData& imu_data);
   void AddOdometryData(const sensor::OdometryData& odometry_data);
 
@@ -108,6 +115,7 @@ class LocalTrajectoryBuilder2D {
   scan_matching::CeresScanMatcher2D ceres_scan_matcher_;
 
   std::unique_ptr<PoseExtrapolator> extrapolator_;
+  RangeDataUnwarper range_data_unwarper_;
 
   int num_accumulated_ = 0;
   sensor::RangeData accumulated_range_data_;
@@ -117,6 +125,8 @@ class LocalTrajectoryBuilder2D {
   absl::optional<common::Time> last_sensor_time_;
 
   RangeDataCollator range_data_collator_;
+  // Output of 'range_data_collator_', kept to reuse its memory across scans.
+  sensor::TimedPointCloudOriginData synchronized_data_;
 };
 
 }  // namespace mapping
@@ -17,6 +17,7 @@
 #include "cartographer/mapping/internal/2d/pose_graph_2d.h"
 
 #include <algorithm>
+#include <chrono>
 #include <cmath>
 #include <cstdio>
 #include <functional>
@@ -43,11 +44,15 @@ namespace mapping {
 
 static auto* kWorkQueueDelayMetric = metrics::Gauge::Null();
 static auto* kWorkQueueSizeMetric = metrics::Gauge::Null();
+static auto* kSensorDataWorkQueueLatencyMetric = metrics::Histogram::Null();
+static auto* kNodesWorkQueueLatencyMetric = metrics::Histogram::Null();
 static auto* kConstraintsSameTrajectoryMetric = metrics::Gauge::Null();
 static auto* kConstraintsDifferentTrajectoryMetric = metrics::Gauge::Null();
 static auto* kActiveSubmapsMetric = metrics::Gauge::Null();
 static auto* kFrozenSubmapsMetric = metrics::Gauge::Null();
 static auto* kDeletedSubmapsMetric = metrics::Gauge::Null();
+static auto* kSubmapLevelOptimizationDurationMetric = metrics::Gauge::Null();
+static auto* kNodeRefinementDurationMetric = metrics::Gauge::Null();
 
 PoseGraph2D::PoseGraph2D(
     const proto::PoseGraphOptions& options,
@@ -56,7 +61,17 @@ PoseGraph2D::PoseGraph2D(
     : options_(options),
       optimization_problem_(std::move(optimization_problem)),
       constraint_builder_(options_.constraint_builder_options(), thread_pool),
-      thread_pool_(thread_pool) {
+      thread_pool_(thread_pool),
+      finished_submap_index_(
+          options_.constraint_builder_options().max_constraint_distance()),
+      node_index_(
+          options_.constraint_builder_options().max_constraint_distance()) {
+  optimization_problem_->SetThreadPool(thread_pool);
+  CHECK(!options_.optimize_in_background() ||
+        !options_.optimization_problem_options()
+             .use_persistent_problem_in_2d())
+      << "'optimize_in_background' and 'use_persistent_problem_in_2d' are "
+         "mutually exclusive.";
   if (options.has_overlapping_submaps_trimmer_2d()) {
     const auto& trimmer_options = options.overlapping_submaps_trimmer_2d();
     AddTrimmer(absl::make_unique<OverlappingSubmapsTrimmer2D>(
@@ -172,7 +187,8 @@ NodeId PoseGraph2D::AddNode(
 }
 
 void PoseGraph2D::AddWorkItem(
-    const std::function<WorkItem::Result()>& work_item) {
+    const std::function<WorkItem::Result()>& work_item,
+    const WorkItem::Lane lane) {
   absl::MutexLock locker(&work_queue_mutex_);
   if (work_queue_ == nullptr) {
     work_queue_ = absl::make_unique<WorkQueue>();
@@ -181,14 +197,24 @@ void PoseGraph2D::AddWorkItem(
     thread_pool_->Schedule(std::move(task));
   }
   const auto now = std::chrono::steady_clock::now();
-  work_queue_->push_back({now, work_item});
+  work_queue_->Push({now, work_item, lane});
   kWorkQueueSizeMetric->Set(work_queue_->size());
   kWorkQueueDelayMetric->Set(
       std::chrono::duration_cast<std::chrono::duration<double>>(
-          now - work_queue_->front().time)
+          work_queue_->GetDelay(now))
           .count());
 }
 
+bool PoseGraph2D::IsOverloaded() const {
+  absl::MutexLock locker(&work_queue_mutex_);
+  return work_queue_ != nullptr &&
+         work_queue_->IsOverloaded(
+             std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                 std::chrono::duration<double>(
+                     options_.overloaded_work_queue_delay_seconds())),
+             std::chrono::steady_clock::now());
+}
+
 void PoseGraph2D::AddTrajectoryIfNeeded(const int trajectory_id) {
   data_.trajectories_state[trajectory_id];
   CHECK(data_.trajectories_state.at(trajectory_id).state !=
@@ -208,54 +234,64 @@ void PoseGraph2D::AddTrajectoryIfNeeded(const int trajectory_id) {
 
 void PoseGraph2D::AddImuData(const int trajectory_id,
                              const sensor::ImuData& imu_data) {
-  AddWorkItem([=]() LOCKS_EXCLUDED(mutex_) {
-    absl::MutexLock locker(&mutex_);
-    if (CanAddWorkItemModifying(trajectory_id)) {
-      optimization_problem_->AddImuData(trajectory_id, imu_data);
-    }
-    return WorkItem::Result::kDoNotRunOptimization;
-  });
+  AddWorkItem(
+      [=]() LOCKS_EXCLUDED(mutex_) {
+        absl::MutexLock locker(&mutex_);
+        if (CanAddWorkItemModifying(trajectory_id)) {
+          optimization_problem_->AddImuData(trajectory_id, imu_data);
+        }
+        return WorkItem::Result::kDoNotRunOptimization;
+      },
+      WorkItem::Lane::kSensorData);
 }
 
 void PoseGraph2D::AddOdometryData(const int trajectory_id,
                                   const sensor::OdometryData& odometry_data) {
-  AddWorkItem([=]() LOCKS_EXCLUDED(mutex_) {
-    absl::MutexLock locker(&mutex_);
-    if (CanAddWorkItemModifying(trajectory_id)) {
-      optimization_problem_->AddOdometryData(trajectory_id, odometry_data);
-    }
-    return WorkItem::Result::kDoNotRunOptimization;
-  });
+  AddWorkItem(
+      [=]() LOCKS_EXCLUDED(mutex_) {
+        absl::MutexLock locker(&mutex_);
+        if (CanAddWorkItemModifying(trajectory_id)) {
+          optimization_problem_->AddOdometryData(trajectory_id, odometry_data);
+        }
+        return WorkItem::Result::kDoNotRunOptimization;
+      },
+      WorkItem::Lane::kSensorData);
 }
 
 void PoseGraph2D::AddFixedFramePoseData(
     const int trajectory_id,
     const sensor::FixedFramePoseData& fixed_frame_pose_data) {
-  AddWorkItem([=]() LOCKS_EXCLUDED(mutex_) {
-    absl::MutexLock locker(&mutex_);
-    if (CanAddWorkItemModifying(trajectory_id)) {
-      optimization_problem_->AddFixedFramePoseData(trajectory_id,
-                                                   fixed_frame_pose_data);
-    }
-    return WorkItem::Result::kDoNotRunOptimization;
-  });
+  AddWorkItem(
+      [=]() LOCKS_EXCLUDED(mutex_) {
+        absl::MutexLock locker(&mutex_);
+        if (CanAddWorkItemModifying(trajectory_id)) {
+          optimization_problem_->AddFixedFramePoseData(trajectory_id,
+                                                       fixed_frame_pose_data);
+        }
+        return WorkItem::Result::kDoNotRunOptimization;
+      },
+      WorkItem::Lane::kSensorData);
 }
 
 void PoseGraph2D::AddLandmarkData(int trajectory_id,
                                   const sensor::LandmarkData& landmark_data) {
-  AddWorkItem([=]() LOCKS_EXCLUDED(mutex_) {
-    absl::MutexLock locker(&mutex_);
-    if (CanAddWorkItemModifying(trajectory_id)) {
-      for (const auto& observation : landmark_data.landmark_observations) {
-        data_.landmark_nodes[observation.id].landmark_observations.emplace_back(
-            PoseGraphInterface::LandmarkNode::LandmarkObservation{
-                trajectory_id, landmark_data.time,
-                observation.landmark_to_tracking_transform,
-                observation.translation_weight, observation.rotation_weight});
-      }
-    }
-    return WorkItem::Result::kDoNotRunOptimization;
-  });
+  AddWorkItem(
+      [=]() LOCKS_EXCLUDED(mutex_) {
+        absl::MutexLock locker(&mutex_);
+        if (CanAddWorkItemModifying(trajectory_id)) {
+          for (const auto& observation : landmark_data.landmark_observations) {
+            data_.landmark_nodes[observation.id]
+                .landmark_observations.emplace_back(
+                    PoseGraphInterface::LandmarkNode::LandmarkObservation{
+                        trajectory_id, landmark_data.time,
+                        observation.landmark_to_tracking_transform,
+                        observation.translation_weight,
+                        observation.rotation_weight});
+          }
+        }
+        return WorkItem::Result::kDoNotRunOptimization;
+      },
+      WorkItem::Lane::kSensorData);
 }
 
 void PoseGraph2D::ComputeConstraint(const NodeId& node_id,
@@ -273,15 +309,8 @@ void PoseGraph2D::ComputeConstraint(const NodeId& node_id,
       return;
     }
 
-    const common::Time node_time = GetLatestNodeTime(node_id, submap_id);
-    const common::Time last_connection_time =
-        data_.trajectory_connectivity_state.LastConnectionTime(
-            node_id.trajectory_id, submap_id.trajectory_id);
-    if (node_id.trajectory_id == submap_id.trajectory_id ||
-        node_time <
-            last_connection_time +
-                common::FromSeconds(
-                    options_.global_constraint_search_after_n_seconds())) {
+    if (IsLocalConstraintSearch(node_id.trajectory_id, submap_id.trajectory_id,
+                                GetLatestNodeTime(node_id, submap_id))) {
       // If the node and the submap belong to the same trajectory or if there
       // has been a recent global constraint that ties that node's trajectory to
       // the submap's trajectory, it suffices to do a match constrained to a
@@ -315,7 +344,7 @@ WorkItem::Result PoseGraph2D::ComputeConstraintsForNode(
     const bool newly_finished_submap) {
   std::vector<SubmapId> submap_ids;
   std::vector<SubmapId> finished_submap_ids;
-  std::set<NodeId> newly_finished_submap_node_ids;
+  std::vector<NodeId> newly_finished_submap_node_ids;
   {
     absl::MutexLock locker(&mutex_);
     const auto& constant_data =
@@ -337,6 +366,8 @@ WorkItem::Result PoseGraph2D::ComputeConstraintsForNode(
         optimization::NodeSpec2D{constant_data->time, local_pose_2d,
                                  global_pose_2d,
                                  constant_data->gravity_alignment});
+    node_index_.Insert(node_id,
+                       transform::Embed3D(global_pose_2d).translation());
     for (size_t i = 0; i < insertion_submaps.size(); ++i) {
       const SubmapId submap_id = submap_ids[i];
       // Even if this was the last node added to 'submap_id', the submap will
@@ -358,21 +389,75 @@ WorkItem::Result PoseGraph2D::ComputeConstraintsForNode(
 
     // TODO(gaschler): Consider not searching for constraints against
     // trajectories scheduled for deletion.
-    // TODO(danielsievers): Add a member variable and avoid having to copy
-    // them out here.
-    for (const auto& submap_id_data : data_.submap_data) {
-      if (submap_id_data.data.state == SubmapState::kFinished) {
-        CHECK_EQ(submap_id_data.data.node_ids.count(node_id), 0);
-        finished_submap_ids.emplace_back(submap_id_data.id);
+    // Finished submaps of trajectories which may be searched globally are all
+    // candidates, otherwise only those close enough for a local search.
+    const common::Time latest_node_time = GetLatestNodeTime();
+    for (const int trajectory_id : data_.submap_data.trajectory_ids()) {
+      if (IsLocalConstraintSearch(node_id.trajectory_id, trajectory_id,
+                                  latest_node_time)) {
+        continue;
       }
+      for (const auto& submap_id_data :
+           data_.submap_data.trajectory(trajectory_id)) {
+        if (submap_id_data.data.state == SubmapState::kFinished) {
+          finished_submap_ids.push_back(submap_id_data.id);
+        }
+      }
+    }
+    for (const SubmapId& submap_id : finished_submap_index_.Query(
+             transform::Embed3D(global_pose_2d).translation())) {
+      if (IsLocalConstraintSearch(node_id.trajectory_id,
+                                  submap_id.trajectory_id, latest_node_time)) {
+        finished_submap_ids.push_back(submap_id);
+      }
+    }
+    std::sort(finished_submap_ids.begin(), finished_submap_ids.end());
+    for (const SubmapId& submap_id : finished_submap_ids) {
+      CHECK(data_.submap_data.at(submap_id).state == SubmapState::kFinished);
+      CHECK_EQ(data_.submap_data.at(submap_id).node_ids.count(node_id), 0);
     }
+
     if (newly_finished_submap) {
       const SubmapId newly_finished_submap_id = submap_ids.front();
       InternalSubmapData& finished_submap_data =
           data_.submap_data.at(newly_finished_submap_id);
       CHECK(finished_submap_data.state == SubmapState::kNoConstraintSearch);
       finished_submap_data.state = SubmapState::kFinished;
-      newly_finished_submap_node_ids = finished_submap_data.node_ids;
+      const transform::Rigid2d& global_submap_pose =
+          optimization_problem_->submap_data()
+              .at(newly_finished_submap_id)
+              .global_pose;
+      const Eigen::Vector3d global_submap_position =
+          transform::Embed3D(global_submap_pose).translation();
+      finished_submap_index_.Insert(newly_finished_submap_id,
+                                    global_submap_position);
+      // We have a new completed submap, so we look into adding constraints
+      // for old nodes, in the same way as above.
+      const std::set<NodeId>& submap_node_ids = finished_submap_data.node_ids;
+      const auto& node_data = optimization_problem_->node_data();
+      for (const int trajectory_id : node_data.trajectory_ids()) {
+        if (IsLocalConstraintSearch(trajectory_id,
+                                    newly_finished_submap_id.trajectory_id,
+                                    latest_node_time)) {
+          continue;
+        }
+        for (const auto& node_id_data : node_data.trajectory(trajectory_id)) {
+          if (submap_node_ids.count(node_id_data.id) == 0) {
+            newly_finished_submap_node_ids.push_back(node_id_data.id);
+          }
+        }
+      }
+      for (const NodeId& other_node_id :
+           node_index_.Query(global_submap_position)) {
+        if (submap_node_ids.count(other_node_id) == 0 &&
+            IsLocalConstraintSearch(other_node_id.trajectory_id,
+                                    newly_finished_submap_id.trajectory_id,
+                                    latest_node_time)) {
+          newly_finished_submap_node_ids.push_back(other_node_id);
+        }
+      }
+      std::sort(newly_finished_submap_node_ids.begin(),
+                newly_finished_submap_node_ids.end());
     }
   }
 
@@ -382,13 +467,8 @@ WorkItem::Result PoseGraph2D::ComputeConstraintsForNode(
 
   if (newly_finished_submap) {
     const SubmapId newly_finished_submap_id = submap_ids.front();
-    // We have a new completed submap, so we look into adding constraints for
-    // old nodes.
-    for (const auto& node_id_data : optimization_problem_->node_data()) {
-      const NodeId& node_id = node_id_data.id;
-      if (newly_finished_submap_node_ids.count(node_id) == 0) {
-        ComputeConstraint(node_id, newly_finished_submap_id);
-      }
+    for (const NodeId& other_node_id : newly_finished_submap_node_ids) {
+      ComputeConstraint(other_node_id, newly_finished_submap_id);
     }
   }
   constraint_builder_.NotifyEndOfNode();
@@ -415,6 +495,32 @@ common::Time PoseGraph2D::GetLatestNodeTime(const NodeId& node_id,
   return time;
 }
 
+common::Time PoseGraph2D::GetLatestNodeTime() const {
+  common::Time time = common::Time::min();
+  for (const int trajectory_id : data_.trajectory_nodes.trajectory_ids()) {
+    const auto end_it = data_.trajectory_nodes.EndOfTrajectory(trajectory_id);
+    if (data_.trajectory_nodes.BeginOfTrajectory(trajectory_id) != end_it) {
+      time = std::max(time, std::prev(end_it)->data.time());
+    }
+  }
+  return time;
+}
+
+bool PoseGraph2D::IsLocalConstraintSearch(const int node_trajectory_id,
+                                          const int submap_trajectory_id,
+                                          const common::Time node_time) const {
+  if (node_trajectory_id == submap_trajectory_id) {
+    return true;
+  }
+  const common::Time last_connection_time =
+      data_.trajectory_connectivity_state.LastConnectionTime(
+          node_trajectory_id, submap_trajectory_id);
+  return node_time <
+         last_connection_time +
+             common::FromSeconds(
+                 options_.global_constraint_search_after_n_seconds());
+}
+
 void PoseGraph2D::UpdateTrajectoryConnectivity(const Constraint& constraint) {
   CHECK_EQ(constraint.tag, Constraint::INTER_SUBMAP);
   const common::Time time =
@@ -443,43 +549,38 @@ void PoseGraph2D::DeleteTrajectoriesIfNeeded() {
 
 void PoseGraph2D::HandleWorkQueue(
     const constraints::ConstraintBuilder2D::Result& result) {
+  bool run_optimization = true;
   {
     absl::MutexLock locker(&mutex_);
     data_.constraints.insert(data_.constraints.end(), result.begin(),
                              result.end());
-  }
-  RunOptimization();
-
-  if (global_slam_optimization_callback_) {
-    std::map<int, NodeId> trajectory_id_to_last_optimized_node_id;
-    std::map<int, SubmapId> trajectory_id_to_last_optimized_submap_id;
-    {
-      absl::MutexLock locker(&mutex_);
-      const auto& submap_data = optimization_problem_->submap_data();
-      const auto& node_data = optimization_problem_->node_data();
-      for (const int trajectory_id : node_data.trajectory_ids()) {
-        if (node_data.SizeOfTrajectoryOrZero(trajectory_id) == 0 ||
-            submap_data.SizeOfTrajectoryOrZero(trajectory_id) == 0) {
-          continue;
+    for (const Constraint& constraint : result) {
+      UpdateTrajectoryConnectivity(constraint);
+    }
+    if (options_.optimize_in_background()) {
+      if (background_optimization_running_) {
+        if (final_optimization_requested_) {
+          // The final optimization starts from the result of the running one,
+          // so the work queue is resumed once that finished.
+          work_queue_waiting_for_optimization_ = true;
+          return;
         }
-        trajectory_id_to_last_optimized_node_id.emplace(
-            trajectory_id,
-            std::prev(node_data.EndOfTrajectory(trajectory_id))->id);
-        trajectory_id_to_last_optimized_submap_id.emplace(
-            trajectory_id,
-            std::prev(submap_data.EndOfTrajectory(trajectory_id))->id);
+        background_optimization_requested_ = true;
+        run_optimization = false;
+      } else if (!final_optimization_requested_) {
+        StartBackgroundOptimization();
+        run_optimization = false;
       }
     }
-    global_slam_optimization_callback_(
-        trajectory_id_to_last_optimized_submap_id,
-        trajectory_id_to_last_optimized_node_id);
+  }
+  if (run_optimization) {
+    RunOptimization();
+    RunGlobalSlamOptimizationCallback();
   }
 
   {
     absl::MutexLock locker(&mutex_);
-    for (const Constraint& constraint : result) {
-      UpdateTrajectoryConnectivity(constraint);
-    }
+    final_optimization_requested_ = false;
     DeleteTrajectoriesIfNeeded();
     TrimmingHandle trimming_handle(this);
     for (auto& trimmer : trimmers_) {
@@ -512,6 +613,7 @@ void PoseGraph2D::HandleWorkQueue(
     kConstraintsSameTrajectoryMetric->Set(inter_constraints_same_trajectory);
     kConstraintsDifferentTrajectoryMetric->Set(
         inter_constraints_different_trajectory);
+    PublishSnapshot();
   }
 
   DrainWorkQueue();
@@ -528,10 +630,19 @@ void PoseGraph2D::DrainWorkQueue() {
         work_queue_.reset();
         return;
       }
-      work_item = work_queue_->front().task;
-      work_queue_->pop_front();
+      const WorkItem next_work_item = work_queue_->Pop();
+      work_item = next_work_item.task;
       work_queue_size = work_queue_->size();
       kWorkQueueSizeMetric->Set(work_queue_size);
+      const double latency =
+          std::chrono::duration_cast<std::chrono::duration<double>>(
+              std::chrono::steady_clock::now() - next_work_item.time)
+              .count();
+      if (next_work_item.lane == WorkItem::Lane::kSensorData) {
+        kSensorDataWorkQueueLatencyMetric->Observe(latency);
+      } else {
+        kNodesWorkQueueLatencyMetric->Observe(latency);
+      }
     }
     process_work_queue = work_item() == WorkItem::Result::kDoNotRunOptimization;
   }
@@ -603,6 +714,14 @@ void PoseGraph2D::WaitForAllComputations() {
     report_progress();
   }
   CHECK_EQ(constraint_builder_.GetNumFinishedNodes(), num_trajectory_nodes);
+
+  // Optimizations solved in the background have to be merged as well, and
+  // their tasks have to return before 'this' may be destroyed.
+  const auto optimization_predicate =
+      [this]() EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+        return num_background_optimization_tasks_ == 0;
+      };
+  mutex_.Await(absl::Condition(&optimization_predicate));
   std::cout << "\r\x1b[KOptimizing: Done.     " << std::endl;
 }
 
@@ -640,6 +759,10 @@ void PoseGraph2D::FinishTrajectory(const int trajectory_id) {
 
     for (const auto& submap : data_.submap_data.trajectory(trajectory_id)) {
       data_.submap_data.at(submap.id).state = SubmapState::kFinished;
+      const transform::Rigid2d& global_submap_pose =
+          optimization_problem_->submap_data().at(submap.id).global_pose;
+      finished_submap_index_.Insert(
+          submap.id, transform::Embed3D(global_submap_pose).translation());
     }
     return WorkItem::Result::kRunOptimization;
   });
@@ -724,6 +847,8 @@ void PoseGraph2D::AddSubmapFromProto(
         absl::MutexLock locker(&mutex_);
         data_.submap_data.at(submap_id).state = SubmapState::kFinished;
         optimization_problem_->InsertSubmap(submap_id, global_submap_pose_2d);
+        finished_submap_index_.Insert(
+            submap_id, transform::Embed3D(global_submap_pose_2d).translation());
         return WorkItem::Result::kDoNotRunOptimization;
       });
 }
@@ -749,14 +874,17 @@ void PoseGraph2D::AddNodeFromProto(const transform::Rigid3d& global_pose,
         data_.trajectory_nodes.at(node_id).constant_data;
     const auto gravity_alignment_inverse = transform::Rigid3d::Rotation(
         constant_data->gravity_alignment.inverse());
+    const transform::Rigid2d global_pose_2d =
+        transform::Project2D(global_pose * gravity_alignment_inverse);
     optimization_problem_->InsertTrajectoryNode(
         node_id,
         optimization::NodeSpec2D{
             constant_data->time,
             transform::Project2D(constant_data->local_pose *
                                  gravity_alignment_inverse),
-            transform::Project2D(global_pose * gravity_alignment_inverse),
-            constant_data->gravity_alignment});
+            global_pose_2d, constant_data->gravity_alignment});
+    node_index_.Insert(node_id,
+                       transform::Embed3D(global_pose_2d).translation());
     return WorkItem::Result::kDoNotRunOptimization;
   });
 }
@@ -842,6 +970,7 @@ void PoseGraph2D::RunFinalOptimization() {
   {
     AddWorkItem([this]() LOCKS_EXCLUDED(mutex_) {
       absl::MutexLock locker(&mutex_);
+      final_optimization_requested_ = true;
       optimization_problem_->SetMaxNumIterations(
           options_.max_num_final_iterations());
       return WorkItem::Result::kRunOptimization;
@@ -867,10 +996,28 @@ void PoseGraph2D::RunOptimization() {
   // data_.constraints, data_.frozen_trajectories and data_.landmark_nodes
   // when executing the Solve. Solve is time consuming, so not taking the mutex
   // before Solve to avoid blocking foreground processing.
-  optimization_problem_->Solve(data_.constraints, GetTrajectoryStates(),
-                               data_.landmark_nodes);
+  SolveOptimizationProblem(optimization_problem_.get(), data_.constraints,
+                           GetTrajectoryStates(), data_.landmark_nodes);
   absl::MutexLock locker(&mutex_);
+  UpdateGlobalPoses();
+}
+
+void PoseGraph2D::SolveOptimizationProblem(
+    optimization::OptimizationProblem2D* const optimization_problem,
+    const std::vector<Constraint>& constraints,
+    const std::map<int, TrajectoryState>& trajectories_state,
+    const std::map<std::string, LandmarkNode>& landmark_nodes) {
+  if (options_.optimization_problem_options()
+          .use_submap_level_optimization()) {
+    RunSubmapLevelOptimization(optimization_problem, constraints,
+                               trajectories_state);
+  } else {
+    optimization_problem->Solve(constraints, trajectories_state,
+                                landmark_nodes);
+  }
+}
 
+void PoseGraph2D::UpdateGlobalPoses() {
   const auto& submap_data = optimization_problem_->submap_data();
   const auto& node_data = optimization_problem_->node_data();
   for (const int trajectory_id : node_data.trajectory_ids()) {
@@ -880,6 +1027,8 @@ void PoseGraph2D::RunOptimization() {
           transform::Embed3D(node.data.global_pose_2d) *
           transform::Rigid3d::Rotation(
               mutable_trajectory_node.constant_data->gravity_alignment);
+      node_index_.Insert(
+          node.id, transform::Embed3D(node.data.global_pose_2d).translation());
     }
 
     // Extrapolate all point cloud poses that were not included in the
@@ -905,9 +1054,161 @@ void PoseGraph2D::RunOptimization() {
   for (const auto& landmark : optimization_problem_->landmark_data()) {
     data_.landmark_nodes[landmark.first].global_landmark_pose = landmark.second;
   }
+  for (const auto& submap : submap_data) {
+    if (data_.submap_data.at(submap.id).state == SubmapState::kFinished) {
+      finished_submap_index_.Insert(
+          submap.id, transform::Embed3D(submap.data.global_pose).translation());
+    }
+  }
   data_.global_submap_poses_2d = submap_data;
 }
 
+void PoseGraph2D::RunSubmapLevelOptimization(
+    optimization::OptimizationProblem2D* const optimization_problem,
+    const std::vector<Constraint>& constraints,
+    const std::map<int, TrajectoryState>& trajectories_state) {
+  const auto start_time = std::chrono::steady_clock::now();
+  optimization_problem->SolveSubmapPoses(constraints, trajectories_state);
+  const auto submap_level_end_time = std::chrono::steady_clock::now();
+  const double submap_level_seconds =
+      std::chrono::duration<double>(submap_level_end_time - start_time)
+          .count();
+  kSubmapLevelOptimizationDurationMetric->Set(submap_level_seconds);
+  if (!options_.optimization_problem_options()
+           .refine_nodes_after_submap_level_optimization()) {
+    LOG(INFO) << "Submap level optimization took " << submap_level_seconds
+              << " s.";
+    return;
+  }
+  optimization_problem->RefineNodePoses(constraints, trajectories_state);
+  const double node_refinement_seconds =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                    submap_level_end_time)
+          .count();
+  kNodeRefinementDurationMetric->Set(node_refinement_seconds);
+  LOG(INFO) << "Submap level optimization took " << submap_level_seconds
+            << " s, node refinement took " << node_refinement_seconds << " s.";
+}
+
+void PoseGraph2D::RunGlobalSlamOptimizationCallback() {
+  if (!global_slam_optimization_callback_) {
+    return;
+  }
+  std::map<int, NodeId> trajectory_id_to_last_optimized_node_id;
+  std::map<int, SubmapId> trajectory_id_to_last_optimized_submap_id;
+  {
+    absl::MutexLock locker(&mutex_);
+    const auto& submap_data = optimization_problem_->submap_data();
+    const auto& node_data = optimization_problem_->node_data();
+    for (const int trajectory_id : node_data.trajectory_ids()) {
+      if (node_data.SizeOfTrajectoryOrZero(trajectory_id) == 0 ||
+          submap_data.SizeOfTrajectoryOrZero(trajectory_id) == 0) {
+        continue;
+      }
+      trajectory_id_to_last_optimized_node_id.emplace(
+          trajectory_id,
+          std::prev(node_data.EndOfTrajectory(trajectory_id))->id);
+      trajectory_id_to_last_optimized_submap_id.emplace(
+          trajectory_id,
+          std::prev(submap_data.EndOfTrajectory(trajectory_id))->id);
+    }
+  }
+  global_slam_optimization_callback_(
+      trajectory_id_to_last_optimized_submap_id,
+      trajectory_id_to_last_optimized_node_id);
+}
+
+void PoseGraph2D::StartBackgroundOptimization() {
+  background_optimization_running_ = true;
+  background_optimization_requested_ = false;
+  ++num_background_optimization_tasks_;
+  // The copies are solved without holding 'mutex_', while the work queue keeps
+  // changing the originals.
+  auto background_optimization = std::make_shared<BackgroundOptimization>();
+  background_optimization->optimization_problem =
+      optimization_problem_->CopyData();
+  background_optimization->constraints = data_.constraints;
+  background_optimization->trajectories_state = GetTrajectoryStatesUnderLock();
+  background_optimization->landmark_nodes = data_.landmark_nodes;
+  auto task = absl::make_unique<common::Task>();
+  task->SetWorkItem([this, background_optimization]() {
+    RunBackgroundOptimization(background_optimization.get());
+  });
+  thread_pool_->Schedule(std::move(task));
+}
+
+void PoseGraph2D::RunBackgroundOptimization(
+    BackgroundOptimization* const background_optimization) {
+  optimization::OptimizationProblem2D* const optimization_problem =
+      background_optimization->optimization_problem.get();
+  const auto& submap_data = optimization_problem->submap_data();
+  // Nodes and submaps added while solving are moved like the last submap of
+  // their trajectory.
+  std::map<int, transform::Rigid2d> last_submap_poses;
+  for (const int trajectory_id : submap_data.trajectory_ids()) {
+    if (submap_data.SizeOfTrajectoryOrZero(trajectory_id) != 0) {
+      last_submap_poses.emplace(
+          trajectory_id,
+          std::prev(submap_data.EndOfTrajectory(trajectory_id))
+              ->data.global_pose);
+    }
+  }
+  const auto start_time = std::chrono::steady_clock::now();
+  SolveOptimizationProblem(optimization_problem,
+                           background_optimization->constraints,
+                           background_optimization->trajectories_state,
+                           background_optimization->landmark_nodes);
+  LOG(INFO) << "Background optimization took "
+            << std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                             start_time)
+                   .count()
+            << " s.";
+  std::map<int, transform::Rigid2d> corrections;
+  for (const auto& last_submap_pose : last_submap_poses) {
+    corrections.emplace(
+        last_submap_pose.first,
+        std::prev(submap_data.EndOfTrajectory(last_submap_pose.first))
+                ->data.global_pose *
+            last_submap_pose.second.inverse());
+  }
+
+  {
+    absl::MutexLock locker(&mutex_);
+    optimization_problem_->MergeSolution(*optimization_problem, corrections);
+    UpdateGlobalPoses();
+    PublishSnapshot();
+  }
+  // Runs while the optimization still counts as running, so that it cannot
+  // overlap with the callback of another optimization.
+  RunGlobalSlamOptimizationCallback();
+
+  bool resume_work_queue = false;
+  {
+    absl::MutexLock locker(&mutex_);
+    background_optimization_running_ = false;
+    if (work_queue_waiting_for_optimization_) {
+      work_queue_waiting_for_optimization_ = false;
+      background_optimization_requested_ = false;
+      resume_work_queue = true;
+    } else if (background_optimization_requested_) {
+      if (final_optimization_requested_) {
+        // The requested final optimization covers this request.
+        background_optimization_requested_ = false;
+      } else {
+        StartBackgroundOptimization();
+      }
+    }
+  }
+  if (resume_work_queue) {
+    // Continues where 'HandleWorkQueue()' stopped, i.e. runs the final
+    // optimization and then processes the work queue.
+    HandleWorkQueue({});
+  }
+  // Must be the last access to 'this', which may be destroyed right after.
+  absl::MutexLock locker(&mutex_);
+  --num_background_optimization_tasks_;
+}
+
 bool PoseGraph2D::CanAddWorkItemModifying(int trajectory_id) {
   auto it = data_.trajectories_state.find(trajectory_id);
   if (it == data_.trajectories_state.end()) {
@@ -943,8 +1244,13 @@ MapById<NodeId, TrajectoryNode> PoseGraph2D::GetTrajectoryNodes() const {
 
 MapById<NodeId, TrajectoryNodePose> PoseGraph2D::GetTrajectoryNodePoses()
     const {
-  MapById<NodeId, TrajectoryNodePose> node_poses;
   absl::MutexLock locker(&mutex_);
+  return GetTrajectoryNodePosesUnderLock();
+}
+
+MapById<NodeId, TrajectoryNodePose>
+PoseGraph2D::GetTrajectoryNodePosesUnderLock() const {
+  MapById<NodeId, TrajectoryNodePose> node_poses;
   for (const auto& node_id_data : data_.trajectory_nodes) {
     absl::optional<TrajectoryNodePose::ConstantPoseData> constant_pose_data;
     if (node_id_data.data.constant_data != nullptr) {
@@ -961,8 +1267,13 @@ MapById<NodeId, TrajectoryNodePose> PoseGraph2D::GetTrajectoryNodePoses()
 
 std::map<int, PoseGraphInterface::TrajectoryState>
 PoseGraph2D::GetTrajectoryStates() const {
-  std::map<int, PoseGraphInterface::TrajectoryState> trajectories_state;
   absl::MutexLock locker(&mutex_);
+  return GetTrajectoryStatesUnderLock();
+}
+
+std::map<int, PoseGraphInterface::TrajectoryState>
+PoseGraph2D::GetTrajectoryStatesUnderLock() const {
+  std::map<int, PoseGraphInterface::TrajectoryState> trajectories_state;
   for (const auto& it : data_.trajectories_state) {
     trajectories_state[it.first] = it.second.state;
   }
@@ -971,8 +1282,13 @@ PoseGraph2D::GetTrajectoryStates() const {
 
 std::map<std::string, transform::Rigid3d> PoseGraph2D::GetLandmarkPoses()
     const {
-  std::map<std::string, transform::Rigid3d> landmark_poses;
   absl::MutexLock locker(&mutex_);
+  return GetLandmarkPosesUnderLock();
+}
+
+std::map<std::string, transform::Rigid3d>
+PoseGraph2D::GetLandmarkPosesUnderLock() const {
+  std::map<std::string, transform::Rigid3d> landmark_poses;
   for (const auto& landmark : data_.landmark_nodes) {
     // Landmark without value has not been optimized yet.
     if (!landmark.second.global_landmark_pose.has_value()) continue;
@@ -1022,8 +1338,13 @@ PoseGraph2D::GetFixedFramePoseData() const {
 }
 
 std::vector<PoseGraphInterface::Constraint> PoseGraph2D::constraints() const {
-  std::vector<PoseGraphInterface::Constraint> result;
   absl::MutexLock locker(&mutex_);
+  return GetConstraintsUnderLock();
+}
+
+std::vector<PoseGraphInterface::Constraint>
+PoseGraph2D::GetConstraintsUnderLock() const {
+  std::vector<PoseGraphInterface::Constraint> result;
   for (const Constraint& constraint : data_.constraints) {
     result.push_back(Constraint{
         constraint.submap_id, constraint.node_id,
@@ -1095,6 +1416,11 @@ PoseGraph2D::GetAllSubmapData() const {
 MapById<SubmapId, PoseGraphInterface::SubmapPose>
 PoseGraph2D::GetAllSubmapPoses() const {
   absl::MutexLock locker(&mutex_);
+  return GetAllSubmapPosesUnderLock();
+}
+
+MapById<SubmapId, PoseGraphInterface::SubmapPose>
+PoseGraph2D::GetAllSubmapPosesUnderLock() const {
   MapById<SubmapId, SubmapPose> submap_poses;
   for (const auto& submap_id_data : data_.submap_data) {
     auto submap_data = GetSubmapDataUnderLock(submap_id_data.id);
@@ -1281,6 +1607,7 @@ void PoseGraph2D::TrimmingHandle::TrimSubmap(const SubmapId& submap_id) {
   parent_->data_.submap_data.Trim(submap_id);
   parent_->constraint_builder_.DeleteScanMatcher(submap_id);
   parent_->optimization_problem_->TrimSubmap(submap_id);
+  parent_->finished_submap_index_.Remove(submap_id);
 
   // We have one submap less, update the gauge metrics.
   kDeletedSubmapsMetric->Increment();
@@ -1295,6 +1622,7 @@ void PoseGraph2D::TrimmingHandle::TrimSubmap(const SubmapId& submap_id) {
   for (const NodeId& node_id : nodes_to_remove) {
     parent_->data_.trajectory_nodes.Trim(node_id);
     parent_->optimization_problem_->TrimTrajectoryNode(node_id);
+    parent_->node_index_.Remove(node_id);
   }
 }
 
@@ -1308,6 +1636,29 @@ PoseGraph2D::GetSubmapDataUnderLock() const {
   return submaps;
 }
 
+std::shared_ptr<const PoseGraphInterface::Snapshot>
+PoseGraph2D::GetSnapshot() const {
+  absl::MutexLock locker(&snapshot_mutex_);
+  return snapshot_;
+}
+
+void PoseGraph2D::PublishSnapshot() {
+  auto snapshot = std::make_shared<Snapshot>();
+  snapshot->trajectory_node_poses = GetTrajectoryNodePosesUnderLock();
+  snapshot->submap_data = GetSubmapDataUnderLock();
+  snapshot->submap_poses = GetAllSubmapPosesUnderLock();
+  snapshot->constraints = GetConstraintsUnderLock();
+  snapshot->landmark_poses = GetLandmarkPosesUnderLock();
+  snapshot->trajectory_states = GetTrajectoryStatesUnderLock();
+  std::shared_ptr<const Snapshot> previous_snapshot = std::move(snapshot);
+  {
+    absl::MutexLock locker(&snapshot_mutex_);
+    std::swap(snapshot_, previous_snapshot);
+  }
+  // Readers still holding the previous snapshot keep it alive, otherwise it
+  // is freed here without blocking 'GetSnapshot()'.
+}
+
 void PoseGraph2D::SetGlobalSlamOptimizationCallback(
     PoseGraphInterface::GlobalSlamOptimizationCallback callback) {
   global_slam_optimization_callback_ = callback;
@@ -1322,6 +1673,13 @@ void PoseGraph2D::RegisterMetrics(metrics::FamilyFactory* family_factory) {
       family_factory->NewGaugeFamily("mapping_2d_pose_graph_work_queue_size",
                                      "Number of items in the work queue");
   kWorkQueueSizeMetric = queue_size->Add({});
+  auto* queue_latency = family_factory->NewHistogramFamily(
+      "mapping_2d_pose_graph_work_queue_latency",
+      "Time in seconds work items waited in the work queue",
+      metrics::Histogram::ScaledPowersOf(2, 1e-4, 100.));
+  kSensorDataWorkQueueLatencyMetric =
+      queue_latency->Add({{"lane", "sensor_data"}});
+  kNodesWorkQueueLatencyMetric = queue_latency->Add({{"lane", "nodes"}});
   auto* constraints = family_factory->NewGaugeFamily(
       "mapping_2d_pose_graph_constraints",
       "Current number of constraints in the pose graph");
@@ -1334,6 +1692,13 @@ void PoseGraph2D::RegisterMetrics(metrics::FamilyFactory* family_factory) {
   kActiveSubmapsMetric = submaps->Add({{"state", "active"}});
   kFrozenSubmapsMetric = submaps->Add({{"state", "frozen"}});
   kDeletedSubmapsMetric = submaps->Add({{"state", "deleted"}});
+  auto* optimization_duration = family_factory->NewGaugeFamily(
+      "mapping_2d_pose_graph_optimization_duration",
+      "Duration of the last optimization level in seconds");
+  kSubmapLevelOptimizationDurationMetric =
+      optimization_duration->Add({{"level", "submaps"}});
+  kNodeRefinementDurationMetric =
+      optimization_duration->Add({{"level", "nodes"}});
 }
 
 }  // namespace mapping
@@ -16,11 +16,15 @@
 
 #include "cartographer/mapping/internal/2d/pose_graph_2d.h"
 
+#include <chrono>
 #include <cmath>
+#include <map>
 #include <memory>
 #include <random>
+#include <thread>
 
 #include "absl/memory/memory.h"
+#include "absl/synchronization/mutex.h"
 #include "cartographer/common/internal/testing/lua_parameter_dictionary_test_helpers.h"
 #include "cartographer/common/thread_pool.h"
 #include "cartographer/common/time.h"
@@ -88,11 +92,18 @@ class PoseGraph2DTest : public ::testing::Test {
             optimize_every_n_nodes = 1000,
             constraint_builder = {
               sampling_ratio = 1.,
+              adaptive_sampling = {
+                use_adaptive_sampling = false,
+                closure_staleness_seconds = 30.,
+                closure_uncertainty_meters = 10.,
+                cpu_budget = 0.,
+              },
               max_constraint_distance = 6.,
               min_score = 0.5,
               global_localization_min_score = 0.6,
               loop_closure_translation_weight = 1.,
               loop_closure_rotation_weight = 1.,
+              share_rotated_scans_in_2d = false,
               log_matches = true,
               fast_correlative_scan_matcher = {
                 linear_search_window = 3.,
@@ -117,6 +128,8 @@ class PoseGraph2DTest : public ::testing::Test {
                 linear_xy_search_window = 4.,
                 linear_z_search_window = 4.,
                 angular_search_window = 0.1,
+                num_precomputation_threads = 1,
+                serialize_precomputation_grids = false,
               },
               ceres_scan_matcher_3d = {
                 occupied_space_weight_0 = 20.,
@@ -148,6 +161,9 @@ class PoseGraph2DTest : public ::testing::Test {
               log_solver_summary = true,
               use_online_imu_extrinsics_in_3d = true,
               fix_z_in_3d = false,
+              use_persistent_problem_in_2d = false,
+              use_submap_level_optimization = false,
+              refine_nodes_after_submap_level_optimization = false,
               ceres_solver_options = {
                 use_nonmonotonic_steps = false,
                 max_num_iterations = 200,
@@ -158,12 +174,15 @@ class PoseGraph2DTest : public ::testing::Test {
             global_sampling_ratio = 0.01,
             log_residual_histograms = true,
             global_constraint_search_after_n_seconds = 10.0,
+            overloaded_work_queue_delay_seconds = 5.0,
+            optimize_in_background = false,
           })text");
-      auto options = CreatePoseGraphOptions(parameter_dictionary.get());
+      pose_graph_options_ =
+          CreatePoseGraphOptions(parameter_dictionary.get());
       pose_graph_ = absl::make_unique<PoseGraph2D>(
-          options,
+          pose_graph_options_,
           absl::make_unique<optimization::OptimizationProblem2D>(
-              options.optimization_problem_options()),
+              pose_graph_options_.optimization_problem_options()),
           &thread_pool_);
     }
 
@@ -210,6 +229,7 @@ class PoseGraph2DTest : public ::testing::Test {
   sensor::PointCloud point_cloud_;
   std::unique_ptr<ActiveSubmaps2D> active_submaps_;
   common::ThreadPool thread_pool_;
+  proto::PoseGraphOptions pose_graph_options_;
   std::unique_ptr<PoseGraph2D> pose_graph_;
   transform::Rigid2d current_pose_;
 };
@@ -237,6 +257,31 @@ TEST_F(PoseGraph2DTest, NoMovement) {
               transform::IsNearly(transform::Rigid3d::Identity(), 1e-2));
 }
 
+TEST_F(PoseGraph2DTest, SnapshotMatchesGetters) {
+  const auto empty_snapshot = pose_graph_->GetSnapshot();
+  ASSERT_NE(empty_snapshot, nullptr);
+  EXPECT_TRUE(empty_snapshot->trajectory_node_poses.empty());
+  for (int i = 0; i != 3; ++i) {
+    MoveRelative(transform::Rigid2d({0., 2.}, 0.));
+  }
+  pose_graph_->RunFinalOptimization();
+  const auto snapshot = pose_graph_->GetSnapshot();
+  const auto node_poses = pose_graph_->GetTrajectoryNodePoses();
+  ASSERT_EQ(snapshot->trajectory_node_poses.size(), node_poses.size());
+  for (const auto& node : node_poses) {
+    EXPECT_THAT(snapshot->trajectory_node_poses.at(node.id).global_pose,
+                transform::IsNearly(node.data.global_pose, 1e-9));
+  }
+  EXPECT_EQ(snapshot->submap_poses.size(),
+            pose_graph_->GetAllSubmapPoses().size());
+  EXPECT_EQ(snapshot->submap_data.size(),
+            pose_graph_->GetAllSubmapData().size());
+  EXPECT_EQ(snapshot->constraints.size(), pose_graph_->constraints().size());
+  EXPECT_EQ(snapshot->trajectory_states, pose_graph_->GetTrajectoryStates());
+  // Snapshots held by readers are never modified.
+  EXPECT_TRUE(empty_snapshot->trajectory_node_poses.empty());
+}
+
 TEST_F(PoseGraph2DTest, NoOverlappingNodes) {
   std::mt19937 rng(0);
   std::uniform_real_distribution<double> distribution(-1., 1.);
@@ -279,6 +324,140 @@ TEST_F(PoseGraph2DTest, ConsecutivelyOverlappingNodes) {
   }
 }
 
+TEST_F(PoseGraph2DTest, OptimizesInBackground) {
+  proto::PoseGraphOptions options = pose_graph_options_;
+  options.set_optimize_in_background(true);
+  options.set_optimize_every_n_nodes(2);
+  pose_graph_ = absl::make_unique<PoseGraph2D>(
+      options,
+      absl::make_unique<optimization::OptimizationProblem2D>(
+          options.optimization_problem_options()),
+      &thread_pool_);
+  std::mt19937 rng(0);
+  std::uniform_real_distribution<double> distribution(-1., 1.);
+  std::vector<transform::Rigid2d> poses;
+  for (int i = 0; i != 10; ++i) {
+    MoveRelative(transform::Rigid2d({0.25 * distribution(rng), 2.}, 0.));
+    poses.emplace_back(current_pose_);
+  }
+  pose_graph_->RunFinalOptimization();
+  const auto nodes = pose_graph_->GetTrajectoryNodes();
+  ASSERT_THAT(ToVectorInt(nodes.trajectory_ids()),
+              ::testing::ContainerEq(std::vector<int>{0}));
+  for (int i = 0; i != 10; ++i) {
+    EXPECT_THAT(
+        poses[i],
+        IsNearly(transform::Project2D(nodes.at(NodeId{0, i}).global_pose),
+                 1e-2))
+        << i;
+  }
+}
+
+TEST_F(PoseGraph2DTest, MergesBackgroundOptimizationsWhileAddingNodes) {
+  proto::PoseGraphOptions options = pose_graph_options_;
+  options.set_optimize_in_background(true);
+  options.set_optimize_every_n_nodes(2);
+  pose_graph_ = absl::make_unique<PoseGraph2D>(
+      options,
+      absl::make_unique<optimization::OptimizationProblem2D>(
+          options.optimization_problem_options()),
+      &thread_pool_);
+  absl::Mutex mutex;
+  std::vector<transform::Rigid2d> poses;
+  int num_optimizations = 0;
+  int num_checked_nodes = 0;
+  // Checks the merged poses right after each background optimization, while
+  // the test keeps adding nodes.
+  PoseGraph2D* const pose_graph = pose_graph_.get();
+  pose_graph_->SetGlobalSlamOptimizationCallback(
+      [&](const std::map<int, SubmapId>&, const std::map<int, NodeId>&) {
+        const auto node_poses = pose_graph->GetTrajectoryNodePoses();
+        absl::MutexLock locker(&mutex);
+        ++num_optimizations;
+        for (const auto& node : node_poses) {
+          if (node.id.node_index >= static_cast<int>(poses.size())) {
+            continue;
+          }
+          EXPECT_THAT(poses[node.id.node_index],
+                      IsNearly(transform::Project2D(node.data.global_pose),
+                               1e-2))
+              << node.id;
+          ++num_checked_nodes;
+        }
+      });
+  std::mt19937 rng(0);
+  std::uniform_real_distribution<double> distribution(-1., 1.);
+  for (int i = 0; i != 10; ++i) {
+    MoveRelative(transform::Rigid2d({0.25 * distribution(rng), 2.}, 0.));
+    absl::MutexLock locker(&mutex);
+    poses.emplace_back(current_pose_);
+  }
+  {
+    absl::MutexLock locker(&mutex);
+    const auto optimized = [&num_optimizations]() {
+      return num_optimizations > 0;
+    };
+    mutex.Await(absl::Condition(&optimized));
+  }
+  // Destroys the pose graph before the callback's captures go away.
+  pose_graph_.reset();
+  absl::MutexLock locker(&mutex);
+  EXPECT_GT(num_checked_nodes, 0);
+}
+
+TEST_F(PoseGraph2DTest, DestroysWhileOptimizingInBackground) {
+  proto::PoseGraphOptions options = pose_graph_options_;
+  options.set_optimize_in_background(true);
+  options.set_optimize_every_n_nodes(1);
+  pose_graph_ = absl::make_unique<PoseGraph2D>(
+      options,
+      absl::make_unique<optimization::OptimizationProblem2D>(
+          options.optimization_problem_options()),
+      &thread_pool_);
+  absl::Mutex mutex;
+  int num_started_callbacks = 0;
+  int num_running_callbacks = 0;
+  pose_graph_->SetGlobalSlamOptimizationCallback(
+      [&](const std::map<int, SubmapId>&, const std::map<int, NodeId>&) {
+        {
+          absl::MutexLock locker(&mutex);
+          ++num_started_callbacks;
+          ++num_running_callbacks;
+        }
+        // Keeps the background optimization task busy while the pose graph
+        // is being destroyed.
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        absl::MutexLock locker(&mutex);
+        --num_running_callbacks;
+      });
+  for (int i = 0; i != 4; ++i) {
+    MoveRelative(transform::Rigid2d({0., 2.}, 0.));
+  }
+  {
+    absl::MutexLock locker(&mutex);
+    const auto started = [&num_started_callbacks]() {
+      return num_started_callbacks > 0;
+    };
+    mutex.Await(absl::Condition(&started));
+  }
+  pose_graph_.reset();
+  absl::MutexLock locker(&mutex);
+  EXPECT_EQ(num_running_callbacks, 0);
+}
+
+TEST_F(PoseGraph2DTest, OptimizingInBackgroundRequiresRebuiltProblem) {
+  proto::PoseGraphOptions options = pose_graph_options_;
+  options.set_optimize_in_background(true);
+  options.mutable_optimization_problem_options()
+      ->set_use_persistent_problem_in_2d(true);
+  EXPECT_DEATH(
+      PoseGraph2D(options,
+                  absl::make_unique<optimization::OptimizationProblem2D>(
+                      options.optimization_problem_options()),
+                  &thread_pool_),
+      "mutually exclusive");
+}
+
 TEST_F(PoseGraph2DTest, OverlappingNodes) {
   std::mt19937 rng(0);
   std::uniform_real_distribution<double> distribution(-1., 1.);
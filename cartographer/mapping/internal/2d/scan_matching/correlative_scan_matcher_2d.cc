@@ -108,20 +108,27 @@ std::vector<sensor::PointCloud> GenerateRotatedScans(
   return rotated_scans;
 }
 
+DiscreteScan2D DiscretizeScan(const MapLimits& map_limits,
+                              const sensor::PointCloud& scan,
+                              const Eigen::Translation2f& initial_translation) {
+  DiscreteScan2D discrete_scan;
+  discrete_scan.reserve(scan.size());
+  for (const sensor::RangefinderPoint& point : scan) {
+    const Eigen::Vector2f translated_point =
+        Eigen::Affine2f(initial_translation) * point.position.head<2>();
+    discrete_scan.push_back(map_limits.GetCellIndex(translated_point));
+  }
+  return discrete_scan;
+}
+
 std::vector<DiscreteScan2D> DiscretizeScans(
     const MapLimits& map_limits, const std::vector<sensor::PointCloud>& scans,
     const Eigen::Translation2f& initial_translation) {
   std::vector<DiscreteScan2D> discrete_scans;
   discrete_scans.reserve(scans.size());
   for (const sensor::PointCloud& scan : scans) {
-    discrete_scans.emplace_back();
-    discrete_scans.back().reserve(scan.size());
-    for (const sensor::RangefinderPoint& point : scan) {
-      const Eigen::Vector2f translated_point =
-          Eigen::Affine2f(initial_translation) * point.position.head<2>();
-      discrete_scans.back().push_back(
-          map_limits.GetCellIndex(translated_point));
-    }
+    discrete_scans.push_back(
+        DiscretizeScan(map_limits, scan, initial_translation));
   }
   return discrete_scans;
 }
@@ -64,6 +64,11 @@ std::vector<sensor::PointCloud> GenerateRotatedScans(
     const sensor::PointCloud& point_cloud,
     const SearchParameters& search_parameters);
 
+// Translates and discretizes a rotated scan into a vector of integer indices.
+DiscreteScan2D DiscretizeScan(const MapLimits& map_limits,
+                              const sensor::PointCloud& scan,
+                              const Eigen::Translation2f& initial_translation);
+
 // Translates and discretizes the rotated scans into a vector of integer
 // indices.
 std::vector<DiscreteScan2D> DiscretizeScans(
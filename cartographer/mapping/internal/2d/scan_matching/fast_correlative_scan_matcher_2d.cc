@@ -73,6 +73,17 @@ class SlidingWindowMaximum {
   std::deque<float> non_ascending_maxima_;
 };
 
+// Returns the number of angles on the full circle, such that the angular step
+// is at most the one SearchParameters would use for 'point_cloud'.
+int ComputeNumAngles(const sensor::PointCloud& point_cloud,
+                     const double resolution) {
+  const double max_angular_step_size =
+      SearchParameters(0. /* linear_search_window */,
+                       0. /* angular_search_window */, point_cloud, resolution)
+          .angular_perturbation_step_size;
+  return std::ceil(2. * M_PI / max_angular_step_size);
+}
+
 }  // namespace
 
 proto::FastCorrelativeScanMatcherOptions2D
@@ -185,6 +196,43 @@ PrecomputationGridStack2D::PrecomputationGridStack2D(
   }
 }
 
+RotatedScans2D::RotatedScans2D(const sensor::PointCloud& point_cloud,
+                               const double resolution)
+    : point_cloud_(point_cloud),
+      resolution_(resolution),
+      num_angles_(ComputeNumAngles(point_cloud, resolution)),
+      angular_step_size_(2. * M_PI / num_angles_),
+      rotated_scans_(num_angles_) {}
+
+int RotatedScans2D::GetClosestIndex(const double angle) const {
+  return common::RoundToInt(angle / angular_step_size_);
+}
+
+const sensor::PointCloud& RotatedScans2D::Get(int index) const {
+  index %= num_angles_;
+  if (index < 0) {
+    index += num_angles_;
+  }
+  {
+    absl::MutexLock locker(&mutex_);
+    if (rotated_scans_[index] != nullptr) {
+      return *rotated_scans_[index];
+    }
+  }
+  // Rotate without holding the lock, so that matches of this point cloud can
+  // rotate it in parallel. Scans are never replaced once they are set.
+  auto rotated_scan =
+      absl::make_unique<const sensor::PointCloud>(sensor::TransformPointCloud(
+          point_cloud_,
+          transform::Rigid3f::Rotation(Eigen::AngleAxisf(
+              index * angular_step_size_, Eigen::Vector3f::UnitZ()))));
+  absl::MutexLock locker(&mutex_);
+  if (rotated_scans_[index] == nullptr) {
+    rotated_scans_[index] = std::move(rotated_scan);
+  }
+  return *rotated_scans_[index];
+}
+
 FastCorrelativeScanMatcher2D::FastCorrelativeScanMatcher2D(
     const Grid2D& grid,
     const proto::FastCorrelativeScanMatcherOptions2D& options)
@@ -216,12 +264,27 @@ bool FastCorrelativeScanMatcher2D::MatchFullSubmap(
       1e6 * limits_.resolution(),  // Linear search window, 1e6 cells/direction.
       M_PI,  // Angular search window, 180 degrees in both directions.
       point_cloud, limits_.resolution());
-  const transform::Rigid2d center = transform::Rigid2d::Translation(
-      limits_.max() - 0.5 * limits_.resolution() *
-                          Eigen::Vector2d(limits_.cell_limits().num_y_cells,
-                                          limits_.cell_limits().num_x_cells));
-  return MatchWithSearchParameters(search_parameters, center, point_cloud,
-                                   min_score, score, pose_estimate);
+  return MatchWithSearchParameters(search_parameters, GetFullSubmapCenter(),
+                                   point_cloud, min_score, score,
+                                   pose_estimate);
+}
+
+bool FastCorrelativeScanMatcher2D::Match(
+    const transform::Rigid2d& initial_pose_estimate,
+    const RotatedScans2D& rotated_scans, const float min_score, float* score,
+    transform::Rigid2d* pose_estimate) const {
+  return MatchRotatedScans(options_.linear_search_window(),
+                           options_.angular_search_window(),
+                           initial_pose_estimate, rotated_scans, min_score,
+                           score, pose_estimate);
+}
+
+bool FastCorrelativeScanMatcher2D::MatchFullSubmap(
+    const RotatedScans2D& rotated_scans, const float min_score, float* score,
+    transform::Rigid2d* pose_estimate) const {
+  return MatchRotatedScans(1e6 * limits_.resolution(), M_PI,
+                           GetFullSubmapCenter(), rotated_scans, min_score,
+                           score, pose_estimate);
 }
 
 bool FastCorrelativeScanMatcher2D::MatchWithSearchParameters(
@@ -229,9 +292,6 @@ bool FastCorrelativeScanMatcher2D::MatchWithSearchParameters(
     const transform::Rigid2d& initial_pose_estimate,
     const sensor::PointCloud& point_cloud, float min_score, float* score,
     transform::Rigid2d* pose_estimate) const {
-  CHECK(score != nullptr);
-  CHECK(pose_estimate != nullptr);
-
   const Eigen::Rotation2Dd initial_rotation = initial_pose_estimate.rotation();
   const sensor::PointCloud rotated_point_cloud = sensor::TransformPointCloud(
       point_cloud,
@@ -243,6 +303,47 @@ bool FastCorrelativeScanMatcher2D::MatchWithSearchParameters(
       limits_, rotated_scans,
       Eigen::Translation2f(initial_pose_estimate.translation().x(),
                            initial_pose_estimate.translation().y()));
+  return MatchDiscreteScans(search_parameters, initial_pose_estimate,
+                            discrete_scans, min_score, score, pose_estimate);
+}
+
+bool FastCorrelativeScanMatcher2D::MatchRotatedScans(
+    const double linear_search_window, const double angular_search_window,
+    const transform::Rigid2d& initial_pose_estimate,
+    const RotatedScans2D& rotated_scans, const float min_score, float* score,
+    transform::Rigid2d* pose_estimate) const {
+  CHECK_EQ(rotated_scans.resolution(), limits_.resolution());
+  const SearchParameters search_parameters(
+      std::ceil(linear_search_window / limits_.resolution()),
+      std::ceil(angular_search_window / rotated_scans.angular_step_size()),
+      rotated_scans.angular_step_size(), limits_.resolution());
+  const int center_index =
+      rotated_scans.GetClosestIndex(initial_pose_estimate.normalized_angle());
+  const Eigen::Translation2f initial_translation(
+      initial_pose_estimate.translation().x(),
+      initial_pose_estimate.translation().y());
+  std::vector<DiscreteScan2D> discrete_scans;
+  discrete_scans.reserve(search_parameters.num_scans);
+  for (int i = -search_parameters.num_angular_perturbations;
+       i <= search_parameters.num_angular_perturbations; ++i) {
+    discrete_scans.push_back(DiscretizeScan(
+        limits_, rotated_scans.Get(center_index + i), initial_translation));
+  }
+  return MatchDiscreteScans(
+      search_parameters,
+      transform::Rigid2d(initial_pose_estimate.translation(),
+                         center_index * rotated_scans.angular_step_size()),
+      discrete_scans, min_score, score, pose_estimate);
+}
+
+bool FastCorrelativeScanMatcher2D::MatchDiscreteScans(
+    SearchParameters search_parameters,
+    const transform::Rigid2d& initial_pose_estimate,
+    const std::vector<DiscreteScan2D>& discrete_scans, const float min_score,
+    float* score, transform::Rigid2d* pose_estimate) const {
+  CHECK(score != nullptr);
+  CHECK(pose_estimate != nullptr);
+
   search_parameters.ShrinkToFit(discrete_scans, limits_.cell_limits());
 
   const std::vector<Candidate2D> lowest_resolution_candidates =
@@ -255,12 +356,20 @@ bool FastCorrelativeScanMatcher2D::MatchWithSearchParameters(
     *pose_estimate = transform::Rigid2d(
         {initial_pose_estimate.translation().x() + best_candidate.x,
          initial_pose_estimate.translation().y() + best_candidate.y},
-        initial_rotation * Eigen::Rotation2Dd(best_candidate.orientation));
+        initial_pose_estimate.rotation() *
+            Eigen::Rotation2Dd(best_candidate.orientation));
     return true;
   }
   return false;
 }
 
+transform::Rigid2d FastCorrelativeScanMatcher2D::GetFullSubmapCenter() const {
+  return transform::Rigid2d::Translation(
+      limits_.max() - 0.5 * limits_.resolution() *
+                          Eigen::Vector2d(limits_.cell_limits().num_y_cells,
+                                          limits_.cell_limits().num_x_cells));
+}
+
 std::vector<Candidate2D>
 FastCorrelativeScanMatcher2D::ComputeLowestResolutionCandidates(
     const std::vector<DiscreteScan2D>& discrete_scans,
@@ -29,6 +29,7 @@
 #include <vector>
 
 #include "Eigen/Core"
+#include "absl/synchronization/mutex.h"
 #include "cartographer/common/port.h"
 #include "cartographer/mapping/2d/grid_2d.h"
 #include "cartographer/mapping/internal/2d/scan_matching/correlative_scan_matcher_2d.h"
@@ -108,6 +109,41 @@ class PrecomputationGridStack2D {
   std::vector<PrecomputationGrid2D> precomputation_grids_;
 };
 
+// Rotations of a point cloud on a fixed grid of angles covering the full
+// circle, which are generated when first needed. Matches of the point cloud
+// against several grids of the same resolution can share them instead of
+// rotating the point cloud again for each match. The angular step is at most
+// the one chosen by SearchParameters for the point cloud.
+//
+// This class is thread-safe.
+class RotatedScans2D {
+ public:
+  // 'point_cloud' must outlive this object.
+  RotatedScans2D(const sensor::PointCloud& point_cloud, double resolution);
+
+  RotatedScans2D(const RotatedScans2D&) = delete;
+  RotatedScans2D& operator=(const RotatedScans2D&) = delete;
+
+  double resolution() const { return resolution_; }
+  double angular_step_size() const { return angular_step_size_; }
+
+  // Returns the index of the angle on the grid which is closest to 'angle'.
+  int GetClosestIndex(double angle) const;
+
+  // Returns the point cloud rotated by 'index' angular steps. Indices outside
+  // of one full turn wrap around.
+  const sensor::PointCloud& Get(int index) const LOCKS_EXCLUDED(mutex_);
+
+ private:
+  const sensor::PointCloud& point_cloud_;
+  const double resolution_;
+  const int num_angles_;
+  const double angular_step_size_;
+  mutable absl::Mutex mutex_;
+  mutable std::vector<std::unique_ptr<const sensor::PointCloud>> rotated_scans_
+      GUARDED_BY(mutex_);
+};
+
 // An implementation of "Real-Time Correlative Scan Matching" by Olson.
 class FastCorrelativeScanMatcher2D {
  public:
@@ -135,6 +171,19 @@ class FastCorrelativeScanMatcher2D {
   bool MatchFullSubmap(const sensor::PointCloud& point_cloud, float min_score,
                        float* score, transform::Rigid2d* pose_estimate) const;
 
+  // Same as Match(), but uses the shared 'rotated_scans' of the point cloud.
+  // The orientation of the 'initial_pose_estimate' is moved to the closest
+  // angle of 'rotated_scans', which has to be of the same resolution as the
+  // 'grid'.
+  bool Match(const transform::Rigid2d& initial_pose_estimate,
+             const RotatedScans2D& rotated_scans, float min_score,
+             float* score, transform::Rigid2d* pose_estimate) const;
+
+  // Same as MatchFullSubmap(), but uses the shared 'rotated_scans' of the
+  // point cloud.
+  bool MatchFullSubmap(const RotatedScans2D& rotated_scans, float min_score,
+                       float* score, transform::Rigid2d* pose_estimate) const;
+
  private:
   // The actual implementation of the scan matcher, called by Match() and
   // MatchFullSubmap() with appropriate 'initial_pose_estimate' and
@@ -144,6 +193,27 @@ class FastCorrelativeScanMatcher2D {
       const transform::Rigid2d& initial_pose_estimate,
       const sensor::PointCloud& point_cloud, float min_score, float* score,
       transform::Rigid2d* pose_estimate) const;
+
+  // Same as above, but takes the rotations of the point cloud from
+  // 'rotated_scans'.
+  bool MatchRotatedScans(double linear_search_window,
+                         double angular_search_window,
+                         const transform::Rigid2d& initial_pose_estimate,
+                         const RotatedScans2D& rotated_scans, float min_score,
+                         float* score, transform::Rigid2d* pose_estimate) const;
+
+  // Searches the 'discrete_scans', which are rotated and translated by the
+  // 'initial_pose_estimate', for the best pose.
+  bool MatchDiscreteScans(SearchParameters search_parameters,
+                          const transform::Rigid2d& initial_pose_estimate,
+                          const std::vector<DiscreteScan2D>& discrete_scans,
+                          float min_score, float* score,
+                          transform::Rigid2d* pose_estimate) const;
+
+  // Returns the pose in the center of the 'grid' from which the full submap
+  // is searched.
+  transform::Rigid2d GetFullSubmapCenter() const;
+
   std::vector<Candidate2D> ComputeLowestResolutionCandidates(
       const std::vector<DiscreteScan2D>& discrete_scans,
       const SearchParameters& search_parameters) const;
@@ -245,6 +245,69 @@ TEST(FastCorrelativeScanMatcherTest, FullSubmapMatching) {
   }
 }
 
+TEST(FastCorrelativeScanMatcherTest, SharedRotatedScans) {
+  std::mt19937 prng(42);
+  std::uniform_real_distribution<float> distribution(-1.f, 1.f);
+  ProbabilityGridRangeDataInserter2D range_data_inserter(
+      CreateRangeDataInserterTestOptions2D());
+  constexpr float kMinScore = 0.1f;
+  const auto options = CreateFastCorrelativeScanMatcherTestOptions2D(6);
+
+  sensor::PointCloud point_cloud;
+  point_cloud.push_back({Eigen::Vector3f{-2.5f, 0.5f, 0.f}});
+  point_cloud.push_back({Eigen::Vector3f{-2.f, 0.5f, 0.f}});
+  point_cloud.push_back({Eigen::Vector3f{0.f, -0.5f, 0.f}});
+  point_cloud.push_back({Eigen::Vector3f{0.5f, -1.6f, 0.f}});
+  point_cloud.push_back({Eigen::Vector3f{2.5f, 0.5f, 0.f}});
+  point_cloud.push_back({Eigen::Vector3f{2.5f, 1.7f, 0.f}});
+  const RotatedScans2D rotated_scans(point_cloud, 0.05);
+
+  // The same rotated scans are matched against several grids.
+  for (int i = 0; i != 20; ++i) {
+    const transform::Rigid2f expected_pose(
+        {2. * distribution(prng), 2. * distribution(prng)},
+        0.5 * distribution(prng));
+    // The initial orientation is not on the grid of angles.
+    const transform::Rigid2d initial_pose_estimate(
+        Eigen::Vector2d::Zero(), 0.3 * distribution(prng));
+
+    ValueConversionTables conversion_tables;
+    ProbabilityGrid probability_grid(
+        MapLimits(0.05, Eigen::Vector2d(5., 5.), CellLimits(200, 200)),
+        &conversion_tables);
+    range_data_inserter.Insert(
+        sensor::RangeData{
+            Eigen::Vector3f(expected_pose.translation().x(),
+                            expected_pose.translation().y(), 0.f),
+            sensor::TransformPointCloud(
+                point_cloud, transform::Embed3D(expected_pose.cast<float>())),
+            {}},
+        &probability_grid);
+    probability_grid.FinishUpdate();
+
+    FastCorrelativeScanMatcher2D fast_correlative_scan_matcher(probability_grid,
+                                                               options);
+    transform::Rigid2d pose_estimate;
+    float score;
+    EXPECT_TRUE(fast_correlative_scan_matcher.Match(
+        initial_pose_estimate, rotated_scans, kMinScore, &score,
+        &pose_estimate));
+    EXPECT_LT(kMinScore, score);
+    EXPECT_THAT(expected_pose,
+                transform::IsNearly(pose_estimate.cast<float>(), 0.03f))
+        << "Actual: " << transform::ToProto(pose_estimate).DebugString()
+        << "\nExpected: " << transform::ToProto(expected_pose).DebugString();
+
+    EXPECT_TRUE(fast_correlative_scan_matcher.MatchFullSubmap(
+        rotated_scans, kMinScore, &score, &pose_estimate));
+    EXPECT_LT(kMinScore, score);
+    EXPECT_THAT(expected_pose,
+                transform::IsNearly(pose_estimate.cast<float>(), 0.03f))
+        << "Actual: " << transform::ToProto(pose_estimate).DebugString()
+        << "\nExpected: " << transform::ToProto(expected_pose).DebugString();
+  }
+}
+
 }  // namespace
 }  // namespace scan_matching
 }  // namespace mapping
@@ -103,19 +103,14 @@ struct ExtrapolatePoseResult {
 };
 
 // Returns pose and linear velocity at 'time' which is equal to
-// 'prev_from_tracking' extrapolated using IMU data.
-template <typename T, typename RangeType, typename IteratorType>
+// 'prev_from_tracking' extrapolated using the result of integrating IMU data
+// from 'prev_time' to 'time'.
+template <typename T>
 ExtrapolatePoseResult<T> ExtrapolatePoseWithImu(
     const transform::Rigid3<T>& prev_from_tracking,
     const Eigen::Matrix<T, 3, 1>& prev_velocity_in_tracking,
     const common::Time prev_time, const Eigen::Matrix<T, 3, 1>& gravity,
-    const common::Time time, const RangeType& imu_data,
-    IteratorType* const imu_it) {
-  const IntegrateImuResult<T> result =
-      IntegrateImu(imu_data, Eigen::Transform<T, 3, Eigen::Affine>::Identity(),
-                   Eigen::Transform<T, 3, Eigen::Affine>::Identity(), prev_time,
-                   time, imu_it);
-
+    const common::Time time, const IntegrateImuResult<T>& result) {
   const T delta_t = static_cast<T>(common::ToSeconds(time - prev_time));
   const Eigen::Matrix<T, 3, 1> translation =
       prev_from_tracking.translation() +
@@ -133,15 +128,30 @@ ExtrapolatePoseResult<T> ExtrapolatePoseWithImu(
                                   velocity};
 }
 
-// Same as above but given the last two poses.
+// Same as above but integrating 'imu_data'.
 template <typename T, typename RangeType, typename IteratorType>
+ExtrapolatePoseResult<T> ExtrapolatePoseWithImu(
+    const transform::Rigid3<T>& prev_from_tracking,
+    const Eigen::Matrix<T, 3, 1>& prev_velocity_in_tracking,
+    const common::Time prev_time, const Eigen::Matrix<T, 3, 1>& gravity,
+    const common::Time time, const RangeType& imu_data,
+    IteratorType* const imu_it) {
+  return ExtrapolatePoseWithImu(
+      prev_from_tracking, prev_velocity_in_tracking, prev_time, gravity, time,
+      IntegrateImu(imu_data, Eigen::Transform<T, 3, Eigen::Affine>::Identity(),
+                   Eigen::Transform<T, 3, Eigen::Affine>::Identity(),
+                   prev_time, time, imu_it));
+}
+
+// Same as above but given the last two poses and the result of integrating
+// IMU data from 'prev_time' to 'time'.
+template <typename T>
 ExtrapolatePoseResult<T> ExtrapolatePoseWithImu(
     const transform::Rigid3<T>& prev_from_tracking,
     const common::Time prev_time,
     const transform::Rigid3<T>& prev_prev_from_tracking,
     const common::Time prev_prev_time, const Eigen::Matrix<T, 3, 1>& gravity,
-    const common::Time time, const RangeType& imu_data,
-    IteratorType* const imu_it) {
+    const common::Time time, const IntegrateImuResult<T>& result) {
   // TODO(danielsievers): Really we should integrate velocities starting from
   // the midpoint in between two poses, since this is how we fit them to poses
   // in the optimization.
@@ -154,7 +164,24 @@ ExtrapolatePoseResult<T> ExtrapolatePoseWithImu(
       prev_delta_t;
 
   return ExtrapolatePoseWithImu(prev_from_tracking, prev_velocity_in_tracking,
-                                prev_time, gravity, time, imu_data, imu_it);
+                                prev_time, gravity, time, result);
+}
+
+// Same as above but integrating 'imu_data'.
+template <typename T, typename RangeType, typename IteratorType>
+ExtrapolatePoseResult<T> ExtrapolatePoseWithImu(
+    const transform::Rigid3<T>& prev_from_tracking,
+    const common::Time prev_time,
+    const transform::Rigid3<T>& prev_prev_from_tracking,
+    const common::Time prev_prev_time, const Eigen::Matrix<T, 3, 1>& gravity,
+    const common::Time time, const RangeType& imu_data,
+    IteratorType* const imu_it) {
+  return ExtrapolatePoseWithImu(
+      prev_from_tracking, prev_time, prev_prev_from_tracking, prev_prev_time,
+      gravity, time,
+      IntegrateImu(imu_data, Eigen::Transform<T, 3, Eigen::Affine>::Identity(),
+                   Eigen::Transform<T, 3, Eigen::Affine>::Identity(),
+                   prev_time, time, imu_it));
 }
 
 }  // namespace mapping
@@ -0,0 +1,109 @@
+/*
+ * Copyright 2018 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/internal/3d/imu_preintegration.h"
+
+#include <algorithm>
+
+#include "cartographer/transform/transform.h"
+#include "glog/logging.h"
+
+namespace cartographer {
+namespace mapping {
+
+void ImuPreintegration::Add(const sensor::ImuData& imu_data) {
+  if (states_.empty()) {
+    states_.push_back(State{imu_data, Eigen::Quaterniond::Identity(),
+                            Eigen::Vector3d::Zero(), Eigen::Vector3d::Zero()});
+    return;
+  }
+  CHECK_GE(imu_data.time, states_.back().imu_data.time);
+  State state = Advance(states_.back(), imu_data.time);
+  state.imu_data = imu_data;
+  states_.push_back(state);
+}
+
+void ImuPreintegration::TrimBefore(const common::Time time) {
+  if (states_.size() < 2 || states_[1].imu_data.time > time) {
+    return;
+  }
+  while (states_.size() > 1 && states_[1].imu_data.time <= time) {
+    states_.pop_front();
+  }
+  // Integrate from the new oldest sample on, so that the cumulative values
+  // stay small.
+  const State origin = states_.front();
+  const Eigen::Quaterniond inverse_rotation = origin.rotation.conjugate();
+  for (State& state : states_) {
+    const double delta_t =
+        common::ToSeconds(state.imu_data.time - origin.imu_data.time);
+    state.translation =
+        inverse_rotation * (state.translation - origin.translation -
+                            delta_t * origin.velocity);
+    state.velocity = inverse_rotation * (state.velocity - origin.velocity);
+    state.rotation = (inverse_rotation * state.rotation).normalized();
+  }
+}
+
+common::Time ImuPreintegration::start_time() const {
+  CHECK(!states_.empty());
+  return states_.front().imu_data.time;
+}
+
+IntegrateImuResult<double> ImuPreintegration::Integrate(
+    const common::Time start_time, const common::Time end_time) const {
+  CHECK_LE(start_time, end_time);
+  const State start = StateAt(start_time);
+  const State end = StateAt(end_time);
+  const Eigen::Quaterniond inverse_rotation = start.rotation.conjugate();
+  return IntegrateImuResult<double>{
+      inverse_rotation * (end.velocity - start.velocity),
+      inverse_rotation *
+          (end.translation - start.translation -
+           common::ToSeconds(end_time - start_time) * start.velocity),
+      inverse_rotation * end.rotation};
+}
+
+ImuPreintegration::State ImuPreintegration::Advance(const State& state,
+                                                    const common::Time time) {
+  const double delta_t = common::ToSeconds(time - state.imu_data.time);
+  State result = state;
+  result.rotation = (state.rotation *
+                     transform::AngleAxisVectorToRotationQuaternion(
+                         Eigen::Vector3d(state.imu_data.angular_velocity *
+                                         delta_t)))
+                        .normalized();
+  result.velocity +=
+      result.rotation * (state.imu_data.linear_acceleration * delta_t);
+  result.translation += delta_t * result.velocity;
+  return result;
+}
+
+ImuPreintegration::State ImuPreintegration::StateAt(
+    const common::Time time) const {
+  CHECK(!states_.empty());
+  CHECK_GE(time, states_.front().imu_data.time);
+  // The newest sample at or before 'time'.
+  const auto it = std::prev(std::upper_bound(
+      states_.begin(), states_.end(), time,
+      [](const common::Time time, const State& state) {
+        return time < state.imu_data.time;
+      }));
+  return Advance(*it, time);
+}
+
+}  // namespace mapping
+}  // namespace cartographer
@@ -0,0 +1,81 @@
+/*
+ * Copyright 2018 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_MAPPING_INTERNAL_3D_IMU_PREINTEGRATION_H_
+#define CARTOGRAPHER_MAPPING_INTERNAL_3D_IMU_PREINTEGRATION_H_
+
+#include <deque>
+
+#include "Eigen/Core"
+#include "Eigen/Geometry"
+#include "cartographer/common/time.h"
+#include "cartographer/mapping/internal/3d/imu_integration.h"
+#include "cartographer/sensor/imu_data.h"
+
+namespace cartographer {
+namespace mapping {
+
+// Integrates IMU data cumulatively as it arrives, such that integrating over
+// any interval covered by the data takes O(log n) instead of replaying all
+// samples of the interval: the result is found from the cumulative states at
+// the start and the end of the interval.
+//
+// Up to rounding, the result equals IntegrateImu() over the same interval,
+// except that the step between two samples containing the start of the
+// interval is integrated as a whole rather than split at the start.
+class ImuPreintegration {
+ public:
+  // Adds 'imu_data', which must not be older than the newest sample.
+  void Add(const sensor::ImuData& imu_data);
+
+  // Removes samples which are not needed to integrate from 'time' on, i.e.
+  // all samples before the newest one at or before 'time'.
+  void TrimBefore(common::Time time);
+
+  bool empty() const { return states_.empty(); }
+  size_t size() const { return states_.size(); }
+
+  // Returns the time of the oldest sample.
+  common::Time start_time() const;
+
+  // Integrates the IMU data from 'start_time' to 'end_time', holding the
+  // newest sample beyond its time. 'start_time' must not be before
+  // start_time().
+  IntegrateImuResult<double> Integrate(common::Time start_time,
+                                       common::Time end_time) const;
+
+ private:
+  struct State {
+    sensor::ImuData imu_data;
+    // Integrated from the time of the oldest sample to the time of
+    // 'imu_data'.
+    Eigen::Quaterniond rotation;
+    Eigen::Vector3d velocity;
+    Eigen::Vector3d translation;
+  };
+
+  // Returns 'state' integrated from the time of its sample to 'time'.
+  static State Advance(const State& state, common::Time time);
+
+  State StateAt(common::Time time) const;
+
+  std::deque<State> states_;
+};
+
+}  // namespace mapping
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_MAPPING_INTERNAL_3D_IMU_PREINTEGRATION_H_
@@ -0,0 +1,119 @@
+/*
+ * Copyright 2018 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/internal/3d/imu_preintegration.h"
+
+#include <algorithm>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace mapping {
+namespace {
+
+constexpr double kPrecision = 1e-9;
+
+class ImuPreintegrationTest : public ::testing::Test {
+ protected:
+  ImuPreintegrationTest() {
+    std::mt19937 prng(42);
+    std::uniform_real_distribution<double> distribution(-1., 1.);
+    for (int i = 0; i < 200; ++i) {
+      imu_data_.push_back(sensor::ImuData{
+          common::FromUniversal(1000) + common::FromSeconds(0.01 * i),
+          Eigen::Vector3d(distribution(prng), distribution(prng),
+                          9.8 + distribution(prng)),
+          Eigen::Vector3d(distribution(prng), distribution(prng),
+                          distribution(prng))});
+      preintegration_.Add(imu_data_.back());
+    }
+  }
+
+  IntegrateImuResult<double> IntegrateImuData(const common::Time start_time,
+                                              const common::Time end_time) {
+    auto it = std::prev(std::upper_bound(
+        imu_data_.begin(), imu_data_.end(), start_time,
+        [](const common::Time time, const sensor::ImuData& imu_data) {
+          return time < imu_data.time;
+        }));
+    return IntegrateImu(imu_data_, start_time, end_time, &it);
+  }
+
+  void ExpectNear(const IntegrateImuResult<double>& actual,
+                  const IntegrateImuResult<double>& expected,
+                  const double precision) {
+    EXPECT_TRUE(actual.delta_velocity.isApprox(expected.delta_velocity,
+                                               precision))
+        << actual.delta_velocity.transpose() << " vs "
+        << expected.delta_velocity.transpose();
+    EXPECT_TRUE(actual.delta_translation.isApprox(expected.delta_translation,
+                                                  precision))
+        << actual.delta_translation.transpose() << " vs "
+        << expected.delta_translation.transpose();
+    EXPECT_NEAR(actual.delta_rotation.angularDistance(expected.delta_rotation),
+                0., precision);
+  }
+
+  common::Time SampleTime(const int index) { return imu_data_[index].time; }
+
+  std::vector<sensor::ImuData> imu_data_;
+  ImuPreintegration preintegration_;
+};
+
+TEST_F(ImuPreintegrationTest, MatchesIntegrationFromSampleTimes) {
+  EXPECT_EQ(preintegration_.size(), imu_data_.size());
+  EXPECT_EQ(preintegration_.start_time(), SampleTime(0));
+  const std::vector<std::pair<int, int>> intervals = {
+      {0, 0}, {0, 199}, {17, 18}, {50, 120}};
+  for (const auto& interval : intervals) {
+    ExpectNear(preintegration_.Integrate(SampleTime(interval.first),
+                                         SampleTime(interval.second)),
+               IntegrateImuData(SampleTime(interval.first),
+                                SampleTime(interval.second)),
+               kPrecision);
+  }
+  // Ends between samples and after the last sample.
+  const common::Time end_time = SampleTime(199) + common::FromSeconds(0.123);
+  ExpectNear(preintegration_.Integrate(SampleTime(20), end_time),
+             IntegrateImuData(SampleTime(20), end_time), kPrecision);
+}
+
+TEST_F(ImuPreintegrationTest, MatchesIntegrationFromBetweenSamples) {
+  // Only the step containing the start is integrated differently.
+  const common::Time start_time = SampleTime(30) + common::FromSeconds(0.004);
+  const common::Time end_time = SampleTime(90) + common::FromSeconds(0.007);
+  ExpectNear(preintegration_.Integrate(start_time, end_time),
+             IntegrateImuData(start_time, end_time), 1e-3);
+}
+
+TEST_F(ImuPreintegrationTest, TrimKeepsResults) {
+  const common::Time start_time = SampleTime(60) + common::FromSeconds(0.005);
+  const common::Time end_time = SampleTime(150);
+  const IntegrateImuResult<double> expected =
+      preintegration_.Integrate(start_time, end_time);
+  preintegration_.TrimBefore(start_time);
+  EXPECT_EQ(preintegration_.start_time(), SampleTime(60));
+  EXPECT_EQ(preintegration_.size(), imu_data_.size() - 60);
+  ExpectNear(preintegration_.Integrate(start_time, end_time), expected,
+             kPrecision);
+}
+
+}  // namespace
+}  // namespace mapping
+}  // namespace cartographer
@@ -56,6 +56,8 @@ LocalTrajectoryBuilder3D::LocalTrajectoryBuilder3D(
               options_.real_time_correlative_scan_matcher_options())),
       ceres_scan_matcher_(absl::make_unique<scan_matching::CeresScanMatcher3D>(
           options_.ceres_scan_matcher_options())),
+      range_data_unwarper_(
+          common::FromSeconds(options_.max_unwarping_pose_interval())),
       range_data_collator_(expected_range_sensor_ids) {}
 
 LocalTrajectoryBuilder3D::~LocalTrajectoryBuilder3D() {}
@@ -69,6 +71,10 @@ std::unique_ptr<transform::Rigid3d> LocalTrajectoryBuilder3D::ScanMatch(
   }
   std::shared_ptr<const mapping::Submap3D> matching_submap =
       active_submaps_.submaps().front();
+  const std::shared_ptr<const HybridGrid> high_resolution_hybrid_grid =
+      matching_submap->high_resolution_hybrid_grid();
+  const std::shared_ptr<const HybridGrid> low_resolution_hybrid_grid =
+      matching_submap->low_resolution_hybrid_grid();
   transform::Rigid3d initial_ceres_pose =
       matching_submap->local_pose().inverse() * pose_prediction;
   if (options_.use_online_correlative_scan_matching()) {
@@ -76,7 +82,7 @@ std::unique_ptr<transform::Rigid3d> LocalTrajectoryBuilder3D::ScanMatch(
     const transform::Rigid3d initial_pose = initial_ceres_pose;
     const double score = real_time_correlative_scan_matcher_->Match(
         initial_pose, high_resolution_point_cloud_in_tracking,
-        matching_submap->high_resolution_hybrid_grid(), &initial_ceres_pose);
+        *high_resolution_hybrid_grid, &initial_ceres_pose);
     kRealTimeCorrelativeScanMatcherScoreMetric->Observe(score);
   }
 
@@ -89,10 +95,10 @@ std::unique_ptr<transform::Rigid3d> LocalTrajectoryBuilder3D::ScanMatch(
   ceres_scan_matcher_->Match(
       (matching_submap->local_pose().inverse() * pose_prediction).translation(),
       initial_ceres_pose, {{&high_resolution_point_cloud_in_tracking,
-                            &matching_submap->high_resolution_hybrid_grid(),
+                            high_resolution_hybrid_grid.get(),
                             high_resolution_intensity_hybrid_grid},
                            {&low_resolution_point_cloud_in_tracking,
-                            &matching_submap->low_resolution_hybrid_grid(),
+                            low_resolution_hybrid_grid.get(),
                             /*intensity_hybrid_grid=*/nullptr}},
       &pose_observation_in_submap, &summary);
   kCeresScanMatcherCostMetric->Observe(summary.final_cost);
@@ -126,6 +132,14 @@ void LocalTrajectoryBuilder3D::AddImuData(const sensor::ImuData& imu_data) {
       options_.pose_extrapolator_options(), initial_imu_data, initial_poses);
 }
 
+std::unique_ptr<LocalTrajectoryBuilder3D::MatchingResult>
+LocalTrajectoryBuilder3D::AddRangeData(
+    const std::string& sensor_id,
+    const sensor::OrganizedPointCloudData& range_data) {
+  return AddRangeData(sensor_id, sensor::ToTimedPointCloudData(
+                                     range_data, options_.min_range()));
+}
+
 std::unique_ptr<LocalTrajectoryBuilder3D::MatchingResult>
 LocalTrajectoryBuilder3D::AddRangeData(
     const std::string& sensor_id,
@@ -200,10 +214,10 @@ LocalTrajectoryBuilder3D::AddRangeData(
   hit_times.push_back(accumulated_point_cloud_origin_data_.back().time);
 
   const PoseExtrapolatorInterface::ExtrapolationResult extrapolation_result =
-      extrapolator_->ExtrapolatePosesWithGravity(hit_times);
-  std::vector<transform::Rigid3f> hits_poses(
-      std::move(extrapolation_result.previous_poses));
-  hits_poses.push_back(extrapolation_result.current_pose.cast<float>());
+      range_data_unwarper_.ExtrapolatePosesWithGravity(hit_times,
+                                                       extrapolator_.get());
+  const std::vector<transform::Rigid3f>& hits_poses =
+      range_data_unwarper_.poses();
   CHECK_EQ(hits_poses.size(), hit_times.size());
 
   const size_t max_possible_number_of_accumulated_points = hit_times.size();
@@ -214,6 +228,23 @@ LocalTrajectoryBuilder3D::AddRangeData(
     accumulated_intensities.reserve(max_possible_number_of_accumulated_points);
   }
   sensor::PointCloud misses;
+  // The attributes of all origins of the accumulated data, and where to find
+  // those of the accumulated points. Only tracked if there are any.
+  std::vector<const sensor::PointAttributes*> attribute_sources;
+  bool has_attributes = false;
+  for (const auto& point_cloud_origin_data :
+       accumulated_point_cloud_origin_data_) {
+    for (const auto& attributes : point_cloud_origin_data.attributes) {
+      attribute_sources.push_back(&attributes);
+      has_attributes = has_attributes || !attributes.empty();
+    }
+  }
+  std::vector<sensor::PointAttributes::SourcePoint> accumulated_source_points;
+  if (has_attributes) {
+    accumulated_source_points.reserve(
+        max_possible_number_of_accumulated_points);
+  }
+  uint32 first_attribute_source = 0;
   std::vector<transform::Rigid3f>::const_iterator hits_poses_it =
       hits_poses.begin();
   for (const auto& point_cloud_origin_data :
@@ -231,6 +262,12 @@ LocalTrajectoryBuilder3D::AddRangeData(
           if (options_.use_intensities()) {
             accumulated_intensities.push_back(hit.intensity);
           }
+          if (has_attributes) {
+            accumulated_source_points.push_back(
+                {first_attribute_source +
+                     static_cast<uint32>(hit.origin_index),
+                 hit.point_index});
+          }
         } else {
           // We insert a ray cropped to 'max_range' as a miss for hits beyond
           // the maximum range. This way the free space up to the maximum range
@@ -243,10 +280,14 @@ LocalTrajectoryBuilder3D::AddRangeData(
       }
       ++hits_poses_it;
     }
+    first_attribute_source += point_cloud_origin_data.attributes.size();
   }
   CHECK(std::next(hits_poses_it) == hits_poses.end());
-  const sensor::PointCloud returns(std::move(accumulated_points),
-                                   std::move(accumulated_intensities));
+  const sensor::PointCloud returns(
+      std::move(accumulated_points), std::move(accumulated_intensities),
+      has_attributes ? sensor::PointAttributes::Gather(
+                           attribute_sources, accumulated_source_points)
+                     : sensor::PointAttributes());
 
   const common::Time current_sensor_time = synchronized_data.time;
   absl::optional<common::Duration> sensor_duration;
@@ -294,10 +335,13 @@ LocalTrajectoryBuilder3D::AddAccumulatedRangeData(
 
   const auto scan_matcher_start = std::chrono::steady_clock::now();
 
+  sensor::MultiResolutionVoxelFilter voxel_filter(
+      filtered_range_data_in_tracking.returns);
   const sensor::PointCloud high_resolution_point_cloud_in_tracking =
       sensor::AdaptiveVoxelFilter(
           filtered_range_data_in_tracking.returns,
-          options_.high_resolution_adaptive_voxel_filter_options());
+          options_.high_resolution_adaptive_voxel_filter_options(),
+          &voxel_filter);
   if (high_resolution_point_cloud_in_tracking.empty()) {
     LOG(WARNING) << "Dropped empty high resolution point cloud data.";
     return nullptr;
@@ -305,7 +349,8 @@ LocalTrajectoryBuilder3D::AddAccumulatedRangeData(
   const sensor::PointCloud low_resolution_point_cloud_in_tracking =
       sensor::AdaptiveVoxelFilter(
           filtered_range_data_in_tracking.returns,
-          options_.low_resolution_adaptive_voxel_filter_options());
+          options_.low_resolution_adaptive_voxel_filter_options(),
+          &voxel_filter);
   if (low_resolution_point_cloud_in_tracking.empty()) {
     LOG(WARNING) << "Dropped empty low resolution point cloud data.";
     return nullptr;
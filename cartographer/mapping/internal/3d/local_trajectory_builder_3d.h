@@ -26,12 +26,14 @@
 #include "cartographer/mapping/internal/3d/scan_matching/real_time_correlative_scan_matcher_3d.h"
 #include "cartographer/mapping/internal/motion_filter.h"
 #include "cartographer/mapping/internal/range_data_collator.h"
+#include "cartographer/mapping/internal/range_data_unwarper.h"
 #include "cartographer/mapping/pose_extrapolator_interface.h"
 #include "cartographer/mapping/proto/local_trajectory_builder_options_3d.pb.h"
 #include "cartographer/metrics/family_factory.h"
 #include "cartographer/sensor/imu_data.h"
 #include "cartographer/sensor/internal/voxel_filter.h"
 #include "cartographer/sensor/odometry_data.h"
+#include "cartographer/sensor/organized_point_cloud.h"
 #include "cartographer/sensor/range_data.h"
 #include "cartographer/sensor/timed_point_cloud_data.h"
 #include "cartographer/transform/rigid_transform.h"
@@ -71,6 +73,11 @@ class LocalTrajectoryBuilder3D {
   std::unique_ptr<MatchingResult> AddRangeData(
       const std::string& sensor_id,
       const sensor::TimedPointCloudData& range_data);
+  // Like above, but for an organized scan. Points closer than 'min_range' are
+  // dropped on the range image before anything else is done.
+  std::unique_ptr<MatchingResult> AddRangeData(
+      const std::string& sensor_id,
+      const sensor::OrganizedPointCloudData& range_data);
   void AddOdometryData(const sensor::OdometryData& odometry_data);
 
   static void RegisterMetrics(metrics::FamilyFactory* family_factory);
@@ -107,6 +114,7 @@ class LocalTrajectoryBuilder3D {
   std::unique_ptr<scan_matching::CeresScanMatcher3D> ceres_scan_matcher_;
 
   std::unique_ptr<mapping::PoseExtrapolatorInterface> extrapolator_;
+  RangeDataUnwarper range_data_unwarper_;
 
   int num_accumulated_ = 0;
   std::vector<sensor::TimedPointCloudOriginData>
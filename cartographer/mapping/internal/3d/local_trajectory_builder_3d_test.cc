@@ -53,6 +53,7 @@ class LocalTrajectoryBuilderTest : public ::testing::Test {
           min_range = 0.5,
           max_range = 50.,
           num_accumulated_range_data = 1,
+          max_unwarping_pose_interval = 0.,
           voxel_filter_size = 0.2,
 
           high_resolution_adaptive_voxel_filter = {
@@ -125,6 +126,7 @@ class LocalTrajectoryBuilderTest : public ::testing::Test {
             high_resolution_max_range = 50.,
             low_resolution = 0.5,
             num_range_data = 45000,
+            num_insertion_threads = 1,
             range_data_inserter = {
               hit_probability = 0.7,
               miss_probability = 0.4,
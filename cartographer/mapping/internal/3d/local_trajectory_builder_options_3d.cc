@@ -34,6 +34,8 @@ proto::LocalTrajectoryBuilderOptions3D CreateLocalTrajectoryBuilderOptions3D(
   options.set_max_range(parameter_dictionary->GetDouble("max_range"));
   options.set_num_accumulated_range_data(
       parameter_dictionary->GetInt("num_accumulated_range_data"));
+  options.set_max_unwarping_pose_interval(
+      parameter_dictionary->GetDouble("max_unwarping_pose_interval"));
   options.set_voxel_filter_size(
       parameter_dictionary->GetDouble("voxel_filter_size"));
   *options.mutable_high_resolution_adaptive_voxel_filter_options() =
@@ -23,6 +23,7 @@
 #include <map>
 #include <memory>
 #include <set>
+#include <string>
 #include <vector>
 
 #include "Eigen/Core"
@@ -37,6 +38,7 @@
 #include "cartographer/mapping/internal/optimization/optimization_problem_3d.h"
 #include "cartographer/mapping/internal/trajectory_connectivity_state.h"
 #include "cartographer/mapping/internal/pose_graph_data.h"
+#include "cartographer/mapping/internal/spatial_index.h"
 #include "cartographer/mapping/internal/work_queue.h"
 #include "cartographer/mapping/pose_graph.h"
 #include "cartographer/mapping/pose_graph_trimmer.h"
@@ -145,6 +147,8 @@ class PoseGraph3D : public PoseGraph {
   std::map<int, TrajectoryData> GetTrajectoryData() const override;
 
   std::vector<Constraint> constraints() const override LOCKS_EXCLUDED(mutex_);
+  std::shared_ptr<const Snapshot> GetSnapshot() const override
+      LOCKS_EXCLUDED(snapshot_mutex_);
   void SetInitialTrajectoryPose(int from_trajectory_id, int to_trajectory_id,
                                 const transform::Rigid3d& pose,
                                 const common::Time time) override
@@ -155,6 +159,10 @@ class PoseGraph3D : public PoseGraph {
       int trajectory_id, const common::Time time) const
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
+  // Returns true while a node has been waiting in the work queue for longer
+  // than 'overloaded_work_queue_delay_seconds', so that callers can back off.
+  bool IsOverloaded() const LOCKS_EXCLUDED(work_queue_mutex_);
+
   static void RegisterMetrics(metrics::FamilyFactory* family_factory);
 
  protected:
@@ -167,8 +175,24 @@ class PoseGraph3D : public PoseGraph {
   MapById<SubmapId, SubmapData> GetSubmapDataUnderLock() const
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
+  MapById<NodeId, TrajectoryNodePose> GetTrajectoryNodePosesUnderLock() const
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  MapById<SubmapId, SubmapPose> GetAllSubmapPosesUnderLock() const
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  std::map<int, TrajectoryState> GetTrajectoryStatesUnderLock() const
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  std::map<std::string, transform::Rigid3d> GetLandmarkPosesUnderLock() const
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  std::vector<Constraint> GetConstraintsUnderLock() const
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Replaces the snapshot returned by 'GetSnapshot()' with the current state.
+  void PublishSnapshot() EXCLUSIVE_LOCKS_REQUIRED(mutex_)
+      LOCKS_EXCLUDED(snapshot_mutex_);
+
   // Handles a new work item.
-  void AddWorkItem(const std::function<WorkItem::Result()>& work_item)
+  void AddWorkItem(const std::function<WorkItem::Result()>& work_item,
+                   WorkItem::Lane lane = WorkItem::Lane::kNodes)
       LOCKS_EXCLUDED(mutex_) LOCKS_EXCLUDED(work_queue_mutex_);
 
   // Adds connectivity and sampler for a trajectory if it does not exist.
@@ -216,6 +240,47 @@ class PoseGraph3D : public PoseGraph {
   // optimization being run at a time.
   void RunOptimization() LOCKS_EXCLUDED(mutex_);
 
+  // Solves 'optimization_problem' with the given inputs, either in full or by
+  // the submap level optimization.
+  void SolveOptimizationProblem(
+      optimization::OptimizationProblem3D* optimization_problem,
+      const std::vector<Constraint>& constraints,
+      const std::map<int, TrajectoryState>& trajectories_state,
+      const std::map<std::string, LandmarkNode>& landmark_nodes);
+
+  // Runs the submap level optimization and, if configured, the node
+  // refinement in place of solving the full optimization problem.
+  void RunSubmapLevelOptimization(
+      optimization::OptimizationProblem3D* optimization_problem,
+      const std::vector<Constraint>& constraints,
+      const std::map<int, TrajectoryState>& trajectories_state);
+
+  // Updates the global poses of nodes, submaps and landmarks from the
+  // 'optimization_problem_', and extrapolates the nodes not included yet.
+  void UpdateGlobalPoses() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Reports the last optimized nodes and submaps to the
+  // 'global_slam_optimization_callback_', if any.
+  void RunGlobalSlamOptimizationCallback() LOCKS_EXCLUDED(mutex_);
+
+  // Inputs of an optimization which is solved in the background, copied from
+  // the pose graph when it was started.
+  struct BackgroundOptimization {
+    std::unique_ptr<optimization::OptimizationProblem3D> optimization_problem;
+    std::vector<Constraint> constraints;
+    std::map<int, TrajectoryState> trajectories_state;
+    std::map<std::string, LandmarkNode> landmark_nodes;
+  };
+
+  // Starts solving a copy of the optimization problem on the 'thread_pool_',
+  // see 'optimize_in_background'.
+  void StartBackgroundOptimization() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Solves 'background_optimization' and merges the result into the pose
+  // graph, moving the nodes and submaps added meanwhile along.
+  void RunBackgroundOptimization(
+      BackgroundOptimization* background_optimization) LOCKS_EXCLUDED(mutex_);
+
   bool CanAddWorkItemModifying(int trajectory_id)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
@@ -232,6 +297,19 @@ class PoseGraph3D : public PoseGraph {
                                  const SubmapId& submap_id) const
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
+  // Returns the time of the latest node of all trajectories, which is an upper
+  // bound of 'GetLatestNodeTime()' for any node and submap.
+  common::Time GetLatestNodeTime() const EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Returns true if constraints between nodes of 'node_trajectory_id' and
+  // submaps of 'submap_trajectory_id' are searched for in a local window, i.e.
+  // only up to 'max_constraint_distance', given that 'GetLatestNodeTime()' of
+  // the node and submap is 'node_time'.
+  bool IsLocalConstraintSearch(int node_trajectory_id,
+                               int submap_trajectory_id,
+                               common::Time node_time) const
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
   // Logs histograms for the translational and rotational residual of node
   // poses.
   void LogResidualHistograms() const EXCLUSIVE_LOCKS_REQUIRED(mutex_);
@@ -243,7 +321,12 @@ class PoseGraph3D : public PoseGraph {
   const proto::PoseGraphOptions options_;
   GlobalSlamOptimizationCallback global_slam_optimization_callback_;
   mutable absl::Mutex mutex_;
-  absl::Mutex work_queue_mutex_;
+  mutable absl::Mutex work_queue_mutex_;
+  mutable absl::Mutex snapshot_mutex_;
+
+  // Last published snapshot. It is only ever replaced, never modified.
+  std::shared_ptr<const Snapshot> snapshot_ GUARDED_BY(snapshot_mutex_) =
+      std::make_shared<const Snapshot>();
 
   // If it exists, further work items must be added to this queue, and will be
   // considered later.
@@ -256,6 +339,20 @@ class PoseGraph3D : public PoseGraph {
   // Number of nodes added since last loop closure.
   int num_nodes_since_last_loop_closure_ GUARDED_BY(mutex_) = 0;
 
+  // Whether an optimization is solved in the background, and whether another
+  // one was requested meanwhile, which is then started right after it.
+  bool background_optimization_running_ GUARDED_BY(mutex_) = false;
+  bool background_optimization_requested_ GUARDED_BY(mutex_) = false;
+  // Number of scheduled background optimization tasks which did not return
+  // yet. Unlike 'background_optimization_running_', this covers the callbacks
+  // and the work queue processing done by the task after the merge.
+  int num_background_optimization_tasks_ GUARDED_BY(mutex_) = 0;
+  // Set by 'RunFinalOptimization()', which always optimizes in the foreground.
+  bool final_optimization_requested_ GUARDED_BY(mutex_) = false;
+  // Set while the work queue waits for the background optimization to finish
+  // before it runs the final optimization.
+  bool work_queue_waiting_for_optimization_ GUARDED_BY(mutex_) = false;
+
   // Current optimization problem.
   std::unique_ptr<optimization::OptimizationProblem3D> optimization_problem_;
   constraints::ConstraintBuilder3D constraint_builder_;
@@ -268,6 +365,12 @@ class PoseGraph3D : public PoseGraph {
 
   PoseGraphData data_ GUARDED_BY(mutex_);
 
+  // Global positions of the finished submaps and of the nodes in the
+  // 'optimization_problem_', to find candidates for local constraints without
+  // looking at all submaps and nodes.
+  SpatialIndex<SubmapId> finished_submap_index_ GUARDED_BY(mutex_);
+  SpatialIndex<NodeId> node_index_ GUARDED_BY(mutex_);
+
   // Allows querying and manipulating the pose graph by the 'trimmers_'. The
   // 'mutex_' of the pose graph is held while this class is used.
   class TrimmingHandle : public Trimmable {
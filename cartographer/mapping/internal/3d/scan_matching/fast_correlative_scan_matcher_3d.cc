@@ -20,6 +20,8 @@
 #include <cmath>
 #include <functional>
 #include <limits>
+#include <memory>
+#include <utility>
 
 #include "Eigen/Geometry"
 #include "absl/memory/memory.h"
@@ -51,31 +53,13 @@ CreateFastCorrelativeScanMatcherOptions3D(
       parameter_dictionary->GetDouble("linear_z_search_window"));
   options.set_angular_search_window(
       parameter_dictionary->GetDouble("angular_search_window"));
+  options.set_num_precomputation_threads(
+      parameter_dictionary->GetNonNegativeInt("num_precomputation_threads"));
+  options.set_serialize_precomputation_grids(
+      parameter_dictionary->GetBool("serialize_precomputation_grids"));
   return options;
 }
 
-PrecomputationGridStack3D::PrecomputationGridStack3D(
-    const HybridGrid& hybrid_grid,
-    const proto::FastCorrelativeScanMatcherOptions3D& options) {
-  CHECK_GE(options.branch_and_bound_depth(), 1);
-  CHECK_GE(options.full_resolution_depth(), 1);
-  precomputation_grids_.reserve(options.branch_and_bound_depth());
-  precomputation_grids_.push_back(ConvertToPrecomputationGrid(hybrid_grid));
-  Eigen::Array3i last_width = Eigen::Array3i::Ones();
-  for (int depth = 1; depth != options.branch_and_bound_depth(); ++depth) {
-    const bool half_resolution = depth >= options.full_resolution_depth();
-    const Eigen::Array3i next_width = ((1 << depth) * Eigen::Array3i::Ones());
-    const int full_voxels_per_high_resolution_voxel =
-        1 << std::max(0, depth - options.full_resolution_depth());
-    const Eigen::Array3i shift = (next_width - last_width +
-                                  (full_voxels_per_high_resolution_voxel - 1)) /
-                                 full_voxels_per_high_resolution_voxel;
-    precomputation_grids_.push_back(
-        PrecomputeGrid(precomputation_grids_.back(), half_resolution, shift));
-    last_width = next_width;
-  }
-}
-
 struct DiscreteScan3D {
   transform::Rigid3f pose;
   // Contains a vector of discretized scans for each 'depth'.
@@ -118,10 +102,28 @@ FastCorrelativeScanMatcher3D::FastCorrelativeScanMatcher3D(
       resolution_(hybrid_grid.resolution()),
       width_in_voxels_(hybrid_grid.grid_size()),
       precomputation_grid_stack_(
-          absl::make_unique<PrecomputationGridStack3D>(hybrid_grid, options)),
+          std::make_shared<const PrecomputationGridStack3D>(hybrid_grid,
+                                                            options)),
       low_resolution_hybrid_grid_(low_resolution_hybrid_grid),
       rotational_scan_matcher_(rotational_scan_matcher_histogram) {}
 
+FastCorrelativeScanMatcher3D::FastCorrelativeScanMatcher3D(
+    const HybridGrid& hybrid_grid,
+    const HybridGrid* const low_resolution_hybrid_grid,
+    const Eigen::VectorXf* rotational_scan_matcher_histogram,
+    std::shared_ptr<const PrecomputationGridStack3D> precomputation_grid_stack,
+    const proto::FastCorrelativeScanMatcherOptions3D& options)
+    : options_(options),
+      resolution_(hybrid_grid.resolution()),
+      width_in_voxels_(hybrid_grid.grid_size()),
+      precomputation_grid_stack_(std::move(precomputation_grid_stack)),
+      low_resolution_hybrid_grid_(low_resolution_hybrid_grid),
+      rotational_scan_matcher_(rotational_scan_matcher_histogram) {
+  CHECK(precomputation_grid_stack_ != nullptr);
+  CHECK(precomputation_grid_stack_->IsCompatible(options_));
+  CHECK_EQ(precomputation_grid_stack_->Get(0).resolution(), resolution_);
+}
+
 FastCorrelativeScanMatcher3D::~FastCorrelativeScanMatcher3D() {}
 
 std::unique_ptr<FastCorrelativeScanMatcher3D::Result>
@@ -41,22 +41,6 @@ proto::FastCorrelativeScanMatcherOptions3D
 CreateFastCorrelativeScanMatcherOptions3D(
     common::LuaParameterDictionary* parameter_dictionary);
 
-class PrecomputationGridStack3D {
- public:
-  PrecomputationGridStack3D(
-      const HybridGrid& hybrid_grid,
-      const proto::FastCorrelativeScanMatcherOptions3D& options);
-
-  const PrecomputationGrid3D& Get(int depth) const {
-    return precomputation_grids_.at(depth);
-  }
-
-  int max_depth() const { return precomputation_grids_.size() - 1; }
-
- private:
-  std::vector<PrecomputationGrid3D> precomputation_grids_;
-};
-
 struct DiscreteScan3D;
 struct Candidate3D;
 
@@ -77,12 +61,26 @@ class FastCorrelativeScanMatcher3D {
       const HybridGrid* low_resolution_hybrid_grid,
       const Eigen::VectorXf* rotational_scan_matcher_histogram,
       const proto::FastCorrelativeScanMatcherOptions3D& options);
+  // Same as above, but uses an already computed 'precomputation_grid_stack'
+  // for 'hybrid_grid', e.g. one that was loaded together with the submap.
+  FastCorrelativeScanMatcher3D(
+      const HybridGrid& hybrid_grid,
+      const HybridGrid* low_resolution_hybrid_grid,
+      const Eigen::VectorXf* rotational_scan_matcher_histogram,
+      std::shared_ptr<const PrecomputationGridStack3D>
+          precomputation_grid_stack,
+      const proto::FastCorrelativeScanMatcherOptions3D& options);
   ~FastCorrelativeScanMatcher3D();
 
   FastCorrelativeScanMatcher3D(const FastCorrelativeScanMatcher3D&) = delete;
   FastCorrelativeScanMatcher3D& operator=(const FastCorrelativeScanMatcher3D&) =
       delete;
 
+  const std::shared_ptr<const PrecomputationGridStack3D>&
+  precomputation_grid_stack() const {
+    return precomputation_grid_stack_;
+  }
+
   // Aligns the node with the given 'constant_data' within the 'hybrid_grid'
   // given 'global_node_pose' and 'global_submap_pose'. 'Result' is only
   // returned if a score above 'min_score' (excluding equality) is possible.
@@ -145,7 +143,7 @@ class FastCorrelativeScanMatcher3D {
   const proto::FastCorrelativeScanMatcherOptions3D options_;
   const float resolution_;
   const int width_in_voxels_;
-  std::unique_ptr<PrecomputationGridStack3D> precomputation_grid_stack_;
+  std::shared_ptr<const PrecomputationGridStack3D> precomputation_grid_stack_;
   const HybridGrid* const low_resolution_hybrid_grid_;
   RotationalScanMatcher rotational_scan_matcher_;
 };
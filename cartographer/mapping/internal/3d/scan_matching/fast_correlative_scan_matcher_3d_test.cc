@@ -82,6 +82,8 @@ class FastCorrelativeScanMatcher3DTest : public ::testing::Test {
         "linear_xy_search_window = 0.8, "
         "linear_z_search_window = 0.8, "
         "angular_search_window = 0.3, "
+        "num_precomputation_threads = 1, "
+        "serialize_precomputation_grids = false, "
         "}");
     return CreateFastCorrelativeScanMatcherOptions3D(
         parameter_dictionary.get());
@@ -101,7 +103,7 @@ class FastCorrelativeScanMatcher3DTest : public ::testing::Test {
 
   std::unique_ptr<FastCorrelativeScanMatcher3D> GetFastCorrelativeScanMatcher(
       const proto::FastCorrelativeScanMatcherOptions3D& options,
-      const transform::Rigid3f& pose) {
+      const transform::Rigid3f& pose, const bool freeze = false) {
     hybrid_grid_ = absl::make_unique<HybridGrid>(0.05f);
     range_data_inserter_.Insert(
         sensor::RangeData{pose.translation(),
@@ -110,6 +112,9 @@ class FastCorrelativeScanMatcher3DTest : public ::testing::Test {
         hybrid_grid_.get(),
         /*intensity_hybrid_grid=*/nullptr);
     hybrid_grid_->FinishUpdate();
+    if (freeze) {
+      hybrid_grid_ = hybrid_grid_->CreateFrozenCopy();
+    }
 
     return absl::make_unique<FastCorrelativeScanMatcher3D>(
         *hybrid_grid_, hybrid_grid_.get(), &GetRotationalScanMatcherHistogram(),
@@ -203,6 +208,31 @@ TEST_F(FastCorrelativeScanMatcher3DTest, CorrectPoseForMatchFullSubmap) {
       << low_resolution_result->low_resolution_score;
 }
 
+TEST_F(FastCorrelativeScanMatcher3DTest,
+       CorrectPoseForMatchFullSubmapOfFrozenGridFarFromOrigin) {
+  // The grid has to grow well beyond its initial size to contain the data.
+  const auto expected_pose =
+      transform::Rigid3f::Translation(Eigen::Vector3f(15.f, 0.f, 0.f)) *
+      GetRandomPose();
+
+  std::unique_ptr<FastCorrelativeScanMatcher3D> fast_correlative_scan_matcher(
+      GetFastCorrelativeScanMatcher(options_, expected_pose,
+                                    true /* freeze */));
+  EXPECT_TRUE(hybrid_grid_->frozen());
+  EXPECT_LT(2 * 15.f / 0.05f, hybrid_grid_->grid_size());
+
+  const std::unique_ptr<FastCorrelativeScanMatcher3D::Result> result =
+      fast_correlative_scan_matcher->MatchFullSubmap(
+          Eigen::Quaterniond::Identity(), Eigen::Quaterniond::Identity(),
+          CreateConstantData(point_cloud_), kMinScore);
+  ASSERT_THAT(result, testing::NotNull());
+  EXPECT_LT(kMinScore, result->score);
+  EXPECT_THAT(expected_pose,
+              transform::IsNearly(result->pose_estimate.cast<float>(), 0.05f))
+      << "Actual: " << transform::ToProto(result->pose_estimate).DebugString()
+      << "\nExpected: " << transform::ToProto(expected_pose).DebugString();
+}
+
 }  // namespace
 }  // namespace scan_matching
 }  // namespace mapping
@@ -22,10 +22,13 @@ namespace scan_matching {
 
 std::function<float(const transform::Rigid3f&)> CreateLowResolutionMatcher(
     const HybridGrid* low_resolution_grid, const sensor::PointCloud* points) {
-  return [=](const transform::Rigid3f& pose) {
+  // The buffer for the transformed points is reused across calls, so that
+  // scoring candidates does not allocate.
+  std::vector<sensor::RangefinderPoint> transformed_points;
+  return [=](const transform::Rigid3f& pose) mutable {
+    sensor::TransformPointCloud(*points, pose, &transformed_points);
     float score = 0.f;
-    for (const sensor::RangefinderPoint& point :
-         sensor::TransformPointCloud(*points, pose)) {
+    for (const sensor::RangefinderPoint& point : transformed_points) {
       // TODO(zhengj, whess): Interpolate the Grid to get better score.
       score += low_resolution_grid->GetProbability(
           low_resolution_grid->GetCellIndex(point.position));
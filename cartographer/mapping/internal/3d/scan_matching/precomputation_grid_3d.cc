@@ -17,8 +17,15 @@
 #include "cartographer/mapping/internal/3d/scan_matching/precomputation_grid_3d.h"
 
 #include <algorithm>
+#include <array>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
 
 #include "Eigen/Core"
+#include "absl/container/flat_hash_map.h"
+#include "absl/memory/memory.h"
 #include "cartographer/common/math.h"
 #include "cartographer/mapping/probability_values.h"
 #include "glog/logging.h"
@@ -28,58 +35,395 @@ namespace mapping {
 namespace scan_matching {
 namespace {
 
-// C++11 defines that integer division rounds towards zero. For index math, we
-// actually need it to round towards negative infinity. Luckily bit shifts have
-// that property.
-inline int DivideByTwoRoundingTowardsNegativeInfinity(const int value) {
-  return value >> 1;
+// The grids are processed in blocks of 2^'kBlockBits' voxels per dimension.
+// This matches the size of the FlatGrids of a HybridGridBase.
+constexpr int kBlockBits = 3;
+constexpr int kBlockSize = 1 << kBlockBits;
+constexpr int kBlockVolume = kBlockSize * kBlockSize * kBlockSize;
+
+using Block = std::array<uint8, kBlockVolume>;
+
+// Returns 'index' divided by 2^'bits'. Bit shifts round towards negative
+// infinity as needed for index math, unlike C++11 integer division.
+Eigen::Array3i ShiftRight(const Eigen::Array3i& index, const int bits) {
+  return Eigen::Array3i(index[0] >> bits, index[1] >> bits, index[2] >> bits);
+}
+
+// Packs a block index into a single integer for hashing. Cell indices of a
+// HybridGridBase are limited to +/- 8192, so 21 bits per dimension suffice.
+int64 ToBlockKey(const Eigen::Array3i& block_index) {
+  constexpr int64 kOffset = 1 << 20;
+  constexpr int64 kMask = (int64{1} << 21) - 1;
+  return (((block_index[0] + kOffset) & kMask) << 42) |
+         (((block_index[1] + kOffset) & kMask) << 21) |
+         ((block_index[2] + kOffset) & kMask);
+}
+
+bool BlockIndexLess(const Eigen::Array3i& lhs, const Eigen::Array3i& rhs) {
+  return std::lexicographical_compare(lhs.data(), lhs.data() + 3, rhs.data(),
+                                      rhs.data() + 3);
 }
 
-// Computes the half resolution index corresponding to the full resolution
-// 'cell_index'.
-Eigen::Array3i CellIndexAtHalfResolution(const Eigen::Array3i& cell_index) {
-  return Eigen::Array3i(
-      DivideByTwoRoundingTowardsNegativeInfinity(cell_index[0]),
-      DivideByTwoRoundingTowardsNegativeInfinity(cell_index[1]),
-      DivideByTwoRoundingTowardsNegativeInfinity(cell_index[2]));
+// The non-empty blocks of a PrecomputationGrid3D, copied into contiguous
+// memory for fast dense access.
+class BlockedGrid {
+ public:
+  explicit BlockedGrid(const PrecomputationGrid3D& grid) {
+    for (auto it = PrecomputationGrid3D::Iterator(grid); !it.Done();
+         it.Next()) {
+      const Eigen::Array3i cell_index = it.GetCellIndex();
+      const Eigen::Array3i block_index = ShiftRight(cell_index, kBlockBits);
+      auto insertion_result =
+          block_positions_.emplace(ToBlockKey(block_index), blocks_.size());
+      if (insertion_result.second) {
+        block_indices_.push_back(block_index);
+        blocks_.emplace_back();
+        blocks_.back().fill(0);
+      }
+      blocks_[insertion_result.first->second][ToFlatIndex(
+          cell_index - block_index * kBlockSize, kBlockBits)] = it.GetValue();
+    }
+  }
+
+  const std::vector<Eigen::Array3i>& block_indices() const {
+    return block_indices_;
+  }
+  const Block& block(const size_t i) const { return blocks_[i]; }
+
+  // Returns the block at 'block_index' or nullptr if it is empty.
+  const Block* Find(const Eigen::Array3i& block_index) const {
+    const auto it = block_positions_.find(ToBlockKey(block_index));
+    if (it == block_positions_.end()) {
+      return nullptr;
+    }
+    return &blocks_[it->second];
+  }
+
+  // Copies the voxels of the box starting at 'origin' with 'size' voxels per
+  // dimension into 'dense' in z-major order. Voxels not in any non-empty block
+  // are zero.
+  void CopyToDense(const Eigen::Array3i& origin, const Eigen::Array3i& size,
+                   std::vector<uint8>* const dense) const {
+    dense->assign(size.prod(), 0);
+    const Eigen::Array3i first_block = ShiftRight(origin, kBlockBits);
+    const Eigen::Array3i last_block =
+        ShiftRight(origin + size - 1, kBlockBits);
+    for (int bz = first_block.z(); bz <= last_block.z(); ++bz) {
+      for (int by = first_block.y(); by <= last_block.y(); ++by) {
+        for (int bx = first_block.x(); bx <= last_block.x(); ++bx) {
+          const Eigen::Array3i block_index(bx, by, bz);
+          const Block* const block = Find(block_index);
+          if (block == nullptr) {
+            continue;
+          }
+          // Intersection of the block with the box in box coordinates.
+          const Eigen::Array3i block_origin = block_index * kBlockSize - origin;
+          const Eigen::Array3i begin = block_origin.max(0);
+          const Eigen::Array3i end = (block_origin + kBlockSize).min(size);
+          const int row_length = end.x() - begin.x();
+          for (int z = begin.z(); z < end.z(); ++z) {
+            for (int y = begin.y(); y < end.y(); ++y) {
+              const Eigen::Array3i in_block =
+                  Eigen::Array3i(begin.x(), y, z) - block_origin;
+              std::memcpy(
+                  dense->data() + (z * size.y() + y) * size.x() + begin.x(),
+                  block->data() + ToFlatIndex(in_block, kBlockBits),
+                  row_length);
+            }
+          }
+        }
+      }
+    }
+  }
+
+ private:
+  absl::flat_hash_map<int64, size_t> block_positions_;
+  std::vector<Eigen::Array3i> block_indices_;
+  std::vector<Block> blocks_;
+};
+
+// Sets 'output[i]' to the maximum of 'a[i]' and 'b[i]'. Written as a simple
+// loop over contiguous memory so that it is vectorized by the compiler.
+inline void RowMax(const uint8* const a, const uint8* const b, const int length,
+                   uint8* const output) {
+  for (int i = 0; i != length; ++i) {
+    output[i] = std::max(a[i], b[i]);
+  }
+}
+
+// Reusable buffers for 'ComputeBlock'.
+struct Scratch {
+  std::vector<uint8> source;
+  std::vector<uint8> x_max;
+  std::vector<uint8> xy_max;
+  std::vector<uint8> xyz_max;
+};
+
+// Computes the result block at 'block_index' of 'PrecomputeGrid'. The 8-voxel
+// maximum is separable, so it is computed as a maximum of two voxels along x,
+// then y, then z. At half resolution, the 2x2x2 reduction is separable as well.
+void ComputeBlock(const BlockedGrid& grid, const Eigen::Array3i& block_index,
+                  const bool half_resolution, const Eigen::Array3i& shift,
+                  Scratch* const scratch, Block* const result) {
+  // Number of full resolution voxels per dimension needed for this block.
+  const int n = half_resolution ? 2 * kBlockSize : kBlockSize;
+  const Eigen::Array3i size = n + shift;
+  grid.CopyToDense(block_index * n, size, &scratch->source);
+
+  // Maximum along x: n x size.y() x size.z() voxels.
+  scratch->x_max.resize(n * size.y() * size.z());
+  for (int zy = 0; zy != size.y() * size.z(); ++zy) {
+    const uint8* const row = scratch->source.data() + zy * size.x();
+    RowMax(row, row + shift.x(), n, scratch->x_max.data() + zy * n);
+  }
+  // Maximum along y: n x n x size.z() voxels.
+  scratch->xy_max.resize(n * n * size.z());
+  for (int z = 0; z != size.z(); ++z) {
+    const uint8* const plane = scratch->x_max.data() + z * size.y() * n;
+    RowMax(plane, plane + shift.y() * n, n * n,
+           scratch->xy_max.data() + z * n * n);
+  }
+  // Maximum along z: n x n x n voxels.
+  if (!half_resolution) {
+    RowMax(scratch->xy_max.data(), scratch->xy_max.data() + shift.z() * n * n,
+           kBlockVolume, result->data());
+    return;
+  }
+  scratch->xyz_max.resize(n * n * n);
+  RowMax(scratch->xy_max.data(), scratch->xy_max.data() + shift.z() * n * n,
+         n * n * n, scratch->xyz_max.data());
+
+  // Reduce 2x2x2 voxels to one, first along z and y on whole rows, then x.
+  for (int z = 0; z != kBlockSize; ++z) {
+    for (int y = 0; y != kBlockSize; ++y) {
+      const uint8* const row_00 =
+          scratch->xyz_max.data() + ((2 * z) * n + 2 * y) * n;
+      const uint8* const row_01 = row_00 + n;
+      const uint8* const row_10 = row_00 + n * n;
+      const uint8* const row_11 = row_10 + n;
+      std::array<uint8, 2 * kBlockSize> row;
+      RowMax(row_00, row_01, n, row.data());
+      RowMax(row.data(), row_10, n, row.data());
+      RowMax(row.data(), row_11, n, row.data());
+      uint8* const output = result->data() + (z * kBlockSize + y) * kBlockSize;
+      for (int x = 0; x != kBlockSize; ++x) {
+        output[x] = std::max(row[2 * x], row[2 * x + 1]);
+      }
+    }
+  }
+}
+
+// Returns the sorted indices of all result blocks of 'PrecomputeGrid' which
+// can contain non-zero values.
+std::vector<Eigen::Array3i> ComputeResultBlockIndices(
+    const BlockedGrid& grid, const bool half_resolution,
+    const Eigen::Array3i& shift) {
+  const int result_block_bits = kBlockBits + (half_resolution ? 1 : 0);
+  std::vector<Eigen::Array3i> result;
+  for (const Eigen::Array3i& block_index : grid.block_indices()) {
+    // Voxels of this block influence the full resolution voxels from
+    // 'begin' to 'end' (inclusive), since values are moved by '-shift'.
+    const Eigen::Array3i begin = block_index * kBlockSize - shift;
+    const Eigen::Array3i end = block_index * kBlockSize + (kBlockSize - 1);
+    const Eigen::Array3i first = ShiftRight(begin, result_block_bits);
+    const Eigen::Array3i last = ShiftRight(end, result_block_bits);
+    for (int z = first.z(); z <= last.z(); ++z) {
+      for (int y = first.y(); y <= last.y(); ++y) {
+        for (int x = first.x(); x <= last.x(); ++x) {
+          result.emplace_back(x, y, z);
+        }
+      }
+    }
+  }
+  std::sort(result.begin(), result.end(), BlockIndexLess);
+  result.erase(std::unique(result.begin(), result.end(),
+                           [](const Eigen::Array3i& lhs,
+                              const Eigen::Array3i& rhs) {
+                             return (lhs == rhs).all();
+                           }),
+               result.end());
+  return result;
+}
+
+// Maps probability values, with or without update marker, to [0, 255].
+std::unique_ptr<std::vector<uint8>> PrecomputeValueToPrecomputationValue() {
+  auto result = absl::make_unique<std::vector<uint8>>();
+  result->reserve(2 * kUpdateMarker);
+  for (int value = 0; value != 2 * kUpdateMarker; ++value) {
+    const int cell_value = common::RoundToInt(
+        (ValueToProbability(value) - kMinProbability) *
+        (255.f / (kMaxProbability - kMinProbability)));
+    CHECK_GE(cell_value, 0);
+    CHECK_LE(cell_value, 255);
+    result->push_back(cell_value);
+  }
+  return result;
+}
+
+// Initialized on first use, since 'kValueToProbability' is not available
+// during static initialization of this translation unit.
+const std::vector<uint8>& ValueToPrecomputationValue() {
+  static const std::vector<uint8>* const kValueToPrecomputationValue =
+      PrecomputeValueToPrecomputationValue().release();
+  return *kValueToPrecomputationValue;
 }
 
 }  // namespace
 
+PrecomputationGrid3D::PrecomputationGrid3D(
+    const mapping::proto::PrecomputationGrid3D& proto)
+    : PrecomputationGrid3D(proto.resolution()) {
+  CHECK_EQ(proto.x_block_indices_size(), proto.y_block_indices_size());
+  CHECK_EQ(proto.x_block_indices_size(), proto.z_block_indices_size());
+  CHECK_EQ(proto.values().size(),
+           static_cast<size_t>(proto.x_block_indices_size()) * kBlockVolume);
+  const uint8* values = reinterpret_cast<const uint8*>(proto.values().data());
+  for (int i = 0; i != proto.x_block_indices_size(); ++i) {
+    const Eigen::Array3i block_origin =
+        kBlockSize * Eigen::Array3i(proto.x_block_indices(i),
+                                    proto.y_block_indices(i),
+                                    proto.z_block_indices(i));
+    for (int j = 0; j != kBlockVolume; ++j, ++values) {
+      if (*values != 0) {
+        *mutable_value(block_origin + To3DIndex(j, kBlockBits)) = *values;
+      }
+    }
+  }
+}
+
+mapping::proto::PrecomputationGrid3D PrecomputationGrid3D::ToProto() const {
+  const BlockedGrid blocked_grid(*this);
+  std::vector<size_t> order(blocked_grid.block_indices().size());
+  for (size_t i = 0; i != order.size(); ++i) {
+    order[i] = i;
+  }
+  std::sort(order.begin(), order.end(),
+            [&blocked_grid](const size_t lhs, const size_t rhs) {
+              return BlockIndexLess(blocked_grid.block_indices()[lhs],
+                                    blocked_grid.block_indices()[rhs]);
+            });
+  mapping::proto::PrecomputationGrid3D result;
+  result.set_resolution(resolution());
+  std::string* const values = result.mutable_values();
+  values->reserve(order.size() * kBlockVolume);
+  for (const size_t i : order) {
+    const Eigen::Array3i& block_index = blocked_grid.block_indices()[i];
+    result.add_x_block_indices(block_index.x());
+    result.add_y_block_indices(block_index.y());
+    result.add_z_block_indices(block_index.z());
+    values->append(reinterpret_cast<const char*>(blocked_grid.block(i).data()),
+                   kBlockVolume);
+  }
+  return result;
+}
+
 PrecomputationGrid3D ConvertToPrecomputationGrid(
     const HybridGrid& hybrid_grid) {
+  const std::vector<uint8>& value_to_precomputation_value =
+      ValueToPrecomputationValue();
   PrecomputationGrid3D result(hybrid_grid.resolution());
   for (auto it = HybridGrid::Iterator(hybrid_grid); !it.Done(); it.Next()) {
-    const int cell_value = common::RoundToInt(
-        (ValueToProbability(it.GetValue()) - kMinProbability) *
-        (255.f / (kMaxProbability - kMinProbability)));
-    CHECK_GE(cell_value, 0);
-    CHECK_LE(cell_value, 255);
-    *result.mutable_value(it.GetCellIndex()) = cell_value;
+    *result.mutable_value(it.GetCellIndex()) =
+        value_to_precomputation_value[it.GetValue()];
   }
   return result;
 }
 
 PrecomputationGrid3D PrecomputeGrid(const PrecomputationGrid3D& grid,
                                     const bool half_resolution,
-                                    const Eigen::Array3i& shift) {
+                                    const Eigen::Array3i& shift,
+                                    const int num_threads) {
+  CHECK((shift >= 0).all()) << shift;
+  const BlockedGrid blocked_grid(grid);
+  const std::vector<Eigen::Array3i> result_block_indices =
+      ComputeResultBlockIndices(blocked_grid, half_resolution, shift);
+
+  std::vector<Block> result_blocks(result_block_indices.size());
+  const auto compute_blocks = [&](const size_t begin, const size_t end) {
+    Scratch scratch;
+    for (size_t i = begin; i != end; ++i) {
+      ComputeBlock(blocked_grid, result_block_indices[i], half_resolution,
+                   shift, &scratch, &result_blocks[i]);
+    }
+  };
+  const size_t num_workers = std::max<size_t>(
+      1, std::min<size_t>(num_threads, result_block_indices.size()));
+  if (num_workers == 1) {
+    compute_blocks(0, result_block_indices.size());
+  } else {
+    std::vector<std::thread> workers;
+    workers.reserve(num_workers);
+    for (size_t i = 0; i != num_workers; ++i) {
+      workers.emplace_back(compute_blocks,
+                           i * result_block_indices.size() / num_workers,
+                           (i + 1) * result_block_indices.size() / num_workers);
+    }
+    for (std::thread& worker : workers) {
+      worker.join();
+    }
+  }
+
+  // Only the calling thread modifies 'result', since allocating new blocks in
+  // a HybridGridBase is not thread-safe.
   PrecomputationGrid3D result(grid.resolution());
-  for (auto it = PrecomputationGrid3D::Iterator(grid); !it.Done(); it.Next()) {
-    for (int i = 0; i != 8; ++i) {
-      // We use this value to update 8 values in the resulting grid, at
-      // position (x - {0, 'shift'}, y - {0, 'shift'}, z - {0, 'shift'}).
-      // If 'shift' is 2 ** (depth - 1), where depth 0 is the original grid,
-      // this results in precomputation grids analogous to the 2D case.
-      const Eigen::Array3i cell_index =
-          it.GetCellIndex() - shift * PrecomputationGrid3D::GetOctant(i);
-      auto* const cell_value = result.mutable_value(
-          half_resolution ? CellIndexAtHalfResolution(cell_index) : cell_index);
-      *cell_value = std::max(it.GetValue(), *cell_value);
+  for (size_t i = 0; i != result_block_indices.size(); ++i) {
+    const Eigen::Array3i block_origin = result_block_indices[i] * kBlockSize;
+    const Block& block = result_blocks[i];
+    for (int j = 0; j != kBlockVolume; ++j) {
+      if (block[j] != 0) {
+        *result.mutable_value(block_origin + To3DIndex(j, kBlockBits)) =
+            block[j];
+      }
     }
   }
   return result;
 }
 
+PrecomputationGridStack3D::PrecomputationGridStack3D(
+    const HybridGrid& hybrid_grid,
+    const proto::FastCorrelativeScanMatcherOptions3D& options)
+    : full_resolution_depth_(options.full_resolution_depth()) {
+  CHECK_GE(options.branch_and_bound_depth(), 1);
+  CHECK_GE(options.full_resolution_depth(), 1);
+  precomputation_grids_.reserve(options.branch_and_bound_depth());
+  precomputation_grids_.push_back(ConvertToPrecomputationGrid(hybrid_grid));
+  Eigen::Array3i last_width = Eigen::Array3i::Ones();
+  for (int depth = 1; depth != options.branch_and_bound_depth(); ++depth) {
+    const bool half_resolution = depth >= options.full_resolution_depth();
+    const Eigen::Array3i next_width = ((1 << depth) * Eigen::Array3i::Ones());
+    const int full_voxels_per_high_resolution_voxel =
+        1 << std::max(0, depth - options.full_resolution_depth());
+    const Eigen::Array3i shift = (next_width - last_width +
+                                  (full_voxels_per_high_resolution_voxel - 1)) /
+                                 full_voxels_per_high_resolution_voxel;
+    precomputation_grids_.push_back(
+        PrecomputeGrid(precomputation_grids_.back(), half_resolution, shift,
+                       options.num_precomputation_threads()));
+    last_width = next_width;
+  }
+}
+
+PrecomputationGridStack3D::PrecomputationGridStack3D(
+    const mapping::proto::PrecomputationGridStack3D& proto)
+    : full_resolution_depth_(proto.full_resolution_depth()) {
+  CHECK_GE(proto.precomputation_grids_size(), 1);
+  precomputation_grids_.reserve(proto.precomputation_grids_size());
+  for (const auto& precomputation_grid : proto.precomputation_grids()) {
+    precomputation_grids_.emplace_back(precomputation_grid);
+  }
+}
+
+mapping::proto::PrecomputationGridStack3D PrecomputationGridStack3D::ToProto()
+    const {
+  mapping::proto::PrecomputationGridStack3D result;
+  result.set_full_resolution_depth(full_resolution_depth_);
+  for (const PrecomputationGrid3D& precomputation_grid :
+       precomputation_grids_) {
+    *result.add_precomputation_grids() = precomputation_grid.ToProto();
+  }
+  return result;
+}
+
 }  // namespace scan_matching
 }  // namespace mapping
 }  // namespace cartographer
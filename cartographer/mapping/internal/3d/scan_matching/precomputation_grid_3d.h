@@ -17,7 +17,11 @@
 #ifndef CARTOGRAPHER_MAPPING_INTERNAL_3D_SCAN_MATCHING_PRECOMPUTATION_GRID_3D_H_
 #define CARTOGRAPHER_MAPPING_INTERNAL_3D_SCAN_MATCHING_PRECOMPUTATION_GRID_3D_H_
 
+#include <vector>
+
 #include "cartographer/mapping/3d/hybrid_grid.h"
+#include "cartographer/mapping/proto/hybrid_grid.pb.h"
+#include "cartographer/mapping/proto/scan_matching/fast_correlative_scan_matcher_options_3d.pb.h"
 
 namespace cartographer {
 namespace mapping {
@@ -28,11 +32,16 @@ class PrecomputationGrid3D : public HybridGridBase<uint8> {
   explicit PrecomputationGrid3D(const float resolution)
       : HybridGridBase<uint8>(resolution) {}
 
+  explicit PrecomputationGrid3D(
+      const mapping::proto::PrecomputationGrid3D& proto);
+
   // Maps values from [0, 255] to [kMinProbability, kMaxProbability].
   static float ToProbability(float value) {
     return kMinProbability +
            value * ((kMaxProbability - kMinProbability) / 255.f);
   }
+
+  mapping::proto::PrecomputationGrid3D ToProto() const;
 };
 
 // Converts a HybridGrid to a PrecomputationGrid3D representing the same data,
@@ -45,9 +54,43 @@ PrecomputationGrid3D ConvertToPrecomputationGrid(const HybridGrid& hybrid_grid);
 // If 'shift' is 2 ** (depth - 1), where depth 0 is the original grid, and this
 // is using the precomputed grid of one depth before, this results in
 // precomputation grids analogous to the 2D case.
+//
+// The computation is done per 8x8x8 block of the result using separable max
+// filters over contiguous rows, and blocks are distributed over 'num_threads'
+// threads.
 PrecomputationGrid3D PrecomputeGrid(const PrecomputationGrid3D& grid,
                                     bool half_resolution,
-                                    const Eigen::Array3i& shift);
+                                    const Eigen::Array3i& shift,
+                                    int num_threads);
+
+class PrecomputationGridStack3D {
+ public:
+  PrecomputationGridStack3D(
+      const HybridGrid& hybrid_grid,
+      const proto::FastCorrelativeScanMatcherOptions3D& options);
+
+  explicit PrecomputationGridStack3D(
+      const mapping::proto::PrecomputationGridStack3D& proto);
+
+  const PrecomputationGrid3D& Get(int depth) const {
+    return precomputation_grids_.at(depth);
+  }
+
+  int max_depth() const { return precomputation_grids_.size() - 1; }
+
+  // Returns true if this stack is the one computed for 'options'.
+  bool IsCompatible(
+      const proto::FastCorrelativeScanMatcherOptions3D& options) const {
+    return max_depth() + 1 == options.branch_and_bound_depth() &&
+           full_resolution_depth_ == options.full_resolution_depth();
+  }
+
+  mapping::proto::PrecomputationGridStack3D ToProto() const;
+
+ private:
+  int full_resolution_depth_;
+  std::vector<PrecomputationGrid3D> precomputation_grids_;
+};
 
 }  // namespace scan_matching
 }  // namespace mapping
@@ -28,6 +28,38 @@ namespace mapping {
 namespace scan_matching {
 namespace {
 
+HybridGrid CreateRandomHybridGrid(const int seed) {
+  HybridGrid hybrid_grid(2.f);
+  std::mt19937 rng(seed);
+  std::uniform_int_distribution<int> coordinate_distribution(-50, 49);
+  std::uniform_real_distribution<float> value_distribution(kMinProbability,
+                                                           kMaxProbability);
+  for (int i = 0; i < 1000; ++i) {
+    const auto x = coordinate_distribution(rng);
+    const auto y = coordinate_distribution(rng);
+    const auto z = coordinate_distribution(rng);
+    hybrid_grid.SetProbability(Eigen::Array3i(x, y, z),
+                               value_distribution(rng));
+  }
+  return hybrid_grid;
+}
+
+void ExpectEqual(const PrecomputationGrid3D& expected,
+                 const PrecomputationGrid3D& actual) {
+  EXPECT_EQ(expected.resolution(), actual.resolution());
+  int num_cells = 0;
+  for (auto it = PrecomputationGrid3D::Iterator(expected); !it.Done();
+       it.Next()) {
+    EXPECT_EQ(it.GetValue(), actual.value(it.GetCellIndex()));
+    ++num_cells;
+  }
+  for (auto it = PrecomputationGrid3D::Iterator(actual); !it.Done();
+       it.Next()) {
+    --num_cells;
+  }
+  EXPECT_EQ(num_cells, 0);
+}
+
 TEST(PrecomputedGridGenerator3DTest, TestAgainstNaiveAlgorithm) {
   HybridGrid hybrid_grid(2.f);
 
@@ -50,7 +82,8 @@ TEST(PrecomputedGridGenerator3DTest, TestAgainstNaiveAlgorithm) {
     } else {
       precomputed_grids.push_back(
           PrecomputeGrid(precomputed_grids.back(), false,
-                         (1 << (depth - 1)) * Eigen::Array3i::Ones()));
+                         (1 << (depth - 1)) * Eigen::Array3i::Ones(),
+                         1 /* num_threads */));
     }
     const int width = 1 << depth;
     for (int i = 0; i < 100; ++i) {
@@ -76,6 +109,49 @@ TEST(PrecomputedGridGenerator3DTest, TestAgainstNaiveAlgorithm) {
   }
 }
 
+TEST(PrecomputedGridGenerator3DTest, TestHalfResolutionAgainstNaiveAlgorithm) {
+  const PrecomputationGrid3D grid =
+      ConvertToPrecomputationGrid(CreateRandomHybridGrid(4711));
+  const Eigen::Array3i shift(3, 1, 2);
+  PrecomputationGrid3D expected(grid.resolution());
+  for (auto it = PrecomputationGrid3D::Iterator(grid); !it.Done(); it.Next()) {
+    for (int i = 0; i != 8; ++i) {
+      const Eigen::Array3i cell_index =
+          it.GetCellIndex() - shift * PrecomputationGrid3D::GetOctant(i);
+      const Eigen::Array3i half_resolution_cell_index(
+          cell_index.x() >> 1, cell_index.y() >> 1, cell_index.z() >> 1);
+      auto* const cell_value =
+          expected.mutable_value(half_resolution_cell_index);
+      *cell_value = std::max(it.GetValue(), *cell_value);
+    }
+  }
+  ExpectEqual(expected, PrecomputeGrid(grid, true, shift, 1 /* num_threads */));
+}
+
+TEST(PrecomputedGridGenerator3DTest, MultiThreadedMatchesSingleThreaded) {
+  const PrecomputationGrid3D grid =
+      ConvertToPrecomputationGrid(CreateRandomHybridGrid(1234));
+  for (const bool half_resolution : {false, true}) {
+    const Eigen::Array3i shift = 2 * Eigen::Array3i::Ones();
+    ExpectEqual(PrecomputeGrid(grid, half_resolution, shift, 1),
+                PrecomputeGrid(grid, half_resolution, shift, 4));
+  }
+}
+
+TEST(PrecomputationGridStack3DTest, ToProtoAndBack) {
+  proto::FastCorrelativeScanMatcherOptions3D options;
+  options.set_branch_and_bound_depth(5);
+  options.set_full_resolution_depth(3);
+  options.set_num_precomputation_threads(2);
+  const PrecomputationGridStack3D stack(CreateRandomHybridGrid(42), options);
+  const PrecomputationGridStack3D restored(stack.ToProto());
+  ASSERT_EQ(stack.max_depth(), restored.max_depth());
+  EXPECT_TRUE(restored.IsCompatible(options));
+  for (int depth = 0; depth <= stack.max_depth(); ++depth) {
+    ExpectEqual(stack.Get(depth), restored.Get(depth));
+  }
+}
+
 }  // namespace
 }  // namespace scan_matching
 }  // namespace mapping
@@ -16,7 +16,11 @@
 
 #include "cartographer/mapping/internal/3d/scan_matching/rotational_scan_matcher.h"
 
-#include <map>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <numeric>
 #include <vector>
 
 #include "cartographer/common/math.h"
@@ -49,86 +53,121 @@ void AddValueToHistogram(float angle, const float value,
   (*histogram)(bucket) += value;
 }
 
-Eigen::Vector3f ComputeCentroid(const sensor::PointCloud& slice) {
-  CHECK(!slice.empty());
-  Eigen::Vector3f sum = Eigen::Vector3f::Zero();
-  for (const sensor::RangefinderPoint& point : slice) {
-    sum += point.position;
+// Maps 'value' to an unsigned integer with the same ordering.
+uint32 ToOrderedBits(const int32 value) {
+  return static_cast<uint32>(value) ^ 0x80000000u;
+}
+
+// Maps 'value' to an unsigned integer with the same ordering as floats.
+uint32 ToOrderedBits(const float value) {
+  uint32 bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  return (bits & 0x80000000u) ? ~bits : (bits | 0x80000000u);
+}
+
+// Stable LSD radix sort of 'indices' by 'keys[index]', one byte at a time.
+// Bytes that are identical for all keys are skipped, so small keys only cost
+// a few linear passes.
+void RadixSortIndices(const std::vector<uint64>& keys,
+                      std::vector<int>* const indices) {
+  std::vector<int> buffer(indices->size());
+  for (int shift = 0; shift < 64; shift += 8) {
+    std::array<size_t, 257> offsets{};
+    for (const int index : *indices) {
+      ++offsets[((keys[index] >> shift) & 0xff) + 1];
+    }
+    if (std::find(offsets.begin(), offsets.end(), indices->size()) !=
+        offsets.end()) {
+      continue;
+    }
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+    for (const int index : *indices) {
+      buffer[offsets[(keys[index] >> shift) & 0xff]++] = index;
+    }
+    indices->swap(buffer);
   }
-  return sum / static_cast<float>(slice.size());
 }
 
-void AddPointCloudSliceToHistogram(const sensor::PointCloud& slice,
+// Scratch space for the deltas and directions of one slice, stored as
+// separate arrays so that the scoring loop can be vectorized.
+struct SliceScratch {
+  void Clear() {
+    delta_x.clear();
+    delta_y.clear();
+    direction_x.clear();
+    direction_y.clear();
+  }
+
+  std::vector<float> delta_x;
+  std::vector<float> delta_y;
+  std::vector<float> direction_x;
+  std::vector<float> direction_y;
+  std::vector<float> values;
+};
+
+// Adds the points 'indices' of 'point_cloud', which form one slice sorted by
+// angle around its centroid, to the 'histogram'.
+void AddPointCloudSliceToHistogram(const sensor::PointCloud& point_cloud,
+                                   const int* const indices,
+                                   const int num_indices,
+                                   SliceScratch* const scratch,
                                    Eigen::VectorXf* const histogram) {
-  if (slice.empty()) {
+  if (num_indices == 0) {
     return;
   }
   // We compute the angle of the ray from a point to the centroid of the whole
   // point cloud. If it is orthogonal to the angle we compute between points, we
   // will add the angle between points to the histogram with the maximum weight.
   // This is to reject, e.g., the angles observed on the ceiling and floor.
-  const Eigen::Vector3f centroid = ComputeCentroid(slice);
-  Eigen::Vector3f last_point_position = slice.points().front().position;
-  for (const sensor::RangefinderPoint& point : slice) {
-    const Eigen::Vector2f delta =
-        (point.position - last_point_position).head<2>();
-    const Eigen::Vector2f direction = (point.position - centroid).head<2>();
+  Eigen::Vector3f sum = Eigen::Vector3f::Zero();
+  for (int i = 0; i != num_indices; ++i) {
+    sum += point_cloud[indices[i]].position;
+  }
+  const Eigen::Vector3f centroid = sum / static_cast<float>(num_indices);
+
+  // Selecting the contributing pairs depends on the previous selections, so
+  // this pass is serial. It only records the vectors involved.
+  scratch->Clear();
+  Eigen::Vector3f last_point_position = point_cloud[indices[0]].position;
+  for (int i = 0; i != num_indices; ++i) {
+    const Eigen::Vector3f& position = point_cloud[indices[i]].position;
+    const Eigen::Vector2f delta = (position - last_point_position).head<2>();
+    const Eigen::Vector2f direction = (position - centroid).head<2>();
     const float distance = delta.norm();
     if (distance < kMinDistance || direction.norm() < kMinDistance) {
       continue;
     }
     if (distance > kMaxDistance) {
-      last_point_position = point.position;
+      last_point_position = position;
       continue;
     }
-    const float angle = common::atan2(delta);
-    const float value = std::max(
-        0.f, 1.f - std::abs(delta.normalized().dot(direction.normalized())));
-    AddValueToHistogram(angle, value, histogram);
+    scratch->delta_x.push_back(delta.x());
+    scratch->delta_y.push_back(delta.y());
+    scratch->direction_x.push_back(direction.x());
+    scratch->direction_y.push_back(direction.y());
   }
-}
-
-// A function to sort the points in each slice by angle around the centroid.
-// This is because the returns from different rangefinders are interleaved in
-// the data.
-sensor::PointCloud SortSlice(const sensor::PointCloud& slice) {
-  struct SortableAnglePointPair {
-    bool operator<(const SortableAnglePointPair& rhs) const {
-      return angle < rhs.angle;
-    }
 
-    float angle;
-    sensor::RangefinderPoint point;
-  };
-  const Eigen::Vector3f centroid = ComputeCentroid(slice);
-  std::vector<SortableAnglePointPair> by_angle;
-  by_angle.reserve(slice.size());
-  for (const sensor::RangefinderPoint& point : slice) {
-    const Eigen::Vector2f delta = (point.position - centroid).head<2>();
-    if (delta.norm() < kMinDistance) {
-      continue;
-    }
-    by_angle.push_back(SortableAnglePointPair{common::atan2(delta), point});
+  const size_t num_pairs = scratch->delta_x.size();
+  scratch->values.resize(num_pairs);
+  const float* const delta_x = scratch->delta_x.data();
+  const float* const delta_y = scratch->delta_y.data();
+  const float* const direction_x = scratch->direction_x.data();
+  const float* const direction_y = scratch->direction_y.data();
+  float* const values = scratch->values.data();
+  for (size_t i = 0; i < num_pairs; ++i) {
+    const float delta_norm =
+        std::sqrt(delta_x[i] * delta_x[i] + delta_y[i] * delta_y[i]);
+    const float direction_norm = std::sqrt(direction_x[i] * direction_x[i] +
+                                           direction_y[i] * direction_y[i]);
+    const float cosine =
+        (delta_x[i] / delta_norm) * (direction_x[i] / direction_norm) +
+        (delta_y[i] / delta_norm) * (direction_y[i] / direction_norm);
+    values[i] = std::max(0.f, 1.f - std::abs(cosine));
   }
-  std::sort(by_angle.begin(), by_angle.end());
-  sensor::PointCloud result;
-  for (const auto& pair : by_angle) {
-    result.push_back(pair.point);
+  for (size_t i = 0; i < num_pairs; ++i) {
+    AddValueToHistogram(std::atan2(delta_y[i], delta_x[i]), values[i],
+                        histogram);
   }
-  return result;
-}
-
-float MatchHistograms(const Eigen::VectorXf& submap_histogram,
-                      const Eigen::VectorXf& scan_histogram) {
-  // We compute the dot product of normalized histograms as a measure of
-  // similarity.
-  const float scan_histogram_norm = scan_histogram.norm();
-  const float submap_histogram_norm = submap_histogram.norm();
-  const float normalization = scan_histogram_norm * submap_histogram_norm;
-  if (normalization < 1e-3f) {
-    return 1.f;
-  }
-  return submap_histogram.dot(scan_histogram) / normalization;
 }
 
 }  // namespace
@@ -164,26 +203,129 @@ Eigen::VectorXf RotationalScanMatcher::RotateHistogram(
 Eigen::VectorXf RotationalScanMatcher::ComputeHistogram(
     const sensor::PointCloud& point_cloud, const int histogram_size) {
   Eigen::VectorXf histogram = Eigen::VectorXf::Zero(histogram_size);
-  std::map<int, sensor::PointCloud> slices;
-  for (const sensor::RangefinderPoint& point : point_cloud) {
-    slices[common::RoundToInt(point.position.z() / kSliceHeight)].push_back(
-        point);
+  const int num_points = point_cloud.size();
+  if (num_points == 0) {
+    return histogram;
+  }
+  // Group the points into horizontal slices. The sort is stable, so points
+  // keep their original order within each slice.
+  std::vector<uint64> slice_keys(num_points);
+  std::vector<int> by_slice(num_points);
+  for (int i = 0; i != num_points; ++i) {
+    slice_keys[i] = ToOrderedBits(static_cast<int32>(
+        common::RoundToInt(point_cloud[i].position.z() / kSliceHeight)));
+    by_slice[i] = i;
+  }
+  RadixSortIndices(slice_keys, &by_slice);
+
+  // Within each slice, drop the points close to the slice centroid and order
+  // the others by their angle around it. This is because the returns from
+  // different rangefinders are interleaved in the data. The slice number in
+  // the upper half of the key keeps the slices apart.
+  std::vector<uint64> angle_keys(num_points);
+  std::vector<int> by_angle;
+  by_angle.reserve(num_points);
+  uint64 slice_number = 0;
+  for (int begin = 0; begin != num_points; ++slice_number) {
+    int end = begin + 1;
+    while (end != num_points &&
+           slice_keys[by_slice[end]] == slice_keys[by_slice[begin]]) {
+      ++end;
+    }
+    Eigen::Vector3f sum = Eigen::Vector3f::Zero();
+    for (int i = begin; i != end; ++i) {
+      sum += point_cloud[by_slice[i]].position;
+    }
+    const Eigen::Vector3f centroid = sum / static_cast<float>(end - begin);
+    for (int i = begin; i != end; ++i) {
+      const int index = by_slice[i];
+      const Eigen::Vector2f delta =
+          (point_cloud[index].position - centroid).head<2>();
+      if (delta.norm() < kMinDistance) {
+        continue;
+      }
+      angle_keys[index] =
+          (slice_number << 32) | ToOrderedBits(common::atan2(delta));
+      by_angle.push_back(index);
+    }
+    begin = end;
   }
-  for (const auto& slice : slices) {
-    AddPointCloudSliceToHistogram(SortSlice(slice.second), &histogram);
+  RadixSortIndices(angle_keys, &by_angle);
+
+  SliceScratch scratch;
+  const int num_sorted = by_angle.size();
+  for (int begin = 0; begin != num_sorted;) {
+    int end = begin + 1;
+    while (end != num_sorted && (angle_keys[by_angle[end]] >> 32) ==
+                                    (angle_keys[by_angle[begin]] >> 32)) {
+      ++end;
+    }
+    AddPointCloudSliceToHistogram(point_cloud, by_angle.data() + begin,
+                                  end - begin, &scratch, &histogram);
+    begin = end;
   }
   return histogram;
 }
 
+// Rotating the scan histogram 'h' by 'k' + 'f' buckets yields
+// (1 - f) * h[i + k] + f * h[i + k + 1], so its dot product with the submap
+// histogram 's' is a linear interpolation of the circular cross-correlation
+// C[k] = sum_i s[i] * h[i + k]. Its squared norm only depends on 'f', |h|^2
+// and the lag one autocorrelation of 'h'. This scores all 'angles' without
+// materializing rotated histograms, and each lag of C is computed at most
+// once.
 std::vector<float> RotationalScanMatcher::Match(
     const Eigen::VectorXf& histogram, const float initial_angle,
     const std::vector<float>& angles) const {
+  const int size = histogram.size();
+  CHECK_EQ(size, histogram_->size());
+  if (size == 0) {
+    return std::vector<float>(angles.size(), 1.f);
+  }
+  // Two copies of 'histogram' back to back so that every lag of the circular
+  // cross-correlation is a contiguous dot product.
+  Eigen::VectorXf doubled_histogram(2 * size);
+  doubled_histogram << histogram, histogram;
+  const float squared_norm = histogram.squaredNorm();
+  const float lag_one_autocorrelation =
+      histogram.dot(doubled_histogram.segment(1, size));
+  const float submap_histogram_norm = histogram_->norm();
+
+  std::vector<float> cross_correlation(size);
+  std::vector<bool> computed(size, false);
+  const auto get_cross_correlation = [&](const int lag) {
+    if (!computed[lag]) {
+      cross_correlation[lag] =
+          histogram_->dot(doubled_histogram.segment(lag, size));
+      computed[lag] = true;
+    }
+    return cross_correlation[lag];
+  };
+
   std::vector<float> result;
   result.reserve(angles.size());
   for (const float angle : angles) {
-    const Eigen::VectorXf scan_histogram =
-        RotateHistogram(histogram, initial_angle + angle);
-    result.push_back(MatchHistograms(*histogram_, scan_histogram));
+    // Same bucket arithmetic as in RotateHistogram().
+    const float rotate_by_buckets = -(initial_angle + angle) * size / M_PI;
+    const int full_buckets = common::RoundToInt(rotate_by_buckets - 0.5f);
+    const float fraction = rotate_by_buckets - full_buckets;
+    const int lag = ((full_buckets % size) + size) % size;
+    const int next_lag = lag + 1 == size ? 0 : lag + 1;
+    const float dot = (1.f - fraction) * get_cross_correlation(lag) +
+                      fraction * get_cross_correlation(next_lag);
+    const float rotated_squared_norm =
+        ((1.f - fraction) * (1.f - fraction) + fraction * fraction) *
+            squared_norm +
+        2.f * fraction * (1.f - fraction) * lag_one_autocorrelation;
+    // We compute the dot product of normalized histograms as a measure of
+    // similarity.
+    const float normalization =
+        std::sqrt(std::max(0.f, rotated_squared_norm)) * submap_histogram_norm;
+    if (normalization < 1e-3f) {
+      result.push_back(1.f);
+      continue;
+    }
+    result.push_back(dot / normalization);
   }
   return result;
 }
@@ -17,6 +17,8 @@
 #include "cartographer/mapping/internal/3d/scan_matching/rotational_scan_matcher.h"
 
 #include <cmath>
+#include <random>
+#include <vector>
 
 #include "gtest/gtest.h"
 
@@ -66,6 +68,38 @@ TEST(RotationalScanMatcher3DTest, InterpolatesAsExpected) {
   }
 }
 
+TEST(RotationalScanMatcher3DTest, MatchesRotatedHistograms) {
+  std::mt19937 prng(42);
+  std::uniform_real_distribution<float> value_distribution(0.f, 10.f);
+  std::uniform_real_distribution<float> angle_distribution(-2.f * M_PI,
+                                                           2.f * M_PI);
+  constexpr int kNumBuckets = 120;
+  Eigen::VectorXf submap_histogram(kNumBuckets);
+  Eigen::VectorXf scan_histogram(kNumBuckets);
+  for (int i = 0; i != kNumBuckets; ++i) {
+    submap_histogram[i] = value_distribution(prng);
+    scan_histogram[i] = value_distribution(prng);
+  }
+  const float initial_angle = angle_distribution(prng);
+  std::vector<float> angles;
+  for (int i = 0; i != 100; ++i) {
+    angles.push_back(angle_distribution(prng));
+  }
+  RotationalScanMatcher matcher(&submap_histogram);
+  const std::vector<float> scores =
+      matcher.Match(scan_histogram, initial_angle, angles);
+  ASSERT_EQ(angles.size(), scores.size());
+  for (size_t i = 0; i != angles.size(); ++i) {
+    const Eigen::VectorXf rotated_histogram =
+        RotationalScanMatcher::RotateHistogram(scan_histogram,
+                                               initial_angle + angles[i]);
+    const float expected_score =
+        submap_histogram.dot(rotated_histogram) /
+        (submap_histogram.norm() * rotated_histogram.norm());
+    EXPECT_NEAR(expected_score, scores[i], 1e-5);
+  }
+}
+
 }  // namespace
 }  // namespace scan_matching
 }  // namespace mapping
@@ -57,6 +57,12 @@ class CollatedTrajectoryBuilder : public TrajectoryBuilderInterface {
     AddData(sensor::MakeDispatchable(sensor_id, timed_point_cloud_data));
   }
 
+  void AddSensorData(const std::string& sensor_id,
+                     const sensor::OrganizedPointCloudData&
+                         organized_point_cloud_data) override {
+    AddData(sensor::MakeDispatchable(sensor_id, organized_point_cloud_data));
+  }
+
   void AddSensorData(const std::string& sensor_id,
                      const sensor::ImuData& imu_data) override {
     AddData(sensor::MakeDispatchable(sensor_id, imu_data));
@@ -0,0 +1,193 @@
+/*
+ * Copyright 2018 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/internal/constraints/adaptive_constraint_sampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+
+namespace cartographer {
+namespace mapping {
+namespace constraints {
+namespace {
+
+// The CPU budget saved up while no matches are made is limited to this many
+// seconds worth of it.
+constexpr double kMaxCpuBudgetDurationSeconds = 1.;
+
+}  // namespace
+
+AdaptiveConstraintSampler::AdaptiveConstraintSampler(
+    const proto::ConstraintBuilderOptions& options)
+    : options_(options),
+      cpu_budget_seconds_(options.adaptive_sampling_options().cpu_budget() *
+                          kMaxCpuBudgetDurationSeconds) {}
+
+bool AdaptiveConstraintSampler::ShouldMatch(
+    const SubmapId& submap_id, const NodeId& node_id,
+    const common::Time node_time, const transform::Rigid3d& node_local_pose,
+    const double distance, const std::chrono::steady_clock::time_point now) {
+  absl::MutexLock locker(&mutex_);
+  TrajectoryState& trajectory_state = trajectory_states_[node_id.trajectory_id];
+  auto& travel_distances = trajectory_state.travel_distances;
+  if (travel_distances.empty()) {
+    travel_distances.emplace(node_id.node_index, 0.);
+    trajectory_state.last_local_translation = node_local_pose.translation();
+  } else if (node_id.node_index > travel_distances.rbegin()->first) {
+    // Nodes are approximately connected by straight lines.
+    travel_distances.emplace(
+        node_id.node_index,
+        travel_distances.rbegin()->second +
+            (node_local_pose.translation() -
+             trajectory_state.last_local_translation)
+                .norm());
+    trajectory_state.last_local_translation = node_local_pose.translation();
+  }
+  SubmapState& submap_state = submap_states_[submap_id];
+  submap_state.accumulated_matches +=
+      options_.sampling_ratio() *
+      ComputeWeight(submap_state, trajectory_state, node_time,
+                    GetTravelDistance(trajectory_state, node_id.node_index),
+                    distance);
+  if (submap_state.accumulated_matches < 1.) {
+    return false;
+  }
+  UpdateCpuBudget(now);
+  if (options_.adaptive_sampling_options().cpu_budget() > 0. &&
+      cpu_budget_seconds_ <= 0.) {
+    // Matches as soon as there is budget again.
+    submap_state.accumulated_matches = 1.;
+    return false;
+  }
+  // Every candidate is matched at most once, so there is no point in
+  // accumulating more than the next match.
+  submap_state.accumulated_matches =
+      std::min(submap_state.accumulated_matches - 1., 1.);
+  return true;
+}
+
+void AdaptiveConstraintSampler::ReportMatch(const SubmapId& submap_id,
+                                            const NodeId& node_id,
+                                            const common::Time node_time,
+                                            const bool constraint_found,
+                                            const double cpu_seconds) {
+  absl::MutexLock locker(&mutex_);
+  const auto it = submap_states_.find(submap_id);
+  if (it != submap_states_.end()) {
+    ++it->second.num_matches;
+    if (constraint_found) {
+      ++it->second.num_constraints_found;
+    }
+  }
+  if (constraint_found) {
+    TrajectoryState& trajectory_state =
+        trajectory_states_[node_id.trajectory_id];
+    if (!trajectory_state.last_constraint_time.has_value() ||
+        trajectory_state.last_constraint_time.value() < node_time) {
+      trajectory_state.last_constraint_time = node_time;
+      trajectory_state.last_constraint_travel_distance =
+          GetTravelDistance(trajectory_state, node_id.node_index);
+    }
+  }
+  cpu_budget_seconds_ -= cpu_seconds;
+  ++statistics_.num_matches;
+  if (constraint_found) {
+    ++statistics_.num_constraints_found;
+  }
+  statistics_.cpu_seconds += cpu_seconds;
+}
+
+void AdaptiveConstraintSampler::DeleteSubmap(const SubmapId& submap_id) {
+  absl::MutexLock locker(&mutex_);
+  submap_states_.erase(submap_id);
+}
+
+AdaptiveConstraintSampler::Statistics AdaptiveConstraintSampler::GetStatistics()
+    const {
+  absl::MutexLock locker(&mutex_);
+  return statistics_;
+}
+
+double AdaptiveConstraintSampler::GetTravelDistance(
+    const TrajectoryState& trajectory_state, const int node_index) {
+  const auto& travel_distances = trajectory_state.travel_distances;
+  auto it = travel_distances.upper_bound(node_index);
+  if (it == travel_distances.begin()) {
+    return it == travel_distances.end() ? 0. : it->second;
+  }
+  return std::prev(it)->second;
+}
+
+double AdaptiveConstraintSampler::ComputeWeight(
+    const SubmapState& submap_state, const TrajectoryState& trajectory_state,
+    const common::Time node_time, const double node_travel_distance,
+    const double distance) const {
+  // The success rate is estimated with a uniform prior, so that it is 1/2 for
+  // new submaps and never drops to 0, which would exclude a submap for good.
+  const double success_rate = (submap_state.num_constraints_found + 1.) /
+                              (submap_state.num_matches + 2.);
+  const double closeness =
+      1. - 0.5 * std::min(distance / options_.max_constraint_distance(), 1.);
+  if (!trajectory_state.last_constraint_time.has_value()) {
+    return 2. * success_rate * closeness;
+  }
+  double staleness = 1.;
+  const double closure_staleness_seconds =
+      options_.adaptive_sampling_options().closure_staleness_seconds();
+  if (closure_staleness_seconds > 0.) {
+    const double seconds_since_last_constraint = std::max(
+        common::ToSeconds(node_time -
+                          trajectory_state.last_constraint_time.value()),
+        0.);
+    staleness = 1. - 0.5 * std::exp(-seconds_since_last_constraint /
+                                    closure_staleness_seconds);
+  }
+  // Nodes before the last constraint are just as uncertain relative to it.
+  double uncertainty = 1.;
+  const double closure_uncertainty_meters =
+      options_.adaptive_sampling_options().closure_uncertainty_meters();
+  if (closure_uncertainty_meters > 0.) {
+    const double meters_from_last_constraint = std::abs(
+        node_travel_distance -
+        trajectory_state.last_constraint_travel_distance);
+    uncertainty = 1. - 0.5 * std::exp(-meters_from_last_constraint /
+                                      closure_uncertainty_meters);
+  }
+  return 2. * success_rate * closeness * staleness * uncertainty;
+}
+
+void AdaptiveConstraintSampler::UpdateCpuBudget(
+    const std::chrono::steady_clock::time_point now) {
+  const double cpu_budget = options_.adaptive_sampling_options().cpu_budget();
+  if (cpu_budget <= 0.) {
+    return;
+  }
+  if (last_budget_update_ != std::chrono::steady_clock::time_point() &&
+      now > last_budget_update_) {
+    cpu_budget_seconds_ = std::min(
+        cpu_budget_seconds_ +
+            cpu_budget *
+                std::chrono::duration<double>(now - last_budget_update_)
+                    .count(),
+        cpu_budget * kMaxCpuBudgetDurationSeconds);
+  }
+  last_budget_update_ = std::max(last_budget_update_, now);
+}
+
+}  // namespace constraints
+}  // namespace mapping
+}  // namespace cartographer
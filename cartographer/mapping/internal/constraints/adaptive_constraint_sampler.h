@@ -0,0 +1,135 @@
+/*
+ * Copyright 2018 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_MAPPING_INTERNAL_CONSTRAINTS_ADAPTIVE_CONSTRAINT_SAMPLER_H_
+#define CARTOGRAPHER_MAPPING_INTERNAL_CONSTRAINTS_ADAPTIVE_CONSTRAINT_SAMPLER_H_
+
+#include <chrono>
+#include <map>
+
+#include "absl/synchronization/mutex.h"
+#include "absl/types/optional.h"
+#include "cartographer/common/port.h"
+#include "cartographer/common/time.h"
+#include "cartographer/mapping/id.h"
+#include "cartographer/mapping/proto/pose_graph/constraint_builder_options.pb.h"
+#include "cartographer/transform/rigid_transform.h"
+
+namespace cartographer {
+namespace mapping {
+namespace constraints {
+
+// Decides which nodes are matched against which submaps when searching for
+// local constraints. Instead of matching a fixed ratio of the candidates of
+// each submap, every candidate is weighted by the expected gain of matching
+// it, which is the product of:
+// - the rate at which matches against the submap found constraints so far,
+// - how close the node is expected to be to the submap,
+// - how long ago the last constraint for a node of its trajectory was found,
+//   since the drift to correct grows over time,
+// - how far local SLAM traveled between the node and the last constrained
+//   node of its trajectory, which stands in for the growth of the node's pose
+//   covariance relative to that node since odometry and scan matching errors
+//   accumulate with the distance traveled.
+// The weight is 1 for a node next to a new submap on a trajectory without
+// recent constraints. Each submap accumulates 'sampling_ratio' times the
+// weights of its candidates, and a match is made whenever a whole match has
+// accumulated and the CPU budget is not exhausted.
+//
+// This class is thread-safe.
+class AdaptiveConstraintSampler {
+ public:
+  struct Statistics {
+    int64 num_matches = 0;
+    int64 num_constraints_found = 0;
+    double cpu_seconds = 0.;
+  };
+
+  explicit AdaptiveConstraintSampler(
+      const proto::ConstraintBuilderOptions& options);
+
+  AdaptiveConstraintSampler(const AdaptiveConstraintSampler&) = delete;
+  AdaptiveConstraintSampler& operator=(const AdaptiveConstraintSampler&) =
+      delete;
+
+  // Returns true if 'node_id' at 'node_time' and 'node_local_pose' should be
+  // matched against 'submap_id', which is expected at 'distance' from it.
+  bool ShouldMatch(const SubmapId& submap_id, const NodeId& node_id,
+                   common::Time node_time,
+                   const transform::Rigid3d& node_local_pose, double distance,
+                   std::chrono::steady_clock::time_point now)
+      LOCKS_EXCLUDED(mutex_);
+
+  // Reports whether a match of 'node_id' at 'node_time' against 'submap_id'
+  // found a constraint, and the CPU time it took.
+  void ReportMatch(const SubmapId& submap_id, const NodeId& node_id,
+                   common::Time node_time, bool constraint_found,
+                   double cpu_seconds) LOCKS_EXCLUDED(mutex_);
+
+  // Forgets the match statistics of 'submap_id'.
+  void DeleteSubmap(const SubmapId& submap_id) LOCKS_EXCLUDED(mutex_);
+
+  // Returns the totals of all reported matches.
+  Statistics GetStatistics() const LOCKS_EXCLUDED(mutex_);
+
+ private:
+  struct SubmapState {
+    int num_matches = 0;
+    int num_constraints_found = 0;
+    // Matches accumulated from the weights of the candidates.
+    double accumulated_matches = 0.;
+  };
+
+  struct TrajectoryState {
+    // Distance traveled by local SLAM up to each node passed to ShouldMatch().
+    std::map<int, double> travel_distances;
+    // Local translation of the last node in 'travel_distances'.
+    Eigen::Vector3d last_local_translation;
+    // Time and travel distance of the latest node with a constraint.
+    absl::optional<common::Time> last_constraint_time;
+    double last_constraint_travel_distance = 0.;
+  };
+
+  // Returns the travel distance of 'node_index', or of the closest earlier
+  // node known if it was never passed to ShouldMatch().
+  static double GetTravelDistance(const TrajectoryState& trajectory_state,
+                                  int node_index);
+
+  double ComputeWeight(const SubmapState& submap_state,
+                       const TrajectoryState& trajectory_state,
+                       common::Time node_time, double node_travel_distance,
+                       double distance) const
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Adds the CPU time which became available since the last call.
+  void UpdateCpuBudget(std::chrono::steady_clock::time_point now)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  const proto::ConstraintBuilderOptions options_;
+  mutable absl::Mutex mutex_;
+  std::map<SubmapId, SubmapState> submap_states_ GUARDED_BY(mutex_);
+  std::map<int, TrajectoryState> trajectory_states_ GUARDED_BY(mutex_);
+  // Available CPU seconds, negative while the budget is overdrawn.
+  double cpu_budget_seconds_ GUARDED_BY(mutex_);
+  std::chrono::steady_clock::time_point last_budget_update_ GUARDED_BY(mutex_);
+  Statistics statistics_ GUARDED_BY(mutex_);
+};
+
+}  // namespace constraints
+}  // namespace mapping
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_MAPPING_INTERNAL_CONSTRAINTS_ADAPTIVE_CONSTRAINT_SAMPLER_H_
@@ -0,0 +1,155 @@
+/*
+ * Copyright 2018 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/internal/constraints/adaptive_constraint_sampler.h"
+
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace mapping {
+namespace constraints {
+namespace {
+
+constexpr int kTrajectoryId = 0;
+
+proto::ConstraintBuilderOptions CreateOptions(const double cpu_budget) {
+  proto::ConstraintBuilderOptions options;
+  options.set_sampling_ratio(0.5);
+  options.set_max_constraint_distance(10.);
+  auto* const adaptive_sampling_options =
+      options.mutable_adaptive_sampling_options();
+  adaptive_sampling_options->set_use_adaptive_sampling(true);
+  adaptive_sampling_options->set_closure_staleness_seconds(10.);
+  adaptive_sampling_options->set_closure_uncertainty_meters(1.);
+  adaptive_sampling_options->set_cpu_budget(cpu_budget);
+  return options;
+}
+
+common::Time CreateTime(const double seconds) {
+  return common::FromUniversal(0) + common::FromSeconds(seconds);
+}
+
+// Node 'node_index' is at 'node_index' meters from the first node.
+int CountMatches(const SubmapId& submap_id, const int num_candidates,
+                 const double distance, const common::Time node_time,
+                 const int node_index,
+                 AdaptiveConstraintSampler* const sampler) {
+  const auto now = std::chrono::steady_clock::now();
+  const transform::Rigid3d node_local_pose =
+      transform::Rigid3d::Translation(Eigen::Vector3d(node_index, 0., 0.));
+  int num_matches = 0;
+  for (int i = 0; i != num_candidates; ++i) {
+    if (sampler->ShouldMatch(submap_id, NodeId{kTrajectoryId, node_index},
+                             node_time, node_local_pose, distance, now)) {
+      ++num_matches;
+    }
+  }
+  return num_matches;
+}
+
+TEST(AdaptiveConstraintSamplerTest, MatchesSamplingRatioOfNewSubmaps) {
+  AdaptiveConstraintSampler sampler(CreateOptions(0.));
+  EXPECT_EQ(50, CountMatches(SubmapId{0, 0}, 100, 0., CreateTime(0.), 0,
+                             &sampler));
+  // Distant nodes are matched less often.
+  EXPECT_EQ(25, CountMatches(SubmapId{0, 1}, 100, 10., CreateTime(0.), 0,
+                             &sampler));
+}
+
+TEST(AdaptiveConstraintSamplerTest, PrefersSubmapsWithSuccessfulMatches) {
+  AdaptiveConstraintSampler sampler(CreateOptions(0.));
+  const SubmapId failing_submap_id{0, 0};
+  const SubmapId succeeding_submap_id{0, 1};
+  const NodeId node_id{kTrajectoryId, 0};
+  CountMatches(failing_submap_id, 1, 0., CreateTime(0.), 0, &sampler);
+  CountMatches(succeeding_submap_id, 1, 0., CreateTime(0.), 0, &sampler);
+  for (int i = 0; i != 8; ++i) {
+    sampler.ReportMatch(failing_submap_id, node_id, CreateTime(0.),
+                        false /* constraint_found */, 0.1);
+    sampler.ReportMatch(succeeding_submap_id, node_id, CreateTime(0.),
+                        true /* constraint_found */, 0.1);
+  }
+  // Long after and far from the last constraint, so that only the success
+  // rates differ.
+  const common::Time node_time = CreateTime(1000.);
+  const int num_failing_matches =
+      CountMatches(failing_submap_id, 100, 0., node_time, 100, &sampler);
+  const int num_succeeding_matches =
+      CountMatches(succeeding_submap_id, 100, 0., node_time, 100, &sampler);
+  EXPECT_NEAR(10, num_failing_matches, 1);
+  EXPECT_NEAR(90, num_succeeding_matches, 1);
+
+  // Right after a constraint was found, matching is less important.
+  EXPECT_NEAR(45, CountMatches(succeeding_submap_id, 100, 0., CreateTime(0.),
+                               100, &sampler),
+              1);
+  // Also close to the constrained node it is even less important.
+  EXPECT_NEAR(23, CountMatches(succeeding_submap_id, 100, 0., CreateTime(0.),
+                               0, &sampler),
+              1);
+
+  const AdaptiveConstraintSampler::Statistics statistics =
+      sampler.GetStatistics();
+  EXPECT_EQ(16, statistics.num_matches);
+  EXPECT_EQ(8, statistics.num_constraints_found);
+  EXPECT_NEAR(1.6, statistics.cpu_seconds, 1e-9);
+}
+
+TEST(AdaptiveConstraintSamplerTest, KeepsCpuBudget) {
+  AdaptiveConstraintSampler sampler(CreateOptions(2.));
+  const SubmapId submap_id{0, 0};
+  const NodeId node_id{kTrajectoryId, 0};
+  const auto now = std::chrono::steady_clock::now();
+  auto should_match = [&](const std::chrono::steady_clock::time_point time) {
+    // Every second candidate is matched, so this asks twice.
+    return sampler.ShouldMatch(submap_id, node_id, CreateTime(0.),
+                               transform::Rigid3d::Identity(), 0., time) ||
+           sampler.ShouldMatch(submap_id, node_id, CreateTime(0.),
+                               transform::Rigid3d::Identity(), 0., time);
+  };
+  EXPECT_TRUE(should_match(now));
+  sampler.ReportMatch(submap_id, node_id, CreateTime(0.), false, 5.);
+  EXPECT_FALSE(should_match(now));
+  EXPECT_FALSE(should_match(now + std::chrono::seconds(1)));
+  // The 3 CPU seconds overdrawn are available again after 1.5 seconds.
+  EXPECT_TRUE(should_match(now + std::chrono::seconds(2)));
+}
+
+TEST(AdaptiveConstraintSamplerTest, PrefersNodesFarAlongFromLastConstraint) {
+  AdaptiveConstraintSampler sampler(CreateOptions(0.));
+  const SubmapId submap_id{0, 0};
+  // Local SLAM travels 1 meter per node.
+  for (int node_index = 0; node_index != 10; ++node_index) {
+    CountMatches(submap_id, 1, 0., CreateTime(0.), node_index, &sampler);
+  }
+  sampler.ReportMatch(submap_id, NodeId{kTrajectoryId, 5}, CreateTime(0.),
+                      true /* constraint_found */, 0.1);
+  // At the same time, only the distance traveled differs.
+  const int num_close_matches =
+      CountMatches(SubmapId{0, 1}, 100, 0., CreateTime(0.), 5, &sampler);
+  const int num_far_matches =
+      CountMatches(SubmapId{0, 2}, 100, 0., CreateTime(0.), 9, &sampler);
+  const int num_earlier_far_matches =
+      CountMatches(SubmapId{0, 3}, 100, 0., CreateTime(0.), 1, &sampler);
+  EXPECT_NEAR(12, num_close_matches, 1);
+  EXPECT_NEAR(25, num_far_matches, 1);
+  EXPECT_EQ(num_far_matches, num_earlier_far_matches);
+}
+
+}  // namespace
+}  // namespace constraints
+}  // namespace mapping
+}  // namespace cartographer
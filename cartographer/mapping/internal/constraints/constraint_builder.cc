@@ -25,11 +25,30 @@
 namespace cartographer {
 namespace mapping {
 namespace constraints {
+namespace {
+
+proto::ConstraintBuilderOptions::AdaptiveSamplingOptions
+CreateAdaptiveSamplingOptions(
+    common::LuaParameterDictionary* const parameter_dictionary) {
+  proto::ConstraintBuilderOptions::AdaptiveSamplingOptions options;
+  options.set_use_adaptive_sampling(
+      parameter_dictionary->GetBool("use_adaptive_sampling"));
+  options.set_closure_staleness_seconds(
+      parameter_dictionary->GetDouble("closure_staleness_seconds"));
+  options.set_closure_uncertainty_meters(
+      parameter_dictionary->GetDouble("closure_uncertainty_meters"));
+  options.set_cpu_budget(parameter_dictionary->GetDouble("cpu_budget"));
+  return options;
+}
+
+}  // namespace
 
 proto::ConstraintBuilderOptions CreateConstraintBuilderOptions(
     common::LuaParameterDictionary* const parameter_dictionary) {
   proto::ConstraintBuilderOptions options;
   options.set_sampling_ratio(parameter_dictionary->GetDouble("sampling_ratio"));
+  *options.mutable_adaptive_sampling_options() = CreateAdaptiveSamplingOptions(
+      parameter_dictionary->GetDictionary("adaptive_sampling").get());
   options.set_max_constraint_distance(
       parameter_dictionary->GetDouble("max_constraint_distance"));
   options.set_min_score(parameter_dictionary->GetDouble("min_score"));
@@ -39,6 +58,8 @@ proto::ConstraintBuilderOptions CreateConstraintBuilderOptions(
       parameter_dictionary->GetDouble("loop_closure_translation_weight"));
   options.set_loop_closure_rotation_weight(
       parameter_dictionary->GetDouble("loop_closure_rotation_weight"));
+  options.set_share_rotated_scans_in_2d(
+      parameter_dictionary->GetBool("share_rotated_scans_in_2d"));
   options.set_log_matches(parameter_dictionary->GetBool("log_matches"));
   *options.mutable_fast_correlative_scan_matcher_options() =
       scan_matching::CreateFastCorrelativeScanMatcherOptions2D(
@@ -16,6 +16,7 @@
 
 #include "cartographer/mapping/internal/constraints/constraint_builder_2d.h"
 
+#include <chrono>
 #include <cmath>
 #include <functional>
 #include <iomanip>
@@ -51,6 +52,8 @@ static auto* kQueueLengthMetric = metrics::Gauge::Null();
 static auto* kConstraintScoresMetric = metrics::Histogram::Null();
 static auto* kGlobalConstraintScoresMetric = metrics::Histogram::Null();
 static auto* kNumSubmapScanMatchersMetric = metrics::Gauge::Null();
+static auto* kMatchAcceptanceRateMetric = metrics::Gauge::Null();
+static auto* kCpuSecondsPerConstraintMetric = metrics::Gauge::Null();
 
 transform::Rigid2d ComputeSubmapPose(const Submap2D& submap) {
   return transform::Project2D(submap.local_pose());
@@ -63,6 +66,7 @@ ConstraintBuilder2D::ConstraintBuilder2D(
       thread_pool_(thread_pool),
       finish_node_task_(absl::make_unique<common::Task>()),
       when_done_task_(absl::make_unique<common::Task>()),
+      adaptive_sampler_(options),
       ceres_scan_matcher_(options.ceres_scan_matcher_options()) {}
 
 ConstraintBuilder2D::~ConstraintBuilder2D() {
@@ -78,14 +82,21 @@ void ConstraintBuilder2D::MaybeAddConstraint(
     const SubmapId& submap_id, const Submap2D* const submap,
     const NodeId& node_id, const TrajectoryNode::Data* const constant_data,
     const transform::Rigid2d& initial_relative_pose) {
-  if (initial_relative_pose.translation().norm() >
-      options_.max_constraint_distance()) {
+  const double distance = initial_relative_pose.translation().norm();
+  if (distance > options_.max_constraint_distance()) {
     return;
   }
-  if (!per_submap_sampler_
-           .emplace(std::piecewise_construct, std::forward_as_tuple(submap_id),
-                    std::forward_as_tuple(options_.sampling_ratio()))
-           .first->second.Pulse()) {
+  if (options_.adaptive_sampling_options().use_adaptive_sampling()) {
+    if (!adaptive_sampler_.ShouldMatch(
+            submap_id, node_id, constant_data->time, constant_data->local_pose,
+            distance, std::chrono::steady_clock::now())) {
+      return;
+    }
+  } else if (!per_submap_sampler_
+                  .emplace(std::piecewise_construct,
+                           std::forward_as_tuple(submap_id),
+                           std::forward_as_tuple(options_.sampling_ratio()))
+                  .first->second.Pulse()) {
     return;
   }
 
@@ -99,11 +110,17 @@ void ConstraintBuilder2D::MaybeAddConstraint(
   auto* const constraint = &constraints_.back();
   const auto* scan_matcher =
       DispatchScanMatcherConstruction(submap_id, submap->grid());
+  const auto rotated_scans = GetRotatedScans(
+      node_id, constant_data, submap->grid()->limits().resolution());
   auto constraint_task = absl::make_unique<common::Task>();
   constraint_task->SetWorkItem([=]() LOCKS_EXCLUDED(mutex_) {
+    const double start_cpu_seconds = common::GetThreadCpuTimeSeconds();
     ComputeConstraint(submap_id, submap, node_id, false, /* match_full_submap */
                       constant_data, initial_relative_pose, *scan_matcher,
-                      constraint);
+                      rotated_scans.get(), constraint);
+    ReportLocalMatch(submap_id, node_id, constant_data->time,
+                     *constraint != nullptr,
+                     common::GetThreadCpuTimeSeconds() - start_cpu_seconds);
   });
   constraint_task->AddDependency(scan_matcher->creation_task_handle);
   auto constraint_task_handle =
@@ -124,11 +141,13 @@ void ConstraintBuilder2D::MaybeAddGlobalConstraint(
   auto* const constraint = &constraints_.back();
   const auto* scan_matcher =
       DispatchScanMatcherConstruction(submap_id, submap->grid());
+  const auto rotated_scans = GetRotatedScans(
+      node_id, constant_data, submap->grid()->limits().resolution());
   auto constraint_task = absl::make_unique<common::Task>();
   constraint_task->SetWorkItem([=]() LOCKS_EXCLUDED(mutex_) {
     ComputeConstraint(submap_id, submap, node_id, true, /* match_full_submap */
                       constant_data, transform::Rigid2d::Identity(),
-                      *scan_matcher, constraint);
+                      *scan_matcher, rotated_scans.get(), constraint);
   });
   constraint_task->AddDependency(scan_matcher->creation_task_handle);
   auto constraint_task_handle =
@@ -148,6 +167,7 @@ void ConstraintBuilder2D::NotifyEndOfNode() {
   finish_node_task_ = absl::make_unique<common::Task>();
   when_done_task_->AddDependency(finish_node_task_handle);
   ++num_started_nodes_;
+  rotated_scans_.clear();
 }
 
 void ConstraintBuilder2D::WhenDone(
@@ -185,14 +205,33 @@ ConstraintBuilder2D::DispatchScanMatcherConstruction(const SubmapId& submap_id,
   return &submap_scan_matchers_.at(submap_id);
 }
 
+std::shared_ptr<const scan_matching::RotatedScans2D>
+ConstraintBuilder2D::GetRotatedScans(
+    const NodeId& node_id, const TrajectoryNode::Data* const constant_data,
+    const double resolution) {
+  if (!options_.share_rotated_scans_in_2d()) {
+    return nullptr;
+  }
+  auto& rotated_scans = rotated_scans_[node_id];
+  if (rotated_scans == nullptr || rotated_scans->resolution() != resolution) {
+    rotated_scans = std::make_shared<const scan_matching::RotatedScans2D>(
+        constant_data->filtered_gravity_aligned_point_cloud, resolution);
+  }
+  return rotated_scans;
+}
+
 void ConstraintBuilder2D::ComputeConstraint(
     const SubmapId& submap_id, const Submap2D* const submap,
     const NodeId& node_id, bool match_full_submap,
     const TrajectoryNode::Data* const constant_data,
     const transform::Rigid2d& initial_relative_pose,
     const SubmapScanMatcher& submap_scan_matcher,
+    const scan_matching::RotatedScans2D* const rotated_scans,
     std::unique_ptr<ConstraintBuilder2D::Constraint>* constraint) {
   CHECK(submap_scan_matcher.fast_correlative_scan_matcher);
+  const scan_matching::FastCorrelativeScanMatcher2D&
+      fast_correlative_scan_matcher =
+          *submap_scan_matcher.fast_correlative_scan_matcher;
   const transform::Rigid2d initial_pose =
       ComputeSubmapPose(*submap) * initial_relative_pose;
 
@@ -210,9 +249,14 @@ void ConstraintBuilder2D::ComputeConstraint(
   // 3. Refine.
   if (match_full_submap) {
     kGlobalConstraintsSearchedMetric->Increment();
-    if (submap_scan_matcher.fast_correlative_scan_matcher->MatchFullSubmap(
-            constant_data->filtered_gravity_aligned_point_cloud,
-            options_.global_localization_min_score(), &score, &pose_estimate)) {
+    if (rotated_scans != nullptr
+            ? fast_correlative_scan_matcher.MatchFullSubmap(
+                  *rotated_scans, options_.global_localization_min_score(),
+                  &score, &pose_estimate)
+            : fast_correlative_scan_matcher.MatchFullSubmap(
+                  constant_data->filtered_gravity_aligned_point_cloud,
+                  options_.global_localization_min_score(), &score,
+                  &pose_estimate)) {
       CHECK_GT(score, options_.global_localization_min_score());
       CHECK_GE(node_id.trajectory_id, 0);
       CHECK_GE(submap_id.trajectory_id, 0);
@@ -223,9 +267,14 @@ void ConstraintBuilder2D::ComputeConstraint(
     }
   } else {
     kConstraintsSearchedMetric->Increment();
-    if (submap_scan_matcher.fast_correlative_scan_matcher->Match(
-            initial_pose, constant_data->filtered_gravity_aligned_point_cloud,
-            options_.min_score(), &score, &pose_estimate)) {
+    if (rotated_scans != nullptr
+            ? fast_correlative_scan_matcher.Match(initial_pose, *rotated_scans,
+                                                  options_.min_score(), &score,
+                                                  &pose_estimate)
+            : fast_correlative_scan_matcher.Match(
+                  initial_pose,
+                  constant_data->filtered_gravity_aligned_point_cloud,
+                  options_.min_score(), &score, &pose_estimate)) {
       // We've reported a successful local match.
       CHECK_GT(score, options_.min_score());
       kConstraintsFoundMetric->Increment();
@@ -299,6 +348,24 @@ void ConstraintBuilder2D::RunWhenDoneCallback() {
   (*callback)(result);
 }
 
+void ConstraintBuilder2D::ReportLocalMatch(const SubmapId& submap_id,
+                                           const NodeId& node_id,
+                                           const common::Time node_time,
+                                           const bool constraint_found,
+                                           const double cpu_seconds) {
+  adaptive_sampler_.ReportMatch(submap_id, node_id, node_time,
+                                constraint_found, cpu_seconds);
+  const AdaptiveConstraintSampler::Statistics statistics =
+      adaptive_sampler_.GetStatistics();
+  kMatchAcceptanceRateMetric->Set(
+      static_cast<double>(statistics.num_constraints_found) /
+      statistics.num_matches);
+  if (statistics.num_constraints_found != 0) {
+    kCpuSecondsPerConstraintMetric->Set(statistics.cpu_seconds /
+                                        statistics.num_constraints_found);
+  }
+}
+
 int ConstraintBuilder2D::GetNumFinishedNodes() {
   absl::MutexLock locker(&mutex_);
   return num_finished_nodes_;
@@ -312,6 +379,7 @@ void ConstraintBuilder2D::DeleteScanMatcher(const SubmapId& submap_id) {
   }
   submap_scan_matchers_.erase(submap_id);
   per_submap_sampler_.erase(submap_id);
+  adaptive_sampler_.DeleteSubmap(submap_id);
   kNumSubmapScanMatchersMetric->Set(submap_scan_matchers_.size());
 }
 
@@ -340,6 +408,14 @@ void ConstraintBuilder2D::RegisterMetrics(metrics::FamilyFactory* factory) {
       "mapping_constraints_constraint_builder_2d_num_submap_scan_matchers",
       "Current number of constructed submap scan matchers");
   kNumSubmapScanMatchersMetric = num_matchers->Add({});
+  auto* acceptance_rate = factory->NewGaugeFamily(
+      "mapping_constraints_constraint_builder_2d_match_acceptance_rate",
+      "Fraction of local matches which resulted in a constraint");
+  kMatchAcceptanceRateMetric = acceptance_rate->Add({});
+  auto* cpu_seconds_per_constraint = factory->NewGaugeFamily(
+      "mapping_constraints_constraint_builder_2d_cpu_seconds_per_constraint",
+      "CPU seconds spent on local matches per constraint found");
+  kCpuSecondsPerConstraintMetric = cpu_seconds_per_constraint->Add({});
 }
 
 }  // namespace constraints
@@ -22,6 +22,7 @@
 #include <functional>
 #include <limits>
 #include <map>
+#include <memory>
 #include <vector>
 
 #include "Eigen/Core"
@@ -32,9 +33,11 @@
 #include "cartographer/common/math.h"
 #include "cartographer/common/task.h"
 #include "cartographer/common/thread_pool.h"
+#include "cartographer/common/time.h"
 #include "cartographer/mapping/2d/submap_2d.h"
 #include "cartographer/mapping/internal/2d/scan_matching/ceres_scan_matcher_2d.h"
 #include "cartographer/mapping/internal/2d/scan_matching/fast_correlative_scan_matcher_2d.h"
+#include "cartographer/mapping/internal/constraints/adaptive_constraint_sampler.h"
 #include "cartographer/mapping/pose_graph_interface.h"
 #include "cartographer/mapping/proto/pose_graph/constraint_builder_options.pb.h"
 #include "cartographer/metrics/family_factory.h"
@@ -120,19 +123,34 @@ class ConstraintBuilder2D {
       const SubmapId& submap_id, const Grid2D* grid)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
+  // Returns the rotated scans of the node shared by all its matches against
+  // grids of 'resolution', or nullptr if they are not shared.
+  std::shared_ptr<const scan_matching::RotatedScans2D> GetRotatedScans(
+      const NodeId& node_id, const TrajectoryNode::Data* constant_data,
+      double resolution) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
   // Runs in a background thread and does computations for an additional
   // constraint, assuming 'submap' and 'compressed_point_cloud' do not change
-  // anymore. As output, it may create a new Constraint in 'constraint'.
+  // anymore. If 'rotated_scans' is not nullptr, the fast correlative scan
+  // matcher uses them instead of rotating the point cloud. As output, it may
+  // create a new Constraint in 'constraint'.
   void ComputeConstraint(const SubmapId& submap_id, const Submap2D* submap,
                          const NodeId& node_id, bool match_full_submap,
                          const TrajectoryNode::Data* const constant_data,
                          const transform::Rigid2d& initial_relative_pose,
                          const SubmapScanMatcher& submap_scan_matcher,
+                         const scan_matching::RotatedScans2D* rotated_scans,
                          std::unique_ptr<Constraint>* constraint)
       LOCKS_EXCLUDED(mutex_);
 
   void RunWhenDoneCallback() LOCKS_EXCLUDED(mutex_);
 
+  // Reports the outcome of a local match to the 'adaptive_sampler_' and
+  // updates the match metrics.
+  void ReportLocalMatch(const SubmapId& submap_id, const NodeId& node_id,
+                        common::Time node_time, bool constraint_found,
+                        double cpu_seconds) LOCKS_EXCLUDED(mutex_);
+
   const constraints::proto::ConstraintBuilderOptions options_;
   common::ThreadPoolInterface* thread_pool_;
   absl::Mutex mutex_;
@@ -161,7 +179,17 @@ class ConstraintBuilder2D {
   // Map of dispatched or constructed scan matchers by 'submap_id'.
   std::map<SubmapId, SubmapScanMatcher> submap_scan_matchers_
       GUARDED_BY(mutex_);
+  // Rotated scans by 'node_id' of the nodes matched since the last
+  // NotifyEndOfNode(). The matches keep them alive until they finish. Only
+  // the matches of the newly added node share them; old nodes matched against
+  // a newly finished submap are matched once per batch, so theirs are not
+  // reused.
+  std::map<NodeId, std::shared_ptr<const scan_matching::RotatedScans2D>>
+      rotated_scans_ GUARDED_BY(mutex_);
   std::map<SubmapId, common::FixedRatioSampler> per_submap_sampler_;
+  // Used in place of the 'per_submap_sampler_' if 'use_adaptive_sampling',
+  // and to track the outcome of local matches in any case.
+  AdaptiveConstraintSampler adaptive_sampler_;
 
   scan_matching::CeresScanMatcher2D ceres_scan_matcher_;
 
@@ -45,11 +45,57 @@ class ConstraintBuilder2DTest : public ::testing::Test {
             POSE_GRAPH.constraint_builder.min_score = 0
             POSE_GRAPH.constraint_builder.global_localization_min_score = 0
             return POSE_GRAPH.constraint_builder)text");
-    constraint_builder_ = absl::make_unique<ConstraintBuilder2D>(
-        CreateConstraintBuilderOptions(constraint_builder_parameters.get()),
-        &thread_pool_);
+    options_ =
+        CreateConstraintBuilderOptions(constraint_builder_parameters.get());
+    constraint_builder_ =
+        absl::make_unique<ConstraintBuilder2D>(options_, &thread_pool_);
   }
 
+  void ExpectToFindConstraints() {
+    TrajectoryNode::Data node_data;
+    node_data.filtered_gravity_aligned_point_cloud.push_back(
+        {Eigen::Vector3f(0.1, 0.2, 0.3)});
+    node_data.gravity_alignment = Eigen::Quaterniond::Identity();
+    node_data.local_pose = transform::Rigid3d::Identity();
+    SubmapId submap_id{0, 1};
+    MapLimits map_limits(1., Eigen::Vector2d(2., 3.), CellLimits(100, 110));
+    ValueConversionTables conversion_tables;
+    Submap2D submap(
+        Eigen::Vector2f(4.f, 5.f),
+        absl::make_unique<ProbabilityGrid>(map_limits, &conversion_tables),
+        &conversion_tables);
+    int expected_nodes = 0;
+    for (int i = 0; i < 2; ++i) {
+      EXPECT_EQ(constraint_builder_->GetNumFinishedNodes(), expected_nodes);
+      for (int j = 0; j < 2; ++j) {
+        constraint_builder_->MaybeAddConstraint(
+            submap_id, &submap, NodeId{0, 0}, &node_data,
+            transform::Rigid2d::Identity());
+      }
+      constraint_builder_->MaybeAddGlobalConstraint(submap_id, &submap,
+                                                    NodeId{0, 0}, &node_data);
+      constraint_builder_->NotifyEndOfNode();
+      thread_pool_.WaitUntilIdle();
+      EXPECT_EQ(constraint_builder_->GetNumFinishedNodes(), ++expected_nodes);
+      constraint_builder_->NotifyEndOfNode();
+      thread_pool_.WaitUntilIdle();
+      EXPECT_EQ(constraint_builder_->GetNumFinishedNodes(), ++expected_nodes);
+      EXPECT_CALL(mock_,
+                  Run(::testing::AllOf(
+                      ::testing::SizeIs(3),
+                      ::testing::Each(::testing::Field(
+                          &PoseGraphInterface::Constraint::tag,
+                          PoseGraphInterface::Constraint::INTER_SUBMAP)))));
+      constraint_builder_->WhenDone(
+          [this](const constraints::ConstraintBuilder2D::Result& result) {
+            mock_.Run(result);
+          });
+      thread_pool_.WaitUntilIdle();
+      constraint_builder_->DeleteScanMatcher(submap_id);
+    }
+  }
+
+  proto::ConstraintBuilderOptions options_;
   std::unique_ptr<ConstraintBuilder2D> constraint_builder_;
   MockCallback mock_;
   common::testing::ThreadPoolForTesting thread_pool_;
@@ -68,47 +114,14 @@ TEST_F(ConstraintBuilder2DTest, CallsBack) {
 }
 
 TEST_F(ConstraintBuilder2DTest, FindsConstraints) {
-  TrajectoryNode::Data node_data;
-  node_data.filtered_gravity_aligned_point_cloud.push_back(
-      {Eigen::Vector3f(0.1, 0.2, 0.3)});
-  node_data.gravity_alignment = Eigen::Quaterniond::Identity();
-  node_data.local_pose = transform::Rigid3d::Identity();
-  SubmapId submap_id{0, 1};
-  MapLimits map_limits(1., Eigen::Vector2d(2., 3.), CellLimits(100, 110));
-  ValueConversionTables conversion_tables;
-  Submap2D submap(
-      Eigen::Vector2f(4.f, 5.f),
-      absl::make_unique<ProbabilityGrid>(map_limits, &conversion_tables),
-      &conversion_tables);
-  int expected_nodes = 0;
-  for (int i = 0; i < 2; ++i) {
-    EXPECT_EQ(constraint_builder_->GetNumFinishedNodes(), expected_nodes);
-    for (int j = 0; j < 2; ++j) {
-      constraint_builder_->MaybeAddConstraint(submap_id, &submap, NodeId{0, 0},
-                                              &node_data,
-                                              transform::Rigid2d::Identity());
-    }
-    constraint_builder_->MaybeAddGlobalConstraint(submap_id, &submap,
-                                                  NodeId{0, 0}, &node_data);
-    constraint_builder_->NotifyEndOfNode();
-    thread_pool_.WaitUntilIdle();
-    EXPECT_EQ(constraint_builder_->GetNumFinishedNodes(), ++expected_nodes);
-    constraint_builder_->NotifyEndOfNode();
-    thread_pool_.WaitUntilIdle();
-    EXPECT_EQ(constraint_builder_->GetNumFinishedNodes(), ++expected_nodes);
-    EXPECT_CALL(mock_,
-                Run(::testing::AllOf(
-                    ::testing::SizeIs(3),
-                    ::testing::Each(::testing::Field(
-                        &PoseGraphInterface::Constraint::tag,
-                        PoseGraphInterface::Constraint::INTER_SUBMAP)))));
-    constraint_builder_->WhenDone(
-        [this](const constraints::ConstraintBuilder2D::Result& result) {
-          mock_.Run(result);
-        });
-    thread_pool_.WaitUntilIdle();
-    constraint_builder_->DeleteScanMatcher(submap_id);
-  }
+  ExpectToFindConstraints();
+}
+
+TEST_F(ConstraintBuilder2DTest, FindsConstraintsWithSharedRotatedScans) {
+  options_.set_share_rotated_scans_in_2d(true);
+  constraint_builder_ =
+      absl::make_unique<ConstraintBuilder2D>(options_, &thread_pool_);
+  ExpectToFindConstraints();
 }
 
 }  // namespace
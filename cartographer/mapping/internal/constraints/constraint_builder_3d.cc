@@ -16,6 +16,7 @@
 
 #include "cartographer/mapping/internal/constraints/constraint_builder_3d.h"
 
+#include <chrono>
 #include <cmath>
 #include <functional>
 #include <iomanip>
@@ -57,6 +58,8 @@ static auto* kGlobalConstraintRotationalScoresMetric =
 static auto* kGlobalConstraintLowResolutionScoresMetric =
     metrics::Histogram::Null();
 static auto* kNumSubmapScanMatchersMetric = metrics::Gauge::Null();
+static auto* kMatchAcceptanceRateMetric = metrics::Gauge::Null();
+static auto* kCpuSecondsPerConstraintMetric = metrics::Gauge::Null();
 
 ConstraintBuilder3D::ConstraintBuilder3D(
     const proto::ConstraintBuilderOptions& options,
@@ -65,6 +68,7 @@ ConstraintBuilder3D::ConstraintBuilder3D(
       thread_pool_(thread_pool),
       finish_node_task_(absl::make_unique<common::Task>()),
       when_done_task_(absl::make_unique<common::Task>()),
+      adaptive_sampler_(options),
       ceres_scan_matcher_(options.ceres_scan_matcher_options_3d()) {}
 
 ConstraintBuilder3D::~ConstraintBuilder3D() {
@@ -81,14 +85,23 @@ void ConstraintBuilder3D::MaybeAddConstraint(
     const NodeId& node_id, const TrajectoryNode::Data* const constant_data,
     const transform::Rigid3d& global_node_pose,
     const transform::Rigid3d& global_submap_pose) {
-  if ((global_node_pose.translation() - global_submap_pose.translation())
-          .norm() > options_.max_constraint_distance()) {
+  const double distance =
+      (global_node_pose.translation() - global_submap_pose.translation())
+          .norm();
+  if (distance > options_.max_constraint_distance()) {
     return;
   }
-  if (!per_submap_sampler_
-           .emplace(std::piecewise_construct, std::forward_as_tuple(submap_id),
-                    std::forward_as_tuple(options_.sampling_ratio()))
-           .first->second.Pulse()) {
+  if (options_.adaptive_sampling_options().use_adaptive_sampling()) {
+    if (!adaptive_sampler_.ShouldMatch(
+            submap_id, node_id, constant_data->time, constant_data->local_pose,
+            distance, std::chrono::steady_clock::now())) {
+      return;
+    }
+  } else if (!per_submap_sampler_
+                  .emplace(std::piecewise_construct,
+                           std::forward_as_tuple(submap_id),
+                           std::forward_as_tuple(options_.sampling_ratio()))
+                  .first->second.Pulse()) {
     return;
   }
 
@@ -103,9 +116,13 @@ void ConstraintBuilder3D::MaybeAddConstraint(
   const auto* scan_matcher = DispatchScanMatcherConstruction(submap_id, submap);
   auto constraint_task = absl::make_unique<common::Task>();
   constraint_task->SetWorkItem([=]() LOCKS_EXCLUDED(mutex_) {
+    const double start_cpu_seconds = common::GetThreadCpuTimeSeconds();
     ComputeConstraint(submap_id, node_id, false, /* match_full_submap */
                       constant_data, global_node_pose, global_submap_pose,
                       *scan_matcher, constraint);
+    ReportLocalMatch(submap_id, node_id, constant_data->time,
+                     *constraint != nullptr,
+                     common::GetThreadCpuTimeSeconds() - start_cpu_seconds);
   });
   constraint_task->AddDependency(scan_matcher->creation_task_handle);
   auto constraint_task_handle =
@@ -176,22 +193,39 @@ ConstraintBuilder3D::DispatchScanMatcherConstruction(const SubmapId& submap_id,
   auto& submap_scan_matcher = submap_scan_matchers_[submap_id];
   kNumSubmapScanMatchersMetric->Set(submap_scan_matchers_.size());
   submap_scan_matcher.high_resolution_hybrid_grid =
-      &submap->high_resolution_hybrid_grid();
+      submap->high_resolution_hybrid_grid();
   submap_scan_matcher.low_resolution_hybrid_grid =
-      &submap->low_resolution_hybrid_grid();
+      submap->low_resolution_hybrid_grid();
   auto& scan_matcher_options =
       options_.fast_correlative_scan_matcher_options_3d();
   const Eigen::VectorXf* histogram =
       &submap->rotational_scan_matcher_histogram();
+  const auto precomputation_grid_stack = submap->precomputation_grid_stack();
   auto scan_matcher_task = absl::make_unique<common::Task>();
-  scan_matcher_task->SetWorkItem(
-      [&submap_scan_matcher, &scan_matcher_options, histogram]() {
-        submap_scan_matcher.fast_correlative_scan_matcher =
-            absl::make_unique<scan_matching::FastCorrelativeScanMatcher3D>(
-                *submap_scan_matcher.high_resolution_hybrid_grid,
-                submap_scan_matcher.low_resolution_hybrid_grid, histogram,
-                scan_matcher_options);
-      });
+  scan_matcher_task->SetWorkItem([&submap_scan_matcher, &scan_matcher_options,
+                                  histogram, submap,
+                                  precomputation_grid_stack]() {
+    if (precomputation_grid_stack != nullptr &&
+        precomputation_grid_stack->IsCompatible(scan_matcher_options)) {
+      submap_scan_matcher.fast_correlative_scan_matcher =
+          absl::make_unique<scan_matching::FastCorrelativeScanMatcher3D>(
+              *submap_scan_matcher.high_resolution_hybrid_grid,
+              submap_scan_matcher.low_resolution_hybrid_grid.get(), histogram,
+              precomputation_grid_stack, scan_matcher_options);
+      return;
+    }
+    submap_scan_matcher.fast_correlative_scan_matcher =
+        absl::make_unique<scan_matching::FastCorrelativeScanMatcher3D>(
+            *submap_scan_matcher.high_resolution_hybrid_grid,
+            submap_scan_matcher.low_resolution_hybrid_grid.get(), histogram,
+            scan_matcher_options);
+    if (scan_matcher_options.serialize_precomputation_grids() &&
+        submap->insertion_finished()) {
+      submap->SetPrecomputationGridStack(
+          submap_scan_matcher.fast_correlative_scan_matcher
+              ->precomputation_grid_stack());
+    }
+  });
   submap_scan_matcher.creation_task_handle =
       thread_pool_->Schedule(std::move(scan_matcher_task));
   return &submap_scan_matchers_.at(submap_id);
@@ -264,15 +298,15 @@ void ConstraintBuilder3D::ComputeConstraint(
   // CSM estimate.
   ceres::Solver::Summary unused_summary;
   transform::Rigid3d constraint_transform;
-  ceres_scan_matcher_.Match(match_result->pose_estimate.translation(),
-                            match_result->pose_estimate,
-                            {{&constant_data->high_resolution_point_cloud,
-                              submap_scan_matcher.high_resolution_hybrid_grid,
-                              /*intensity_hybrid_grid=*/nullptr},
-                             {&constant_data->low_resolution_point_cloud,
-                              submap_scan_matcher.low_resolution_hybrid_grid,
-                              /*intensity_hybrid_grid=*/nullptr}},
-                            &constraint_transform, &unused_summary);
+  ceres_scan_matcher_.Match(
+      match_result->pose_estimate.translation(), match_result->pose_estimate,
+      {{&constant_data->high_resolution_point_cloud,
+        submap_scan_matcher.high_resolution_hybrid_grid.get(),
+        /*intensity_hybrid_grid=*/nullptr},
+       {&constant_data->low_resolution_point_cloud,
+        submap_scan_matcher.low_resolution_hybrid_grid.get(),
+        /*intensity_hybrid_grid=*/nullptr}},
+      &constraint_transform, &unused_summary);
 
   constraint->reset(new Constraint{
       submap_id,
@@ -332,6 +366,24 @@ void ConstraintBuilder3D::RunWhenDoneCallback() {
   (*callback)(result);
 }
 
+void ConstraintBuilder3D::ReportLocalMatch(const SubmapId& submap_id,
+                                           const NodeId& node_id,
+                                           const common::Time node_time,
+                                           const bool constraint_found,
+                                           const double cpu_seconds) {
+  adaptive_sampler_.ReportMatch(submap_id, node_id, node_time,
+                                constraint_found, cpu_seconds);
+  const AdaptiveConstraintSampler::Statistics statistics =
+      adaptive_sampler_.GetStatistics();
+  kMatchAcceptanceRateMetric->Set(
+      static_cast<double>(statistics.num_constraints_found) /
+      statistics.num_matches);
+  if (statistics.num_constraints_found != 0) {
+    kCpuSecondsPerConstraintMetric->Set(statistics.cpu_seconds /
+                                        statistics.num_constraints_found);
+  }
+}
+
 int ConstraintBuilder3D::GetNumFinishedNodes() {
   absl::MutexLock locker(&mutex_);
   return num_finished_nodes_;
@@ -345,6 +397,7 @@ void ConstraintBuilder3D::DeleteScanMatcher(const SubmapId& submap_id) {
   }
   submap_scan_matchers_.erase(submap_id);
   per_submap_sampler_.erase(submap_id);
+  adaptive_sampler_.DeleteSubmap(submap_id);
   kNumSubmapScanMatchersMetric->Set(submap_scan_matchers_.size());
 }
 
@@ -383,6 +436,14 @@ void ConstraintBuilder3D::RegisterMetrics(metrics::FamilyFactory* factory) {
       "mapping_constraints_constraint_builder_3d_num_submap_scan_matchers",
       "Current number of constructed submap scan matchers");
   kNumSubmapScanMatchersMetric = num_matchers->Add({});
+  auto* acceptance_rate = factory->NewGaugeFamily(
+      "mapping_constraints_constraint_builder_3d_match_acceptance_rate",
+      "Fraction of local matches which resulted in a constraint");
+  kMatchAcceptanceRateMetric = acceptance_rate->Add({});
+  auto* cpu_seconds_per_constraint = factory->NewGaugeFamily(
+      "mapping_constraints_constraint_builder_3d_cpu_seconds_per_constraint",
+      "CPU seconds spent on local matches per constraint found");
+  kCpuSecondsPerConstraintMetric = cpu_seconds_per_constraint->Add({});
 }
 
 }  // namespace constraints
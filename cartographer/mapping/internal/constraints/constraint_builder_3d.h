@@ -33,9 +33,11 @@
 #include "cartographer/common/math.h"
 #include "cartographer/common/task.h"
 #include "cartographer/common/thread_pool.h"
+#include "cartographer/common/time.h"
 #include "cartographer/mapping/3d/submap_3d.h"
 #include "cartographer/mapping/internal/3d/scan_matching/ceres_scan_matcher_3d.h"
 #include "cartographer/mapping/internal/3d/scan_matching/fast_correlative_scan_matcher_3d.h"
+#include "cartographer/mapping/internal/constraints/adaptive_constraint_sampler.h"
 #include "cartographer/mapping/pose_graph_interface.h"
 #include "cartographer/mapping/proto/pose_graph/constraint_builder_options.pb.h"
 #include "cartographer/mapping/trajectory_node.h"
@@ -115,8 +117,8 @@ class ConstraintBuilder3D {
 
  private:
   struct SubmapScanMatcher {
-    const HybridGrid* high_resolution_hybrid_grid = nullptr;
-    const HybridGrid* low_resolution_hybrid_grid = nullptr;
+    std::shared_ptr<const HybridGrid> high_resolution_hybrid_grid;
+    std::shared_ptr<const HybridGrid> low_resolution_hybrid_grid;
     std::unique_ptr<scan_matching::FastCorrelativeScanMatcher3D>
         fast_correlative_scan_matcher;
     std::weak_ptr<common::Task> creation_task_handle;
@@ -142,6 +144,12 @@ class ConstraintBuilder3D {
 
   void RunWhenDoneCallback() LOCKS_EXCLUDED(mutex_);
 
+  // Reports the outcome of a local match to the 'adaptive_sampler_' and
+  // updates the match metrics.
+  void ReportLocalMatch(const SubmapId& submap_id, const NodeId& node_id,
+                        common::Time node_time, bool constraint_found,
+                        double cpu_seconds) LOCKS_EXCLUDED(mutex_);
+
   const proto::ConstraintBuilderOptions options_;
   common::ThreadPoolInterface* thread_pool_;
   absl::Mutex mutex_;
@@ -171,6 +179,9 @@ class ConstraintBuilder3D {
   std::map<SubmapId, SubmapScanMatcher> submap_scan_matchers_
       GUARDED_BY(mutex_);
   std::map<SubmapId, common::FixedRatioSampler> per_submap_sampler_;
+  // Used in place of the 'per_submap_sampler_' if 'use_adaptive_sampling',
+  // and to track the outcome of local matches in any case.
+  AdaptiveConstraintSampler adaptive_sampler_;
 
   scan_matching::CeresScanMatcher3D ceres_scan_matcher_;
 
@@ -32,6 +32,9 @@ namespace {
 
 static auto* kLocalSlamMatchingResults = metrics::Counter::Null();
 static auto* kLocalSlamInsertionResults = metrics::Counter::Null();
+static auto* kPoseGraphOverloadedInsertionResults = metrics::Counter::Null();
+static auto* kPoseGraphOverloadedSkippedInsertionResults =
+    metrics::Counter::Null();
 
 template <typename LocalTrajectoryBuilder, typename PoseGraph>
 class GlobalTrajectoryBuilder : public mapping::TrajectoryBuilderInterface {
@@ -42,12 +45,16 @@ class GlobalTrajectoryBuilder : public mapping::TrajectoryBuilderInterface {
       std::unique_ptr<LocalTrajectoryBuilder> local_trajectory_builder,
       const int trajectory_id, PoseGraph* const pose_graph,
       const LocalSlamResultCallback& local_slam_result_callback,
-      const absl::optional<MotionFilter>& pose_graph_odometry_motion_filter)
+      const absl::optional<MotionFilter>& pose_graph_odometry_motion_filter,
+      const absl::optional<proto::MotionFilterOptions>&
+          overloaded_pose_graph_motion_filter_options)
       : trajectory_id_(trajectory_id),
         pose_graph_(pose_graph),
         local_trajectory_builder_(std::move(local_trajectory_builder)),
         local_slam_result_callback_(local_slam_result_callback),
-        pose_graph_odometry_motion_filter_(pose_graph_odometry_motion_filter) {}
+        pose_graph_odometry_motion_filter_(pose_graph_odometry_motion_filter),
+        overloaded_pose_graph_motion_filter_options_(
+            overloaded_pose_graph_motion_filter_options) {}
   ~GlobalTrajectoryBuilder() override {}
 
   GlobalTrajectoryBuilder(const GlobalTrajectoryBuilder&) = delete;
@@ -56,35 +63,13 @@ class GlobalTrajectoryBuilder : public mapping::TrajectoryBuilderInterface {
   void AddSensorData(
       const std::string& sensor_id,
       const sensor::TimedPointCloudData& timed_point_cloud_data) override {
-    CHECK(local_trajectory_builder_)
-        << "Cannot add TimedPointCloudData without a LocalTrajectoryBuilder.";
-    std::unique_ptr<typename LocalTrajectoryBuilder::MatchingResult>
-        matching_result = local_trajectory_builder_->AddRangeData(
-            sensor_id, timed_point_cloud_data);
-    if (matching_result == nullptr) {
-      // The range data has not been fully accumulated yet.
-      return;
-    }
-    kLocalSlamMatchingResults->Increment();
-    std::unique_ptr<InsertionResult> insertion_result;
-    if (matching_result->insertion_result != nullptr) {
-      kLocalSlamInsertionResults->Increment();
-      auto node_id = pose_graph_->AddNode(
-          matching_result->insertion_result->constant_data, trajectory_id_,
-          matching_result->insertion_result->insertion_submaps);
-      CHECK_EQ(node_id.trajectory_id, trajectory_id_);
-      insertion_result = absl::make_unique<InsertionResult>(InsertionResult{
-          node_id, matching_result->insertion_result->constant_data,
-          std::vector<std::shared_ptr<const Submap>>(
-              matching_result->insertion_result->insertion_submaps.begin(),
-              matching_result->insertion_result->insertion_submaps.end())});
-    }
-    if (local_slam_result_callback_) {
-      local_slam_result_callback_(
-          trajectory_id_, matching_result->time, matching_result->local_pose,
-          std::move(matching_result->range_data_in_local),
-          std::move(insertion_result));
-    }
+    AddRangeData(sensor_id, timed_point_cloud_data);
+  }
+
+  void AddSensorData(const std::string& sensor_id,
+                     const sensor::OrganizedPointCloudData&
+                         organized_point_cloud_data) override {
+    AddRangeData(sensor_id, organized_point_cloud_data);
   }
 
   void AddSensorData(const std::string& sensor_id,
@@ -135,11 +120,114 @@ class GlobalTrajectoryBuilder : public mapping::TrajectoryBuilderInterface {
   }
 
  private:
+  // Adds 'range_data', which is TimedPointCloudData or
+  // OrganizedPointCloudData, to local SLAM and its results to the pose graph.
+  template <typename RangeDataType>
+  void AddRangeData(const std::string& sensor_id,
+                    const RangeDataType& range_data) {
+    CHECK(local_trajectory_builder_)
+        << "Cannot add range data without a LocalTrajectoryBuilder.";
+    std::unique_ptr<typename LocalTrajectoryBuilder::MatchingResult>
+        matching_result =
+            local_trajectory_builder_->AddRangeData(sensor_id, range_data);
+    if (matching_result == nullptr) {
+      // The range data has not been fully accumulated yet.
+      return;
+    }
+    kLocalSlamMatchingResults->Increment();
+    std::unique_ptr<InsertionResult> insertion_result;
+    if (matching_result->insertion_result != nullptr) {
+      kLocalSlamInsertionResults->Increment();
+      UpdatePoseGraphOverloaded();
+      std::vector<std::shared_ptr<const Submap>> insertion_submaps(
+          matching_result->insertion_result->insertion_submaps.begin(),
+          matching_result->insertion_result->insertion_submaps.end());
+      if (ShouldSkipNode(matching_result->time, matching_result->local_pose,
+                         insertion_submaps)) {
+        kPoseGraphOverloadedSkippedInsertionResults->Increment();
+      } else {
+        auto node_id = pose_graph_->AddNode(
+            matching_result->insertion_result->constant_data, trajectory_id_,
+            matching_result->insertion_result->insertion_submaps);
+        CHECK_EQ(node_id.trajectory_id, trajectory_id_);
+        last_insertion_submaps_ = insertion_submaps;
+        ResetOverloadedPoseGraphMotionFilter(matching_result->time,
+                                             matching_result->local_pose);
+        insertion_result = absl::make_unique<InsertionResult>(InsertionResult{
+            node_id, matching_result->insertion_result->constant_data,
+            std::move(insertion_submaps)});
+      }
+    }
+    if (local_slam_result_callback_) {
+      local_slam_result_callback_(
+          trajectory_id_, matching_result->time, matching_result->local_pose,
+          std::move(matching_result->range_data_in_local),
+          std::move(insertion_result));
+    }
+  }
+
+  // Tracks when the pose graph starts and stops falling behind with the
+  // insertion of nodes, e.g. during bursts of loop closure searches.
+  void UpdatePoseGraphOverloaded() {
+    const bool overloaded = pose_graph_->IsOverloaded();
+    if (overloaded) {
+      kPoseGraphOverloadedInsertionResults->Increment();
+    }
+    if (overloaded != pose_graph_overloaded_) {
+      LOG(WARNING) << "Pose graph "
+                   << (overloaded ? "is falling behind" : "caught up")
+                   << " with the nodes of trajectory " << trajectory_id_
+                   << ".";
+      pose_graph_overloaded_ = overloaded;
+    }
+  }
+
+  // Returns true if the node at 'local_pose' should not be added to the pose
+  // graph because the pose graph is overloaded and the node did not move far
+  // enough from the last added node. Nodes which change the submaps known to
+  // the pose graph or finish a submap are always added, since the pose graph
+  // only learns about submaps through its nodes.
+  bool ShouldSkipNode(
+      const common::Time time, const transform::Rigid3d& local_pose,
+      const std::vector<std::shared_ptr<const Submap>>& insertion_submaps) {
+    if (!pose_graph_overloaded_ ||
+        !overloaded_pose_graph_motion_filter_.has_value() ||
+        insertion_submaps != last_insertion_submaps_ ||
+        insertion_submaps.front()->insertion_finished()) {
+      return false;
+    }
+    return overloaded_pose_graph_motion_filter_.value().IsSimilar(time,
+                                                                  local_pose);
+  }
+
+  // Makes the node at 'local_pose', which was just added to the pose graph,
+  // the node which ShouldSkipNode() compares against. This includes nodes
+  // added while the pose graph was not overloaded or because of their submaps.
+  void ResetOverloadedPoseGraphMotionFilter(
+      const common::Time time, const transform::Rigid3d& local_pose) {
+    if (!overloaded_pose_graph_motion_filter_options_.has_value()) {
+      return;
+    }
+    overloaded_pose_graph_motion_filter_.emplace(
+        overloaded_pose_graph_motion_filter_options_.value());
+    // The first pose given to a motion filter becomes its reference.
+    CHECK(!overloaded_pose_graph_motion_filter_.value().IsSimilar(time,
+                                                                  local_pose));
+  }
+
   const int trajectory_id_;
   PoseGraph* const pose_graph_;
+  bool pose_graph_overloaded_ = false;
   std::unique_ptr<LocalTrajectoryBuilder> local_trajectory_builder_;
   LocalSlamResultCallback local_slam_result_callback_;
   absl::optional<MotionFilter> pose_graph_odometry_motion_filter_;
+  const absl::optional<proto::MotionFilterOptions>
+      overloaded_pose_graph_motion_filter_options_;
+  // Compares against the last node added to the pose graph, unset before the
+  // first node was added.
+  absl::optional<MotionFilter> overloaded_pose_graph_motion_filter_;
+  // The submaps of the last node added to the pose graph.
+  std::vector<std::shared_ptr<const Submap>> last_insertion_submaps_;
 };
 
 }  // namespace
@@ -149,11 +237,14 @@ std::unique_ptr<TrajectoryBuilderInterface> CreateGlobalTrajectoryBuilder2D(
     const int trajectory_id, mapping::PoseGraph2D* const pose_graph,
     const TrajectoryBuilderInterface::LocalSlamResultCallback&
         local_slam_result_callback,
-    const absl::optional<MotionFilter>& pose_graph_odometry_motion_filter) {
+    const absl::optional<MotionFilter>& pose_graph_odometry_motion_filter,
+    const absl::optional<proto::MotionFilterOptions>&
+        overloaded_pose_graph_motion_filter_options) {
   return absl::make_unique<
       GlobalTrajectoryBuilder<LocalTrajectoryBuilder2D, mapping::PoseGraph2D>>(
       std::move(local_trajectory_builder), trajectory_id, pose_graph,
-      local_slam_result_callback, pose_graph_odometry_motion_filter);
+      local_slam_result_callback, pose_graph_odometry_motion_filter,
+      overloaded_pose_graph_motion_filter_options);
 }
 
 std::unique_ptr<TrajectoryBuilderInterface> CreateGlobalTrajectoryBuilder3D(
@@ -161,11 +252,14 @@ std::unique_ptr<TrajectoryBuilderInterface> CreateGlobalTrajectoryBuilder3D(
     const int trajectory_id, mapping::PoseGraph3D* const pose_graph,
     const TrajectoryBuilderInterface::LocalSlamResultCallback&
         local_slam_result_callback,
-    const absl::optional<MotionFilter>& pose_graph_odometry_motion_filter) {
+    const absl::optional<MotionFilter>& pose_graph_odometry_motion_filter,
+    const absl::optional<proto::MotionFilterOptions>&
+        overloaded_pose_graph_motion_filter_options) {
   return absl::make_unique<
       GlobalTrajectoryBuilder<LocalTrajectoryBuilder3D, mapping::PoseGraph3D>>(
       std::move(local_trajectory_builder), trajectory_id, pose_graph,
-      local_slam_result_callback, pose_graph_odometry_motion_filter);
+      local_slam_result_callback, pose_graph_odometry_motion_filter,
+      overloaded_pose_graph_motion_filter_options);
 }
 
 void GlobalTrajectoryBuilderRegisterMetrics(metrics::FamilyFactory* factory) {
@@ -174,6 +268,10 @@ void GlobalTrajectoryBuilderRegisterMetrics(metrics::FamilyFactory* factory) {
       "Local SLAM results");
   kLocalSlamMatchingResults = results->Add({{"type", "MatchingResult"}});
   kLocalSlamInsertionResults = results->Add({{"type", "InsertionResult"}});
+  kPoseGraphOverloadedInsertionResults =
+      results->Add({{"type", "InsertionResultWhilePoseGraphOverloaded"}});
+  kPoseGraphOverloadedSkippedInsertionResults = results->Add(
+      {{"type", "InsertionResultSkippedWhilePoseGraphOverloaded"}});
 }
 
 }  // namespace mapping
@@ -35,14 +35,18 @@ std::unique_ptr<TrajectoryBuilderInterface> CreateGlobalTrajectoryBuilder2D(
     const int trajectory_id, mapping::PoseGraph2D* const pose_graph,
     const TrajectoryBuilderInterface::LocalSlamResultCallback&
         local_slam_result_callback,
-    const absl::optional<MotionFilter>& pose_graph_odometry_motion_filter);
+    const absl::optional<MotionFilter>& pose_graph_odometry_motion_filter,
+    const absl::optional<proto::MotionFilterOptions>&
+        overloaded_pose_graph_motion_filter_options);
 
 std::unique_ptr<TrajectoryBuilderInterface> CreateGlobalTrajectoryBuilder3D(
     std::unique_ptr<LocalTrajectoryBuilder3D> local_trajectory_builder,
     const int trajectory_id, mapping::PoseGraph3D* const pose_graph,
     const TrajectoryBuilderInterface::LocalSlamResultCallback&
         local_slam_result_callback,
-    const absl::optional<MotionFilter>& pose_graph_odometry_motion_filter);
+    const absl::optional<MotionFilter>& pose_graph_odometry_motion_filter,
+    const absl::optional<proto::MotionFilterOptions>&
+        overloaded_pose_graph_motion_filter_options);
 
 void GlobalTrajectoryBuilderRegisterMetrics(
     metrics::FamilyFactory* family_factory);
@@ -0,0 +1,148 @@
+/*
+ * Copyright 2018 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/internal/global_trajectory_builder.h"
+
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/synchronization/notification.h"
+#include "cartographer/common/task.h"
+#include "cartographer/common/thread_pool.h"
+#include "cartographer/mapping/internal/2d/local_trajectory_builder_options_2d.h"
+#include "cartographer/mapping/internal/testing/test_helpers.h"
+#include "cartographer/mapping/pose_graph.h"
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace mapping {
+namespace {
+
+constexpr double kDuration = 4.;                // Seconds.
+constexpr double kTimeStep = 0.1;               // Seconds.
+constexpr double kTravelDistance = 1.2;         // Meters.
+constexpr double kOverloadedMaxDistance = 0.1;  // Meters.
+
+struct LocalSlamResult {
+  transform::Rigid3d local_pose;
+  bool added_to_pose_graph;
+  std::vector<std::shared_ptr<const Submap>> insertion_submaps;
+  bool front_submap_finished;
+};
+
+TEST(GlobalTrajectoryBuilderTest, SkipsNodesOnlyWhileSubmapsAreUnchanged) {
+  // Every range data is inserted and the submaps change every 5 nodes.
+  auto local_parameters = testing::ResolveLuaParameters(R"text(
+      include "trajectory_builder_2d.lua"
+      TRAJECTORY_BUILDER_2D.use_imu_data = false
+      TRAJECTORY_BUILDER_2D.motion_filter.max_distance_meters = 0
+      TRAJECTORY_BUILDER_2D.submaps.num_range_data = 5
+      return TRAJECTORY_BUILDER_2D)text");
+  // Any node which is still queued makes the pose graph overloaded.
+  auto pose_graph_parameters = testing::ResolveLuaParameters(R"text(
+      include "pose_graph.lua"
+      POSE_GRAPH.optimize_every_n_nodes = 0
+      POSE_GRAPH.overloaded_work_queue_delay_seconds = 1e-9
+      return POSE_GRAPH)text");
+  const proto::PoseGraphOptions pose_graph_options =
+      CreatePoseGraphOptions(pose_graph_parameters.get());
+  proto::MotionFilterOptions overloaded_motion_filter_options;
+  overloaded_motion_filter_options.set_max_time_seconds(1e3);
+  overloaded_motion_filter_options.set_max_distance_meters(
+      kOverloadedMaxDistance);
+  overloaded_motion_filter_options.set_max_angle_radians(M_PI);
+
+  // Blocks the only background thread so that the pose graph does not catch
+  // up with the added nodes until the end of the test.
+  absl::Notification unblock_thread_pool;
+  common::ThreadPool thread_pool(1);
+  auto blocking_task = absl::make_unique<common::Task>();
+  blocking_task->SetWorkItem(
+      [&unblock_thread_pool]() { unblock_thread_pool.WaitForNotification(); });
+  thread_pool.Schedule(std::move(blocking_task));
+
+  PoseGraph2D pose_graph(
+      pose_graph_options,
+      absl::make_unique<optimization::OptimizationProblem2D>(
+          pose_graph_options.optimization_problem_options()),
+      &thread_pool);
+  std::vector<LocalSlamResult> results;
+  auto global_trajectory_builder = CreateGlobalTrajectoryBuilder2D(
+      absl::make_unique<LocalTrajectoryBuilder2D>(
+          CreateLocalTrajectoryBuilderOptions2D(local_parameters.get()),
+          std::vector<std::string>{"range"}),
+      0 /* trajectory_id */, &pose_graph,
+      [&results](const int trajectory_id, const common::Time time,
+                 const transform::Rigid3d local_pose, sensor::RangeData,
+                 std::unique_ptr<
+                     const TrajectoryBuilderInterface::InsertionResult>
+                     insertion_result) {
+        LocalSlamResult result{local_pose, insertion_result != nullptr, {},
+                               false};
+        if (insertion_result != nullptr) {
+          result.insertion_submaps = insertion_result->insertion_submaps;
+          result.front_submap_finished =
+              result.insertion_submaps.front()->insertion_finished();
+        }
+        results.push_back(result);
+      },
+      absl::nullopt /* pose_graph_odometry_motion_filter */,
+      overloaded_motion_filter_options);
+
+  for (const auto& measurement : testing::GenerateFakeRangeMeasurements(
+           kTravelDistance, kDuration, kTimeStep)) {
+    global_trajectory_builder->AddSensorData("range", measurement);
+  }
+  unblock_thread_pool.Notify();
+
+  ASSERT_FALSE(results.empty());
+  EXPECT_TRUE(results.front().added_to_pose_graph);
+  int num_skipped = 0;
+  const LocalSlamResult* last_added = nullptr;
+  for (const LocalSlamResult& result : results) {
+    if (!result.added_to_pose_graph) {
+      ++num_skipped;
+      continue;
+    }
+    if (last_added != nullptr) {
+      if (result.insertion_submaps != last_added->insertion_submaps) {
+        // The pose graph saw every submap and the last node inserted into a
+        // submap which is no longer being built.
+        EXPECT_EQ(result.insertion_submaps.front(),
+                  last_added->insertion_submaps.back());
+        if (result.insertion_submaps.front() !=
+            last_added->insertion_submaps.front()) {
+          EXPECT_TRUE(last_added->front_submap_finished);
+        }
+      } else if (!result.front_submap_finished) {
+        // Nodes which were only added because they moved far enough are
+        // compared against the last added node, whatever it was added for.
+        EXPECT_GT((result.local_pose.translation() -
+                   last_added->local_pose.translation())
+                      .norm(),
+                  kOverloadedMaxDistance);
+      }
+    }
+    last_added = &result;
+  }
+  EXPECT_GT(num_skipped, 0);
+}
+
+}  // namespace
+}  // namespace mapping
+}  // namespace cartographer
@@ -17,6 +17,7 @@
 #include "cartographer/mapping/internal/imu_based_pose_extrapolator.h"
 
 #include <algorithm>
+#include <chrono>
 
 #include "absl/memory/memory.h"
 #include "cartographer/mapping/internal/3d/imu_integration.h"
@@ -27,6 +28,7 @@
 #include "cartographer/mapping/internal/optimization/cost_functions/rotation_cost_function_3d.h"
 #include "cartographer/mapping/internal/optimization/cost_functions/spa_cost_function_3d.h"
 #include "cartographer/mapping/pose_graph_interface.h"
+#include "cartographer/metrics/histogram.h"
 #include "cartographer/transform/transform.h"
 #include "glog/logging.h"
 
@@ -35,11 +37,57 @@ namespace mapping {
 
 using ::cartographer::transform::TimestampedTransform;
 
+static auto* kExtrapolationLatencyMetric = metrics::Histogram::Null();
+static auto* kSolveLatencyMetric = metrics::Histogram::Null();
+
+namespace {
+
+ceres::Problem::Options CreateProblemOptions() {
+  ceres::Problem::Options options;
+  options.local_parameterization_ownership = ceres::DO_NOT_TAKE_OWNERSHIP;
+  options.enable_fast_removal = true;
+  return options;
+}
+
+transform::Rigid3d ToRigid(const optimization::CeresPose::Data& data) {
+  return transform::Rigid3d::FromArrays(data.rotation, data.translation);
+}
+
+}  // namespace
+
 ImuBasedPoseExtrapolator::ImuBasedPoseExtrapolator(
     const proto::ImuBasedPoseExtrapolatorOptions& options)
     : options_(options),
       solver_options_(
-          common::CreateCeresSolverOptions(options_.solver_options())) {}
+          common::CreateCeresSolverOptions(options_.solver_options())),
+      quaternion_parameterization_(
+          absl::make_unique<ceres::QuaternionParameterization>()),
+      constant_yaw_quaternion_parameterization_(
+          absl::make_unique<ceres::AutoDiffLocalParameterization<
+              ConstantYawQuaternionPlus, 4, 2>>()),
+      problem_(CreateProblemOptions()),
+      gravity_from_local_(
+          optimization::FromPose(transform::Rigid3d::Identity())),
+      gravity_constant_(options_.gravity_constant() > 0
+                            ? options_.gravity_constant()
+                            : 9.8) {
+  // Track gravity alignment over time and use this as a frame here so that
+  // we can estimate the gravity alignment of the current pose.
+  problem_.AddParameterBlock(gravity_from_local_.translation.data(), 3);
+  problem_.AddParameterBlock(gravity_from_local_.rotation.data(), 4,
+                             quaternion_parameterization_.get());
+  problem_.AddParameterBlock(&gravity_constant_, 1);
+  // TODO(danielsievers): Fix gravity in CostFunction.
+  if (options_.gravity_constant() > 0) {
+    problem_.SetParameterBlockConstant(&gravity_constant_);
+  } else {
+    // Force gravity constant to be positive.
+    problem_.SetParameterLowerBound(&gravity_constant_, 0, 0.0);
+  }
+  problem_.AddParameterBlock(imu_calibration_.data(), 4,
+                             quaternion_parameterization_.get());
+  problem_.SetParameterBlockConstant(imu_calibration_.data());
+}
 
 ImuBasedPoseExtrapolator::~ImuBasedPoseExtrapolator() {
   LOG(INFO) << "Number of iterations for pose extrapolation:";
@@ -54,8 +102,9 @@ ImuBasedPoseExtrapolator::InitializeWithImu(
   CHECK(!imu_data.empty());
   LOG(INFO) << options.DebugString();
   auto extrapolator = absl::make_unique<ImuBasedPoseExtrapolator>(options);
-  std::copy(imu_data.begin(), imu_data.end(),
-            std::back_inserter(extrapolator->imu_data_));
+  for (const sensor::ImuData& data : imu_data) {
+    extrapolator->imu_preintegration_.Add(data);
+  }
   if (!initial_poses.empty()) {
     for (const auto& pose : initial_poses) {
       if (pose.time > imu_data.front().time) {
@@ -85,13 +134,23 @@ common::Time ImuBasedPoseExtrapolator::GetLastExtrapolatedTime() const {
 void ImuBasedPoseExtrapolator::AddPose(const common::Time time,
                                        const transform::Rigid3d& pose) {
   timed_pose_queue_.push_back(TimestampedTransform{time, pose});
+  // The previously newest pose is no longer fixed. Since parameterizations
+  // cannot be changed, its parameter blocks and residuals are added again.
+  if (!nodes_.empty()) {
+    RemoveParameterBlocks(&nodes_.back());
+    AddParameterBlocks(false /* is_newest_pose */, &nodes_.back());
+    AddResiduals(nodes_.size() - 1);
+  }
+  nodes_.push_back(Node{
+      time, optimization::FromPose(ToRigid(gravity_from_local_) * pose),
+      false});
+  AddParameterBlocks(true /* is_newest_pose */, &nodes_.back());
+  AddResiduals(nodes_.size() - 1);
   while (timed_pose_queue_.size() > 3 &&
          timed_pose_queue_[1].time <=
              time - common::FromSeconds(options_.pose_queue_duration())) {
-    if (!previous_solution_.empty()) {
-      CHECK_EQ(timed_pose_queue_.front().time, previous_solution_.front().time);
-      previous_solution_.pop_front();
-    }
+    RemoveParameterBlocks(&nodes_.front());
+    nodes_.pop_front();
     timed_pose_queue_.pop_front();
   }
   TrimImuData();
@@ -100,7 +159,7 @@ void ImuBasedPoseExtrapolator::AddPose(const common::Time time,
 void ImuBasedPoseExtrapolator::AddImuData(const sensor::ImuData& imu_data) {
   CHECK(timed_pose_queue_.empty() ||
         imu_data.time >= timed_pose_queue_.back().time);
-  imu_data_.push_back(imu_data);
+  imu_preintegration_.Add(imu_data);
   TrimImuData();
 }
 
@@ -130,210 +189,58 @@ ImuBasedPoseExtrapolator::ExtrapolatePosesWithGravity(
         timed_pose_queue_.back().transform.rotation()};
   }
 
-  ceres::Problem::Options problem_options;
-  ceres::Problem problem(problem_options);
-
-  // Track gravity alignment over time and use this as a frame here so that
-  // we can estimate the gravity alignment of the current pose.
-  optimization::CeresPose gravity_from_local(
-      gravity_from_local_, nullptr,
-      absl::make_unique<ceres::QuaternionParameterization>(), &problem);
-  // Use deque so addresses stay constant during problem formulation.
-  std::deque<optimization::CeresPose> nodes;
-  std::vector<common::Time> node_times;
-
-  for (size_t i = 0; i < timed_pose_queue_.size(); i++) {
-    const bool is_last = (i == (timed_pose_queue_.size() - 1));
-    const auto& timed_pose = timed_pose_queue_[i];
-    node_times.push_back(timed_pose.time);
-
-    transform::Rigid3d gravity_from_node;
-    // Use the last scan match result (timed_pose_queue_.back()) for
-    // initialization here instead of the last result from the optimization.
-    // This keeps poses from slowly drifting apart due to lack of feedback
-    // from the scan matching here.
-    if (!previous_solution_.empty() && !is_last) {
-      CHECK_GT(previous_solution_.size(), i);
-      CHECK_EQ(timed_pose.time, previous_solution_[i].time);
-      gravity_from_node = previous_solution_[i].transform;
-    } else {
-      gravity_from_node = gravity_from_local_ * timed_pose.transform;
-    }
-
-    if (is_last) {
-      nodes.emplace_back(gravity_from_node, nullptr,
-                         absl::make_unique<ceres::AutoDiffLocalParameterization<
-                             ConstantYawQuaternionPlus, 4, 2>>(),
-                         &problem);
-      problem.SetParameterBlockConstant(nodes.back().translation());
-    } else {
-      nodes.emplace_back(gravity_from_node, nullptr,
-                         absl::make_unique<ceres::QuaternionParameterization>(),
-                         &problem);
+  const auto start = std::chrono::steady_clock::now();
+  // Use the last scan match result (timed_pose_queue_.back()) for
+  // initialization here instead of the last result from the optimization.
+  // This keeps poses from slowly drifting apart due to lack of feedback
+  // from the scan matching here.
+  nodes_.back().gravity_from_tracking = optimization::FromPose(
+      ToRigid(gravity_from_local_) * newest_timed_pose.transform);
+  // Odometry data may have arrived after residuals were added.
+  for (size_t i = 1; i < nodes_.size(); ++i) {
+    if (!nodes_[i].has_odometry_residual) {
+      AddOdometryResidual(&nodes_[i - 1], &nodes_[i]);
     }
   }
 
-  double gravity_constant = 9.8;
-  bool fix_gravity = false;
-  if (options_.gravity_constant() > 0) {
-    fix_gravity = true;
-    gravity_constant = options_.gravity_constant();
-  }
-
-  auto imu_it_prev_prev = imu_data_.begin();
-  while (imu_it_prev_prev != std::prev(imu_data_.end()) &&
-         std::next(imu_it_prev_prev)->time <= timed_pose_queue_.back().time) {
-    ++imu_it_prev_prev;
-  }
-
-  const TimestampedTransform prev_gravity_from_tracking =
-      TimestampedTransform{node_times.back(), nodes.back().ToRigid()};
-  const TimestampedTransform prev_prev_gravity_from_tracking =
-      TimestampedTransform{node_times.at(node_times.size() - 2),
-                           nodes.at(nodes.size() - 2).ToRigid()};
+  CHECK(!imu_preintegration_.empty());
+  CHECK_LE(imu_preintegration_.start_time(), timed_pose_queue_.front().time);
+  Node& prev_node = nodes_.back();
+  Node& prev_prev_node = nodes_.at(nodes_.size() - 2);
   const transform::Rigid3d initial_estimate =
       ExtrapolatePoseWithImu<double>(
-          prev_gravity_from_tracking.transform, prev_gravity_from_tracking.time,
-          prev_prev_gravity_from_tracking.transform,
-          prev_prev_gravity_from_tracking.time,
-          gravity_constant * Eigen::Vector3d::UnitZ(), time, imu_data_,
-          &imu_it_prev_prev)
+          ToRigid(prev_node.gravity_from_tracking), prev_node.time,
+          ToRigid(prev_prev_node.gravity_from_tracking), prev_prev_node.time,
+          gravity_constant_ * Eigen::Vector3d::UnitZ(), time,
+          imu_preintegration_.Integrate(prev_node.time, time))
           .pose;
-  nodes.emplace_back(initial_estimate, nullptr,
-                     absl::make_unique<ceres::QuaternionParameterization>(),
-                     &problem);
-  node_times.push_back(time);
-
-  // Add cost functions for node constraints.
-  for (size_t i = 0; i < timed_pose_queue_.size(); i++) {
-    const auto& timed_pose = timed_pose_queue_[i];
-    problem.AddResidualBlock(
-        optimization::SpaCostFunction3D::CreateAutoDiffCostFunction(
-            PoseGraphInterface::Constraint::Pose{
-                timed_pose.transform, options_.pose_translation_weight(),
-                options_.pose_rotation_weight()}),
-        nullptr /* loss function */, gravity_from_local.rotation(),
-        gravity_from_local.translation(), nodes.at(i).rotation(),
-        nodes.at(i).translation());
-  }
-
-  CHECK(!imu_data_.empty());
-  CHECK_LE(imu_data_.front().time, timed_pose_queue_.front().time);
-
-  std::array<double, 4> imu_calibration{{1., 0., 0., 0.}};
-
-  problem.AddParameterBlock(imu_calibration.data(), 4,
-                            new ceres::QuaternionParameterization());
-  problem.SetParameterBlockConstant(imu_calibration.data());
-
-  auto imu_it = imu_data_.begin();
-  CHECK(imu_data_.size() == 1 ||
-        std::next(imu_it)->time > timed_pose_queue_.front().time);
-
-  transform::Rigid3d last_node_odometry;
-  common::Time last_node_odometry_time;
-
-  for (size_t i = 1; i < nodes.size(); i++) {
-    const common::Time first_time = node_times[i - 1];
-    const common::Time second_time = node_times[i];
-
-    auto imu_it2 = imu_it;
-    const IntegrateImuResult<double> result =
-        IntegrateImu(imu_data_, first_time, second_time, &imu_it);
-    if ((i + 1) < nodes.size()) {
-      const common::Time third_time = node_times[i + 1];
-      const common::Duration first_duration = second_time - first_time;
-      const common::Duration second_duration = third_time - second_time;
-      const common::Time first_center = first_time + first_duration / 2;
-      const common::Time second_center = second_time + second_duration / 2;
-      const IntegrateImuResult<double> result_to_first_center =
-          IntegrateImu(imu_data_, first_time, first_center, &imu_it2);
-      const IntegrateImuResult<double> result_center_to_center =
-          IntegrateImu(imu_data_, first_center, second_center, &imu_it2);
-      // 'delta_velocity' is the change in velocity from the point in time
-      // halfway between the first and second poses to halfway between
-      // second and third pose. It is computed from IMU data and still
-      // contains a delta due to gravity. The orientation of this vector is
-      // in the IMU frame at the second pose.
-      const Eigen::Vector3d delta_velocity =
-          (result.delta_rotation.inverse() *
-           result_to_first_center.delta_rotation) *
-          result_center_to_center.delta_velocity;
-      problem.AddResidualBlock(
-          AccelerationCostFunction3D::CreateAutoDiffCostFunction(
-              options_.imu_acceleration_weight(), delta_velocity,
-              common::ToSeconds(first_duration),
-              common::ToSeconds(second_duration)),
-          nullptr /* loss function */, nodes.at(i).rotation(),
-          nodes.at(i - 1).translation(), nodes.at(i).translation(),
-          nodes.at(i + 1).translation(), &gravity_constant,
-          imu_calibration.data());
-      // TODO(danielsievers): Fix gravity in CostFunction.
-      if (fix_gravity) {
-        problem.SetParameterBlockConstant(&gravity_constant);
-      } else {
-        // Force gravity constant to be positive.
-        problem.SetParameterLowerBound(&gravity_constant, 0, 0.0);
-      }
-    }
-    problem.AddResidualBlock(
-        RotationCostFunction3D::CreateAutoDiffCostFunction(
-            options_.imu_rotation_weight(), result.delta_rotation),
-        nullptr /* loss function */, nodes.at(i - 1).rotation(),
-        nodes.at(i).rotation(), imu_calibration.data());
-
-    // Add a relative pose constraint based on the odometry (if available).
-    if (HasOdometryDataForTime(first_time) &&
-        HasOdometryDataForTime(second_time)) {
-      // Here keep track of last node odometry to avoid double computation.
-      // Do this if first loop, or if there were some missing odometry nodes
-      // then recalculate.
-      if (i == 1 || last_node_odometry_time != first_time) {
-        last_node_odometry = InterpolateOdometry(first_time);
-        last_node_odometry_time = first_time;
-      }
-      const transform::Rigid3d current_node_odometry =
-          InterpolateOdometry(second_time);
-      const transform::Rigid3d relative_odometry =
-          CalculateOdometryBetweenNodes(last_node_odometry,
-                                        current_node_odometry);
-
-      problem.AddResidualBlock(
-          optimization::SpaCostFunction3D::CreateAutoDiffCostFunction(
-              PoseGraphInterface::Constraint::Pose{
-                  relative_odometry, options_.odometry_translation_weight(),
-                  options_.odometry_rotation_weight()}),
-          nullptr /* loss function */, nodes.at(i - 1).rotation(),
-          nodes.at(i - 1).translation(), nodes.at(i).rotation(),
-          nodes.at(i).translation());
-      // Use the current node odometry in the next iteration
-      last_node_odometry = current_node_odometry;
-      last_node_odometry_time = second_time;
-    }
-  }
+  Node extrapolated_node{time, optimization::FromPose(initial_estimate),
+                         false};
+  AddParameterBlocks(false /* is_newest_pose */, &extrapolated_node);
+  AddMotionResiduals(&prev_prev_node, &prev_node, &extrapolated_node);
 
   // Solve.
   ceres::Solver::Summary summary;
-  ceres::Solve(solver_options_, &problem, &summary);
-  LOG_IF_EVERY_N(INFO, !fix_gravity, 20) << "Gravity was: " << gravity_constant;
+  ceres::Solve(solver_options_, &problem_, &summary);
+  LOG_IF_EVERY_N(INFO, options_.gravity_constant() <= 0, 20)
+      << "Gravity was: " << gravity_constant_;
+  RemoveParameterBlocks(&extrapolated_node);
 
-  const auto gravity_estimate = nodes.back().ToRigid().rotation();
+  const transform::Rigid3d gravity_from_extrapolated =
+      ToRigid(extrapolated_node.gravity_from_tracking);
+  const auto gravity_estimate = gravity_from_extrapolated.rotation();
 
   const auto& last_pose = timed_pose_queue_.back();
   const auto extrapolated_pose = TimestampedTransform{
       time, last_pose.transform *
-                nodes.at(nodes.size() - 2).ToRigid().inverse() *
-                nodes.back().ToRigid()};
+                ToRigid(prev_node.gravity_from_tracking).inverse() *
+                gravity_from_extrapolated};
 
   num_iterations_hist_.Add(summary.iterations.size());
-
-  gravity_from_local_ = gravity_from_local.ToRigid();
-
-  previous_solution_.clear();
-  for (size_t i = 0; i < nodes.size(); ++i) {
-    previous_solution_.push_back(
-        TimestampedTransform{node_times.at(i), nodes.at(i).ToRigid()});
-  }
+  kSolveLatencyMetric->Observe(summary.total_time_in_seconds);
+  kExtrapolationLatencyMetric->Observe(
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+          .count());
 
   const Eigen::Vector3d current_velocity =
       (extrapolated_pose.transform.translation() -
@@ -386,6 +293,126 @@ Eigen::Quaterniond ImuBasedPoseExtrapolator::EstimateGravityOrientation(
       .gravity_from_tracking;
 }
 
+void ImuBasedPoseExtrapolator::RegisterMetrics(
+    metrics::FamilyFactory* family_factory) {
+  auto* latency = family_factory->NewHistogramFamily(
+      "mapping_imu_based_pose_extrapolator_latency",
+      "Duration in seconds to extrapolate poses",
+      metrics::Histogram::ScaledPowersOf(2, 1e-5, 1.));
+  kExtrapolationLatencyMetric = latency->Add({{"stage", "total"}});
+  kSolveLatencyMetric = latency->Add({{"stage", "solve"}});
+}
+
+void ImuBasedPoseExtrapolator::AddParameterBlocks(const bool is_newest_pose,
+                                                  Node* const node) {
+  problem_.AddParameterBlock(node->gravity_from_tracking.translation.data(),
+                             3);
+  problem_.AddParameterBlock(
+      node->gravity_from_tracking.rotation.data(), 4,
+      is_newest_pose ? constant_yaw_quaternion_parameterization_.get()
+                     : quaternion_parameterization_.get());
+  if (is_newest_pose) {
+    problem_.SetParameterBlockConstant(
+        node->gravity_from_tracking.translation.data());
+  }
+}
+
+void ImuBasedPoseExtrapolator::RemoveParameterBlocks(Node* const node) {
+  problem_.RemoveParameterBlock(node->gravity_from_tracking.translation.data());
+  problem_.RemoveParameterBlock(node->gravity_from_tracking.rotation.data());
+}
+
+void ImuBasedPoseExtrapolator::AddResiduals(const size_t index) {
+  Node* const node = &nodes_.at(index);
+  problem_.AddResidualBlock(
+      optimization::SpaCostFunction3D::CreateAutoDiffCostFunction(
+          PoseGraphInterface::Constraint::Pose{
+              timed_pose_queue_.at(index).transform,
+              options_.pose_translation_weight(),
+              options_.pose_rotation_weight()}),
+      nullptr /* loss function */, gravity_from_local_.rotation.data(),
+      gravity_from_local_.translation.data(),
+      node->gravity_from_tracking.rotation.data(),
+      node->gravity_from_tracking.translation.data());
+  node->has_odometry_residual = false;
+  if (index >= 1) {
+    AddMotionResiduals(index >= 2 ? &nodes_[index - 2] : nullptr,
+                       &nodes_[index - 1], node);
+  }
+}
+
+void ImuBasedPoseExtrapolator::AddMotionResiduals(
+    Node* const previous_previous, Node* const previous, Node* const node) {
+  const common::Time first_time = previous->time;
+  const common::Time second_time = node->time;
+  const IntegrateImuResult<double> result =
+      imu_preintegration_.Integrate(first_time, second_time);
+  if (previous_previous != nullptr) {
+    // Constrains the acceleration at 'previous' by the velocities between
+    // 'previous_previous' and 'previous' and between 'previous' and 'node'.
+    const common::Time zeroth_time = previous_previous->time;
+    const common::Duration zeroth_duration = first_time - zeroth_time;
+    const common::Duration first_duration = second_time - first_time;
+    const common::Time zeroth_center = zeroth_time + zeroth_duration / 2;
+    const common::Time first_center = first_time + first_duration / 2;
+    const IntegrateImuResult<double> previous_result =
+        imu_preintegration_.Integrate(zeroth_time, first_time);
+    const IntegrateImuResult<double> result_to_zeroth_center =
+        imu_preintegration_.Integrate(zeroth_time, zeroth_center);
+    const IntegrateImuResult<double> result_center_to_center =
+        imu_preintegration_.Integrate(zeroth_center, first_center);
+    // 'delta_velocity' is the change in velocity from the point in time
+    // halfway between the first and second poses to halfway between
+    // second and third pose. It is computed from IMU data and still
+    // contains a delta due to gravity. The orientation of this vector is
+    // in the IMU frame at the second pose.
+    const Eigen::Vector3d delta_velocity =
+        (previous_result.delta_rotation.inverse() *
+         result_to_zeroth_center.delta_rotation) *
+        result_center_to_center.delta_velocity;
+    problem_.AddResidualBlock(
+        AccelerationCostFunction3D::CreateAutoDiffCostFunction(
+            options_.imu_acceleration_weight(), delta_velocity,
+            common::ToSeconds(zeroth_duration),
+            common::ToSeconds(first_duration)),
+        nullptr /* loss function */,
+        previous->gravity_from_tracking.rotation.data(),
+        previous_previous->gravity_from_tracking.translation.data(),
+        previous->gravity_from_tracking.translation.data(),
+        node->gravity_from_tracking.translation.data(), &gravity_constant_,
+        imu_calibration_.data());
+  }
+  problem_.AddResidualBlock(
+      RotationCostFunction3D::CreateAutoDiffCostFunction(
+          options_.imu_rotation_weight(), result.delta_rotation),
+      nullptr /* loss function */,
+      previous->gravity_from_tracking.rotation.data(),
+      node->gravity_from_tracking.rotation.data(), imu_calibration_.data());
+  AddOdometryResidual(previous, node);
+}
+
+void ImuBasedPoseExtrapolator::AddOdometryResidual(Node* const previous,
+                                                   Node* const node) {
+  // Add a relative pose constraint based on the odometry (if available).
+  if (!HasOdometryDataForTime(previous->time) ||
+      !HasOdometryDataForTime(node->time)) {
+    return;
+  }
+  const transform::Rigid3d relative_odometry = CalculateOdometryBetweenNodes(
+      InterpolateOdometry(previous->time), InterpolateOdometry(node->time));
+  problem_.AddResidualBlock(
+      optimization::SpaCostFunction3D::CreateAutoDiffCostFunction(
+          PoseGraphInterface::Constraint::Pose{
+              relative_odometry, options_.odometry_translation_weight(),
+              options_.odometry_rotation_weight()}),
+      nullptr /* loss function */,
+      previous->gravity_from_tracking.rotation.data(),
+      previous->gravity_from_tracking.translation.data(),
+      node->gravity_from_tracking.rotation.data(),
+      node->gravity_from_tracking.translation.data());
+  node->has_odometry_residual = true;
+}
+
 template <typename T>
 void ImuBasedPoseExtrapolator::TrimDequeData(std::deque<T>* data) {
   while (data->size() > 1 && !timed_pose_queue_.empty() &&
@@ -395,7 +422,9 @@ void ImuBasedPoseExtrapolator::TrimDequeData(std::deque<T>* data) {
 }
 
 void ImuBasedPoseExtrapolator::TrimImuData() {
-  TrimDequeData<sensor::ImuData>(&imu_data_);
+  if (!timed_pose_queue_.empty()) {
+    imu_preintegration_.TrimBefore(timed_pose_queue_.front().time);
+  }
 }
 
 void ImuBasedPoseExtrapolator::TrimOdometryData() {
@@ -17,20 +17,30 @@
 #ifndef CARTOGRAPHER_MAPPING_IMU_BASED_POSE_EXTRAPOLATOR_H_
 #define CARTOGRAPHER_MAPPING_IMU_BASED_POSE_EXTRAPOLATOR_H_
 
+#include <array>
 #include <deque>
 #include <memory>
 #include <vector>
 
 #include "cartographer/common/internal/ceres_solver_options.h"
 #include "cartographer/common/histogram.h"
+#include "cartographer/mapping/internal/3d/imu_preintegration.h"
+#include "cartographer/mapping/internal/optimization/ceres_pose.h"
 #include "cartographer/mapping/pose_extrapolator_interface.h"
+#include "cartographer/metrics/family_factory.h"
 #include "cartographer/sensor/imu_data.h"
 #include "cartographer/transform/timestamped_transform.h"
+#include "ceres/ceres.h"
 
 namespace cartographer {
 namespace mapping {
 
 // Uses the linear acceleration and rotational velocities to estimate a pose.
+//
+// The poses in the queue are kept in an optimization problem together with
+// their residuals, which is updated as poses are added and dropped, so that
+// each extrapolation only adds the extrapolated pose and warm-starts from the
+// previous solution.
 class ImuBasedPoseExtrapolator : public PoseExtrapolatorInterface {
  public:
   explicit ImuBasedPoseExtrapolator(
@@ -59,7 +69,33 @@ class ImuBasedPoseExtrapolator : public PoseExtrapolatorInterface {
   // Gravity alignment estimate.
   Eigen::Quaterniond EstimateGravityOrientation(common::Time time) override;
 
+  static void RegisterMetrics(metrics::FamilyFactory* family_factory);
+
+  // For testing.
+  int num_parameter_blocks() const { return problem_.NumParameterBlocks(); }
+  int num_residual_blocks() const { return problem_.NumResidualBlocks(); }
+
  private:
+  // A pose in the optimization problem.
+  struct Node {
+    common::Time time;
+    optimization::CeresPose::Data gravity_from_tracking;
+    // Whether the odometry residual to the previous node was added.
+    bool has_odometry_residual;
+  };
+
+  // Adds the parameter blocks of 'node' to 'problem_'. The translation and yaw
+  // of the newest pose are fixed.
+  void AddParameterBlocks(bool is_newest_pose, Node* node);
+  // Removes the parameter blocks of 'node' and all residuals using them.
+  void RemoveParameterBlocks(Node* node);
+  // Adds the residuals between 'nodes_[index]' and earlier nodes.
+  void AddResiduals(size_t index);
+  // Adds the IMU and odometry residuals from 'previous_previous', which may be
+  // null, and 'previous' to 'node'.
+  void AddMotionResiduals(Node* previous_previous, Node* previous, Node* node);
+  void AddOdometryResidual(Node* previous, Node* node);
+
   template <typename T>
   void TrimDequeData(std::deque<T>* data);
 
@@ -81,18 +117,27 @@ class ImuBasedPoseExtrapolator : public PoseExtrapolatorInterface {
       const std::vector<common::Time>::const_iterator times_end);
 
   std::deque<::cartographer::transform::TimestampedTransform> timed_pose_queue_;
-  std::deque<::cartographer::transform::TimestampedTransform>
-      previous_solution_;
 
-  std::deque<sensor::ImuData> imu_data_;
+  ImuPreintegration imu_preintegration_;
   std::deque<sensor::OdometryData> odometry_data_;
   common::Time last_extrapolated_time_ = common::Time::min();
 
-  transform::Rigid3d gravity_from_local_ = transform::Rigid3d::Identity();
-
   const proto::ImuBasedPoseExtrapolatorOptions options_;
   const ceres::Solver::Options solver_options_;
 
+  // Parameterizations shared by all parameter blocks, owned here since
+  // parameter blocks are removed from 'problem_' while it is alive.
+  const std::unique_ptr<ceres::LocalParameterization>
+      quaternion_parameterization_;
+  const std::unique_ptr<ceres::LocalParameterization>
+      constant_yaw_quaternion_parameterization_;
+  ceres::Problem problem_;
+  optimization::CeresPose::Data gravity_from_local_;
+  double gravity_constant_;
+  std::array<double, 4> imu_calibration_{{1., 0., 0., 0.}};
+  // One node per pose in 'timed_pose_queue_'.
+  std::deque<Node> nodes_;
+
   common::Histogram num_iterations_hist_;
 };
 
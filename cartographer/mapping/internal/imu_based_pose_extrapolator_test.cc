@@ -0,0 +1,334 @@
+/*
+ * Copyright 2018 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/internal/imu_based_pose_extrapolator.h"
+
+#include <algorithm>
+#include <array>
+#include <deque>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "cartographer/common/internal/ceres_solver_options.h"
+#include "cartographer/common/internal/testing/lua_parameter_dictionary_test_helpers.h"
+#include "cartographer/mapping/internal/3d/imu_integration.h"
+#include "cartographer/mapping/internal/3d/imu_preintegration.h"
+#include "cartographer/mapping/internal/3d/rotation_parameterization.h"
+#include "cartographer/mapping/internal/optimization/ceres_pose.h"
+#include "cartographer/mapping/internal/optimization/cost_functions/acceleration_cost_function_3d.h"
+#include "cartographer/mapping/internal/optimization/cost_functions/rotation_cost_function_3d.h"
+#include "cartographer/mapping/internal/optimization/cost_functions/spa_cost_function_3d.h"
+#include "cartographer/mapping/pose_graph_interface.h"
+#include "cartographer/transform/rigid_transform_test_helpers.h"
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace mapping {
+namespace {
+
+using transform::TimestampedTransform;
+
+constexpr double kGravityConstant = 9.806;
+constexpr double kPoseQueueDuration = 1.;
+constexpr double kAngularVelocity = 0.3;
+constexpr double kLinearVelocity = 1.;
+constexpr double kLinearAcceleration = 0.5;
+constexpr double kImuPeriod = 0.005;
+constexpr double kPosePeriod = 0.1;
+constexpr double kExtrapolationDuration = 0.05;
+constexpr double kPrecision = 1e-3;
+
+proto::ImuBasedPoseExtrapolatorOptions CreateOptions() {
+  auto parameter_dictionary = common::MakeDictionary(R"text(
+      return {
+        use_imu_based = true,
+        constant_velocity = {
+          imu_gravity_time_constant = 10.,
+          pose_queue_duration = 0.001,
+        },
+        imu_based = {
+          pose_queue_duration = 1.,
+          gravity_constant = 9.806,
+          pose_translation_weight = 1.,
+          pose_rotation_weight = 1.,
+          imu_acceleration_weight = 1.,
+          imu_rotation_weight = 1.,
+          odometry_translation_weight = 1.,
+          odometry_rotation_weight = 1.,
+          solver_options = {
+            use_nonmonotonic_steps = false,
+            max_num_iterations = 50,
+            num_threads = 1,
+          },
+        },
+      })text");
+  return CreatePoseExtrapolatorOptions(parameter_dictionary.get()).imu_based();
+}
+
+// Rotates about the z-axis at a constant rate while accelerating along the
+// x-axis.
+transform::Rigid3d GroundTruthPose(const double t) {
+  return transform::Rigid3d(
+      Eigen::Vector3d(kLinearVelocity * t + 0.5 * kLinearAcceleration * t * t,
+                      0., 0.),
+      Eigen::Quaterniond(
+          Eigen::AngleAxisd(kAngularVelocity * t, Eigen::Vector3d::UnitZ())));
+}
+
+sensor::ImuData GroundTruthImuData(const common::Time time, const double t) {
+  return sensor::ImuData{
+      time,
+      GroundTruthPose(t).rotation().inverse() *
+          Eigen::Vector3d(kLinearAcceleration, 0., kGravityConstant),
+      Eigen::Vector3d(0., 0., kAngularVelocity)};
+}
+
+// The implementation before the problem was kept across extrapolations: a new
+// problem is built from the whole pose queue on every extrapolation. Odometry
+// is not used by these tests and left out.
+class RebuildingPoseExtrapolator {
+ public:
+  explicit RebuildingPoseExtrapolator(
+      const proto::ImuBasedPoseExtrapolatorOptions& options)
+      : options_(options),
+        solver_options_(
+            common::CreateCeresSolverOptions(options_.solver_options())) {}
+
+  void AddPose(const common::Time time, const transform::Rigid3d& pose) {
+    timed_pose_queue_.push_back(TimestampedTransform{time, pose});
+    while (timed_pose_queue_.size() > 3 &&
+           timed_pose_queue_[1].time <=
+               time - common::FromSeconds(options_.pose_queue_duration())) {
+      if (!previous_solution_.empty()) {
+        previous_solution_.pop_front();
+      }
+      timed_pose_queue_.pop_front();
+    }
+    imu_preintegration_.TrimBefore(timed_pose_queue_.front().time);
+  }
+
+  void AddImuData(const sensor::ImuData& imu_data) {
+    imu_preintegration_.Add(imu_data);
+  }
+
+  transform::Rigid3d ExtrapolatePose(const common::Time time) {
+    if (timed_pose_queue_.size() < 3) {
+      return timed_pose_queue_.back().transform;
+    }
+    ceres::Problem problem;
+    optimization::CeresPose gravity_from_local(
+        gravity_from_local_, nullptr,
+        absl::make_unique<ceres::QuaternionParameterization>(), &problem);
+    std::deque<optimization::CeresPose> nodes;
+    std::vector<common::Time> node_times;
+    for (size_t i = 0; i < timed_pose_queue_.size(); ++i) {
+      const bool is_last = (i == timed_pose_queue_.size() - 1);
+      const TimestampedTransform& timed_pose = timed_pose_queue_[i];
+      node_times.push_back(timed_pose.time);
+      const transform::Rigid3d gravity_from_node =
+          i < previous_solution_.size() && !is_last &&
+                  previous_solution_[i].time == timed_pose.time
+              ? previous_solution_[i].transform
+              : gravity_from_local_ * timed_pose.transform;
+      if (is_last) {
+        nodes.emplace_back(
+            gravity_from_node, nullptr,
+            absl::make_unique<ceres::AutoDiffLocalParameterization<
+                ConstantYawQuaternionPlus, 4, 2>>(),
+            &problem);
+        problem.SetParameterBlockConstant(nodes.back().translation());
+      } else {
+        nodes.emplace_back(
+            gravity_from_node, nullptr,
+            absl::make_unique<ceres::QuaternionParameterization>(), &problem);
+      }
+    }
+    double gravity_constant = options_.gravity_constant();
+    const transform::Rigid3d initial_estimate =
+        ExtrapolatePoseWithImu<double>(
+            nodes.back().ToRigid(), node_times.back(),
+            nodes.at(nodes.size() - 2).ToRigid(),
+            node_times.at(node_times.size() - 2),
+            gravity_constant * Eigen::Vector3d::UnitZ(), time,
+            imu_preintegration_.Integrate(node_times.back(), time))
+            .pose;
+    nodes.emplace_back(initial_estimate, nullptr,
+                       absl::make_unique<ceres::QuaternionParameterization>(),
+                       &problem);
+    node_times.push_back(time);
+
+    for (size_t i = 0; i < timed_pose_queue_.size(); ++i) {
+      problem.AddResidualBlock(
+          optimization::SpaCostFunction3D::CreateAutoDiffCostFunction(
+              PoseGraphInterface::Constraint::Pose{
+                  timed_pose_queue_[i].transform,
+                  options_.pose_translation_weight(),
+                  options_.pose_rotation_weight()}),
+          nullptr /* loss function */, gravity_from_local.rotation(),
+          gravity_from_local.translation(), nodes.at(i).rotation(),
+          nodes.at(i).translation());
+    }
+    std::array<double, 4> imu_calibration{{1., 0., 0., 0.}};
+    problem.AddParameterBlock(imu_calibration.data(), 4,
+                              new ceres::QuaternionParameterization());
+    problem.SetParameterBlockConstant(imu_calibration.data());
+    for (size_t i = 1; i < nodes.size(); ++i) {
+      const common::Time first_time = node_times[i - 1];
+      const common::Time second_time = node_times[i];
+      const IntegrateImuResult<double> result =
+          imu_preintegration_.Integrate(first_time, second_time);
+      if (i + 1 < nodes.size()) {
+        const common::Time third_time = node_times[i + 1];
+        const common::Duration first_duration = second_time - first_time;
+        const common::Duration second_duration = third_time - second_time;
+        const common::Time first_center = first_time + first_duration / 2;
+        const common::Time second_center = second_time + second_duration / 2;
+        const IntegrateImuResult<double> result_to_first_center =
+            imu_preintegration_.Integrate(first_time, first_center);
+        const IntegrateImuResult<double> result_center_to_center =
+            imu_preintegration_.Integrate(first_center, second_center);
+        const Eigen::Vector3d delta_velocity =
+            (result.delta_rotation.inverse() *
+             result_to_first_center.delta_rotation) *
+            result_center_to_center.delta_velocity;
+        problem.AddResidualBlock(
+            AccelerationCostFunction3D::CreateAutoDiffCostFunction(
+                options_.imu_acceleration_weight(), delta_velocity,
+                common::ToSeconds(first_duration),
+                common::ToSeconds(second_duration)),
+            nullptr /* loss function */, nodes.at(i).rotation(),
+            nodes.at(i - 1).translation(), nodes.at(i).translation(),
+            nodes.at(i + 1).translation(), &gravity_constant,
+            imu_calibration.data());
+        problem.SetParameterBlockConstant(&gravity_constant);
+      }
+      problem.AddResidualBlock(
+          RotationCostFunction3D::CreateAutoDiffCostFunction(
+              options_.imu_rotation_weight(), result.delta_rotation),
+          nullptr /* loss function */, nodes.at(i - 1).rotation(),
+          nodes.at(i).rotation(), imu_calibration.data());
+    }
+
+    ceres::Solver::Summary summary;
+    ceres::Solve(solver_options_, &problem, &summary);
+
+    gravity_from_local_ = gravity_from_local.ToRigid();
+    previous_solution_.clear();
+    for (size_t i = 0; i < nodes.size(); ++i) {
+      previous_solution_.push_back(
+          TimestampedTransform{node_times.at(i), nodes.at(i).ToRigid()});
+    }
+    return timed_pose_queue_.back().transform *
+           nodes.at(nodes.size() - 2).ToRigid().inverse() *
+           nodes.back().ToRigid();
+  }
+
+ private:
+  const proto::ImuBasedPoseExtrapolatorOptions options_;
+  const ceres::Solver::Options solver_options_;
+  std::deque<TimestampedTransform> timed_pose_queue_;
+  std::deque<TimestampedTransform> previous_solution_;
+  ImuPreintegration imu_preintegration_;
+  transform::Rigid3d gravity_from_local_ = transform::Rigid3d::Identity();
+};
+
+class ImuBasedPoseExtrapolatorTest : public ::testing::Test {
+ protected:
+  ImuBasedPoseExtrapolatorTest()
+      : options_(CreateOptions()),
+        start_time_(common::FromUniversal(1000)),
+        extrapolator_(options_),
+        reference_extrapolator_(options_) {}
+
+  common::Time ToTime(const double t) const {
+    return start_time_ + common::FromSeconds(t);
+  }
+
+  // Adds ground truth IMU data up to 't' to both extrapolators.
+  void AddImuDataUntil(const double t) {
+    for (; next_imu_t_ <= t; next_imu_t_ += kImuPeriod) {
+      const sensor::ImuData imu_data =
+          GroundTruthImuData(ToTime(next_imu_t_), next_imu_t_);
+      extrapolator_.AddImuData(imu_data);
+      reference_extrapolator_.AddImuData(imu_data);
+    }
+  }
+
+  const proto::ImuBasedPoseExtrapolatorOptions options_;
+  const common::Time start_time_;
+  double next_imu_t_ = 0.;
+  ImuBasedPoseExtrapolator extrapolator_;
+  RebuildingPoseExtrapolator reference_extrapolator_;
+};
+
+TEST_F(ImuBasedPoseExtrapolatorTest, MatchesRebuildingTheProblem) {
+  AddImuDataUntil(0.);
+  // Long enough for poses to be dropped from the pose queue.
+  for (double t = kPosePeriod; t < 3. * kPoseQueueDuration; t += kPosePeriod) {
+    AddImuDataUntil(t + kExtrapolationDuration);
+    extrapolator_.AddPose(ToTime(t), GroundTruthPose(t));
+    reference_extrapolator_.AddPose(ToTime(t), GroundTruthPose(t));
+    const common::Time time = ToTime(t + kExtrapolationDuration);
+    const transform::Rigid3d expected_pose =
+        reference_extrapolator_.ExtrapolatePose(time);
+    EXPECT_THAT(extrapolator_.ExtrapolatePose(time),
+                transform::IsNearly(expected_pose, kPrecision))
+        << "t = " << t;
+  }
+}
+
+TEST_F(ImuBasedPoseExtrapolatorTest, RemovesDroppedPosesFromTheProblem) {
+  // Gravity from local, the gravity constant and the IMU calibration.
+  constexpr int kNumConstantParameterBlocks = 4;
+  EXPECT_EQ(extrapolator_.num_parameter_blocks(), kNumConstantParameterBlocks);
+  EXPECT_EQ(extrapolator_.num_residual_blocks(), 0);
+  AddImuDataUntil(0.);
+  // Mirrors the pose queue of the extrapolator.
+  std::deque<common::Time> pose_times;
+  for (double t = kPosePeriod; t < 3. * kPoseQueueDuration; t += kPosePeriod) {
+    AddImuDataUntil(t + kExtrapolationDuration);
+    extrapolator_.AddPose(ToTime(t), GroundTruthPose(t));
+    pose_times.push_back(ToTime(t));
+    while (pose_times.size() > 3 &&
+           pose_times[1] <=
+               ToTime(t) - common::FromSeconds(kPoseQueueDuration)) {
+      pose_times.pop_front();
+    }
+    const int num_poses = pose_times.size();
+    // Two parameter blocks per pose. Each pose has a pose residual, a
+    // rotation residual to the previous pose and an acceleration residual
+    // with the two previous poses.
+    const int expected_num_parameter_blocks =
+        kNumConstantParameterBlocks + 2 * num_poses;
+    const int expected_num_residual_blocks =
+        num_poses + std::max(num_poses - 1, 0) + std::max(num_poses - 2, 0);
+    EXPECT_EQ(extrapolator_.num_parameter_blocks(),
+              expected_num_parameter_blocks);
+    EXPECT_EQ(extrapolator_.num_residual_blocks(),
+              expected_num_residual_blocks);
+    // The extrapolated pose is only temporarily part of the problem.
+    extrapolator_.ExtrapolatePose(ToTime(t + kExtrapolationDuration));
+    EXPECT_EQ(extrapolator_.num_parameter_blocks(),
+              expected_num_parameter_blocks);
+    EXPECT_EQ(extrapolator_.num_residual_blocks(),
+              expected_num_residual_blocks);
+  }
+  EXPECT_LT(pose_times.size(), 3. * kPoseQueueDuration / kPosePeriod - 1.);
+}
+
+}  // namespace
+}  // namespace mapping
+}  // namespace cartographer
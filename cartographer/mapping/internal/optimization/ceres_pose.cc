@@ -39,6 +39,17 @@ CeresPose::CeresPose(
                              rotation_parametrization.release());
 }
 
+CeresPose::CeresPose(std::shared_ptr<Data> data,
+                     ceres::LocalParameterization* translation_parametrization,
+                     ceres::LocalParameterization* rotation_parametrization,
+                     ceres::Problem* problem)
+    : data_(std::move(data)) {
+  problem->AddParameterBlock(data_->translation.data(), 3,
+                             translation_parametrization);
+  problem->AddParameterBlock(data_->rotation.data(), 4,
+                             rotation_parametrization);
+}
+
 const transform::Rigid3d CeresPose::ToRigid() const {
   return transform::Rigid3d::FromArrays(data_->rotation, data_->translation);
 }
@@ -30,12 +30,27 @@ namespace optimization {
 
 class CeresPose {
  public:
+  struct Data {
+    std::array<double, 3> translation;
+    // Rotation quaternion as (w, x, y, z).
+    std::array<double, 4> rotation;
+  };
+
   CeresPose(
       const transform::Rigid3d& rigid,
       std::unique_ptr<ceres::LocalParameterization> translation_parametrization,
       std::unique_ptr<ceres::LocalParameterization> rotation_parametrization,
       ceres::Problem* problem);
 
+  // Uses the already initialized 'data' for the parameter blocks, which may
+  // point into storage shared by many poses to avoid an allocation per pose.
+  // The parametrizations may be used for other parameter blocks of 'problem'
+  // as well; unless configured otherwise, 'problem' deletes each one once.
+  CeresPose(std::shared_ptr<Data> data,
+            ceres::LocalParameterization* translation_parametrization,
+            ceres::LocalParameterization* rotation_parametrization,
+            ceres::Problem* problem);
+
   const transform::Rigid3d ToRigid() const;
 
   double* translation() { return data_->translation.data(); }
@@ -44,12 +59,6 @@ class CeresPose {
   double* rotation() { return data_->rotation.data(); }
   const double* rotation() const { return data_->rotation.data(); }
 
-  struct Data {
-    std::array<double, 3> translation;
-    // Rotation quaternion as (w, x, y, z).
-    std::array<double, 4> rotation;
-  };
-
   Data& data() { return *data_; }
 
  private:
@@ -24,12 +24,15 @@
 #include <string>
 #include <vector>
 
+#include "absl/memory/memory.h"
 #include "cartographer/common/internal/ceres_solver_options.h"
+#include "cartographer/common/internal/parallel_for.h"
 #include "cartographer/common/histogram.h"
 #include "cartographer/common/math.h"
 #include "cartographer/mapping/internal/optimization/ceres_pose.h"
 #include "cartographer/mapping/internal/optimization/cost_functions/landmark_cost_function_2d.h"
 #include "cartographer/mapping/internal/optimization/cost_functions/spa_cost_function_2d.h"
+#include "cartographer/mapping/internal/optimization/submap_level_optimization.h"
 #include "cartographer/sensor/odometry_data.h"
 #include "cartographer/transform/transform.h"
 #include "ceres/ceres.h"
@@ -106,63 +109,39 @@ transform::Rigid3d GetInitialLandmarkPose(
          observation.landmark_to_tracking_transform;
 }
 
-void AddLandmarkCostFunctions(
-    const std::map<std::string, LandmarkNode>& landmark_nodes,
-    const MapById<NodeId, NodeSpec2D>& node_data,
-    MapById<NodeId, std::array<double, 3>>* C_nodes,
-    std::map<std::string, CeresPose>* C_landmarks, ceres::Problem* problem,
-    double huber_scale) {
-  for (const auto& landmark_node : landmark_nodes) {
-    for (const auto& observation : landmark_node.second.landmark_observations) {
-      const std::string& landmark_id = landmark_node.first;
-      const auto& begin_of_trajectory =
-          node_data.BeginOfTrajectory(observation.trajectory_id);
-      // The landmark observation was made before the trajectory was created.
-      if (observation.time < begin_of_trajectory->data.time) {
-        continue;
-      }
-      // Find the trajectory nodes before and after the landmark observation.
-      auto next =
-          node_data.lower_bound(observation.trajectory_id, observation.time);
-      // The landmark observation was made, but the next trajectory node has
-      // not been added yet.
-      if (next == node_data.EndOfTrajectory(observation.trajectory_id)) {
-        continue;
-      }
-      if (next == begin_of_trajectory) {
-        next = std::next(next);
-      }
-      auto prev = std::prev(next);
-      // Add parameter blocks for the landmark ID if they were not added before.
-      std::array<double, 3>* prev_node_pose = &C_nodes->at(prev->id);
-      std::array<double, 3>* next_node_pose = &C_nodes->at(next->id);
-      if (!C_landmarks->count(landmark_id)) {
-        const transform::Rigid3d starting_point =
-            landmark_node.second.global_landmark_pose.has_value()
-                ? landmark_node.second.global_landmark_pose.value()
-                : GetInitialLandmarkPose(observation, prev->data, next->data,
-                                         *prev_node_pose, *next_node_pose);
-        C_landmarks->emplace(
-            landmark_id,
-            CeresPose(starting_point, nullptr /* translation_parametrization */,
-                      absl::make_unique<ceres::QuaternionParameterization>(),
-                      problem));
-        // Set landmark constant if it is frozen.
-        if (landmark_node.second.frozen) {
-          problem->SetParameterBlockConstant(
-              C_landmarks->at(landmark_id).translation());
-          problem->SetParameterBlockConstant(
-              C_landmarks->at(landmark_id).rotation());
-        }
-      }
-      problem->AddResidualBlock(
-          LandmarkCostFunction2D::CreateAutoDiffCostFunction(
-              observation, prev->data, next->data),
-          new ceres::HuberLoss(huber_scale), prev_node_pose->data(),
-          next_node_pose->data(), C_landmarks->at(landmark_id).rotation(),
-          C_landmarks->at(landmark_id).translation());
-    }
+bool IsSamePose(const PoseGraphInterface::Constraint::Pose& a,
+                const PoseGraphInterface::Constraint::Pose& b) {
+  return a.zbar_ij.translation() == b.zbar_ij.translation() &&
+         a.zbar_ij.rotation().coeffs() == b.zbar_ij.rotation().coeffs() &&
+         a.translation_weight == b.translation_weight &&
+         a.rotation_weight == b.rotation_weight;
+}
+
+bool IsSameConstraint(const PoseGraphInterface::Constraint& a,
+                      const PoseGraphInterface::Constraint& b) {
+  return a.submap_id == b.submap_id && a.node_id == b.node_id &&
+         a.tag == b.tag && IsSamePose(a.pose, b.pose);
+}
+
+// Returns the first node of 'trajectory_id' with an index of at least
+// 'node_index'. Searches backwards from the end, so this is fast for recently
+// added nodes.
+MapById<NodeId, NodeSpec2D>::ConstIterator FindFirstNodeFrom(
+    const MapById<NodeId, NodeSpec2D>& node_data, const int trajectory_id,
+    const int node_index) {
+  const auto begin_it = node_data.BeginOfTrajectory(trajectory_id);
+  auto it = node_data.EndOfTrajectory(trajectory_id);
+  while (it != begin_it && std::prev(it)->id.node_index >= node_index) {
+    --it;
   }
+  return it;
+}
+
+ceres::Problem::Options CreateProblemOptions() {
+  ceres::Problem::Options problem_options;
+  // Nodes, submaps and constraints are removed from a kept problem.
+  problem_options.enable_fast_removal = true;
+  return problem_options;
 }
 
 }  // namespace
@@ -192,19 +171,37 @@ void OptimizationProblem2D::AddFixedFramePoseData(
 
 void OptimizationProblem2D::AddTrajectoryNode(const int trajectory_id,
                                               const NodeSpec2D& node_data) {
-  node_data_.Append(trajectory_id, node_data);
+  const NodeId node_id = node_data_.Append(trajectory_id, node_data);
   trajectory_data_[trajectory_id];
+  if (problem_ != nullptr) {
+    nodes_to_add_.push_back(node_id);
+  }
 }
 
 void OptimizationProblem2D::SetTrajectoryData(
     int trajectory_id, const TrajectoryData& trajectory_data) {
   trajectory_data_[trajectory_id] = trajectory_data;
+  // The fixed frame origin is only initialized from 'trajectory_data' when the
+  // problem is built.
+  ResetProblem();
 }
 
 void OptimizationProblem2D::InsertTrajectoryNode(const NodeId& node_id,
                                                  const NodeSpec2D& node_data) {
   node_data_.Insert(node_id, node_data);
   trajectory_data_[node_id.trajectory_id];
+  if (problem_ == nullptr) {
+    return;
+  }
+  const int trajectory_id = node_id.trajectory_id;
+  if (node_id.node_index < next_local_slam_pose_node_index_[trajectory_id] ||
+      node_id.node_index < next_odometry_node_index_[trajectory_id] ||
+      node_id.node_index < next_fixed_frame_pose_node_index_[trajectory_id]) {
+    // Residuals of the following nodes were already added without this node.
+    ResetProblem();
+    return;
+  }
+  nodes_to_add_.push_back(node_id);
 }
 
 void OptimizationProblem2D::TrimTrajectoryNode(const NodeId& node_id) {
@@ -212,23 +209,44 @@ void OptimizationProblem2D::TrimTrajectoryNode(const NodeId& node_id) {
   odometry_data_.Trim(node_data_, node_id);
   fixed_frame_pose_data_.Trim(node_data_, node_id);
   node_data_.Trim(node_id);
+  if (problem_ != nullptr && C_nodes_.Contains(node_id)) {
+    // This also removes the residuals of the node.
+    problem_->RemoveParameterBlock(C_nodes_.at(node_id).data());
+    C_nodes_.Trim(node_id);
+  }
   if (node_data_.SizeOfTrajectoryOrZero(node_id.trajectory_id) == 0) {
     trajectory_data_.erase(node_id.trajectory_id);
+    const auto it = C_fixed_frames_.find(node_id.trajectory_id);
+    if (it != C_fixed_frames_.end()) {
+      problem_->RemoveParameterBlock(it->second.data());
+      C_fixed_frames_.erase(it);
+    }
   }
 }
 
 void OptimizationProblem2D::AddSubmap(
     const int trajectory_id, const transform::Rigid2d& global_submap_pose) {
-  submap_data_.Append(trajectory_id, SubmapSpec2D{global_submap_pose});
+  const SubmapId submap_id =
+      submap_data_.Append(trajectory_id, SubmapSpec2D{global_submap_pose});
+  if (problem_ != nullptr) {
+    submaps_to_add_.push_back(submap_id);
+  }
 }
 
 void OptimizationProblem2D::InsertSubmap(
     const SubmapId& submap_id, const transform::Rigid2d& global_submap_pose) {
   submap_data_.Insert(submap_id, SubmapSpec2D{global_submap_pose});
+  if (problem_ != nullptr) {
+    submaps_to_add_.push_back(submap_id);
+  }
 }
 
 void OptimizationProblem2D::TrimSubmap(const SubmapId& submap_id) {
   submap_data_.Trim(submap_id);
+  if (problem_ != nullptr && C_submaps_.Contains(submap_id)) {
+    problem_->RemoveParameterBlock(C_submaps_.at(submap_id).data());
+    C_submaps_.Trim(submap_id);
+  }
 }
 
 void OptimizationProblem2D::SetMaxNumIterations(
@@ -237,6 +255,65 @@ void OptimizationProblem2D::SetMaxNumIterations(
       max_num_iterations);
 }
 
+void OptimizationProblem2D::SetThreadPool(
+    common::ThreadPoolInterface* const thread_pool) {
+  thread_pool_ = thread_pool;
+}
+
+std::unique_ptr<OptimizationProblem2D> OptimizationProblem2D::CopyData()
+    const {
+  auto copy = absl::make_unique<OptimizationProblem2D>(options_);
+  copy->thread_pool_ = thread_pool_;
+  copy->node_data_ = node_data_;
+  copy->submap_data_ = submap_data_;
+  copy->landmark_data_ = landmark_data_;
+  copy->empty_imu_data_ = empty_imu_data_;
+  copy->odometry_data_ = odometry_data_;
+  copy->fixed_frame_pose_data_ = fixed_frame_pose_data_;
+  copy->trajectory_data_ = trajectory_data_;
+  return copy;
+}
+
+void OptimizationProblem2D::MergeSolution(
+    const OptimizationProblem2D& solved_problem,
+    const std::map<int, transform::Rigid2d>& corrections) {
+  for (const auto& submap_id_data : submap_data_) {
+    auto& global_pose = submap_data_.at(submap_id_data.id).global_pose;
+    if (solved_problem.submap_data_.Contains(submap_id_data.id)) {
+      global_pose =
+          solved_problem.submap_data_.at(submap_id_data.id).global_pose;
+      continue;
+    }
+    const auto it = corrections.find(submap_id_data.id.trajectory_id);
+    if (it != corrections.end()) {
+      global_pose = it->second * global_pose;
+    }
+  }
+  for (const auto& node_id_data : node_data_) {
+    auto& global_pose = node_data_.at(node_id_data.id).global_pose_2d;
+    if (solved_problem.node_data_.Contains(node_id_data.id)) {
+      global_pose =
+          solved_problem.node_data_.at(node_id_data.id).global_pose_2d;
+      continue;
+    }
+    const auto it = corrections.find(node_id_data.id.trajectory_id);
+    if (it != corrections.end()) {
+      global_pose = it->second * global_pose;
+    }
+  }
+  for (auto& trajectory_data : trajectory_data_) {
+    const auto it = solved_problem.trajectory_data_.find(trajectory_data.first);
+    if (it != solved_problem.trajectory_data_.end()) {
+      trajectory_data.second = it->second;
+    }
+  }
+  for (const auto& landmark : solved_problem.landmark_data_) {
+    landmark_data_[landmark.first] = landmark.second;
+  }
+  // Poses were changed outside of a kept problem.
+  ResetProblem();
+}
+
 void OptimizationProblem2D::Solve(
     const std::vector<Constraint>& constraints,
     const std::map<int, PoseGraphInterface::TrajectoryState>&
@@ -254,14 +331,38 @@ void OptimizationProblem2D::Solve(
     }
   }
 
+  UpdateProblem(constraints, frozen_trajectories, landmark_nodes);
+
+  // Solve.
+  ceres::Solver::Summary summary;
+  ceres::Solve(
+      common::CreateCeresSolverOptions(options_.ceres_solver_options()),
+      problem_.get(), &summary);
+  if (options_.log_solver_summary()) {
+    LOG(INFO) << summary.FullReport();
+  }
+
+  StoreSolution();
+  if (!options_.use_persistent_problem_in_2d()) {
+    ResetProblem();
+  }
+}
+
+void OptimizationProblem2D::SolveSubmapPoses(
+    const std::vector<Constraint>& constraints,
+    const std::map<int, PoseGraphInterface::TrajectoryState>&
+        trajectories_state) {
+  if (submap_data_.empty()) {
+    return;
+  }
+  // Poses are changed outside of a kept problem.
+  ResetProblem();
+  const std::set<int> frozen_trajectories =
+      GetFrozenTrajectories(trajectories_state);
+
   ceres::Problem::Options problem_options;
   ceres::Problem problem(problem_options);
-
-  // Set the starting point.
-  // TODO(hrapp): Move ceres data into SubmapSpec.
   MapById<SubmapId, std::array<double, 3>> C_submaps;
-  MapById<NodeId, std::array<double, 3>> C_nodes;
-  std::map<std::string, CeresPose> C_landmarks;
   bool first_submap = true;
   for (const auto& submap_id_data : submap_data_) {
     const bool frozen =
@@ -271,70 +372,171 @@ void OptimizationProblem2D::Solve(
     problem.AddParameterBlock(C_submaps.at(submap_id_data.id).data(), 3);
     if (first_submap || frozen) {
       first_submap = false;
-      // Fix the pose of the first submap or all submaps of a frozen
-      // trajectory.
       problem.SetParameterBlockConstant(C_submaps.at(submap_id_data.id).data());
     }
   }
-  for (const auto& node_id_data : node_data_) {
-    const bool frozen =
-        frozen_trajectories.count(node_id_data.id.trajectory_id) != 0;
-    C_nodes.Insert(node_id_data.id, FromPose(node_id_data.data.global_pose_2d));
-    problem.AddParameterBlock(C_nodes.at(node_id_data.id).data(), 3);
-    if (frozen) {
-      problem.SetParameterBlockConstant(C_nodes.at(node_id_data.id).data());
-    }
-  }
-  // Add cost functions for intra- and inter-submap constraints.
-  for (const Constraint& constraint : constraints) {
+  const absl::flat_hash_map<NodeId, size_t> anchor_constraints =
+      FindAnchorConstraints(constraints);
+  for (const SubmapConstraint& constraint :
+       CondenseConstraints(constraints, anchor_constraints)) {
     problem.AddResidualBlock(
         CreateAutoDiffSpaCostFunction(constraint.pose),
-        // Loop closure constraints should have a loss function.
         constraint.tag == Constraint::INTER_SUBMAP
             ? new ceres::HuberLoss(options_.huber_scale())
             : nullptr,
-        C_submaps.at(constraint.submap_id).data(),
-        C_nodes.at(constraint.node_id).data());
+        C_submaps.at(constraint.first).data(),
+        C_submaps.at(constraint.second).data());
   }
-  // Add cost functions for landmarks.
-  AddLandmarkCostFunctions(landmark_nodes, node_data_, &C_nodes, &C_landmarks,
-                           &problem, options_.huber_scale());
-  // Add penalties for violating odometry or changes between consecutive nodes
-  // if odometry is not available.
-  for (auto node_it = node_data_.begin(); node_it != node_data_.end();) {
-    const int trajectory_id = node_it->id.trajectory_id;
-    const auto trajectory_end = node_data_.EndOfTrajectory(trajectory_id);
-    if (frozen_trajectories.count(trajectory_id) != 0) {
-      node_it = trajectory_end;
+
+  ceres::Solver::Summary summary;
+  ceres::Solve(
+      common::CreateCeresSolverOptions(options_.ceres_solver_options()),
+      &problem, &summary);
+  if (options_.log_solver_summary()) {
+    LOG(INFO) << summary.FullReport();
+  }
+
+  // Move the nodes with their anchor submaps.
+  for (const auto& entry : anchor_constraints) {
+    const SubmapId& submap_id = constraints[entry.second].submap_id;
+    if (!node_data_.Contains(entry.first) || !C_submaps.Contains(submap_id)) {
       continue;
     }
+    transform::Rigid2d& global_pose = node_data_.at(entry.first).global_pose_2d;
+    global_pose = ToPose(C_submaps.at(submap_id)) *
+                  submap_data_.at(submap_id).global_pose.inverse() *
+                  global_pose;
+  }
+  for (const auto& C_submap_id_data : C_submaps) {
+    submap_data_.at(C_submap_id_data.id).global_pose =
+        ToPose(C_submap_id_data.data);
+  }
+}
 
-    auto prev_node_it = node_it;
-    for (++node_it; node_it != trajectory_end; ++node_it) {
-      const NodeId first_node_id = prev_node_it->id;
-      const NodeSpec2D& first_node_data = prev_node_it->data;
-      prev_node_it = node_it;
-      const NodeId second_node_id = node_it->id;
-      const NodeSpec2D& second_node_data = node_it->data;
+void OptimizationProblem2D::RefineNodePoses(
+    const std::vector<Constraint>& constraints,
+    const std::map<int, PoseGraphInterface::TrajectoryState>&
+        trajectories_state) {
+  ResetProblem();
+  const absl::flat_hash_map<NodeId, size_t> anchor_constraints =
+      FindAnchorConstraints(constraints);
+  std::vector<SubmapId> anchor_submap_ids;
+  std::vector<std::vector<NodeId>> groups;
+  for (auto& entry : GroupNodesByAnchorSubmap(
+           constraints, anchor_constraints,
+           GetFrozenTrajectories(trajectories_state))) {
+    anchor_submap_ids.push_back(entry.first);
+    groups.push_back(std::move(entry.second));
+  }
+  std::vector<std::vector<const Constraint*>> group_constraints(groups.size());
+  for (const Constraint& constraint : constraints) {
+    const auto anchor_it = anchor_constraints.find(constraint.node_id);
+    if (anchor_it == anchor_constraints.end()) {
+      continue;
+    }
+    const auto group_it = std::lower_bound(
+        anchor_submap_ids.begin(), anchor_submap_ids.end(),
+        constraints[anchor_it->second].submap_id);
+    if (group_it != anchor_submap_ids.end() &&
+        *group_it == constraints[anchor_it->second].submap_id) {
+      group_constraints[group_it - anchor_submap_ids.begin()].push_back(
+          &constraint);
+    }
+  }
 
-      if (second_node_id.node_index != first_node_id.node_index + 1) {
+  // Groups only read the current poses, so they can be optimized in parallel.
+  std::vector<std::vector<transform::Rigid2d>> refined_poses(groups.size());
+  common::ParallelFor(groups.size(),
+                      options_.ceres_solver_options().num_threads(),
+                      thread_pool_, [&](const size_t i) {
+                        refined_poses[i] = RefineNodePosesOfGroup(
+                            groups[i], group_constraints[i]);
+                      });
+  for (size_t i = 0; i != groups.size(); ++i) {
+    for (size_t j = 0; j != groups[i].size(); ++j) {
+      node_data_.at(groups[i][j]).global_pose_2d = refined_poses[i][j];
+    }
+  }
+}
+
+std::vector<transform::Rigid2d> OptimizationProblem2D::RefineNodePosesOfGroup(
+    const std::vector<NodeId>& node_ids,
+    const std::vector<const Constraint*>& constraints) const {
+  ceres::Problem::Options problem_options;
+  ceres::Problem problem(problem_options);
+  std::map<NodeId, std::array<double, 3>> C_nodes;
+  for (const NodeId& node_id : node_ids) {
+    problem.AddParameterBlock(
+        C_nodes
+            .emplace(node_id, FromPose(node_data_.at(node_id).global_pose_2d))
+            .first->second.data(),
+        3);
+  }
+  // Submaps and nodes outside of the group are fixed.
+  std::map<SubmapId, std::array<double, 3>> C_fixed_submaps;
+  std::map<NodeId, std::array<double, 3>> C_fixed_nodes;
+  const auto get_submap = [&](const SubmapId& submap_id) {
+    auto it = C_fixed_submaps.find(submap_id);
+    if (it == C_fixed_submaps.end()) {
+      it = C_fixed_submaps
+               .emplace(submap_id,
+                        FromPose(submap_data_.at(submap_id).global_pose))
+               .first;
+      problem.AddParameterBlock(it->second.data(), 3);
+      problem.SetParameterBlockConstant(it->second.data());
+    }
+    return it->second.data();
+  };
+  const auto get_node = [&](const NodeId& node_id) {
+    const auto group_it = C_nodes.find(node_id);
+    if (group_it != C_nodes.end()) {
+      return group_it->second.data();
+    }
+    auto it = C_fixed_nodes.find(node_id);
+    if (it == C_fixed_nodes.end()) {
+      it = C_fixed_nodes
+               .emplace(node_id,
+                        FromPose(node_data_.at(node_id).global_pose_2d))
+               .first;
+      problem.AddParameterBlock(it->second.data(), 3);
+      problem.SetParameterBlockConstant(it->second.data());
+    }
+    return it->second.data();
+  };
+
+  for (const Constraint* constraint : constraints) {
+    problem.AddResidualBlock(
+        CreateAutoDiffSpaCostFunction(constraint->pose),
+        constraint->tag == Constraint::INTER_SUBMAP
+            ? new ceres::HuberLoss(options_.huber_scale())
+            : nullptr,
+        get_submap(constraint->submap_id), get_node(constraint->node_id));
+  }
+  // Add the local SLAM pose and odometry residuals of each node to its
+  // predecessor, and to its successor if that is not in the group.
+  for (const NodeId& node_id : node_ids) {
+    for (const NodeId& second_node_id :
+         {node_id, NodeId{node_id.trajectory_id, node_id.node_index + 1}}) {
+      const NodeId first_node_id{second_node_id.trajectory_id,
+                                 second_node_id.node_index - 1};
+      if (!node_data_.Contains(first_node_id) ||
+          !node_data_.Contains(second_node_id) ||
+          (second_node_id != node_id && C_nodes.count(second_node_id) != 0)) {
         continue;
       }
-
-      // Add a relative pose constraint based on the odometry (if available).
-      std::unique_ptr<transform::Rigid3d> relative_odometry =
-          CalculateOdometryBetweenNodes(trajectory_id, first_node_data,
+      const NodeSpec2D& first_node_data = node_data_.at(first_node_id);
+      const NodeSpec2D& second_node_data = node_data_.at(second_node_id);
+      const std::unique_ptr<transform::Rigid3d> relative_odometry =
+          CalculateOdometryBetweenNodes(node_id.trajectory_id, first_node_data,
                                         second_node_data);
       if (relative_odometry != nullptr) {
         problem.AddResidualBlock(
             CreateAutoDiffSpaCostFunction(Constraint::Pose{
                 *relative_odometry, options_.odometry_translation_weight(),
                 options_.odometry_rotation_weight()}),
-            nullptr /* loss function */, C_nodes.at(first_node_id).data(),
-            C_nodes.at(second_node_id).data());
+            nullptr /* loss function */, get_node(first_node_id),
+            get_node(second_node_id));
       }
-
-      // Add a relative pose constraint based on consecutive local SLAM poses.
       const transform::Rigid3d relative_local_slam_pose =
           transform::Embed3D(first_node_data.local_pose_2d.inverse() *
                              second_node_data.local_pose_2d);
@@ -343,25 +545,316 @@ void OptimizationProblem2D::Solve(
               Constraint::Pose{relative_local_slam_pose,
                                options_.local_slam_pose_translation_weight(),
                                options_.local_slam_pose_rotation_weight()}),
-          nullptr /* loss function */, C_nodes.at(first_node_id).data(),
-          C_nodes.at(second_node_id).data());
+          nullptr /* loss function */, get_node(first_node_id),
+          get_node(second_node_id));
+    }
+  }
+
+  // Groups are solved in parallel, so each uses a single thread.
+  ceres::Solver::Options solver_options =
+      common::CreateCeresSolverOptions(options_.ceres_solver_options());
+  solver_options.num_threads = 1;
+  ceres::Solver::Summary summary;
+  ceres::Solve(solver_options, &problem, &summary);
+
+  std::vector<transform::Rigid2d> result;
+  result.reserve(node_ids.size());
+  for (const NodeId& node_id : node_ids) {
+    result.push_back(ToPose(C_nodes.at(node_id)));
+  }
+  return result;
+}
+
+void OptimizationProblem2D::ResetProblem() {
+  problem_.reset();
+  C_submaps_ = MapById<SubmapId, std::array<double, 3>>();
+  C_nodes_ = MapById<NodeId, std::array<double, 3>>();
+  C_landmarks_.clear();
+  C_fixed_frames_.clear();
+  submaps_to_add_.clear();
+  nodes_to_add_.clear();
+  frozen_trajectories_.clear();
+  constant_submap_id_.reset();
+  constraint_residuals_.clear();
+  landmark_residuals_.clear();
+  next_local_slam_pose_node_index_.clear();
+  next_odometry_node_index_.clear();
+  next_fixed_frame_pose_node_index_.clear();
+}
+
+void OptimizationProblem2D::UpdateProblem(
+    const std::vector<Constraint>& constraints,
+    const std::set<int>& frozen_trajectories,
+    const std::map<std::string, LandmarkNode>& landmark_nodes) {
+  if (problem_ != nullptr && frozen_trajectories != frozen_trajectories_) {
+    ResetProblem();
+  }
+  if (problem_ == nullptr) {
+    problem_ = absl::make_unique<ceres::Problem>(CreateProblemOptions());
+    frozen_trajectories_ = frozen_trajectories;
+    for (const auto& submap_id_data : submap_data_) {
+      submaps_to_add_.push_back(submap_id_data.id);
+    }
+    for (const auto& node_id_data : node_data_) {
+      nodes_to_add_.push_back(node_id_data.id);
+    }
+  }
+  AddParameterBlocks(frozen_trajectories);
+  // Add cost functions for intra- and inter-submap constraints.
+  UpdateConstraintResiduals(constraints);
+  // Add cost functions for landmarks.
+  UpdateLandmarkResiduals(landmark_nodes);
+  // Add penalties for violating odometry or changes between consecutive nodes
+  // if odometry is not available, and for violating fixed frame poses.
+  AddNodeResiduals(frozen_trajectories);
+}
+
+void OptimizationProblem2D::AddParameterBlocks(
+    const std::set<int>& frozen_trajectories) {
+  // Set the starting point.
+  for (const SubmapId& submap_id : submaps_to_add_) {
+    if (!submap_data_.Contains(submap_id)) {
+      continue;
+    }
+    C_submaps_.Insert(submap_id,
+                      FromPose(submap_data_.at(submap_id).global_pose));
+    problem_->AddParameterBlock(C_submaps_.at(submap_id).data(), 3);
+    if (frozen_trajectories.count(submap_id.trajectory_id) != 0) {
+      // Fix all submaps of a frozen trajectory.
+      problem_->SetParameterBlockConstant(C_submaps_.at(submap_id).data());
+    }
+  }
+  submaps_to_add_.clear();
+  for (const NodeId& node_id : nodes_to_add_) {
+    if (!node_data_.Contains(node_id)) {
+      continue;
+    }
+    C_nodes_.Insert(node_id, FromPose(node_data_.at(node_id).global_pose_2d));
+    problem_->AddParameterBlock(C_nodes_.at(node_id).data(), 3);
+    if (frozen_trajectories.count(node_id.trajectory_id) != 0) {
+      problem_->SetParameterBlockConstant(C_nodes_.at(node_id).data());
+    }
+  }
+  nodes_to_add_.clear();
+
+  // Fix the pose of the first submap.
+  if (C_submaps_.empty()) {
+    return;
+  }
+  const SubmapId first_submap_id = C_submaps_.begin()->id;
+  if (constant_submap_id_.has_value() &&
+      constant_submap_id_.value() == first_submap_id) {
+    return;
+  }
+  if (constant_submap_id_.has_value() &&
+      C_submaps_.Contains(constant_submap_id_.value()) &&
+      frozen_trajectories.count(constant_submap_id_->trajectory_id) == 0) {
+    problem_->SetParameterBlockVariable(
+        C_submaps_.at(constant_submap_id_.value()).data());
+  }
+  problem_->SetParameterBlockConstant(C_submaps_.at(first_submap_id).data());
+  constant_submap_id_ = first_submap_id;
+}
+
+void OptimizationProblem2D::UpdateConstraintResiduals(
+    const std::vector<Constraint>& constraints) {
+  std::vector<ConstraintResidual> constraint_residuals;
+  constraint_residuals.reserve(constraints.size());
+  auto it = constraint_residuals_.begin();
+  for (const Constraint& constraint : constraints) {
+    while (it != constraint_residuals_.end() &&
+           !IsSameConstraint(it->constraint, constraint)) {
+      // Residuals of trimmed submaps and nodes were removed with them.
+      if (C_submaps_.Contains(it->constraint.submap_id) &&
+          C_nodes_.Contains(it->constraint.node_id)) {
+        problem_->RemoveResidualBlock(it->residual_block_id);
+      }
+      ++it;
+    }
+    if (it != constraint_residuals_.end()) {
+      constraint_residuals.push_back(*it);
+      ++it;
+      continue;
+    }
+    constraint_residuals.push_back(ConstraintResidual{
+        constraint,
+        problem_->AddResidualBlock(
+            CreateAutoDiffSpaCostFunction(constraint.pose),
+            // Loop closure constraints should have a loss function.
+            constraint.tag == Constraint::INTER_SUBMAP
+                ? new ceres::HuberLoss(options_.huber_scale())
+                : nullptr,
+            C_submaps_.at(constraint.submap_id).data(),
+            C_nodes_.at(constraint.node_id).data())});
+  }
+  for (; it != constraint_residuals_.end(); ++it) {
+    if (C_submaps_.Contains(it->constraint.submap_id) &&
+        C_nodes_.Contains(it->constraint.node_id)) {
+      problem_->RemoveResidualBlock(it->residual_block_id);
+    }
+  }
+  constraint_residuals_ = std::move(constraint_residuals);
+}
+
+void OptimizationProblem2D::UpdateLandmarkResiduals(
+    const std::map<std::string, LandmarkNode>& landmark_nodes) {
+  // Landmark observations are interpolated between the nodes around them,
+  // which change as nodes are added, so their residuals are always rebuilt.
+  for (const LandmarkResidual& landmark_residual : landmark_residuals_) {
+    if (C_nodes_.Contains(landmark_residual.prev_node_id) &&
+        C_nodes_.Contains(landmark_residual.next_node_id)) {
+      problem_->RemoveResidualBlock(landmark_residual.residual_block_id);
+    }
+  }
+  landmark_residuals_.clear();
+  for (const auto& landmark_node : landmark_nodes) {
+    for (const auto& observation : landmark_node.second.landmark_observations) {
+      const std::string& landmark_id = landmark_node.first;
+      const auto& begin_of_trajectory =
+          node_data_.BeginOfTrajectory(observation.trajectory_id);
+      // The landmark observation was made before the trajectory was created.
+      if (observation.time < begin_of_trajectory->data.time) {
+        continue;
+      }
+      // Find the trajectory nodes before and after the landmark observation.
+      auto next =
+          node_data_.lower_bound(observation.trajectory_id, observation.time);
+      // The landmark observation was made, but the next trajectory node has
+      // not been added yet.
+      if (next == node_data_.EndOfTrajectory(observation.trajectory_id)) {
+        continue;
+      }
+      if (next == begin_of_trajectory) {
+        next = std::next(next);
+      }
+      auto prev = std::prev(next);
+      // Add parameter blocks for the landmark ID if they were not added before.
+      std::array<double, 3>* prev_node_pose = &C_nodes_.at(prev->id);
+      std::array<double, 3>* next_node_pose = &C_nodes_.at(next->id);
+      if (!C_landmarks_.count(landmark_id)) {
+        const transform::Rigid3d starting_point =
+            landmark_node.second.global_landmark_pose.has_value()
+                ? landmark_node.second.global_landmark_pose.value()
+                : GetInitialLandmarkPose(observation, prev->data, next->data,
+                                         *prev_node_pose, *next_node_pose);
+        C_landmarks_.emplace(
+            landmark_id,
+            CeresPose(starting_point, nullptr /* translation_parametrization */,
+                      absl::make_unique<ceres::QuaternionParameterization>(),
+                      problem_.get()));
+      }
+      CeresPose& C_landmark = C_landmarks_.at(landmark_id);
+      if (landmark_node.second.global_landmark_pose.has_value()) {
+        // The pose might have been set from outside since the last solve.
+        const transform::Rigid3d& pose =
+            landmark_node.second.global_landmark_pose.value();
+        C_landmark.data() = CeresPose::Data{
+            {{pose.translation().x(), pose.translation().y(),
+              pose.translation().z()}},
+            {{pose.rotation().w(), pose.rotation().x(), pose.rotation().y(),
+              pose.rotation().z()}}};
+      }
+      // Set landmark constant if it is frozen.
+      if (landmark_node.second.frozen) {
+        problem_->SetParameterBlockConstant(C_landmark.translation());
+        problem_->SetParameterBlockConstant(C_landmark.rotation());
+      } else {
+        problem_->SetParameterBlockVariable(C_landmark.translation());
+        problem_->SetParameterBlockVariable(C_landmark.rotation());
+      }
+      landmark_residuals_.push_back(LandmarkResidual{
+          prev->id, next->id,
+          problem_->AddResidualBlock(
+              LandmarkCostFunction2D::CreateAutoDiffCostFunction(
+                  observation, prev->data, next->data),
+              new ceres::HuberLoss(options_.huber_scale()),
+              prev_node_pose->data(), next_node_pose->data(),
+              C_landmark.rotation(), C_landmark.translation())});
     }
   }
+}
 
-  std::map<int, std::array<double, 3>> C_fixed_frames;
-  for (auto node_it = node_data_.begin(); node_it != node_data_.end();) {
-    const int trajectory_id = node_it->id.trajectory_id;
+void OptimizationProblem2D::AddNodeResiduals(
+    const std::set<int>& frozen_trajectories) {
+  for (const int trajectory_id : node_data_.trajectory_ids()) {
+    if (frozen_trajectories.count(trajectory_id) != 0) {
+      continue;
+    }
     const auto trajectory_end = node_data_.EndOfTrajectory(trajectory_id);
-    if (!fixed_frame_pose_data_.HasTrajectory(trajectory_id)) {
-      node_it = trajectory_end;
+    // Add a relative pose constraint based on consecutive local SLAM poses.
+    int& next_local_slam_pose_node_index =
+        next_local_slam_pose_node_index_[trajectory_id];
+    for (auto node_it = FindFirstNodeFrom(node_data_, trajectory_id,
+                                          next_local_slam_pose_node_index);
+         node_it != trajectory_end; ++node_it) {
+      const NodeId second_node_id = node_it->id;
+      next_local_slam_pose_node_index = second_node_id.node_index + 1;
+      const NodeId first_node_id(trajectory_id, second_node_id.node_index - 1);
+      if (!node_data_.Contains(first_node_id)) {
+        continue;
+      }
+      const transform::Rigid3d relative_local_slam_pose = transform::Embed3D(
+          node_data_.at(first_node_id).local_pose_2d.inverse() *
+          node_it->data.local_pose_2d);
+      problem_->AddResidualBlock(
+          CreateAutoDiffSpaCostFunction(
+              Constraint::Pose{relative_local_slam_pose,
+                               options_.local_slam_pose_translation_weight(),
+                               options_.local_slam_pose_rotation_weight()}),
+          nullptr /* loss function */, C_nodes_.at(first_node_id).data(),
+          C_nodes_.at(second_node_id).data());
+    }
+
+    // Add a relative pose constraint based on the odometry (if available).
+    // Nodes newer than the latest odometry data are left for later.
+    if (!odometry_data_.HasTrajectory(trajectory_id)) {
       continue;
     }
+    const common::Time odometry_end_time =
+        std::prev(odometry_data_.EndOfTrajectory(trajectory_id))->time;
+    int& next_odometry_node_index = next_odometry_node_index_[trajectory_id];
+    for (auto node_it = FindFirstNodeFrom(node_data_, trajectory_id,
+                                          next_odometry_node_index);
+         node_it != trajectory_end && node_it->data.time <= odometry_end_time;
+         ++node_it) {
+      const NodeId second_node_id = node_it->id;
+      next_odometry_node_index = second_node_id.node_index + 1;
+      const NodeId first_node_id(trajectory_id, second_node_id.node_index - 1);
+      if (!node_data_.Contains(first_node_id)) {
+        continue;
+      }
+      const std::unique_ptr<transform::Rigid3d> relative_odometry =
+          CalculateOdometryBetweenNodes(
+              trajectory_id, node_data_.at(first_node_id), node_it->data);
+      if (relative_odometry == nullptr) {
+        continue;
+      }
+      problem_->AddResidualBlock(
+          CreateAutoDiffSpaCostFunction(Constraint::Pose{
+              *relative_odometry, options_.odometry_translation_weight(),
+              options_.odometry_rotation_weight()}),
+          nullptr /* loss function */, C_nodes_.at(first_node_id).data(),
+          C_nodes_.at(second_node_id).data());
+    }
+  }
 
+  for (const int trajectory_id : node_data_.trajectory_ids()) {
+    if (!fixed_frame_pose_data_.HasTrajectory(trajectory_id)) {
+      continue;
+    }
+    const common::Time fixed_frame_pose_end_time =
+        std::prev(fixed_frame_pose_data_.EndOfTrajectory(trajectory_id))->time;
     const TrajectoryData& trajectory_data = trajectory_data_.at(trajectory_id);
-    bool fixed_frame_pose_initialized = false;
-    for (; node_it != trajectory_end; ++node_it) {
+    int& next_fixed_frame_pose_node_index =
+        next_fixed_frame_pose_node_index_[trajectory_id];
+    for (auto node_it = FindFirstNodeFrom(node_data_, trajectory_id,
+                                          next_fixed_frame_pose_node_index);
+         node_it != node_data_.EndOfTrajectory(trajectory_id) &&
+         node_it->data.time <= fixed_frame_pose_end_time;
+         ++node_it) {
       const NodeId node_id = node_it->id;
       const NodeSpec2D& node_data = node_it->data;
+      next_fixed_frame_pose_node_index = node_id.node_index + 1;
 
       const std::unique_ptr<transform::Rigid3d> fixed_frame_pose =
           Interpolate(fixed_frame_pose_data_, trajectory_id, node_data.time);
@@ -373,7 +866,7 @@ void OptimizationProblem2D::Solve(
           *fixed_frame_pose, options_.fixed_frame_pose_translation_weight(),
           options_.fixed_frame_pose_rotation_weight()};
 
-      if (!fixed_frame_pose_initialized) {
+      if (C_fixed_frames_.count(trajectory_id) == 0) {
         transform::Rigid2d fixed_frame_pose_in_map;
         if (trajectory_data.fixed_frame_origin_in_map.has_value()) {
           fixed_frame_pose_in_map = transform::Project2D(
@@ -384,45 +877,37 @@ void OptimizationProblem2D::Solve(
               transform::Project2D(constraint_pose.zbar_ij).inverse();
         }
 
-        C_fixed_frames.emplace(trajectory_id,
-                               FromPose(fixed_frame_pose_in_map));
-        fixed_frame_pose_initialized = true;
+        C_fixed_frames_.emplace(trajectory_id,
+                                FromPose(fixed_frame_pose_in_map));
       }
 
-      problem.AddResidualBlock(
+      problem_->AddResidualBlock(
           CreateAutoDiffSpaCostFunction(constraint_pose),
           options_.fixed_frame_pose_use_tolerant_loss()
               ? new ceres::TolerantLoss(
                     options_.fixed_frame_pose_tolerant_loss_param_a(),
                     options_.fixed_frame_pose_tolerant_loss_param_b())
               : nullptr,
-          C_fixed_frames.at(trajectory_id).data(), C_nodes.at(node_id).data());
+          C_fixed_frames_.at(trajectory_id).data(),
+          C_nodes_.at(node_id).data());
     }
   }
+}
 
-  // Solve.
-  ceres::Solver::Summary summary;
-  ceres::Solve(
-      common::CreateCeresSolverOptions(options_.ceres_solver_options()),
-      &problem, &summary);
-  if (options_.log_solver_summary()) {
-    LOG(INFO) << summary.FullReport();
-  }
-
-  // Store the result.
-  for (const auto& C_submap_id_data : C_submaps) {
+void OptimizationProblem2D::StoreSolution() {
+  for (const auto& C_submap_id_data : C_submaps_) {
     submap_data_.at(C_submap_id_data.id).global_pose =
         ToPose(C_submap_id_data.data);
   }
-  for (const auto& C_node_id_data : C_nodes) {
+  for (const auto& C_node_id_data : C_nodes_) {
     node_data_.at(C_node_id_data.id).global_pose_2d =
         ToPose(C_node_id_data.data);
   }
-  for (const auto& C_fixed_frame : C_fixed_frames) {
+  for (const auto& C_fixed_frame : C_fixed_frames_) {
     trajectory_data_.at(C_fixed_frame.first).fixed_frame_origin_in_map =
         transform::Embed3D(ToPose(C_fixed_frame.second));
   }
-  for (const auto& C_landmark : C_landmarks) {
+  for (const auto& C_landmark : C_landmarks_) {
     landmark_data_[C_landmark.first] = C_landmark.second.ToRigid();
   }
 }
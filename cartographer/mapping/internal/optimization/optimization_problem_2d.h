@@ -20,14 +20,20 @@
 #include <array>
 #include <deque>
 #include <map>
+#include <memory>
 #include <set>
+#include <string>
+#include <utility>
 #include <vector>
 
 #include "Eigen/Core"
 #include "Eigen/Geometry"
+#include "absl/types/optional.h"
 #include "cartographer/common/port.h"
+#include "cartographer/common/thread_pool.h"
 #include "cartographer/common/time.h"
 #include "cartographer/mapping/id.h"
+#include "cartographer/mapping/internal/optimization/ceres_pose.h"
 #include "cartographer/mapping/internal/optimization/optimization_problem_interface.h"
 #include "cartographer/mapping/pose_graph_interface.h"
 #include "cartographer/mapping/proto/pose_graph/optimization_problem_options.pb.h"
@@ -35,6 +41,7 @@
 #include "cartographer/sensor/map_by_time.h"
 #include "cartographer/sensor/odometry_data.h"
 #include "cartographer/transform/timestamped_transform.h"
+#include "ceres/ceres.h"
 
 namespace cartographer {
 namespace mapping {
@@ -76,12 +83,37 @@ class OptimizationProblem2D
                     const transform::Rigid2d& global_submap_pose) override;
   void TrimSubmap(const SubmapId& submap_id) override;
   void SetMaxNumIterations(int32 max_num_iterations) override;
+  // Spreads work in 'Solve()' and 'RefineNodePoses()' over 'thread_pool' in
+  // addition to the calling thread. Without a thread pool, which is the
+  // default, all work is done on the calling thread.
+  void SetThreadPool(common::ThreadPoolInterface* thread_pool);
+
+  // Returns a new problem with a copy of the data of this one, so that it can
+  // be solved while this one keeps changing. The copy has the same options,
+  // including the number of iterations set by 'SetMaxNumIterations()', and the
+  // thread pool set by 'SetThreadPool()'.
+  std::unique_ptr<OptimizationProblem2D> CopyData() const;
+  // Takes over the poses of 'solved_problem', which was created by
+  // 'CopyData()' of this problem and solved since. Nodes and submaps which were
+  // added after the copy was made are moved by the 'corrections' of their
+  // trajectory, the ones which were trimmed meanwhile are ignored. A problem
+  // kept by 'use_persistent_problem_in_2d' is rebuilt by the next 'Solve()'.
+  void MergeSolution(const OptimizationProblem2D& solved_problem,
+                     const std::map<int, transform::Rigid2d>& corrections);
 
   void Solve(
       const std::vector<Constraint>& constraints,
       const std::map<int, PoseGraphInterface::TrajectoryState>&
           trajectories_state,
       const std::map<std::string, LandmarkNode>& landmark_nodes) override;
+  void SolveSubmapPoses(
+      const std::vector<Constraint>& constraints,
+      const std::map<int, PoseGraphInterface::TrajectoryState>&
+          trajectories_state) override;
+  void RefineNodePoses(
+      const std::vector<Constraint>& constraints,
+      const std::map<int, PoseGraphInterface::TrajectoryState>&
+          trajectories_state) override;
 
   const MapById<NodeId, NodeSpec2D>& node_data() const override {
     return node_data_;
@@ -117,6 +149,45 @@ class OptimizationProblem2D
   }
 
  private:
+  // Optimizes the nodes 'node_ids' with all other poses fixed, using
+  // 'constraints' which are the constraints of these nodes. Returns the new
+  // global poses of the nodes.
+  std::vector<transform::Rigid2d> RefineNodePosesOfGroup(
+      const std::vector<NodeId>& node_ids,
+      const std::vector<const Constraint*>& constraints) const;
+
+  struct ConstraintResidual {
+    Constraint constraint;
+    ceres::ResidualBlockId residual_block_id;
+  };
+
+  struct LandmarkResidual {
+    NodeId prev_node_id;
+    NodeId next_node_id;
+    ceres::ResidualBlockId residual_block_id;
+  };
+
+  // Drops 'problem_', so that it is built from scratch by the next 'Solve()'.
+  void ResetProblem();
+  // Brings 'problem_' up to date with the data added or trimmed since the
+  // last 'Solve()', or builds it if there is none.
+  void UpdateProblem(const std::vector<Constraint>& constraints,
+                     const std::set<int>& frozen_trajectories,
+                     const std::map<std::string, LandmarkNode>& landmark_nodes);
+  void AddParameterBlocks(const std::set<int>& frozen_trajectories);
+  // Keeps the residuals of constraints which were passed to the last
+  // 'Solve()', and adds or removes the others. This is efficient if the
+  // constraints were only appended to, or some of them removed.
+  void UpdateConstraintResiduals(const std::vector<Constraint>& constraints);
+  void UpdateLandmarkResiduals(
+      const std::map<std::string, LandmarkNode>& landmark_nodes);
+  // Adds the local SLAM pose and odometry residuals between consecutive nodes,
+  // and the fixed frame pose residuals of the nodes which were not considered
+  // yet. Residuals depending on sensor data are only added once no further
+  // data can change them.
+  void AddNodeResiduals(const std::set<int>& frozen_trajectories);
+  void StoreSolution();
+
   std::unique_ptr<transform::Rigid3d> InterpolateOdometry(
       int trajectory_id, common::Time time) const;
   // Computes the relative pose between two nodes based on odometry data.
@@ -125,6 +196,7 @@ class OptimizationProblem2D
       const NodeSpec2D& second_node_data) const;
 
   optimization::proto::OptimizationProblemOptions options_;
+  common::ThreadPoolInterface* thread_pool_ = nullptr;
   MapById<NodeId, NodeSpec2D> node_data_;
   MapById<SubmapId, SubmapSpec2D> submap_data_;
   std::map<std::string, transform::Rigid3d> landmark_data_;
@@ -132,6 +204,28 @@ class OptimizationProblem2D
   sensor::MapByTime<sensor::OdometryData> odometry_data_;
   sensor::MapByTime<sensor::FixedFramePoseData> fixed_frame_pose_data_;
   std::map<int, PoseGraphInterface::TrajectoryData> trajectory_data_;
+
+  // The Ceres problem and its parameter blocks. Unless
+  // 'options_.use_persistent_problem_in_2d()', this only exists in 'Solve()'.
+  std::unique_ptr<ceres::Problem> problem_;
+  MapById<SubmapId, std::array<double, 3>> C_submaps_;
+  MapById<NodeId, std::array<double, 3>> C_nodes_;
+  std::map<std::string, CeresPose> C_landmarks_;
+  std::map<int, std::array<double, 3>> C_fixed_frames_;
+  // Submaps and nodes which were added since 'problem_' was last updated.
+  std::vector<SubmapId> submaps_to_add_;
+  std::vector<NodeId> nodes_to_add_;
+  // The frozen trajectories and the fixed submap of 'problem_'.
+  std::set<int> frozen_trajectories_;
+  absl::optional<SubmapId> constant_submap_id_;
+  std::vector<ConstraintResidual> constraint_residuals_;
+  std::vector<LandmarkResidual> landmark_residuals_;
+  // Per trajectory, the index of the first node for which the residuals to
+  // its predecessor, respectively its fixed frame pose residual, may still
+  // have to be added.
+  std::map<int, int> next_local_slam_pose_node_index_;
+  std::map<int, int> next_odometry_node_index_;
+  std::map<int, int> next_fixed_frame_pose_node_index_;
 };
 
 }  // namespace optimization
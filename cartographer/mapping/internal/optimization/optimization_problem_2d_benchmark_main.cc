@@ -0,0 +1,180 @@
+/*
+ * Copyright 2018 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "cartographer/common/internal/benchmark.h"
+#include "cartographer/common/time.h"
+#include "cartographer/mapping/internal/optimization/optimization_problem_2d.h"
+#include "cartographer/transform/transform.h"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+DEFINE_int32(num_nodes, 100000, "Number of nodes of the synthetic graph.");
+DEFINE_int32(nodes_per_submap, 90, "Number of nodes inserted per submap.");
+DEFINE_int32(optimize_every_n_nodes, 900,
+             "Number of nodes added between optimizations.");
+DEFINE_int32(max_num_iterations, 5,
+             "Maximum number of iterations of each optimization.");
+DEFINE_int32(num_threads, 4, "Number of threads used by Ceres.");
+
+namespace cartographer {
+namespace mapping {
+namespace optimization {
+namespace {
+
+using Constraint = OptimizationProblem2D::Constraint;
+
+constexpr int kTrajectoryId = 0;
+// Nodes are on a circle, which is passed again and again, so loop closures
+// are found to the submaps of earlier laps.
+constexpr int kNodesPerLap = 2000;
+constexpr double kRadius = 50.;
+
+proto::OptimizationProblemOptions CreateOptions(
+    const bool use_persistent_problem) {
+  proto::OptimizationProblemOptions options;
+  options.set_huber_scale(1e1);
+  options.set_local_slam_pose_translation_weight(1e5);
+  options.set_local_slam_pose_rotation_weight(1e5);
+  options.set_odometry_translation_weight(1e5);
+  options.set_odometry_rotation_weight(1e5);
+  options.set_use_persistent_problem_in_2d(use_persistent_problem);
+  options.mutable_ceres_solver_options()->set_max_num_iterations(
+      FLAGS_max_num_iterations);
+  options.mutable_ceres_solver_options()->set_num_threads(FLAGS_num_threads);
+  return options;
+}
+
+transform::Rigid2d GetGroundTruthPose(const int node_index) {
+  const double angle = 2. * M_PI * node_index / kNodesPerLap;
+  return transform::Rigid2d(
+      Eigen::Vector2d(kRadius * std::cos(angle), kRadius * std::sin(angle)),
+      angle + M_PI / 2.);
+}
+
+// Grows a graph like online SLAM does and optimizes it periodically. Returns
+// the poses of all nodes after the last optimization.
+std::vector<transform::Rigid2d> Run(const bool use_persistent_problem) {
+  OptimizationProblem2D problem(CreateOptions(use_persistent_problem));
+  std::mt19937 prng(42);
+  std::normal_distribution<double> noise(0., 0.01);
+  std::vector<Constraint> constraints;
+  const common::Time start = common::FromUniversal(1000000);
+  double solve_seconds = 0.;
+  double last_solve_seconds = 0.;
+  int num_solves = 0;
+  for (int node_index = 0; node_index < FLAGS_num_nodes; ++node_index) {
+    const int submap_index = node_index / FLAGS_nodes_per_submap;
+    const transform::Rigid2d ground_truth = GetGroundTruthPose(node_index);
+    if (node_index % FLAGS_nodes_per_submap == 0) {
+      problem.AddSubmap(kTrajectoryId, ground_truth);
+    }
+    const transform::Rigid2d pose =
+        ground_truth *
+        transform::Rigid2d({noise(prng), noise(prng)}, noise(prng));
+    const common::Time time = start + common::FromSeconds(0.1 * node_index);
+    problem.AddOdometryData(
+        kTrajectoryId,
+        sensor::OdometryData{time, transform::Embed3D(ground_truth)});
+    problem.AddTrajectoryNode(
+        kTrajectoryId,
+        NodeSpec2D{time, pose, pose, Eigen::Quaterniond::Identity()});
+    const SubmapId submap_id{kTrajectoryId, submap_index};
+    const NodeId node_id{kTrajectoryId, node_index};
+    constraints.push_back(Constraint{
+        submap_id,
+        node_id,
+        {transform::Embed3D(
+             problem.submap_data().at(submap_id).global_pose.inverse() *
+             pose),
+         1e5, 1e5},
+        Constraint::INTRA_SUBMAP});
+    if (node_index >= kNodesPerLap && node_index % 10 == 0) {
+      const int loop_closure_node_index = node_index - kNodesPerLap;
+      const SubmapId loop_closure_submap_id{
+          kTrajectoryId, loop_closure_node_index / FLAGS_nodes_per_submap};
+      constraints.push_back(Constraint{
+          loop_closure_submap_id,
+          node_id,
+          {transform::Embed3D(GetGroundTruthPose(
+                                  loop_closure_submap_id.submap_index *
+                                  FLAGS_nodes_per_submap)
+                                  .inverse() *
+                              ground_truth),
+           1e4, 1e4},
+          Constraint::INTER_SUBMAP});
+    }
+    if ((node_index + 1) % FLAGS_optimize_every_n_nodes == 0 ||
+        node_index + 1 == FLAGS_num_nodes) {
+      const auto wall_time_start = std::chrono::steady_clock::now();
+      problem.Solve(
+          constraints,
+          {{kTrajectoryId, PoseGraphInterface::TrajectoryState::ACTIVE}}, {});
+      last_solve_seconds = common::SecondsSince(wall_time_start);
+      solve_seconds += last_solve_seconds;
+      ++num_solves;
+    }
+  }
+  LOG(INFO) << (use_persistent_problem ? "Persistent" : "Rebuilt")
+            << " problem: " << num_solves << " optimizations took "
+            << solve_seconds << " s, the last one " << 1e3 * last_solve_seconds
+            << " ms.";
+  std::vector<transform::Rigid2d> poses;
+  for (const auto& node_id_data : problem.node_data()) {
+    poses.push_back(node_id_data.data.global_pose_2d);
+  }
+  return poses;
+}
+
+void Benchmark() {
+  const std::vector<transform::Rigid2d> expected_poses = Run(false);
+  const std::vector<transform::Rigid2d> poses = Run(true);
+  CHECK_EQ(poses.size(), expected_poses.size());
+  double max_translation_difference = 0.;
+  double max_rotation_difference = 0.;
+  for (size_t i = 0; i < poses.size(); ++i) {
+    const transform::Rigid2d difference =
+        expected_poses[i].inverse() * poses[i];
+    max_translation_difference = std::max(max_translation_difference,
+                                          difference.translation().norm());
+    max_rotation_difference = std::max(
+        max_rotation_difference, std::abs(difference.normalized_angle()));
+  }
+  LOG(INFO) << "Maximum difference of the poses: "
+            << max_translation_difference << " m, " << max_rotation_difference
+            << " rad";
+}
+
+}  // namespace
+}  // namespace optimization
+}  // namespace mapping
+}  // namespace cartographer
+
+int main(int argc, char** argv) {
+  ::cartographer::common::InitBenchmark(
+      "Compares the time spent optimizing a growing 2D pose graph when the "
+      "optimization problem is rebuilt for each optimization to keeping it.",
+      &argc, &argv);
+  CHECK_GT(FLAGS_num_nodes, 0);
+  CHECK_GT(FLAGS_nodes_per_submap, 0);
+  CHECK_GT(FLAGS_optimize_every_n_nodes, 0);
+  ::cartographer::mapping::optimization::Benchmark();
+}
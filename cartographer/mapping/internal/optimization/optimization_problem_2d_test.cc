@@ -0,0 +1,262 @@
+/*
+ * Copyright 2018 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/internal/optimization/optimization_problem_2d.h"
+
+#include <algorithm>
+#include <memory>
+#include <random>
+
+#include "absl/memory/memory.h"
+#include "cartographer/common/internal/testing/lua_parameter_dictionary_test_helpers.h"
+#include "cartographer/common/time.h"
+#include "cartographer/mapping/internal/optimization/optimization_problem_options.h"
+#include "cartographer/transform/transform.h"
+#include "gmock/gmock.h"
+
+namespace cartographer {
+namespace mapping {
+namespace optimization {
+namespace {
+
+using Constraint = OptimizationProblem2D::Constraint;
+
+constexpr int kTrajectoryId = 0;
+constexpr int kNodesPerSubmap = 10;
+
+proto::OptimizationProblemOptions CreateOptions(
+    const bool use_persistent_problem) {
+  auto parameter_dictionary = common::MakeDictionary(R"text(
+      return {
+        acceleration_weight = 1.,
+        rotation_weight = 1.,
+        huber_scale = 1.,
+        local_slam_pose_translation_weight = 1e2,
+        local_slam_pose_rotation_weight = 1e2,
+        odometry_translation_weight = 1e1,
+        odometry_rotation_weight = 1e1,
+        fixed_frame_pose_translation_weight = 1e1,
+        fixed_frame_pose_rotation_weight = 1e2,
+        fixed_frame_pose_use_tolerant_loss = false,
+        fixed_frame_pose_tolerant_loss_param_a = 1,
+        fixed_frame_pose_tolerant_loss_param_b = 1,
+        log_solver_summary = false,
+        use_online_imu_extrinsics_in_3d = true,
+        fix_z_in_3d = false,
+        use_persistent_problem_in_2d = false,
+        use_submap_level_optimization = false,
+        refine_nodes_after_submap_level_optimization = false,
+        ceres_solver_options = {
+          use_nonmonotonic_steps = false,
+          max_num_iterations = 50,
+          num_threads = 1,
+        },
+      })text");
+  proto::OptimizationProblemOptions options =
+      CreateOptimizationProblemOptions(parameter_dictionary.get());
+  options.set_use_persistent_problem_in_2d(use_persistent_problem);
+  return options;
+}
+
+// Feeds the same noisy trajectory with loop closures into a problem which is
+// rebuilt for each solve and one which is kept, and checks that both arrive
+// at the same solution while submaps and nodes are added and trimmed.
+class OptimizationProblem2DTest : public ::testing::Test {
+ protected:
+  OptimizationProblem2DTest()
+      : rebuilt_problem_(CreateOptions(false)),
+        persistent_problem_(CreateOptions(true)),
+        rng_(42) {}
+
+  static transform::Rigid2d GetSubmapPose(const int submap_index) {
+    return transform::Rigid2d::Translation(Eigen::Vector2d(submap_index, 0.));
+  }
+
+  void AddSubmapWithNodes() {
+    const int submap_index = num_submaps_++;
+    const transform::Rigid2d submap_pose = GetSubmapPose(submap_index);
+    for (OptimizationProblem2D* problem : problems()) {
+      problem->AddSubmap(kTrajectoryId, submap_pose);
+    }
+    std::normal_distribution<double> noise(0., 0.05);
+    for (int i = 0; i != kNodesPerSubmap; ++i) {
+      const int node_index = num_nodes_++;
+      const common::Time time =
+          common::FromUniversal(1000) + common::FromSeconds(node_index);
+      // The trajectory is a circle, so the last nodes close the loop.
+      const double angle = 2. * M_PI * node_index / 100.;
+      const transform::Rigid2d ground_truth(
+          Eigen::Vector2d(10. * std::cos(angle), 10. * std::sin(angle)),
+          angle + M_PI / 2.);
+      const transform::Rigid2d noisy_pose =
+          ground_truth * transform::Rigid2d({noise(rng_), noise(rng_)},
+                                            noise(rng_));
+      const sensor::OdometryData odometry_data{
+          time, transform::Embed3D(ground_truth)};
+      for (OptimizationProblem2D* problem : problems()) {
+        problem->AddOdometryData(kTrajectoryId, odometry_data);
+        problem->AddTrajectoryNode(
+            kTrajectoryId,
+            NodeSpec2D{time, noisy_pose, noisy_pose,
+                       Eigen::Quaterniond::Identity()});
+      }
+      constraints_.push_back(Constraint{
+          SubmapId{kTrajectoryId, submap_index},
+          NodeId{kTrajectoryId, node_index},
+          {transform::Embed3D(submap_pose.inverse() * noisy_pose), 1e3, 1e3},
+          Constraint::INTRA_SUBMAP});
+      if (node_index >= 100) {
+        // Loop closures are made against the second submap, which is kept.
+        constraints_.push_back(Constraint{
+            SubmapId{kTrajectoryId, 1},
+            NodeId{kTrajectoryId, node_index},
+            {transform::Embed3D(GetSubmapPose(1).inverse() * ground_truth),
+             1e4, 1e4},
+            Constraint::INTER_SUBMAP});
+      }
+    }
+  }
+
+  void TrimSubmap(const int submap_index) {
+    const SubmapId submap_id{kTrajectoryId, submap_index};
+    std::vector<NodeId> nodes_to_trim;
+    for (const Constraint& constraint : constraints_) {
+      if (constraint.submap_id == submap_id &&
+          constraint.tag == Constraint::INTRA_SUBMAP) {
+        nodes_to_trim.push_back(constraint.node_id);
+      }
+    }
+    constraints_.erase(
+        std::remove_if(constraints_.begin(), constraints_.end(),
+                       [&](const Constraint& constraint) {
+                         return constraint.submap_id == submap_id ||
+                                std::count(nodes_to_trim.begin(),
+                                           nodes_to_trim.end(),
+                                           constraint.node_id) != 0;
+                       }),
+        constraints_.end());
+    for (OptimizationProblem2D* problem : problems()) {
+      for (const NodeId& node_id : nodes_to_trim) {
+        problem->TrimTrajectoryNode(node_id);
+      }
+      problem->TrimSubmap(submap_id);
+    }
+  }
+
+  void SolveAndCompare() {
+    for (OptimizationProblem2D* problem : problems()) {
+      problem->Solve(constraints_,
+                     {{kTrajectoryId,
+                       PoseGraphInterface::TrajectoryState::ACTIVE}},
+                     {});
+    }
+    ASSERT_EQ(rebuilt_problem_.node_data().size(),
+              persistent_problem_.node_data().size());
+    for (const auto& node_id_data : rebuilt_problem_.node_data()) {
+      const transform::Rigid2d& expected = node_id_data.data.global_pose_2d;
+      const transform::Rigid2d& actual =
+          persistent_problem_.node_data().at(node_id_data.id).global_pose_2d;
+      EXPECT_NEAR(expected.translation().x(), actual.translation().x(), 1e-4);
+      EXPECT_NEAR(expected.translation().y(), actual.translation().y(), 1e-4);
+      EXPECT_NEAR(expected.normalized_angle(), actual.normalized_angle(),
+                  1e-4);
+    }
+    for (const auto& submap_id_data : rebuilt_problem_.submap_data()) {
+      const transform::Rigid2d& expected = submap_id_data.data.global_pose;
+      const transform::Rigid2d& actual =
+          persistent_problem_.submap_data().at(submap_id_data.id).global_pose;
+      EXPECT_NEAR(expected.translation().x(), actual.translation().x(), 1e-4);
+      EXPECT_NEAR(expected.translation().y(), actual.translation().y(), 1e-4);
+    }
+  }
+
+  std::vector<OptimizationProblem2D*> problems() {
+    return {&rebuilt_problem_, &persistent_problem_};
+  }
+
+  OptimizationProblem2D rebuilt_problem_;
+  OptimizationProblem2D persistent_problem_;
+  std::vector<Constraint> constraints_;
+  int num_submaps_ = 0;
+  int num_nodes_ = 0;
+  std::mt19937 rng_;
+};
+
+TEST_F(OptimizationProblem2DTest, PersistentProblemMatchesRebuiltProblem) {
+  for (int i = 0; i != 12; ++i) {
+    AddSubmapWithNodes();
+    if (i % 3 == 2) {
+      SolveAndCompare();
+    }
+  }
+  TrimSubmap(3);
+  SolveAndCompare();
+  // Trimming the first submap fixes a different submap.
+  TrimSubmap(0);
+  AddSubmapWithNodes();
+  SolveAndCompare();
+}
+
+TEST_F(OptimizationProblem2DTest, MergesSolutionOfCopy) {
+  for (int i = 0; i != 6; ++i) {
+    AddSubmapWithNodes();
+  }
+  const SubmapId last_submap_id{kTrajectoryId, 5};
+  std::unique_ptr<OptimizationProblem2D> copy = rebuilt_problem_.CopyData();
+  const transform::Rigid2d last_submap_pose_before =
+      copy->submap_data().at(last_submap_id).global_pose;
+  copy->Solve(constraints_,
+              {{kTrajectoryId, PoseGraphInterface::TrajectoryState::ACTIVE}},
+              {});
+  const transform::Rigid2d correction =
+      copy->submap_data().at(last_submap_id).global_pose *
+      last_submap_pose_before.inverse();
+
+  // Data changes while the copy is solved.
+  AddSubmapWithNodes();
+  TrimSubmap(3);
+  rebuilt_problem_.MergeSolution(*copy, {{kTrajectoryId, correction}});
+
+  EXPECT_FALSE(rebuilt_problem_.submap_data().Contains(SubmapId{0, 3}));
+  for (const auto& node_id_data : rebuilt_problem_.node_data()) {
+    // 'persistent_problem_' was never solved, so it has the original poses.
+    const transform::Rigid2d expected =
+        copy->node_data().Contains(node_id_data.id)
+            ? copy->node_data().at(node_id_data.id).global_pose_2d
+            : correction * persistent_problem_.node_data()
+                               .at(node_id_data.id)
+                               .global_pose_2d;
+    const transform::Rigid2d& actual = node_id_data.data.global_pose_2d;
+    EXPECT_NEAR(expected.translation().x(), actual.translation().x(), 1e-9);
+    EXPECT_NEAR(expected.translation().y(), actual.translation().y(), 1e-9);
+    EXPECT_NEAR(expected.normalized_angle(), actual.normalized_angle(), 1e-9);
+  }
+  const transform::Rigid2d expected_new_submap_pose =
+      correction * persistent_problem_.submap_data()
+                       .at(SubmapId{kTrajectoryId, 6})
+                       .global_pose;
+  EXPECT_NEAR(expected_new_submap_pose.translation().x(),
+              rebuilt_problem_.submap_data()
+                  .at(SubmapId{kTrajectoryId, 6})
+                  .global_pose.translation()
+                  .x(),
+              1e-9);
+}
+
+}  // namespace
+}  // namespace optimization
+}  // namespace mapping
+}  // namespace cartographer
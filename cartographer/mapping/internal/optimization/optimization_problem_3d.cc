@@ -28,6 +28,7 @@
 #include "Eigen/Core"
 #include "absl/memory/memory.h"
 #include "cartographer/common/internal/ceres_solver_options.h"
+#include "cartographer/common/internal/parallel_for.h"
 #include "cartographer/common/math.h"
 #include "cartographer/common/time.h"
 #include "cartographer/mapping/internal/3d/imu_integration.h"
@@ -37,6 +38,7 @@
 #include "cartographer/mapping/internal/optimization/cost_functions/landmark_cost_function_3d.h"
 #include "cartographer/mapping/internal/optimization/cost_functions/rotation_cost_function_3d.h"
 #include "cartographer/mapping/internal/optimization/cost_functions/spa_cost_function_3d.h"
+#include "cartographer/mapping/internal/optimization/submap_level_optimization.h"
 #include "cartographer/transform/timestamped_transform.h"
 #include "cartographer/transform/transform.h"
 #include "ceres/ceres.h"
@@ -183,6 +185,13 @@ void AddLandmarkCostFunctions(
   }
 }
 
+std::unique_ptr<ceres::LocalParameterization> CreateTranslationParameterization(
+    const bool fix_z) {
+  return fix_z ? absl::make_unique<ceres::SubsetParameterization>(
+                     3, std::vector<int>{2})
+               : nullptr;
+}
+
 }  // namespace
 
 OptimizationProblem3D::OptimizationProblem3D(
@@ -254,6 +263,62 @@ void OptimizationProblem3D::SetMaxNumIterations(
       max_num_iterations);
 }
 
+void OptimizationProblem3D::SetThreadPool(
+    common::ThreadPoolInterface* const thread_pool) {
+  thread_pool_ = thread_pool;
+}
+
+std::unique_ptr<OptimizationProblem3D> OptimizationProblem3D::CopyData()
+    const {
+  auto copy = absl::make_unique<OptimizationProblem3D>(options_);
+  copy->thread_pool_ = thread_pool_;
+  copy->node_data_ = node_data_;
+  copy->submap_data_ = submap_data_;
+  copy->landmark_data_ = landmark_data_;
+  copy->imu_data_ = imu_data_;
+  copy->odometry_data_ = odometry_data_;
+  copy->fixed_frame_pose_data_ = fixed_frame_pose_data_;
+  copy->trajectory_data_ = trajectory_data_;
+  return copy;
+}
+
+void OptimizationProblem3D::MergeSolution(
+    const OptimizationProblem3D& solved_problem,
+    const std::map<int, transform::Rigid3d>& corrections) {
+  for (const auto& submap_id_data : submap_data_) {
+    auto& global_pose = submap_data_.at(submap_id_data.id).global_pose;
+    if (solved_problem.submap_data_.Contains(submap_id_data.id)) {
+      global_pose =
+          solved_problem.submap_data_.at(submap_id_data.id).global_pose;
+      continue;
+    }
+    const auto it = corrections.find(submap_id_data.id.trajectory_id);
+    if (it != corrections.end()) {
+      global_pose = it->second * global_pose;
+    }
+  }
+  for (const auto& node_id_data : node_data_) {
+    auto& global_pose = node_data_.at(node_id_data.id).global_pose;
+    if (solved_problem.node_data_.Contains(node_id_data.id)) {
+      global_pose = solved_problem.node_data_.at(node_id_data.id).global_pose;
+      continue;
+    }
+    const auto it = corrections.find(node_id_data.id.trajectory_id);
+    if (it != corrections.end()) {
+      global_pose = it->second * global_pose;
+    }
+  }
+  for (auto& trajectory_data : trajectory_data_) {
+    const auto it = solved_problem.trajectory_data_.find(trajectory_data.first);
+    if (it != solved_problem.trajectory_data_.end()) {
+      trajectory_data.second = it->second;
+    }
+  }
+  for (const auto& landmark : solved_problem.landmark_data_) {
+    landmark_data_[landmark.first] = landmark.second;
+  }
+}
+
 void OptimizationProblem3D::Solve(
     const std::vector<Constraint>& constraints,
     const std::map<int, PoseGraphInterface::TrajectoryState>&
@@ -274,16 +339,28 @@ void OptimizationProblem3D::Solve(
   ceres::Problem::Options problem_options;
   ceres::Problem problem(problem_options);
 
-  const auto translation_parameterization =
-      [this]() -> std::unique_ptr<ceres::LocalParameterization> {
-    return options_.fix_z_in_3d()
-               ? absl::make_unique<ceres::SubsetParameterization>(
-                     3, std::vector<int>{2})
-               : nullptr;
-  };
+  // The parametrizations are shared by all poses. 'problem' deletes each of
+  // them once.
+  ceres::LocalParameterization* const translation_parameterization =
+      CreateTranslationParameterization(options_.fix_z_in_3d()).release();
+  ceres::LocalParameterization* const quaternion_parameterization =
+      new ceres::QuaternionParameterization();
 
-  // Set the starting point.
+  // Set the starting point. The parameter blocks of all submaps and nodes are
+  // stored in one allocation.
   CHECK(!submap_data_.empty());
+  const auto C_poses_data = std::make_shared<std::vector<CeresPose::Data>>();
+  C_poses_data->reserve(submap_data_.size() + node_data_.size());
+  const auto add_pose =
+      [&C_poses_data, &problem, translation_parameterization](
+          const transform::Rigid3d& pose,
+          ceres::LocalParameterization* const rotation_parameterization) {
+        C_poses_data->push_back(FromPose(pose));
+        return CeresPose(std::shared_ptr<CeresPose::Data>(
+                             C_poses_data, &C_poses_data->back()),
+                         translation_parameterization,
+                         rotation_parameterization, &problem);
+      };
   MapById<SubmapId, CeresPose> C_submaps;
   MapById<NodeId, CeresPose> C_nodes;
   std::map<std::string, CeresPose> C_landmarks;
@@ -297,20 +374,15 @@ void OptimizationProblem3D::Solve(
       // gravity alignment.
       C_submaps.Insert(
           submap_id_data.id,
-          CeresPose(submap_id_data.data.global_pose,
-                    translation_parameterization(),
-                    absl::make_unique<ceres::AutoDiffLocalParameterization<
-                        ConstantYawQuaternionPlus, 4, 2>>(),
-                    &problem));
+          add_pose(submap_id_data.data.global_pose,
+                   new ceres::AutoDiffLocalParameterization<
+                       ConstantYawQuaternionPlus, 4, 2>()));
       problem.SetParameterBlockConstant(
           C_submaps.at(submap_id_data.id).translation());
     } else {
-      C_submaps.Insert(
-          submap_id_data.id,
-          CeresPose(submap_id_data.data.global_pose,
-                    translation_parameterization(),
-                    absl::make_unique<ceres::QuaternionParameterization>(),
-                    &problem));
+      C_submaps.Insert(submap_id_data.id,
+                       add_pose(submap_id_data.data.global_pose,
+                                quaternion_parameterization));
     }
     if (frozen) {
       problem.SetParameterBlockConstant(
@@ -322,11 +394,8 @@ void OptimizationProblem3D::Solve(
   for (const auto& node_id_data : node_data_) {
     const bool frozen =
         frozen_trajectories.count(node_id_data.id.trajectory_id) != 0;
-    C_nodes.Insert(
-        node_id_data.id,
-        CeresPose(node_id_data.data.global_pose, translation_parameterization(),
-                  absl::make_unique<ceres::QuaternionParameterization>(),
-                  &problem));
+    C_nodes.Insert(node_id_data.id, add_pose(node_id_data.data.global_pose,
+                                             quaternion_parameterization));
     if (frozen) {
       problem.SetParameterBlockConstant(C_nodes.at(node_id_data.id).rotation());
       problem.SetParameterBlockConstant(
@@ -352,18 +421,15 @@ void OptimizationProblem3D::Solve(
   // Add constraints based on IMU observations of angular velocities and
   // linear acceleration.
   if (!options_.fix_z_in_3d()) {
-    for (auto node_it = node_data_.begin(); node_it != node_data_.end();) {
-      const int trajectory_id = node_it->id.trajectory_id;
-      const auto trajectory_end = node_data_.EndOfTrajectory(trajectory_id);
+    for (const int trajectory_id : node_data_.trajectory_ids()) {
       if (frozen_trajectories.count(trajectory_id) != 0) {
         // We skip frozen trajectories.
-        node_it = trajectory_end;
         continue;
       }
       TrajectoryData& trajectory_data = trajectory_data_.at(trajectory_id);
 
       problem.AddParameterBlock(trajectory_data.imu_calibration.data(), 4,
-                                new ceres::QuaternionParameterization());
+                                quaternion_parameterization);
       if (!options_.use_online_imu_extrinsics_in_3d()) {
         problem.SetParameterBlockConstant(
             trajectory_data.imu_calibration.data());
@@ -372,60 +438,95 @@ void OptimizationProblem3D::Solve(
       const auto imu_data = imu_data_.trajectory(trajectory_id);
       CHECK(imu_data.begin() != imu_data.end());
 
-      auto imu_it = imu_data.begin();
-      auto prev_node_it = node_it;
-      for (++node_it; node_it != trajectory_end; ++node_it) {
-        const NodeId first_node_id = prev_node_it->id;
-        const NodeSpec3D& first_node_data = prev_node_it->data;
-        prev_node_it = node_it;
-        const NodeId second_node_id = node_it->id;
-        const NodeSpec3D& second_node_data = node_it->data;
-
-        if (second_node_id.node_index != first_node_id.node_index + 1) {
-          continue;
-        }
-
-        // Skip IMU data before the node.
-        while (std::next(imu_it) != imu_data.end() &&
-               std::next(imu_it)->time <= first_node_data.time) {
-          ++imu_it;
+      // Integrating the IMU data is most of the work of building the problem,
+      // so the cost functions between consecutive nodes are created in
+      // parallel, and only added to 'problem' afterwards.
+      std::vector<NodeId> second_node_ids;
+      for (const auto& node : node_data_.trajectory(trajectory_id)) {
+        if (node_data_.Contains(
+                NodeId{trajectory_id, node.id.node_index - 1})) {
+          second_node_ids.push_back(node.id);
         }
-
-        auto imu_it2 = imu_it;
-        const IntegrateImuResult<double> result = IntegrateImu(
-            imu_data, first_node_data.time, second_node_data.time, &imu_it);
-        const auto next_node_it = std::next(node_it);
-        const common::Time first_time = first_node_data.time;
-        const common::Time second_time = second_node_data.time;
-        const common::Duration first_duration = second_time - first_time;
-        if (next_node_it != trajectory_end &&
-            next_node_it->id.node_index == second_node_id.node_index + 1) {
-          const NodeId third_node_id = next_node_it->id;
-          const NodeSpec3D& third_node_data = next_node_it->data;
-          const common::Time third_time = third_node_data.time;
-          const common::Duration second_duration = third_time - second_time;
-          const common::Time first_center = first_time + first_duration / 2;
-          const common::Time second_center = second_time + second_duration / 2;
-          const IntegrateImuResult<double> result_to_first_center =
-              IntegrateImu(imu_data, first_time, first_center, &imu_it2);
-          const IntegrateImuResult<double> result_center_to_center =
-              IntegrateImu(imu_data, first_center, second_center, &imu_it2);
-          // 'delta_velocity' is the change in velocity from the point in time
-          // halfway between the first and second poses to halfway between
-          // second and third pose. It is computed from IMU data and still
-          // contains a delta due to gravity. The orientation of this vector is
-          // in the IMU frame at the second pose.
-          const Eigen::Vector3d delta_velocity =
-              (result.delta_rotation.inverse() *
-               result_to_first_center.delta_rotation) *
-              result_center_to_center.delta_velocity;
+      }
+      struct ImuCostFunctions {
+        ceres::CostFunction* acceleration;
+        ceres::CostFunction* rotation;
+      };
+      std::vector<ImuCostFunctions> imu_cost_functions(second_node_ids.size());
+      common::ParallelFor(
+          second_node_ids.size(),
+          options_.ceres_solver_options().num_threads(), thread_pool_,
+          [&](const size_t i) {
+            const NodeId& second_node_id = second_node_ids[i];
+            const common::Time first_time =
+                node_data_
+                    .at(NodeId{trajectory_id, second_node_id.node_index - 1})
+                    .time;
+            const common::Time second_time =
+                node_data_.at(second_node_id).time;
+
+            // Start at the last IMU data not after the first node.
+            auto imu_it = imu_data_.lower_bound(trajectory_id, first_time);
+            if (imu_it != imu_data.begin()) {
+              --imu_it;
+            }
+            while (std::next(imu_it) != imu_data.end() &&
+                   std::next(imu_it)->time <= first_time) {
+              ++imu_it;
+            }
+
+            auto imu_it2 = imu_it;
+            const IntegrateImuResult<double> result =
+                IntegrateImu(imu_data, first_time, second_time, &imu_it);
+            const common::Duration first_duration = second_time - first_time;
+            imu_cost_functions[i].acceleration = nullptr;
+            const NodeId third_node_id{trajectory_id,
+                                       second_node_id.node_index + 1};
+            if (node_data_.Contains(third_node_id)) {
+              const common::Time third_time = node_data_.at(third_node_id).time;
+              const common::Duration second_duration =
+                  third_time - second_time;
+              const common::Time first_center =
+                  first_time + first_duration / 2;
+              const common::Time second_center =
+                  second_time + second_duration / 2;
+              const IntegrateImuResult<double> result_to_first_center =
+                  IntegrateImu(imu_data, first_time, first_center, &imu_it2);
+              const IntegrateImuResult<double> result_center_to_center =
+                  IntegrateImu(imu_data, first_center, second_center,
+                               &imu_it2);
+              // 'delta_velocity' is the change in velocity from the point in
+              // time halfway between the first and second poses to halfway
+              // between second and third pose. It is computed from IMU data
+              // and still contains a delta due to gravity. The orientation of
+              // this vector is in the IMU frame at the second pose.
+              const Eigen::Vector3d delta_velocity =
+                  (result.delta_rotation.inverse() *
+                   result_to_first_center.delta_rotation) *
+                  result_center_to_center.delta_velocity;
+              imu_cost_functions[i].acceleration =
+                  AccelerationCostFunction3D::CreateAutoDiffCostFunction(
+                      options_.acceleration_weight() /
+                          common::ToSeconds(first_duration + second_duration),
+                      delta_velocity, common::ToSeconds(first_duration),
+                      common::ToSeconds(second_duration));
+            }
+            imu_cost_functions[i].rotation =
+                RotationCostFunction3D::CreateAutoDiffCostFunction(
+                    options_.rotation_weight() /
+                        common::ToSeconds(first_duration),
+                    result.delta_rotation);
+          });
+
+      for (size_t i = 0; i != second_node_ids.size(); ++i) {
+        const NodeId& second_node_id = second_node_ids[i];
+        const NodeId first_node_id{trajectory_id,
+                                   second_node_id.node_index - 1};
+        if (imu_cost_functions[i].acceleration != nullptr) {
+          const NodeId third_node_id{trajectory_id,
+                                     second_node_id.node_index + 1};
           problem.AddResidualBlock(
-              AccelerationCostFunction3D::CreateAutoDiffCostFunction(
-                  options_.acceleration_weight() /
-                      common::ToSeconds(first_duration + second_duration),
-                  delta_velocity, common::ToSeconds(first_duration),
-                  common::ToSeconds(second_duration)),
-              nullptr /* loss function */,
+              imu_cost_functions[i].acceleration, nullptr /* loss function */,
               C_nodes.at(second_node_id).rotation(),
               C_nodes.at(first_node_id).translation(),
               C_nodes.at(second_node_id).translation(),
@@ -433,13 +534,11 @@ void OptimizationProblem3D::Solve(
               &trajectory_data.gravity_constant,
               trajectory_data.imu_calibration.data());
         }
-        problem.AddResidualBlock(
-            RotationCostFunction3D::CreateAutoDiffCostFunction(
-                options_.rotation_weight() / common::ToSeconds(first_duration),
-                result.delta_rotation),
-            nullptr /* loss function */, C_nodes.at(first_node_id).rotation(),
-            C_nodes.at(second_node_id).rotation(),
-            trajectory_data.imu_calibration.data());
+        problem.AddResidualBlock(imu_cost_functions[i].rotation,
+                                 nullptr /* loss function */,
+                                 C_nodes.at(first_node_id).rotation(),
+                                 C_nodes.at(second_node_id).rotation(),
+                                 trajectory_data.imu_calibration.data());
       }
 
       // Force gravity constant to be positive.
@@ -604,6 +703,255 @@ void OptimizationProblem3D::Solve(
   }
 }
 
+void OptimizationProblem3D::SolveSubmapPoses(
+    const std::vector<Constraint>& constraints,
+    const std::map<int, PoseGraphInterface::TrajectoryState>&
+        trajectories_state) {
+  if (submap_data_.empty()) {
+    return;
+  }
+  const std::set<int> frozen_trajectories =
+      GetFrozenTrajectories(trajectories_state);
+
+  ceres::Problem::Options problem_options;
+  ceres::Problem problem(problem_options);
+  MapById<SubmapId, CeresPose> C_submaps;
+  bool first_submap = true;
+  for (const auto& submap_id_data : submap_data_) {
+    const bool frozen =
+        frozen_trajectories.count(submap_id_data.id.trajectory_id) != 0;
+    if (first_submap) {
+      first_submap = false;
+      // Like in 'Solve()', only gravity alignment of the first submap is
+      // optimized.
+      C_submaps.Insert(
+          submap_id_data.id,
+          CeresPose(submap_id_data.data.global_pose,
+                    CreateTranslationParameterization(options_.fix_z_in_3d()),
+                    absl::make_unique<ceres::AutoDiffLocalParameterization<
+                        ConstantYawQuaternionPlus, 4, 2>>(),
+                    &problem));
+      problem.SetParameterBlockConstant(
+          C_submaps.at(submap_id_data.id).translation());
+    } else {
+      C_submaps.Insert(
+          submap_id_data.id,
+          CeresPose(submap_id_data.data.global_pose,
+                    CreateTranslationParameterization(options_.fix_z_in_3d()),
+                    absl::make_unique<ceres::QuaternionParameterization>(),
+                    &problem));
+    }
+    if (frozen) {
+      problem.SetParameterBlockConstant(
+          C_submaps.at(submap_id_data.id).rotation());
+      problem.SetParameterBlockConstant(
+          C_submaps.at(submap_id_data.id).translation());
+    }
+  }
+  const absl::flat_hash_map<NodeId, size_t> anchor_constraints =
+      FindAnchorConstraints(constraints);
+  for (const SubmapConstraint& constraint :
+       CondenseConstraints(constraints, anchor_constraints)) {
+    problem.AddResidualBlock(
+        SpaCostFunction3D::CreateAutoDiffCostFunction(constraint.pose),
+        constraint.tag == Constraint::INTER_SUBMAP
+            ? new ceres::HuberLoss(options_.huber_scale())
+            : nullptr /* loss function */,
+        C_submaps.at(constraint.first).rotation(),
+        C_submaps.at(constraint.first).translation(),
+        C_submaps.at(constraint.second).rotation(),
+        C_submaps.at(constraint.second).translation());
+  }
+
+  ceres::Solver::Summary summary;
+  ceres::Solve(
+      common::CreateCeresSolverOptions(options_.ceres_solver_options()),
+      &problem, &summary);
+  if (options_.log_solver_summary()) {
+    LOG(INFO) << summary.FullReport();
+  }
+
+  // Move the nodes with their anchor submaps.
+  for (const auto& entry : anchor_constraints) {
+    const SubmapId& submap_id = constraints[entry.second].submap_id;
+    if (!node_data_.Contains(entry.first) || !C_submaps.Contains(submap_id)) {
+      continue;
+    }
+    transform::Rigid3d& global_pose = node_data_.at(entry.first).global_pose;
+    global_pose = C_submaps.at(submap_id).ToRigid() *
+                  submap_data_.at(submap_id).global_pose.inverse() *
+                  global_pose;
+  }
+  for (const auto& C_submap_id_data : C_submaps) {
+    submap_data_.at(C_submap_id_data.id).global_pose =
+        C_submap_id_data.data.ToRigid();
+  }
+}
+
+void OptimizationProblem3D::RefineNodePoses(
+    const std::vector<Constraint>& constraints,
+    const std::map<int, PoseGraphInterface::TrajectoryState>&
+        trajectories_state) {
+  const absl::flat_hash_map<NodeId, size_t> anchor_constraints =
+      FindAnchorConstraints(constraints);
+  std::vector<SubmapId> anchor_submap_ids;
+  std::vector<std::vector<NodeId>> groups;
+  for (auto& entry : GroupNodesByAnchorSubmap(
+           constraints, anchor_constraints,
+           GetFrozenTrajectories(trajectories_state))) {
+    anchor_submap_ids.push_back(entry.first);
+    groups.push_back(std::move(entry.second));
+  }
+  std::vector<std::vector<const Constraint*>> group_constraints(groups.size());
+  for (const Constraint& constraint : constraints) {
+    const auto anchor_it = anchor_constraints.find(constraint.node_id);
+    if (anchor_it == anchor_constraints.end()) {
+      continue;
+    }
+    const auto group_it = std::lower_bound(
+        anchor_submap_ids.begin(), anchor_submap_ids.end(),
+        constraints[anchor_it->second].submap_id);
+    if (group_it != anchor_submap_ids.end() &&
+        *group_it == constraints[anchor_it->second].submap_id) {
+      group_constraints[group_it - anchor_submap_ids.begin()].push_back(
+          &constraint);
+    }
+  }
+
+  // Groups only read the current poses, so they can be optimized in parallel.
+  std::vector<std::vector<transform::Rigid3d>> refined_poses(groups.size());
+  common::ParallelFor(groups.size(),
+                      options_.ceres_solver_options().num_threads(),
+                      thread_pool_, [&](const size_t i) {
+                        refined_poses[i] = RefineNodePosesOfGroup(
+                            groups[i], group_constraints[i]);
+                      });
+  for (size_t i = 0; i != groups.size(); ++i) {
+    for (size_t j = 0; j != groups[i].size(); ++j) {
+      node_data_.at(groups[i][j]).global_pose = refined_poses[i][j];
+    }
+  }
+}
+
+std::vector<transform::Rigid3d> OptimizationProblem3D::RefineNodePosesOfGroup(
+    const std::vector<NodeId>& node_ids,
+    const std::vector<const Constraint*>& constraints) const {
+  ceres::Problem::Options problem_options;
+  ceres::Problem problem(problem_options);
+  std::map<NodeId, CeresPose> C_nodes;
+  for (const NodeId& node_id : node_ids) {
+    C_nodes.emplace(
+        std::piecewise_construct, std::forward_as_tuple(node_id),
+        std::forward_as_tuple(
+            node_data_.at(node_id).global_pose,
+            CreateTranslationParameterization(options_.fix_z_in_3d()),
+            absl::make_unique<ceres::QuaternionParameterization>(), &problem));
+  }
+  // Submaps and nodes outside of the group are fixed.
+  const auto add_fixed_pose = [&problem](const transform::Rigid3d& pose) {
+    CeresPose C_pose(pose, nullptr /* translation_parametrization */,
+                     absl::make_unique<ceres::QuaternionParameterization>(),
+                     &problem);
+    problem.SetParameterBlockConstant(C_pose.rotation());
+    problem.SetParameterBlockConstant(C_pose.translation());
+    return C_pose;
+  };
+  std::map<SubmapId, CeresPose> C_fixed_submaps;
+  std::map<NodeId, CeresPose> C_fixed_nodes;
+  const auto get_submap = [&](const SubmapId& submap_id) -> CeresPose& {
+    auto it = C_fixed_submaps.find(submap_id);
+    if (it == C_fixed_submaps.end()) {
+      it = C_fixed_submaps
+               .emplace(submap_id,
+                        add_fixed_pose(submap_data_.at(submap_id).global_pose))
+               .first;
+    }
+    return it->second;
+  };
+  const auto get_node = [&](const NodeId& node_id) -> CeresPose& {
+    const auto group_it = C_nodes.find(node_id);
+    if (group_it != C_nodes.end()) {
+      return group_it->second;
+    }
+    auto it = C_fixed_nodes.find(node_id);
+    if (it == C_fixed_nodes.end()) {
+      it = C_fixed_nodes
+               .emplace(node_id,
+                        add_fixed_pose(node_data_.at(node_id).global_pose))
+               .first;
+    }
+    return it->second;
+  };
+
+  for (const Constraint* constraint : constraints) {
+    CeresPose& C_submap = get_submap(constraint->submap_id);
+    CeresPose& C_node = get_node(constraint->node_id);
+    problem.AddResidualBlock(
+        SpaCostFunction3D::CreateAutoDiffCostFunction(constraint->pose),
+        constraint->tag == Constraint::INTER_SUBMAP
+            ? new ceres::HuberLoss(options_.huber_scale())
+            : nullptr /* loss function */,
+        C_submap.rotation(), C_submap.translation(), C_node.rotation(),
+        C_node.translation());
+  }
+  // Add the local SLAM pose and odometry residuals of each node to its
+  // predecessor, and to its successor if that is not in the group. Unlike
+  // 'Solve()', these are also used when z is not fixed, in place of the IMU
+  // residuals which would need the IMU calibration and gravity to be solved
+  // for globally.
+  for (const NodeId& node_id : node_ids) {
+    for (const NodeId& second_node_id :
+         {node_id, NodeId{node_id.trajectory_id, node_id.node_index + 1}}) {
+      const NodeId first_node_id{second_node_id.trajectory_id,
+                                 second_node_id.node_index - 1};
+      if (!node_data_.Contains(first_node_id) ||
+          !node_data_.Contains(second_node_id) ||
+          (second_node_id != node_id && C_nodes.count(second_node_id) != 0)) {
+        continue;
+      }
+      const NodeSpec3D& first_node_data = node_data_.at(first_node_id);
+      const NodeSpec3D& second_node_data = node_data_.at(second_node_id);
+      CeresPose& C_first_node = get_node(first_node_id);
+      CeresPose& C_second_node = get_node(second_node_id);
+      const std::unique_ptr<transform::Rigid3d> relative_odometry =
+          CalculateOdometryBetweenNodes(node_id.trajectory_id, first_node_data,
+                                        second_node_data);
+      if (relative_odometry != nullptr) {
+        problem.AddResidualBlock(
+            SpaCostFunction3D::CreateAutoDiffCostFunction(Constraint::Pose{
+                *relative_odometry, options_.odometry_translation_weight(),
+                options_.odometry_rotation_weight()}),
+            nullptr /* loss function */, C_first_node.rotation(),
+            C_first_node.translation(), C_second_node.rotation(),
+            C_second_node.translation());
+      }
+      problem.AddResidualBlock(
+          SpaCostFunction3D::CreateAutoDiffCostFunction(Constraint::Pose{
+              first_node_data.local_pose.inverse() *
+                  second_node_data.local_pose,
+              options_.local_slam_pose_translation_weight(),
+              options_.local_slam_pose_rotation_weight()}),
+          nullptr /* loss function */, C_first_node.rotation(),
+          C_first_node.translation(), C_second_node.rotation(),
+          C_second_node.translation());
+    }
+  }
+
+  // Groups are solved in parallel, so each uses a single thread.
+  ceres::Solver::Options solver_options =
+      common::CreateCeresSolverOptions(options_.ceres_solver_options());
+  solver_options.num_threads = 1;
+  ceres::Solver::Summary summary;
+  ceres::Solve(solver_options, &problem, &summary);
+
+  std::vector<transform::Rigid3d> result;
+  result.reserve(node_ids.size());
+  for (const NodeId& node_id : node_ids) {
+    result.push_back(C_nodes.at(node_id).ToRigid());
+  }
+  return result;
+}
+
 std::unique_ptr<transform::Rigid3d>
 OptimizationProblem3D::CalculateOdometryBetweenNodes(
     const int trajectory_id, const NodeSpec3D& first_node_data,
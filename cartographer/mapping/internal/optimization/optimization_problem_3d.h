@@ -19,6 +19,7 @@
 
 #include <array>
 #include <map>
+#include <memory>
 #include <set>
 #include <vector>
 
@@ -26,6 +27,7 @@
 #include "Eigen/Geometry"
 #include "absl/types/optional.h"
 #include "cartographer/common/port.h"
+#include "cartographer/common/thread_pool.h"
 #include "cartographer/common/time.h"
 #include "cartographer/mapping/id.h"
 #include "cartographer/mapping/internal/optimization/optimization_problem_interface.h"
@@ -76,12 +78,36 @@ class OptimizationProblem3D
                     const transform::Rigid3d& global_submap_pose) override;
   void TrimSubmap(const SubmapId& submap_id) override;
   void SetMaxNumIterations(int32 max_num_iterations) override;
+  // Spreads work in 'Solve()' and 'RefineNodePoses()' over 'thread_pool' in
+  // addition to the calling thread. Without a thread pool, which is the
+  // default, all work is done on the calling thread.
+  void SetThreadPool(common::ThreadPoolInterface* thread_pool);
+
+  // Returns a new problem with a copy of the data of this one, so that it can
+  // be solved while this one keeps changing. The copy has the same options,
+  // including the number of iterations set by 'SetMaxNumIterations()', and the
+  // thread pool set by 'SetThreadPool()'.
+  std::unique_ptr<OptimizationProblem3D> CopyData() const;
+  // Takes over the poses of 'solved_problem', which was created by
+  // 'CopyData()' of this problem and solved since. Nodes and submaps which were
+  // added after the copy was made are moved by the 'corrections' of their
+  // trajectory, the ones which were trimmed meanwhile are ignored.
+  void MergeSolution(const OptimizationProblem3D& solved_problem,
+                     const std::map<int, transform::Rigid3d>& corrections);
 
   void Solve(
       const std::vector<Constraint>& constraints,
       const std::map<int, PoseGraphInterface::TrajectoryState>&
           trajectories_state,
       const std::map<std::string, LandmarkNode>& landmark_nodes) override;
+  void SolveSubmapPoses(
+      const std::vector<Constraint>& constraints,
+      const std::map<int, PoseGraphInterface::TrajectoryState>&
+          trajectories_state) override;
+  void RefineNodePoses(
+      const std::vector<Constraint>& constraints,
+      const std::map<int, PoseGraphInterface::TrajectoryState>&
+          trajectories_state) override;
 
   const MapById<NodeId, NodeSpec3D>& node_data() const override {
     return node_data_;
@@ -117,12 +143,20 @@ class OptimizationProblem3D
   }
 
  private:
+  // Optimizes the nodes 'node_ids' with all other poses fixed, using
+  // 'constraints' which are the constraints of these nodes. Returns the new
+  // global poses of the nodes.
+  std::vector<transform::Rigid3d> RefineNodePosesOfGroup(
+      const std::vector<NodeId>& node_ids,
+      const std::vector<const Constraint*>& constraints) const;
+
   // Computes the relative pose between two nodes based on odometry data.
   std::unique_ptr<transform::Rigid3d> CalculateOdometryBetweenNodes(
       int trajectory_id, const NodeSpec3D& first_node_data,
       const NodeSpec3D& second_node_data) const;
 
   optimization::proto::OptimizationProblemOptions options_;
+  common::ThreadPoolInterface* thread_pool_ = nullptr;
   MapById<NodeId, NodeSpec3D> node_data_;
   MapById<SubmapId, SubmapSpec3D> submap_data_;
   std::map<std::string, transform::Rigid3d> landmark_data_;
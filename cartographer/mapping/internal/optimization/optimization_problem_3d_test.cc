@@ -16,12 +16,16 @@
 
 #include "cartographer/mapping/internal/optimization/optimization_problem_3d.h"
 
+#include <map>
+#include <memory>
 #include <random>
+#include <vector>
 
 #include "Eigen/Core"
 #include "cartographer/common/internal/testing/lua_parameter_dictionary_test_helpers.h"
 #include "cartographer/common/time.h"
 #include "cartographer/mapping/internal/optimization/optimization_problem_options.h"
+#include "cartographer/transform/rigid_transform_test_helpers.h"
 #include "cartographer/transform/transform.h"
 #include "glog/logging.h"
 #include "gmock/gmock.h"
@@ -54,6 +58,9 @@ class OptimizationProblem3DTest : public ::testing::Test {
           log_solver_summary = true,
           use_online_imu_extrinsics_in_3d = true,
           fix_z_in_3d = false,
+          use_persistent_problem_in_2d = false,
+          use_submap_level_optimization = false,
+          refine_nodes_after_submap_level_optimization = false,
           ceres_solver_options = {
             use_nonmonotonic_steps = false,
             max_num_iterations = 200,
@@ -196,6 +203,87 @@ TEST_F(OptimizationProblem3DTest, ReducesNoise) {
   EXPECT_GT(0.8 * rotation_error_before, rotation_error_after);
 }
 
+TEST_F(OptimizationProblem3DTest, MergesSolutionOfCopy) {
+  constexpr int kNumNodes = 20;
+  const int kTrajectoryId = 0;
+  const std::map<int, PoseGraphInterface::TrajectoryState> kTrajectoriesState =
+      {{kTrajectoryId, PoseGraphInterface::TrajectoryState::ACTIVE}};
+  common::Time now = common::FromUniversal(0);
+  std::vector<OptimizationProblem3D::Constraint> constraints;
+  const auto add_node = [&](const int submap_index) {
+    const transform::Rigid3d pose = RandomYawOnlyTransform(10., 3.);
+    optimization_problem_.AddImuData(
+        kTrajectoryId, sensor::ImuData{now, Eigen::Vector3d::UnitZ() * 9.81,
+                                       Eigen::Vector3d::Zero()});
+    optimization_problem_.AddTrajectoryNode(kTrajectoryId,
+                                            NodeSpec3D{now, pose, pose});
+    constraints.push_back(OptimizationProblem3D::Constraint{
+        SubmapId{kTrajectoryId, submap_index},
+        NodeId{kTrajectoryId,
+               static_cast<int>(optimization_problem_.node_data().size()) - 1},
+        OptimizationProblem3D::Constraint::Pose{
+            AddNoise(pose, RandomYawOnlyTransform(0.2, 0.3)), 1., 1.},
+        OptimizationProblem3D::Constraint::INTRA_SUBMAP});
+    now += common::FromSeconds(0.1);
+  };
+  optimization_problem_.AddSubmap(kTrajectoryId,
+                                  transform::Rigid3d::Identity());
+  optimization_problem_.AddSubmap(kTrajectoryId,
+                                  RandomYawOnlyTransform(1., 0.3));
+  for (int j = 0; j != kNumNodes; ++j) {
+    add_node(j < kNumNodes / 2 ? 0 : 1);
+  }
+
+  const SubmapId last_submap_id{kTrajectoryId, 1};
+  std::unique_ptr<OptimizationProblem3D> copy =
+      optimization_problem_.CopyData();
+  EXPECT_EQ(copy->node_data().size(), optimization_problem_.node_data().size());
+  EXPECT_EQ(copy->submap_data().size(),
+            optimization_problem_.submap_data().size());
+  EXPECT_TRUE(copy->imu_data().HasTrajectory(kTrajectoryId));
+  const transform::Rigid3d last_submap_pose_before =
+      copy->submap_data().at(last_submap_id).global_pose;
+  copy->Solve(constraints, kTrajectoriesState, {});
+  const transform::Rigid3d correction =
+      copy->submap_data().at(last_submap_id).global_pose *
+      last_submap_pose_before.inverse();
+
+  // Data changes while the copy is solved.
+  const transform::Rigid3d new_submap_pose = RandomYawOnlyTransform(1., 0.3);
+  optimization_problem_.AddSubmap(kTrajectoryId, new_submap_pose);
+  for (int j = 0; j != 3; ++j) {
+    add_node(2);
+  }
+  const NodeId trimmed_node_id{kTrajectoryId, 0};
+  optimization_problem_.TrimTrajectoryNode(trimmed_node_id);
+  std::map<NodeId, transform::Rigid3d> poses_before_merge;
+  for (const auto& node_id_data : optimization_problem_.node_data()) {
+    poses_before_merge.emplace(node_id_data.id,
+                               node_id_data.data.global_pose);
+  }
+  optimization_problem_.MergeSolution(*copy, {{kTrajectoryId, correction}});
+
+  EXPECT_FALSE(optimization_problem_.node_data().Contains(trimmed_node_id));
+  EXPECT_EQ(optimization_problem_.node_data().size(), kNumNodes + 2);
+  for (const auto& node_id_data : optimization_problem_.node_data()) {
+    const transform::Rigid3d expected =
+        copy->node_data().Contains(node_id_data.id)
+            ? copy->node_data().at(node_id_data.id).global_pose
+            : correction * poses_before_merge.at(node_id_data.id);
+    EXPECT_THAT(node_id_data.data.global_pose,
+                transform::IsNearly(expected, 1e-9))
+        << node_id_data.id;
+  }
+  EXPECT_THAT(optimization_problem_.submap_data()
+                  .at(SubmapId{kTrajectoryId, 2})
+                  .global_pose,
+              transform::IsNearly(correction * new_submap_pose, 1e-9));
+  EXPECT_THAT(
+      optimization_problem_.submap_data().at(last_submap_id).global_pose,
+      transform::IsNearly(copy->submap_data().at(last_submap_id).global_pose,
+                          1e-9));
+}
+
 }  // namespace
 }  // namespace optimization
 }  // namespace mapping
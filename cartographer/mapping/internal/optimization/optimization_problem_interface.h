@@ -73,6 +73,22 @@ class OptimizationProblemInterface {
           trajectories_state,
       const std::map<std::string, LandmarkNode>& landmark_nodes) = 0;
 
+  // Optimizes only the global submap poses, on the constraints condensed into
+  // relative poses between submaps. Each node moves with the first submap it
+  // was inserted into.
+  virtual void SolveSubmapPoses(
+      const std::vector<Constraint>& constraints,
+      const std::map<int, PoseGraphInterface::TrajectoryState>&
+          trajectories_state) = 0;
+
+  // Optimizes the global node poses with fixed submap poses. Nodes which were
+  // first inserted into the same submap are optimized together, and these
+  // groups are optimized in parallel.
+  virtual void RefineNodePoses(
+      const std::vector<Constraint>& constraints,
+      const std::map<int, PoseGraphInterface::TrajectoryState>&
+          trajectories_state) = 0;
+
   virtual const MapById<NodeId, NodeDataType>& node_data() const = 0;
   virtual const MapById<SubmapId, SubmapDataType>& submap_data() const = 0;
   virtual const std::map<std::string, transform::Rigid3d>& landmark_data()
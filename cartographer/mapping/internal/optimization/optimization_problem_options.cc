@@ -53,6 +53,13 @@ proto::OptimizationProblemOptions CreateOptimizationProblemOptions(
   options.set_use_online_imu_extrinsics_in_3d(
       parameter_dictionary->GetBool("use_online_imu_extrinsics_in_3d"));
   options.set_fix_z_in_3d(parameter_dictionary->GetBool("fix_z_in_3d"));
+  options.set_use_persistent_problem_in_2d(
+      parameter_dictionary->GetBool("use_persistent_problem_in_2d"));
+  options.set_use_submap_level_optimization(
+      parameter_dictionary->GetBool("use_submap_level_optimization"));
+  options.set_refine_nodes_after_submap_level_optimization(
+      parameter_dictionary->GetBool(
+          "refine_nodes_after_submap_level_optimization"));
   *options.mutable_ceres_solver_options() =
       common::CreateCeresSolverOptionsProto(
           parameter_dictionary->GetDictionary("ceres_solver_options").get());
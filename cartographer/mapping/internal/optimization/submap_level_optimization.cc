@@ -0,0 +1,116 @@
+/*
+ * Copyright 2018 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/internal/optimization/submap_level_optimization.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "glog/logging.h"
+
+namespace cartographer {
+namespace mapping {
+namespace optimization {
+namespace {
+
+using Constraint = PoseGraphInterface::Constraint;
+
+// Weights are inverse standard deviations, so the weight of the composition
+// of two independent measurements adds their variances.
+double CombineWeights(const double a, const double b) {
+  if (a <= 0. || b <= 0.) {
+    return 0.;
+  }
+  return 1. / std::sqrt(1. / (a * a) + 1. / (b * b));
+}
+
+}  // namespace
+
+std::set<int> GetFrozenTrajectories(
+    const std::map<int, PoseGraphInterface::TrajectoryState>&
+        trajectories_state) {
+  std::set<int> frozen_trajectories;
+  for (const auto& it : trajectories_state) {
+    if (it.second == PoseGraphInterface::TrajectoryState::FROZEN) {
+      frozen_trajectories.insert(it.first);
+    }
+  }
+  return frozen_trajectories;
+}
+
+absl::flat_hash_map<NodeId, size_t> FindAnchorConstraints(
+    const std::vector<Constraint>& constraints) {
+  absl::flat_hash_map<NodeId, size_t> anchor_constraints;
+  for (size_t i = 0; i != constraints.size(); ++i) {
+    const Constraint& constraint = constraints[i];
+    if (constraint.tag != Constraint::INTRA_SUBMAP) {
+      continue;
+    }
+    const auto it = anchor_constraints.emplace(constraint.node_id, i).first;
+    if (constraint.submap_id < constraints[it->second].submap_id) {
+      it->second = i;
+    }
+  }
+  return anchor_constraints;
+}
+
+std::vector<SubmapConstraint> CondenseConstraints(
+    const std::vector<Constraint>& constraints,
+    const absl::flat_hash_map<NodeId, size_t>& anchor_constraints) {
+  std::vector<SubmapConstraint> result;
+  result.reserve(constraints.size());
+  for (const Constraint& constraint : constraints) {
+    const auto it = anchor_constraints.find(constraint.node_id);
+    if (it == anchor_constraints.end()) {
+      continue;
+    }
+    const Constraint& anchor_constraint = constraints[it->second];
+    if (anchor_constraint.submap_id == constraint.submap_id) {
+      continue;
+    }
+    result.push_back(SubmapConstraint{
+        constraint.submap_id,
+        anchor_constraint.submap_id,
+        {constraint.pose.zbar_ij * anchor_constraint.pose.zbar_ij.inverse(),
+         CombineWeights(constraint.pose.translation_weight,
+                        anchor_constraint.pose.translation_weight),
+         CombineWeights(constraint.pose.rotation_weight,
+                        anchor_constraint.pose.rotation_weight)},
+        constraint.tag});
+  }
+  return result;
+}
+
+std::map<SubmapId, std::vector<NodeId>> GroupNodesByAnchorSubmap(
+    const std::vector<Constraint>& constraints,
+    const absl::flat_hash_map<NodeId, size_t>& anchor_constraints,
+    const std::set<int>& frozen_trajectories) {
+  std::map<SubmapId, std::vector<NodeId>> result;
+  for (const auto& entry : anchor_constraints) {
+    if (frozen_trajectories.count(entry.first.trajectory_id) != 0) {
+      continue;
+    }
+    result[constraints[entry.second].submap_id].push_back(entry.first);
+  }
+  for (auto& entry : result) {
+    std::sort(entry.second.begin(), entry.second.end());
+  }
+  return result;
+}
+
+}  // namespace optimization
+}  // namespace mapping
+}  // namespace cartographer
@@ -0,0 +1,78 @@
+/*
+ * Copyright 2018 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_MAPPING_INTERNAL_OPTIMIZATION_SUBMAP_LEVEL_OPTIMIZATION_H_
+#define CARTOGRAPHER_MAPPING_INTERNAL_OPTIMIZATION_SUBMAP_LEVEL_OPTIMIZATION_H_
+
+#include <map>
+#include <set>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "cartographer/mapping/id.h"
+#include "cartographer/mapping/pose_graph_interface.h"
+
+namespace cartographer {
+namespace mapping {
+namespace optimization {
+
+// Helpers for optimizing a large pose graph in two levels: first only the
+// submap poses on a graph in which the nodes are condensed into constraints
+// between submaps, then optionally the node poses with the submaps fixed.
+//
+// Each node is anchored to the first submap it was inserted into, i.e. the
+// submap with the lowest ID among its intra-submap constraints. It moves
+// rigidly with this submap in the first level.
+
+// A relative pose between two submaps: 'pose.zbar_ij' is the pose of submap
+// 'second' relative to submap 'first'.
+struct SubmapConstraint {
+  SubmapId first;
+  SubmapId second;
+  PoseGraphInterface::Constraint::Pose pose;
+  PoseGraphInterface::Constraint::Tag tag;
+};
+
+// Returns the IDs of the trajectories which are frozen in 'trajectories_state'.
+std::set<int> GetFrozenTrajectories(
+    const std::map<int, PoseGraphInterface::TrajectoryState>&
+        trajectories_state);
+
+// Returns, for each node with an intra-submap constraint, the index in
+// 'constraints' of the constraint to its anchor submap.
+absl::flat_hash_map<NodeId, size_t> FindAnchorConstraints(
+    const std::vector<PoseGraphInterface::Constraint>& constraints);
+
+// Condenses each constraint of a node to a submap other than its anchor
+// submap into a constraint between that submap and the anchor submap. The
+// weights account for the uncertainty of both constraints involved.
+// Constraints of nodes without an anchor are dropped.
+std::vector<SubmapConstraint> CondenseConstraints(
+    const std::vector<PoseGraphInterface::Constraint>& constraints,
+    const absl::flat_hash_map<NodeId, size_t>& anchor_constraints);
+
+// Groups the nodes by their anchor submap. Nodes of 'frozen_trajectories'
+// are left out.
+std::map<SubmapId, std::vector<NodeId>> GroupNodesByAnchorSubmap(
+    const std::vector<PoseGraphInterface::Constraint>& constraints,
+    const absl::flat_hash_map<NodeId, size_t>& anchor_constraints,
+    const std::set<int>& frozen_trajectories);
+
+}  // namespace optimization
+}  // namespace mapping
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_MAPPING_INTERNAL_OPTIMIZATION_SUBMAP_LEVEL_OPTIMIZATION_H_
@@ -0,0 +1,99 @@
+/*
+ * Copyright 2018 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/internal/optimization/submap_level_optimization.h"
+
+#include <cmath>
+
+#include "cartographer/transform/rigid_transform_test_helpers.h"
+#include "cartographer/transform/transform.h"
+#include "gmock/gmock.h"
+
+namespace cartographer {
+namespace mapping {
+namespace optimization {
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::Pair;
+using Constraint = PoseGraphInterface::Constraint;
+
+transform::Rigid3d GetSubmapPose(const int submap_index) {
+  return transform::Rigid3d(
+      Eigen::Vector3d(2. * submap_index, 0.5 * submap_index, 0.),
+      transform::RollPitchYaw(0., 0., 0.3 * submap_index));
+}
+
+Constraint CreateConstraint(const int submap_index, const int node_index,
+                            const transform::Rigid3d& node_pose,
+                            const Constraint::Tag tag) {
+  return Constraint{SubmapId{0, submap_index},
+                    NodeId{0, node_index},
+                    {GetSubmapPose(submap_index).inverse() * node_pose, 10.,
+                     10.},
+                    tag};
+}
+
+TEST(SubmapLevelOptimizationTest, FindsAnchorConstraints) {
+  const transform::Rigid3d node_pose = transform::Rigid3d::Identity();
+  const std::vector<Constraint> constraints = {
+      CreateConstraint(1, 0, node_pose, Constraint::INTRA_SUBMAP),
+      CreateConstraint(0, 0, node_pose, Constraint::INTRA_SUBMAP),
+      CreateConstraint(3, 1, node_pose, Constraint::INTER_SUBMAP),
+      CreateConstraint(1, 1, node_pose, Constraint::INTRA_SUBMAP),
+      CreateConstraint(3, 2, node_pose, Constraint::INTER_SUBMAP)};
+  const absl::flat_hash_map<NodeId, size_t> anchor_constraints =
+      FindAnchorConstraints(constraints);
+  EXPECT_EQ(anchor_constraints.size(), 2);
+  EXPECT_EQ(anchor_constraints.at(NodeId(0, 0)), 1);
+  EXPECT_EQ(anchor_constraints.at(NodeId(0, 1)), 3);
+  EXPECT_THAT(GroupNodesByAnchorSubmap(constraints, anchor_constraints, {}),
+              ElementsAre(Pair(SubmapId(0, 0), ElementsAre(NodeId(0, 0))),
+                          Pair(SubmapId(0, 1), ElementsAre(NodeId(0, 1)))));
+  EXPECT_TRUE(
+      GroupNodesByAnchorSubmap(constraints, anchor_constraints, {0}).empty());
+}
+
+TEST(SubmapLevelOptimizationTest, CondensesConstraints) {
+  const transform::Rigid3d node_pose(
+      Eigen::Vector3d(1., 2., 0.3), transform::RollPitchYaw(0.1, 0., -0.4));
+  const std::vector<Constraint> constraints = {
+      CreateConstraint(4, 7, node_pose, Constraint::INTRA_SUBMAP),
+      CreateConstraint(5, 7, node_pose, Constraint::INTRA_SUBMAP),
+      CreateConstraint(0, 7, node_pose, Constraint::INTER_SUBMAP)};
+  const std::vector<SubmapConstraint> submap_constraints =
+      CondenseConstraints(constraints, FindAnchorConstraints(constraints));
+  ASSERT_EQ(submap_constraints.size(), 2);
+  EXPECT_EQ(submap_constraints[0].first, SubmapId(0, 5));
+  EXPECT_EQ(submap_constraints[0].second, SubmapId(0, 4));
+  EXPECT_EQ(submap_constraints[0].tag, Constraint::INTRA_SUBMAP);
+  EXPECT_THAT(submap_constraints[0].pose.zbar_ij,
+              transform::IsNearly(
+                  GetSubmapPose(5).inverse() * GetSubmapPose(4), 1e-9));
+  EXPECT_EQ(submap_constraints[1].first, SubmapId(0, 0));
+  EXPECT_EQ(submap_constraints[1].second, SubmapId(0, 4));
+  EXPECT_EQ(submap_constraints[1].tag, Constraint::INTER_SUBMAP);
+  EXPECT_THAT(submap_constraints[1].pose.zbar_ij,
+              transform::IsNearly(
+                  GetSubmapPose(0).inverse() * GetSubmapPose(4), 1e-9));
+  EXPECT_NEAR(submap_constraints[1].pose.translation_weight,
+              10. / std::sqrt(2.), 1e-9);
+}
+
+}  // namespace
+}  // namespace optimization
+}  // namespace mapping
+}  // namespace cartographer
@@ -16,6 +16,8 @@
 
 #include "cartographer/mapping/internal/range_data_collator.h"
 
+#include <algorithm>
+#include <limits>
 #include <memory>
 
 #include "absl/memory/memory.h"
@@ -27,106 +29,160 @@ namespace mapping {
 
 constexpr float RangeDataCollator::kDefaultIntensityValue;
 
+namespace {
+
+// Returns the first point in ['begin', 'end') for which 'predicate' is false.
+// If 'sorted', 'predicate' must be true for a prefix of the points only and
+// binary search is used.
+template <typename Predicate>
+sensor::TimedPointCloud::const_iterator FindEndOfPrefix(
+    const sensor::TimedPointCloud::const_iterator begin,
+    const sensor::TimedPointCloud::const_iterator end, const bool sorted,
+    Predicate predicate) {
+  if (sorted) {
+    return std::partition_point(begin, end, predicate);
+  }
+  return std::find_if_not(begin, end, predicate);
+}
+
+bool IsBefore(const sensor::TimedPointCloudOriginData::RangeMeasurement& a,
+              const sensor::TimedPointCloudOriginData::RangeMeasurement& b) {
+  return a.point_time.time < b.point_time.time;
+}
+
+}  // namespace
+
 sensor::TimedPointCloudOriginData RangeDataCollator::AddRangeData(
     const std::string& sensor_id,
     sensor::TimedPointCloudData timed_point_cloud_data) {
+  sensor::TimedPointCloudOriginData result;
+  AddRangeData(sensor_id, std::move(timed_point_cloud_data), &result);
+  return result;
+}
+
+void RangeDataCollator::AddRangeData(
+    const std::string& sensor_id,
+    sensor::TimedPointCloudData timed_point_cloud_data,
+    sensor::TimedPointCloudOriginData* const result) {
   CHECK_NE(expected_sensor_ids_.count(sensor_id), 0);
+  CHECK_LE(timed_point_cloud_data.ranges.size(),
+           std::numeric_limits<uint32>::max());
+  CHECK(timed_point_cloud_data.attributes.empty() ||
+        timed_point_cloud_data.attributes.num_points() ==
+            timed_point_cloud_data.ranges.size());
   timed_point_cloud_data.intensities.resize(
       timed_point_cloud_data.ranges.size(), kDefaultIntensityValue);
+  const bool sorted =
+      std::is_sorted(timed_point_cloud_data.ranges.begin(),
+                     timed_point_cloud_data.ranges.end(),
+                     [](const sensor::TimedRangefinderPoint& a,
+                        const sensor::TimedRangefinderPoint& b) {
+                       return a.time < b.time;
+                     });
+  PendingData pending_data{std::move(timed_point_cloud_data), 0, sorted};
   // TODO(gaschler): These two cases can probably be one.
   if (id_to_pending_data_.count(sensor_id) != 0) {
     current_start_ = current_end_;
     // When we have two messages of the same sensor, move forward the older of
     // the two (do not send out current).
-    current_end_ = id_to_pending_data_.at(sensor_id).time;
-    auto result = CropAndMerge();
-    id_to_pending_data_.emplace(sensor_id, std::move(timed_point_cloud_data));
-    return result;
+    current_end_ = id_to_pending_data_.at(sensor_id).data.time;
+    CropAndMerge(result);
+    id_to_pending_data_.emplace(sensor_id, std::move(pending_data));
+    return;
   }
-  id_to_pending_data_.emplace(sensor_id, std::move(timed_point_cloud_data));
+  id_to_pending_data_.emplace(sensor_id, std::move(pending_data));
   if (expected_sensor_ids_.size() != id_to_pending_data_.size()) {
-    return {};
+    *result = sensor::TimedPointCloudOriginData{};
+    return;
   }
   current_start_ = current_end_;
   // We have messages from all sensors, move forward to oldest.
   common::Time oldest_timestamp = common::Time::max();
   for (const auto& pair : id_to_pending_data_) {
-    oldest_timestamp = std::min(oldest_timestamp, pair.second.time);
+    oldest_timestamp = std::min(oldest_timestamp, pair.second.data.time);
   }
   current_end_ = oldest_timestamp;
-  return CropAndMerge();
+  CropAndMerge(result);
 }
 
-sensor::TimedPointCloudOriginData RangeDataCollator::CropAndMerge() {
-  sensor::TimedPointCloudOriginData result{current_end_, {}, {}};
+void RangeDataCollator::CropAndMerge(
+    sensor::TimedPointCloudOriginData* const result) {
+  result->time = current_end_;
+  result->origins.clear();
+  result->ranges.clear();
+  result->attributes.clear();
+  run_offsets_.assign(1, 0);
+  bool all_runs_sorted = true;
   bool warned_for_dropped_points = false;
   for (auto it = id_to_pending_data_.begin();
        it != id_to_pending_data_.end();) {
-    sensor::TimedPointCloudData& data = it->second;
-    const sensor::TimedPointCloud& ranges = it->second.ranges;
-    const std::vector<float>& intensities = it->second.intensities;
-
-    auto overlap_begin = ranges.begin();
-    while (overlap_begin < ranges.end() &&
-           data.time + common::FromSeconds((*overlap_begin).time) <
-               current_start_) {
-      ++overlap_begin;
-    }
-    auto overlap_end = overlap_begin;
-    while (overlap_end < ranges.end() &&
-           data.time + common::FromSeconds((*overlap_end).time) <=
-               current_end_) {
-      ++overlap_end;
-    }
-    if (ranges.begin() < overlap_begin && !warned_for_dropped_points) {
-      LOG(WARNING) << "Dropped " << std::distance(ranges.begin(), overlap_begin)
+    PendingData& pending_data = it->second;
+    const sensor::TimedPointCloudData& data = pending_data.data;
+    const auto ranges_begin = data.ranges.begin() + pending_data.begin;
+    const auto ranges_end = data.ranges.end();
+
+    const auto overlap_begin = FindEndOfPrefix(
+        ranges_begin, ranges_end, pending_data.sorted,
+        [&data, this](const sensor::TimedRangefinderPoint& point) {
+          return data.time + common::FromSeconds(point.time) < current_start_;
+        });
+    const auto overlap_end = FindEndOfPrefix(
+        overlap_begin, ranges_end, pending_data.sorted,
+        [&data, this](const sensor::TimedRangefinderPoint& point) {
+          return data.time + common::FromSeconds(point.time) <= current_end_;
+        });
+    if (ranges_begin < overlap_begin && !warned_for_dropped_points) {
+      LOG(WARNING) << "Dropped " << std::distance(ranges_begin, overlap_begin)
                    << " earlier points.";
       warned_for_dropped_points = true;
     }
 
     // Copy overlapping range.
     if (overlap_begin < overlap_end) {
-      std::size_t origin_index = result.origins.size();
-      result.origins.push_back(data.origin);
+      std::size_t origin_index = result->origins.size();
+      result->origins.push_back(data.origin);
+      // Sharing the columns, attributes are not copied here.
+      result->attributes.push_back(data.attributes);
       const float time_correction =
           static_cast<float>(common::ToSeconds(data.time - current_end_));
       auto intensities_overlap_it =
-          intensities.begin() + (overlap_begin - ranges.begin());
-      result.ranges.reserve(result.ranges.size() +
-                            std::distance(overlap_begin, overlap_end));
+          data.intensities.begin() + (overlap_begin - data.ranges.begin());
+      result->ranges.reserve(result->ranges.size() +
+                             std::distance(overlap_begin, overlap_end));
       for (auto overlap_it = overlap_begin; overlap_it != overlap_end;
            ++overlap_it, ++intensities_overlap_it) {
         sensor::TimedPointCloudOriginData::RangeMeasurement point{
-            *overlap_it, *intensities_overlap_it, origin_index};
+            *overlap_it, *intensities_overlap_it,
+            static_cast<uint32>(overlap_it - data.ranges.begin()),
+            origin_index};
         // current_end_ + point_time[3]_after == in_timestamp +
         // point_time[3]_before
         point.point_time.time += time_correction;
-        result.ranges.push_back(point);
+        result->ranges.push_back(point);
       }
+      run_offsets_.push_back(result->ranges.size());
+      all_runs_sorted = all_runs_sorted && pending_data.sorted;
     }
 
     // Drop buffered points until overlap_end.
-    if (overlap_end == ranges.end()) {
+    if (overlap_end == ranges_end) {
       it = id_to_pending_data_.erase(it);
-    } else if (overlap_end == ranges.begin()) {
-      ++it;
     } else {
-      const auto intensities_overlap_end =
-          intensities.begin() + (overlap_end - ranges.begin());
-      data = sensor::TimedPointCloudData{
-          data.time, data.origin,
-          sensor::TimedPointCloud(overlap_end, ranges.end()),
-          std::vector<float>(intensities_overlap_end, intensities.end())};
+      pending_data.begin = overlap_end - data.ranges.begin();
       ++it;
     }
   }
 
-  std::sort(result.ranges.begin(), result.ranges.end(),
-            [](const sensor::TimedPointCloudOriginData::RangeMeasurement& a,
-               const sensor::TimedPointCloudOriginData::RangeMeasurement& b) {
-              return a.point_time.time < b.point_time.time;
-            });
-  return result;
+  if (!all_runs_sorted) {
+    std::sort(result->ranges.begin(), result->ranges.end(), IsBefore);
+    return;
+  }
+  // Each sensor contributed a sorted run, so merging suffices.
+  for (size_t i = 2; i < run_offsets_.size(); ++i) {
+    std::inplace_merge(result->ranges.begin(),
+                       result->ranges.begin() + run_offsets_[i - 1],
+                       result->ranges.begin() + run_offsets_[i], IsBefore);
+  }
 }
 
 }  // namespace mapping
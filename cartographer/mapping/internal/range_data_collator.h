@@ -17,7 +17,11 @@
 #ifndef CARTOGRAPHER_MAPPING_INTERNAL_RANGE_DATA_COLLATOR_H_
 #define CARTOGRAPHER_MAPPING_INTERNAL_RANGE_DATA_COLLATOR_H_
 
+#include <map>
 #include <memory>
+#include <set>
+#include <string>
+#include <vector>
 
 #include "absl/memory/memory.h"
 #include "cartographer/sensor/timed_point_cloud_data.h"
@@ -38,17 +42,34 @@ class RangeDataCollator {
                              expected_range_sensor_ids.end()) {}
 
   // If timed_point_cloud_data has incomplete intensity data, we will fill the
-  // missing intensities with kDefaultIntensityValue.
+  // missing intensities with kDefaultIntensityValue. Its attributes are passed
+  // on with its origin, see TimedPointCloudOriginData::attributes.
   sensor::TimedPointCloudOriginData AddRangeData(
       const std::string& sensor_id,
       sensor::TimedPointCloudData timed_point_cloud_data);
 
+  // Like above, but writes the result to 'result', reusing its memory.
+  void AddRangeData(const std::string& sensor_id,
+                    sensor::TimedPointCloudData timed_point_cloud_data,
+                    sensor::TimedPointCloudOriginData* result);
+
  private:
-  sensor::TimedPointCloudOriginData CropAndMerge();
+  struct PendingData {
+    sensor::TimedPointCloudData data;
+    // Index of the first point in 'data' which has not been output yet.
+    size_t begin;
+    // Whether the points in 'data' are sorted by time. This allows finding
+    // the overlap by binary search and merging instead of sorting the output.
+    bool sorted;
+  };
+
+  void CropAndMerge(sensor::TimedPointCloudOriginData* result);
 
   const std::set<std::string> expected_sensor_ids_;
   // Store at most one message for each sensor.
-  std::map<std::string, sensor::TimedPointCloudData> id_to_pending_data_;
+  std::map<std::string, PendingData> id_to_pending_data_;
+  // Offsets of the sorted runs in the output of CropAndMerge().
+  std::vector<size_t> run_offsets_;
   common::Time current_start_ = common::Time::min();
   common::Time current_end_ = common::Time::min();
 
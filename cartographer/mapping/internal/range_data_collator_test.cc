@@ -16,6 +16,8 @@
 
 #include "cartographer/mapping/internal/range_data_collator.h"
 
+#include <utility>
+
 #include "cartographer/common/time.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
@@ -156,6 +158,38 @@ TEST(RangeDataCollatorTest, TwoSensors) {
   EXPECT_TRUE(ArePointTimestampsSorted(output_3));
 }
 
+TEST(RangeDataCollatorTest, TwoSensorsUnsortedIntoBuffer) {
+  const std::string sensor_0 = "sensor_0";
+  const std::string sensor_1 = "sensor_1";
+  RangeDataCollator collator({sensor_0, sensor_1});
+  sensor::TimedPointCloudData unsorted_data =
+      CreateFakeRangeData(-1000, 310, true);
+  std::swap(unsorted_data.ranges[0], unsorted_data.ranges[1]);
+  std::swap(unsorted_data.intensities[0], unsorted_data.intensities[1]);
+  sensor::TimedPointCloudOriginData output;
+  collator.AddRangeData(sensor_0, CreateFakeRangeData(200, 300, true),
+                        &output);
+  EXPECT_EQ(output.ranges.size(), 0);
+  collator.AddRangeData(sensor_1, unsorted_data, &output);
+  EXPECT_EQ(common::ToUniversal(output.time), 300);
+  EXPECT_EQ(output.origins.size(), 2);
+  EXPECT_TRUE(ArePointTimestampsSorted(output));
+  IntensitiesAreConsistent(output);
+  size_t num_ranges = output.ranges.size();
+  collator.AddRangeData(sensor_0, CreateFakeRangeData(300, 500, true),
+                        &output);
+  EXPECT_EQ(common::ToUniversal(output.time), 310);
+  EXPECT_TRUE(ArePointTimestampsSorted(output));
+  IntensitiesAreConsistent(output);
+  num_ranges += output.ranges.size();
+  collator.AddRangeData(sensor_0, CreateFakeRangeData(600, 700, true),
+                        &output);
+  EXPECT_EQ(common::ToUniversal(output.time), 500);
+  EXPECT_TRUE(ArePointTimestampsSorted(output));
+  num_ranges += output.ranges.size();
+  EXPECT_EQ(num_ranges, 3 * kNumSamples);
+}
+
 TEST(RangeDataCollatorTest, ThreeSensors) {
   const std::string sensor_0 = "sensor_0";
   const std::string sensor_1 = "sensor_1";
@@ -200,6 +234,47 @@ TEST(RangeDataCollatorTest, ThreeSensorsWithIntensities) {
   IntensitiesAreConsistent(output_3);
 }
 
+TEST(RangeDataCollatorTest, TwoSensorsWithAttributes) {
+  const std::string sensor_0 = "sensor_0";
+  const std::string sensor_1 = "sensor_1";
+  RangeDataCollator collator({sensor_0, sensor_1});
+  const auto add_attributes = [](sensor::TimedPointCloudData data,
+                                 const uint8 ring) {
+    std::vector<uint16> reflectivities;
+    for (const auto& point : data.ranges) {
+      reflectivities.push_back(
+          static_cast<uint16>(1000.f * point.position.z()));
+    }
+    data.attributes.Set(sensor::kReflectivityAttribute,
+                        std::move(reflectivities));
+    data.attributes.Set(sensor::kRingAttribute,
+                        std::vector<uint8>(data.ranges.size(), ring));
+    return data;
+  };
+  sensor::TimedPointCloudOriginData output;
+  collator.AddRangeData(sensor_0,
+                        add_attributes(CreateFakeRangeData(200, 300, false), 0),
+                        &output);
+  collator.AddRangeData(
+      sensor_1, add_attributes(CreateFakeRangeData(-1000, 310, false), 1),
+      &output);
+  ASSERT_EQ(output.origins.size(), 2);
+  ASSERT_EQ(output.attributes.size(), output.origins.size());
+  ASSERT_EQ(output.ranges.size(), 2 * kNumSamples - 1);
+  for (const auto& range : output.ranges) {
+    const sensor::PointAttributes& attributes =
+        output.attributes.at(range.origin_index);
+    const auto* reflectivities =
+        attributes.Find<uint16>(sensor::kReflectivityAttribute);
+    ASSERT_NE(reflectivities, nullptr);
+    EXPECT_EQ(reflectivities->at(range.point_index),
+              static_cast<uint16>(1000.f * range.point_time.position.z()));
+    EXPECT_EQ(attributes.Find<uint8>(sensor::kRingAttribute)
+                  ->at(range.point_index),
+              range.origin_index);
+  }
+}
+
 }  // namespace
 }  // namespace mapping
 }  // namespace cartographer
@@ -0,0 +1,165 @@
+/*
+ * Copyright 2016 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/internal/range_data_unwarper.h"
+
+#include <algorithm>
+
+#include "cartographer/common/math.h"
+#include "glog/logging.h"
+
+namespace cartographer {
+namespace mapping {
+
+RangeDataUnwarper::RangeDataUnwarper(const common::Duration max_pose_interval)
+    : max_pose_interval_(max_pose_interval) {}
+
+const std::vector<transform::Rigid3f>& RangeDataUnwarper::ExtrapolatePoses(
+    const std::vector<common::Time>& times,
+    PoseExtrapolatorInterface* const extrapolator) {
+  if (!ComputeKnotTimes(times)) {
+    poses_.clear();
+    for (size_t i = 0; i < times.size(); ++i) {
+      poses_.push_back(i > 0 && times[i] == times[i - 1]
+                           ? poses_.back()
+                           : extrapolator->ExtrapolatePose(times[i])
+                                 .cast<float>());
+    }
+    return poses_;
+  }
+  knot_poses_.clear();
+  for (const common::Time time : knot_times_) {
+    knot_poses_.push_back(extrapolator->ExtrapolatePose(time).cast<float>());
+  }
+  InterpolatePoses(times);
+  return poses_;
+}
+
+PoseExtrapolatorInterface::ExtrapolationResult
+RangeDataUnwarper::ExtrapolatePosesWithGravity(
+    const std::vector<common::Time>& times,
+    PoseExtrapolatorInterface* const extrapolator) {
+  if (!ComputeKnotTimes(times)) {
+    ComputeUniqueTimes(times);
+    PoseExtrapolatorInterface::ExtrapolationResult result =
+        extrapolator->ExtrapolatePosesWithGravity(unique_times_);
+    if (unique_times_.size() == times.size()) {
+      poses_.swap(result.previous_poses);
+      poses_.push_back(result.current_pose.cast<float>());
+    } else {
+      poses_.resize(times.size());
+      size_t unique_index = 0;
+      for (size_t i = 0; i < times.size(); ++i) {
+        if (times[i] != unique_times_[unique_index]) {
+          ++unique_index;
+        }
+        poses_[i] = unique_index + 1 < unique_times_.size()
+                        ? result.previous_poses[unique_index]
+                        : result.current_pose.cast<float>();
+      }
+    }
+    result.previous_poses.clear();
+    return result;
+  }
+  PoseExtrapolatorInterface::ExtrapolationResult result =
+      extrapolator->ExtrapolatePosesWithGravity(knot_times_);
+  knot_poses_.swap(result.previous_poses);
+  result.previous_poses.clear();
+  knot_poses_.push_back(result.current_pose.cast<float>());
+  InterpolatePoses(times);
+  return result;
+}
+
+bool RangeDataUnwarper::ComputeKnotTimes(
+    const std::vector<common::Time>& times) {
+  CHECK(!times.empty());
+  if (max_pose_interval_ <= common::Duration::zero()) {
+    return false;
+  }
+  const common::Duration duration = times.back() - times.front();
+  const int64 num_segments = std::max<int64>(
+      1, (duration.count() + max_pose_interval_.count() - 1) /
+             max_pose_interval_.count());
+  // Interpolation only pays off if there are fewer knots than points.
+  if (num_segments + 1 >= static_cast<int64>(times.size())) {
+    return false;
+  }
+  knot_times_.clear();
+  for (int64 i = 0; i <= num_segments; ++i) {
+    knot_times_.push_back(times.front() + duration * i / num_segments);
+  }
+  return true;
+}
+
+void RangeDataUnwarper::ComputeUniqueTimes(
+    const std::vector<common::Time>& times) {
+  unique_times_.clear();
+  for (const common::Time time : times) {
+    if (unique_times_.empty() || time != unique_times_.back()) {
+      unique_times_.push_back(time);
+    }
+  }
+}
+
+void RangeDataUnwarper::InterpolatePoses(
+    const std::vector<common::Time>& times) {
+  CHECK_EQ(knot_times_.size(), knot_poses_.size());
+  CHECK_GE(knot_times_.size(), 2);
+  segments_.clear();
+  for (size_t i = 0; i + 1 < knot_times_.size(); ++i) {
+    const transform::Rigid3f& start = knot_poses_[i];
+    const transform::Rigid3f& end = knot_poses_[i + 1];
+    const Eigen::Vector4f start_rotation = start.rotation().coeffs();
+    Eigen::Vector4f end_rotation = end.rotation().coeffs();
+    // Interpolate along the shorter arc.
+    if (start_rotation.dot(end_rotation) < 0.f) {
+      end_rotation = -end_rotation;
+    }
+    const int64 duration = (knot_times_[i + 1] - knot_times_[i]).count();
+    segments_.push_back(
+        Segment{start.translation(), end.translation() - start.translation(),
+                start_rotation, end_rotation - start_rotation,
+                duration > 0 ? 1.f / duration : 0.f});
+  }
+
+  // Normalized linear interpolation of the rotation is used, which for the
+  // small rotations between knots is as accurate as spherical interpolation.
+  poses_.resize(times.size());
+  size_t segment_index = 0;
+  for (size_t i = 0; i < times.size(); ++i) {
+    if (i > 0 && times[i] == times[i - 1]) {
+      poses_[i] = poses_[i - 1];
+      continue;
+    }
+    while (segment_index + 1 < segments_.size() &&
+           times[i] >= knot_times_[segment_index + 1]) {
+      ++segment_index;
+    }
+    const Segment& segment = segments_[segment_index];
+    const float alpha = common::Clamp(
+        (times[i] - knot_times_[segment_index]).count() *
+            segment.inverse_duration,
+        0.f, 1.f);
+    const Eigen::Vector4f rotation =
+        (segment.start_rotation + alpha * segment.delta_rotation).normalized();
+    poses_[i] = transform::Rigid3f(
+        segment.start_translation + alpha * segment.delta_translation,
+        Eigen::Quaternionf(rotation[3], rotation[0], rotation[1], rotation[2]));
+  }
+}
+
+}  // namespace mapping
+}  // namespace cartographer
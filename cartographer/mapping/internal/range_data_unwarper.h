@@ -0,0 +1,93 @@
+/*
+ * Copyright 2016 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_MAPPING_INTERNAL_RANGE_DATA_UNWARPER_H_
+#define CARTOGRAPHER_MAPPING_INTERNAL_RANGE_DATA_UNWARPER_H_
+
+#include <vector>
+
+#include "Eigen/Core"
+#include "cartographer/common/time.h"
+#include "cartographer/mapping/pose_extrapolator_interface.h"
+#include "cartographer/transform/rigid_transform.h"
+
+namespace cartographer {
+namespace mapping {
+
+// Computes the poses of the tracking frame at the times of the individual
+// points of range data, which are needed to unwarp it.
+//
+// Instead of extrapolating a pose for every point, poses are extrapolated at
+// evenly spaced knot times at most 'max_pose_interval' apart and interpolated
+// for the points in between. The interpolation error is bounded by how much
+// the extrapolated motion deviates from a constant velocity motion within
+// 'max_pose_interval'. A non-positive 'max_pose_interval' extrapolates a pose
+// for every point. Points sharing a time, e.g. the points of a column of an
+// organized scan, share a single pose computation. Buffers are reused between
+// calls.
+class RangeDataUnwarper {
+ public:
+  explicit RangeDataUnwarper(common::Duration max_pose_interval);
+
+  RangeDataUnwarper(const RangeDataUnwarper&) = delete;
+  RangeDataUnwarper& operator=(const RangeDataUnwarper&) = delete;
+
+  // Computes the poses at the non-decreasing 'times' using
+  // 'extrapolator->ExtrapolatePose()'. Returns poses for all 'times'.
+  const std::vector<transform::Rigid3f>& ExtrapolatePoses(
+      const std::vector<common::Time>& times,
+      PoseExtrapolatorInterface* extrapolator);
+
+  // Like ExtrapolatePoses(), but uses
+  // 'extrapolator->ExtrapolatePosesWithGravity()'. The poses for all 'times',
+  // including the last one, are returned in 'poses()'; 'previous_poses' of
+  // the returned result is empty.
+  PoseExtrapolatorInterface::ExtrapolationResult ExtrapolatePosesWithGravity(
+      const std::vector<common::Time>& times,
+      PoseExtrapolatorInterface* extrapolator);
+
+  // Returns the poses computed by the last call.
+  const std::vector<transform::Rigid3f>& poses() const { return poses_; }
+
+ private:
+  // Returns true if poses are interpolated for 'times', in which case
+  // 'knot_times_' is filled.
+  bool ComputeKnotTimes(const std::vector<common::Time>& times);
+  // Interpolates 'knot_poses_' at 'times' into 'poses_'.
+  void InterpolatePoses(const std::vector<common::Time>& times);
+  // Fills 'unique_times_' with the distinct values of the sorted 'times'.
+  void ComputeUniqueTimes(const std::vector<common::Time>& times);
+
+  const common::Duration max_pose_interval_;
+  std::vector<common::Time> knot_times_;
+  std::vector<transform::Rigid3f> knot_poses_;
+  // Interpolation data for each pair of consecutive knots.
+  struct Segment {
+    Eigen::Vector3f start_translation;
+    Eigen::Vector3f delta_translation;
+    Eigen::Vector4f start_rotation;
+    Eigen::Vector4f delta_rotation;
+    float inverse_duration;
+  };
+  std::vector<Segment> segments_;
+  std::vector<common::Time> unique_times_;
+  std::vector<transform::Rigid3f> poses_;
+};
+
+}  // namespace mapping
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_MAPPING_INTERNAL_RANGE_DATA_UNWARPER_H_
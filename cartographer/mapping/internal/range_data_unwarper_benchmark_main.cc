@@ -0,0 +1,127 @@
+/*
+ * Copyright 2016 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <vector>
+
+#include "cartographer/common/internal/benchmark.h"
+#include "cartographer/common/time.h"
+#include "cartographer/mapping/internal/range_data_unwarper.h"
+#include "cartographer/mapping/pose_extrapolator.h"
+#include "cartographer/transform/transform.h"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+DEFINE_int32(num_points, 128 * 2048,
+             "Number of points per scan, the default is a 128x2048 scan.");
+DEFINE_double(scan_duration, 0.1, "Duration of a scan in seconds.");
+DEFINE_int32(num_scans, 10, "Number of scans to unwarp.");
+
+namespace cartographer {
+namespace mapping {
+namespace {
+
+// Returns an extrapolator which is moving and rotating around all axes.
+std::unique_ptr<PoseExtrapolator> CreateExtrapolator(const common::Time time) {
+  const Eigen::Vector3d linear_acceleration(0.5, 0.2, 9.8);
+  const Eigen::Vector3d angular_velocity(0.2, -0.3, 1.5);
+  auto extrapolator = PoseExtrapolator::InitializeWithImu(
+      common::FromSeconds(1.), 10.,
+      sensor::ImuData{time, linear_acceleration, angular_velocity});
+  const common::Time end_time =
+      time + common::FromSeconds(FLAGS_num_scans * FLAGS_scan_duration + 1.);
+  for (common::Time imu_time = time + common::FromMilliseconds(5);
+       imu_time <= end_time; imu_time += common::FromMilliseconds(5)) {
+    extrapolator->AddImuData(
+        sensor::ImuData{imu_time, linear_acceleration, angular_velocity});
+  }
+  extrapolator->AddPose(
+      time + common::FromSeconds(0.1),
+      transform::Rigid3d::Translation(Eigen::Vector3d(0.3, 0.1, 0.)));
+  return extrapolator;
+}
+
+// Returns the times of the points of each scan.
+std::vector<std::vector<common::Time>> CreateScanTimes(
+    const common::Time start) {
+  std::vector<std::vector<common::Time>> scan_times(FLAGS_num_scans);
+  for (int scan = 0; scan < FLAGS_num_scans; ++scan) {
+    for (int i = 0; i < FLAGS_num_points; ++i) {
+      scan_times[scan].push_back(
+          start + common::FromSeconds(FLAGS_scan_duration *
+                                      (scan + static_cast<double>(i) /
+                                                  FLAGS_num_points)));
+    }
+  }
+  return scan_times;
+}
+
+// Unwarps all scans and returns the poses of the last one.
+std::vector<transform::Rigid3f> Run(
+    const common::Duration max_pose_interval, const common::Time start,
+    const std::vector<std::vector<common::Time>>& scan_times) {
+  auto extrapolator = CreateExtrapolator(start);
+  RangeDataUnwarper unwarper(max_pose_interval);
+  const auto wall_time_start = std::chrono::steady_clock::now();
+  for (const std::vector<common::Time>& times : scan_times) {
+    unwarper.ExtrapolatePoses(times, extrapolator.get());
+  }
+  const double seconds = common::SecondsSince(wall_time_start);
+  LOG(INFO) << "max_pose_interval " << common::ToSeconds(max_pose_interval)
+            << " s: " << 1e3 * seconds / scan_times.size() << " ms per scan";
+  return unwarper.poses();
+}
+
+void Benchmark() {
+  const common::Time start = common::FromUniversal(1000000);
+  const std::vector<std::vector<common::Time>> scan_times =
+      CreateScanTimes(start + common::FromSeconds(0.1));
+  const std::vector<transform::Rigid3f> expected_poses =
+      Run(common::Duration::zero(), start, scan_times);
+  for (const double max_pose_interval : {0.001, 0.005, 0.02}) {
+    const std::vector<transform::Rigid3f> poses =
+        Run(common::FromSeconds(max_pose_interval), start, scan_times);
+    CHECK_EQ(poses.size(), expected_poses.size());
+    double max_translation_error = 0.;
+    double max_rotation_error = 0.;
+    for (size_t i = 0; i < poses.size(); ++i) {
+      const transform::Rigid3f error = expected_poses[i].inverse() * poses[i];
+      max_translation_error =
+          std::max<double>(max_translation_error, error.translation().norm());
+      max_rotation_error = std::max<double>(
+          max_rotation_error, transform::GetAngle(error));
+    }
+    LOG(INFO) << "max_pose_interval " << max_pose_interval
+              << " s: maximum error " << max_translation_error << " m, "
+              << max_rotation_error << " rad";
+  }
+}
+
+}  // namespace
+}  // namespace mapping
+}  // namespace cartographer
+
+int main(int argc, char** argv) {
+  ::cartographer::common::InitBenchmark(
+      "Compares the latency and error of unwarping range data with "
+      "interpolated poses to extrapolating a pose for every point.",
+      &argc, &argv);
+  CHECK_GT(FLAGS_num_points, 1);
+  CHECK_GT(FLAGS_num_scans, 0);
+  ::cartographer::mapping::Benchmark();
+}
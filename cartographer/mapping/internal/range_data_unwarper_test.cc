@@ -0,0 +1,154 @@
+/*
+ * Copyright 2016 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/internal/range_data_unwarper.h"
+
+#include <memory>
+
+#include "cartographer/mapping/pose_extrapolator.h"
+#include "cartographer/transform/rigid_transform_test_helpers.h"
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace mapping {
+namespace {
+
+constexpr double kPoseQueueDuration = 0.5;
+constexpr double kGravityTimeConstant = 10.;
+
+std::unique_ptr<PoseExtrapolator> CreateMovingExtrapolator(
+    const common::Time time) {
+  const Eigen::Vector3d linear_acceleration(0.5, 0., 9.8);
+  const Eigen::Vector3d angular_velocity(0.1, -0.2, 1.5);
+  auto extrapolator = PoseExtrapolator::InitializeWithImu(
+      common::FromSeconds(kPoseQueueDuration), kGravityTimeConstant,
+      sensor::ImuData{time, linear_acceleration, angular_velocity});
+  for (int i = 1; i <= 10; ++i) {
+    extrapolator->AddImuData(sensor::ImuData{
+        time + common::FromSeconds(0.01 * i), linear_acceleration,
+        angular_velocity});
+  }
+  extrapolator->AddPose(
+      time + common::FromSeconds(0.1),
+      transform::Rigid3d::Translation(Eigen::Vector3d(0.2, 0.1, 0.)));
+  return extrapolator;
+}
+
+std::vector<common::Time> CreateTimes(const common::Time start,
+                                      const int num_times) {
+  std::vector<common::Time> times;
+  for (int i = 0; i < num_times; ++i) {
+    times.push_back(start + common::FromSeconds(0.1 * i / num_times));
+  }
+  return times;
+}
+
+TEST(RangeDataUnwarperTest, InterpolatedPosesMatchExtrapolatedPoses) {
+  const common::Time start = common::FromUniversal(1000000);
+  const std::vector<common::Time> times =
+      CreateTimes(start + common::FromSeconds(0.1), 1000);
+  auto expected_extrapolator = CreateMovingExtrapolator(start);
+  auto extrapolator = CreateMovingExtrapolator(start);
+  RangeDataUnwarper unwarper(common::FromSeconds(0.005));
+  const std::vector<transform::Rigid3f>& poses =
+      unwarper.ExtrapolatePoses(times, extrapolator.get());
+  ASSERT_EQ(times.size(), poses.size());
+  for (size_t i = 0; i < times.size(); ++i) {
+    EXPECT_THAT(poses[i],
+                transform::IsNearly(
+                    expected_extrapolator->ExtrapolatePose(times[i])
+                        .cast<float>(),
+                    1e-4));
+  }
+  EXPECT_EQ(expected_extrapolator->GetLastExtrapolatedTime(),
+            extrapolator->GetLastExtrapolatedTime());
+}
+
+TEST(RangeDataUnwarperTest, ExtrapolatePosesWithGravity) {
+  const common::Time start = common::FromUniversal(1000000);
+  const std::vector<common::Time> times =
+      CreateTimes(start + common::FromSeconds(0.1), 1000);
+  auto expected_extrapolator = CreateMovingExtrapolator(start);
+  auto extrapolator = CreateMovingExtrapolator(start);
+  const PoseExtrapolatorInterface::ExtrapolationResult expected_result =
+      expected_extrapolator->ExtrapolatePosesWithGravity(times);
+  RangeDataUnwarper unwarper(common::FromSeconds(0.005));
+  const PoseExtrapolatorInterface::ExtrapolationResult result =
+      unwarper.ExtrapolatePosesWithGravity(times, extrapolator.get());
+  EXPECT_TRUE(result.previous_poses.empty());
+  EXPECT_THAT(result.current_pose,
+              transform::IsNearly(expected_result.current_pose, 1e-9));
+  EXPECT_TRUE(result.gravity_from_tracking.isApprox(
+      expected_result.gravity_from_tracking));
+  ASSERT_EQ(times.size(), unwarper.poses().size());
+  for (size_t i = 0; i + 1 < times.size(); ++i) {
+    EXPECT_THAT(unwarper.poses()[i],
+                transform::IsNearly(expected_result.previous_poses[i], 1e-4));
+  }
+  EXPECT_THAT(unwarper.poses().back(),
+              transform::IsNearly(expected_result.current_pose.cast<float>(),
+                                  1e-6));
+}
+
+TEST(RangeDataUnwarperTest, ExtrapolatesEveryPoseWithoutInterval) {
+  const common::Time start = common::FromUniversal(1000000);
+  const std::vector<common::Time> times =
+      CreateTimes(start + common::FromSeconds(0.1), 100);
+  auto expected_extrapolator = CreateMovingExtrapolator(start);
+  auto extrapolator = CreateMovingExtrapolator(start);
+  RangeDataUnwarper unwarper(common::Duration::zero());
+  const std::vector<transform::Rigid3f>& poses =
+      unwarper.ExtrapolatePoses(times, extrapolator.get());
+  ASSERT_EQ(times.size(), poses.size());
+  for (size_t i = 0; i < times.size(); ++i) {
+    EXPECT_THAT(poses[i],
+                transform::IsNearly(
+                    expected_extrapolator->ExtrapolatePose(times[i])
+                        .cast<float>(),
+                    1e-9));
+  }
+}
+
+TEST(RangeDataUnwarperTest, SharesPosesOfColumns) {
+  const common::Time start = common::FromUniversal(1000000);
+  // Columns of 16 points each which share a time, as in an organized scan.
+  std::vector<common::Time> times;
+  for (const common::Time time :
+       CreateTimes(start + common::FromSeconds(0.1), 64)) {
+    times.insert(times.end(), 16, time);
+  }
+  auto expected_extrapolator = CreateMovingExtrapolator(start);
+  auto extrapolator = CreateMovingExtrapolator(start);
+  const PoseExtrapolatorInterface::ExtrapolationResult expected_result =
+      expected_extrapolator->ExtrapolatePosesWithGravity(times);
+  RangeDataUnwarper unwarper(common::Duration::zero());
+  const PoseExtrapolatorInterface::ExtrapolationResult result =
+      unwarper.ExtrapolatePosesWithGravity(times, extrapolator.get());
+  EXPECT_THAT(result.current_pose,
+              transform::IsNearly(expected_result.current_pose, 1e-9));
+  ASSERT_EQ(times.size(), unwarper.poses().size());
+  for (size_t i = 0; i + 1 < times.size(); ++i) {
+    EXPECT_THAT(unwarper.poses()[i],
+                transform::IsNearly(expected_result.previous_poses[i], 1e-6));
+  }
+  EXPECT_THAT(unwarper.poses().back(),
+              transform::IsNearly(expected_result.current_pose.cast<float>(),
+                                  1e-6));
+}
+
+}  // namespace
+}  // namespace mapping
+}  // namespace cartographer
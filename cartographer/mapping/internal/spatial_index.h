@@ -0,0 +1,162 @@
+/*
+ * Copyright 2018 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_MAPPING_INTERNAL_SPATIAL_INDEX_H_
+#define CARTOGRAPHER_MAPPING_INTERNAL_SPATIAL_INDEX_H_
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+#include "Eigen/Core"
+#include "absl/container/flat_hash_map.h"
+#include "glog/logging.h"
+
+namespace cartographer {
+namespace mapping {
+
+// Indexes the positions of nodes or submaps in a uniform grid, so that all
+// IDs within a fixed radius of a position are found by looking at a constant
+// number of cells instead of at all IDs.
+template <typename IdType>
+class SpatialIndex {
+ public:
+  explicit SpatialIndex(const double radius)
+      : radius_(radius),
+        cell_size_(radius > kMinCellSize ? radius : kMinCellSize) {
+    CHECK_GE(radius, 0.);
+  }
+
+  SpatialIndex(const SpatialIndex&) = delete;
+  SpatialIndex& operator=(const SpatialIndex&) = delete;
+
+  // Inserts 'id' at 'position', or moves it there if it is already indexed.
+  void Insert(const IdType& id, const Eigen::Vector3d& position) {
+    const CellIndex cell_index = GetCellIndex(position);
+    auto it = cell_indices_.find(id);
+    if (it != cell_indices_.end()) {
+      if (it->second == cell_index) {
+        for (Entry& entry : cells_.at(cell_index)) {
+          if (entry.id == id) {
+            entry.position = position;
+            return;
+          }
+        }
+        LOG(FATAL) << "Missing entry.";
+      }
+      RemoveFromCell(id, it->second);
+      it->second = cell_index;
+    } else {
+      cell_indices_.emplace(id, cell_index);
+    }
+    cells_[cell_index].push_back(Entry{id, position});
+  }
+
+  // Removes 'id' if it is indexed.
+  void Remove(const IdType& id) {
+    const auto it = cell_indices_.find(id);
+    if (it == cell_indices_.end()) {
+      return;
+    }
+    RemoveFromCell(id, it->second);
+    cell_indices_.erase(it);
+  }
+
+  bool Contains(const IdType& id) const {
+    return cell_indices_.count(id) != 0;
+  }
+
+  size_t size() const { return cell_indices_.size(); }
+
+  // Returns the IDs within the radius of 'position' in ascending order. IDs
+  // which are insignificantly further away may be returned as well, so that
+  // callers doing an exact check do not lose candidates to rounding.
+  std::vector<IdType> Query(const Eigen::Vector3d& position) const {
+    const double max_distance = radius_ * (1. + kRelativeTolerance);
+    const double max_squared_distance = max_distance * max_distance;
+    const Eigen::Vector3d extent = Eigen::Vector3d::Constant(max_distance);
+    const CellIndex min_cell_index = GetCellIndex(position - extent);
+    const CellIndex max_cell_index = GetCellIndex(position + extent);
+    std::vector<IdType> result;
+    CellIndex cell_index;
+    for (cell_index[0] = min_cell_index[0]; cell_index[0] <= max_cell_index[0];
+         ++cell_index[0]) {
+      for (cell_index[1] = min_cell_index[1];
+           cell_index[1] <= max_cell_index[1]; ++cell_index[1]) {
+        for (cell_index[2] = min_cell_index[2];
+             cell_index[2] <= max_cell_index[2]; ++cell_index[2]) {
+          const auto it = cells_.find(cell_index);
+          if (it == cells_.end()) {
+            continue;
+          }
+          for (const Entry& entry : it->second) {
+            if ((entry.position - position).squaredNorm() <=
+                max_squared_distance) {
+              result.push_back(entry.id);
+            }
+          }
+        }
+      }
+    }
+    std::sort(result.begin(), result.end());
+    return result;
+  }
+
+ private:
+  using CellIndex = std::array<int, 3>;
+
+  struct Entry {
+    IdType id;
+    Eigen::Vector3d position;
+  };
+
+  // Keeps the number of cells to look at small for tiny radii.
+  static constexpr double kMinCellSize = 1.;
+  static constexpr double kRelativeTolerance = 1e-9;
+
+  CellIndex GetCellIndex(const Eigen::Vector3d& position) const {
+    return {{static_cast<int>(std::floor(position.x() / cell_size_)),
+             static_cast<int>(std::floor(position.y() / cell_size_)),
+             static_cast<int>(std::floor(position.z() / cell_size_))}};
+  }
+
+  void RemoveFromCell(const IdType& id, const CellIndex& cell_index) {
+    const auto cell_it = cells_.find(cell_index);
+    CHECK(cell_it != cells_.end());
+    std::vector<Entry>& entries = cell_it->second;
+    const auto it =
+        std::find_if(entries.begin(), entries.end(),
+                     [&id](const Entry& entry) { return entry.id == id; });
+    CHECK(it != entries.end());
+    *it = std::move(entries.back());
+    entries.pop_back();
+    if (entries.empty()) {
+      cells_.erase(cell_it);
+    }
+  }
+
+  const double radius_;
+  const double cell_size_;
+  absl::flat_hash_map<IdType, CellIndex> cell_indices_;
+  absl::flat_hash_map<CellIndex, std::vector<Entry>> cells_;
+};
+
+}  // namespace mapping
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_MAPPING_INTERNAL_SPATIAL_INDEX_H_
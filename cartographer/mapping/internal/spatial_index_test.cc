@@ -0,0 +1,87 @@
+/*
+ * Copyright 2018 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/internal/spatial_index.h"
+
+#include <random>
+
+#include "cartographer/mapping/id.h"
+#include "gmock/gmock.h"
+
+namespace cartographer {
+namespace mapping {
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::IsEmpty;
+
+TEST(SpatialIndexTest, FindsNearbyIds) {
+  SpatialIndex<NodeId> index(2.);
+  index.Insert(NodeId{0, 0}, Eigen::Vector3d(0., 0., 0.));
+  index.Insert(NodeId{0, 1}, Eigen::Vector3d(1.5, 0., 0.));
+  index.Insert(NodeId{1, 0}, Eigen::Vector3d(-2., 0., 0.));
+  index.Insert(NodeId{1, 1}, Eigen::Vector3d(0., 0., 2.5));
+  EXPECT_EQ(index.size(), 4);
+  EXPECT_THAT(index.Query(Eigen::Vector3d::Zero()),
+              ElementsAre(NodeId{0, 0}, NodeId{0, 1}, NodeId{1, 0}));
+  EXPECT_THAT(index.Query(Eigen::Vector3d(0., 0., 1.)),
+              ElementsAre(NodeId{0, 0}, NodeId{0, 1}, NodeId{1, 1}));
+  EXPECT_THAT(index.Query(Eigen::Vector3d(10., 0., 0.)), IsEmpty());
+}
+
+TEST(SpatialIndexTest, MovesAndRemovesIds) {
+  SpatialIndex<SubmapId> index(1.);
+  index.Insert(SubmapId{0, 0}, Eigen::Vector3d(0., 0., 0.));
+  index.Insert(SubmapId{0, 1}, Eigen::Vector3d(0.5, 0., 0.));
+  index.Insert(SubmapId{0, 0}, Eigen::Vector3d(-10., 0., 0.));
+  EXPECT_EQ(index.size(), 2);
+  EXPECT_THAT(index.Query(Eigen::Vector3d::Zero()),
+              ElementsAre(SubmapId{0, 1}));
+  EXPECT_THAT(index.Query(Eigen::Vector3d(-10.5, 0., 0.)),
+              ElementsAre(SubmapId{0, 0}));
+  index.Remove(SubmapId{0, 1});
+  index.Remove(SubmapId{0, 2});
+  EXPECT_FALSE(index.Contains(SubmapId{0, 1}));
+  EXPECT_TRUE(index.Contains(SubmapId{0, 0}));
+  EXPECT_THAT(index.Query(Eigen::Vector3d::Zero()), IsEmpty());
+}
+
+TEST(SpatialIndexTest, MatchesExhaustiveSearch) {
+  constexpr double kRadius = 15.;
+  std::mt19937 prng(42);
+  std::uniform_real_distribution<double> distribution(-100., 100.);
+  SpatialIndex<NodeId> index(kRadius);
+  std::vector<Eigen::Vector3d> positions;
+  for (int i = 0; i < 1000; ++i) {
+    positions.emplace_back(distribution(prng), distribution(prng),
+                           distribution(prng) / 10.);
+    index.Insert(NodeId{0, i}, positions.back());
+  }
+  for (int i = 0; i < 100; ++i) {
+    const Eigen::Vector3d position(distribution(prng), distribution(prng), 0.);
+    std::vector<NodeId> expected;
+    for (size_t j = 0; j < positions.size(); ++j) {
+      if ((positions[j] - position).norm() <= kRadius) {
+        expected.emplace_back(0, j);
+      }
+    }
+    EXPECT_EQ(index.Query(position), expected);
+  }
+}
+
+}  // namespace
+}  // namespace mapping
+}  // namespace cartographer
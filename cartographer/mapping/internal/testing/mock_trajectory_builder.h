@@ -33,6 +33,8 @@ class MockTrajectoryBuilder : public mapping::TrajectoryBuilderInterface {
 
   MOCK_METHOD2(AddSensorData,
                void(const std::string &, const sensor::TimedPointCloudData &));
+  MOCK_METHOD2(AddSensorData, void(const std::string &,
+                                   const sensor::OrganizedPointCloudData &));
   MOCK_METHOD2(AddSensorData,
                void(const std::string &, const sensor::ImuData &));
   MOCK_METHOD2(AddSensorData,
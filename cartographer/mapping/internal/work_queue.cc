@@ -0,0 +1,81 @@
+/*
+ * Copyright 2018 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/internal/work_queue.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "glog/logging.h"
+
+namespace cartographer {
+namespace mapping {
+
+void WorkQueue::Push(WorkItem work_item) {
+  lanes_.at(static_cast<int>(work_item.lane)).push_back(std::move(work_item));
+}
+
+WorkItem WorkQueue::Pop() {
+  for (auto& lane : lanes_) {
+    if (!lane.empty()) {
+      WorkItem work_item = std::move(lane.front());
+      lane.pop_front();
+      return work_item;
+    }
+  }
+  LOG(FATAL) << "Work queue is empty.";
+}
+
+size_t WorkQueue::size() const {
+  size_t size = 0;
+  for (const auto& lane : lanes_) {
+    size += lane.size();
+  }
+  return size;
+}
+
+size_t WorkQueue::size(const WorkItem::Lane lane) const {
+  return lanes_.at(static_cast<int>(lane)).size();
+}
+
+std::chrono::steady_clock::duration WorkQueue::GetDelay(
+    const WorkItem::Lane lane,
+    const std::chrono::steady_clock::time_point now) const {
+  const auto& items = lanes_.at(static_cast<int>(lane));
+  if (items.empty()) {
+    return std::chrono::steady_clock::duration::zero();
+  }
+  return now - items.front().time;
+}
+
+std::chrono::steady_clock::duration WorkQueue::GetDelay(
+    const std::chrono::steady_clock::time_point now) const {
+  auto delay = std::chrono::steady_clock::duration::zero();
+  for (int lane = 0; lane < WorkItem::kNumLanes; ++lane) {
+    delay = std::max(delay, GetDelay(static_cast<WorkItem::Lane>(lane), now));
+  }
+  return delay;
+}
+
+bool WorkQueue::IsOverloaded(
+    const std::chrono::steady_clock::duration max_node_delay,
+    const std::chrono::steady_clock::time_point now) const {
+  return max_node_delay > std::chrono::steady_clock::duration::zero() &&
+         GetDelay(WorkItem::Lane::kNodes, now) > max_node_delay;
+}
+
+}  // namespace mapping
+}  // namespace cartographer
@@ -17,6 +17,7 @@
 #ifndef CARTOGRAPHER_MAPPING_INTERNAL_WORK_QUEUE_H
 #define CARTOGRAPHER_MAPPING_INTERNAL_WORK_QUEUE_H
 
+#include <array>
 #include <chrono>
 #include <deque>
 #include <functional>
@@ -30,11 +31,55 @@ struct WorkItem {
     kRunOptimization,
   };
 
+  // Items are processed in order within a lane, and lanes are processed in
+  // the order of their priority.
+  enum class Lane {
+    // Sensor data which only adds measurements. It may be processed before
+    // queued items of other lanes without changing the result.
+    kSensorData = 0,
+    // Nodes and everything else which has to stay in order with them, e.g.
+    // changes of the trajectory state and the final optimization.
+    kNodes = 1,
+  };
+  static constexpr int kNumLanes = 2;
+
   std::chrono::steady_clock::time_point time;
   std::function<Result()> task;
+  Lane lane = Lane::kNodes;
 };
 
-using WorkQueue = std::deque<WorkItem>;
+// Queue of the work items of a pose graph with one FIFO lane per
+// 'WorkItem::Lane', so cheap sensor data does not wait behind nodes.
+class WorkQueue {
+ public:
+  void Push(WorkItem work_item);
+
+  // Removes and returns the oldest item of the highest priority lane which is
+  // not empty. The queue must not be empty.
+  WorkItem Pop();
+
+  bool empty() const { return size() == 0; }
+  size_t size() const;
+  size_t size(WorkItem::Lane lane) const;
+
+  // Returns how long the oldest item of 'lane' has been waiting at 'now', or
+  // zero if 'lane' is empty.
+  std::chrono::steady_clock::duration GetDelay(
+      WorkItem::Lane lane, std::chrono::steady_clock::time_point now) const;
+
+  // Returns the longest delay of all lanes.
+  std::chrono::steady_clock::duration GetDelay(
+      std::chrono::steady_clock::time_point now) const;
+
+  // Returns true if the oldest node has been waiting for longer than
+  // 'max_node_delay' at 'now'. Sensor data is cheap and never counts. A
+  // 'max_node_delay' which is not positive disables the check.
+  bool IsOverloaded(std::chrono::steady_clock::duration max_node_delay,
+                    std::chrono::steady_clock::time_point now) const;
+
+ private:
+  std::array<std::deque<WorkItem>, WorkItem::kNumLanes> lanes_;
+};
 
 }  // namespace mapping
 }  // namespace cartographer
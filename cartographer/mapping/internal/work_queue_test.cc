@@ -0,0 +1,127 @@
+/*
+ * Copyright 2018 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/internal/work_queue.h"
+
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace mapping {
+namespace {
+
+WorkItem CreateWorkItem(const WorkItem::Lane lane, const int id,
+                        const std::chrono::steady_clock::time_point time,
+                        std::vector<int>* const processed_ids) {
+  return WorkItem{time,
+                  [id, processed_ids]() {
+                    processed_ids->push_back(id);
+                    return WorkItem::Result::kDoNotRunOptimization;
+                  },
+                  lane};
+}
+
+TEST(WorkQueueTest, ProcessesSensorDataFirstAndLanesInOrder) {
+  const auto now = std::chrono::steady_clock::now();
+  std::vector<int> processed_ids;
+  WorkQueue work_queue;
+  EXPECT_TRUE(work_queue.empty());
+  work_queue.Push(
+      CreateWorkItem(WorkItem::Lane::kNodes, 0, now, &processed_ids));
+  work_queue.Push(
+      CreateWorkItem(WorkItem::Lane::kSensorData, 1, now, &processed_ids));
+  work_queue.Push(
+      CreateWorkItem(WorkItem::Lane::kNodes, 2, now, &processed_ids));
+  work_queue.Push(
+      CreateWorkItem(WorkItem::Lane::kSensorData, 3, now, &processed_ids));
+  EXPECT_EQ(work_queue.size(), 4);
+  EXPECT_EQ(work_queue.size(WorkItem::Lane::kSensorData), 2);
+  while (!work_queue.empty()) {
+    work_queue.Pop().task();
+  }
+  EXPECT_EQ(processed_ids, (std::vector<int>{1, 3, 0, 2}));
+}
+
+TEST(WorkQueueTest, ReportsDelayPerLane) {
+  const auto now = std::chrono::steady_clock::now();
+  std::vector<int> processed_ids;
+  WorkQueue work_queue;
+  EXPECT_EQ(work_queue.GetDelay(now), std::chrono::seconds(0));
+  work_queue.Push(CreateWorkItem(WorkItem::Lane::kNodes, 0,
+                                 now - std::chrono::seconds(3),
+                                 &processed_ids));
+  work_queue.Push(CreateWorkItem(WorkItem::Lane::kSensorData, 1,
+                                 now - std::chrono::seconds(1),
+                                 &processed_ids));
+  work_queue.Push(
+      CreateWorkItem(WorkItem::Lane::kNodes, 2, now, &processed_ids));
+  EXPECT_EQ(work_queue.GetDelay(WorkItem::Lane::kSensorData, now),
+            std::chrono::seconds(1));
+  EXPECT_EQ(work_queue.GetDelay(WorkItem::Lane::kNodes, now),
+            std::chrono::seconds(3));
+  EXPECT_EQ(work_queue.GetDelay(now), std::chrono::seconds(3));
+  EXPECT_EQ(work_queue.Pop().lane, WorkItem::Lane::kSensorData);
+  EXPECT_EQ(work_queue.GetDelay(WorkItem::Lane::kSensorData, now),
+            std::chrono::seconds(0));
+  EXPECT_EQ(work_queue.Pop().lane, WorkItem::Lane::kNodes);
+  EXPECT_EQ(work_queue.GetDelay(now), std::chrono::seconds(0));
+}
+
+TEST(WorkQueueTest, IsOverloadedWhileANodeWaitsTooLong) {
+  const auto now = std::chrono::steady_clock::now();
+  constexpr auto kMaxNodeDelay = std::chrono::seconds(5);
+  std::vector<int> processed_ids;
+  WorkQueue work_queue;
+  EXPECT_FALSE(work_queue.IsOverloaded(kMaxNodeDelay, now));
+  // Sensor data never overloads the queue.
+  work_queue.Push(CreateWorkItem(WorkItem::Lane::kSensorData, 0,
+                                 now - std::chrono::seconds(10),
+                                 &processed_ids));
+  EXPECT_FALSE(work_queue.IsOverloaded(kMaxNodeDelay, now));
+  work_queue.Push(CreateWorkItem(WorkItem::Lane::kNodes, 1,
+                                 now - std::chrono::seconds(4),
+                                 &processed_ids));
+  work_queue.Push(
+      CreateWorkItem(WorkItem::Lane::kNodes, 2, now, &processed_ids));
+  EXPECT_FALSE(work_queue.IsOverloaded(kMaxNodeDelay, now));
+  // Switches on once the oldest node waited for longer than the limit.
+  EXPECT_FALSE(
+      work_queue.IsOverloaded(kMaxNodeDelay, now + std::chrono::seconds(1)));
+  EXPECT_TRUE(work_queue.IsOverloaded(
+      kMaxNodeDelay, now + std::chrono::milliseconds(1001)));
+  EXPECT_TRUE(
+      work_queue.IsOverloaded(kMaxNodeDelay, now + std::chrono::seconds(3)));
+  // A non-positive limit disables the check.
+  EXPECT_FALSE(work_queue.IsOverloaded(std::chrono::seconds(0),
+                                       now + std::chrono::seconds(3)));
+  // Switches off once the old node was processed.
+  EXPECT_EQ(work_queue.Pop().lane, WorkItem::Lane::kSensorData);
+  EXPECT_TRUE(
+      work_queue.IsOverloaded(kMaxNodeDelay, now + std::chrono::seconds(3)));
+  EXPECT_EQ(work_queue.Pop().lane, WorkItem::Lane::kNodes);
+  EXPECT_FALSE(
+      work_queue.IsOverloaded(kMaxNodeDelay, now + std::chrono::seconds(3)));
+  EXPECT_TRUE(
+      work_queue.IsOverloaded(kMaxNodeDelay, now + std::chrono::seconds(6)));
+  work_queue.Pop();
+  EXPECT_FALSE(
+      work_queue.IsOverloaded(kMaxNodeDelay, now + std::chrono::seconds(6)));
+}
+
+}  // namespace
+}  // namespace mapping
+}  // namespace cartographer
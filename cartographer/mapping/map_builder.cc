@@ -31,6 +31,7 @@
 #include "cartographer/mapping/internal/global_trajectory_builder.h"
 #include "cartographer/mapping/internal/motion_filter.h"
 #include "cartographer/sensor/internal/collator.h"
+#include "cartographer/sensor/internal/parallel_trajectory_collator.h"
 #include "cartographer/sensor/internal/trajectory_collator.h"
 #include "cartographer/sensor/internal/voxel_filter.h"
 #include "cartographer/transform/rigid_transform.h"
@@ -92,7 +93,11 @@ MapBuilder::MapBuilder(const proto::MapBuilderOptions& options)
             options_.pose_graph_options().optimization_problem_options()),
         &thread_pool_);
   }
-  if (options.collate_by_trajectory()) {
+  if (options.collate_by_trajectory() &&
+      options.collate_trajectories_in_parallel()) {
+    sensor_collator_ = absl::make_unique<sensor::ParallelTrajectoryCollator>(
+        options.collation_queue_size());
+  } else if (options.collate_by_trajectory()) {
     sensor_collator_ = absl::make_unique<sensor::TrajectoryCollator>();
   } else {
     sensor_collator_ = absl::make_unique<sensor::Collator>();
@@ -111,6 +116,14 @@ int MapBuilder::AddTrajectoryBuilder(
     pose_graph_odometry_motion_filter.emplace(
         MotionFilter(trajectory_options.pose_graph_odometry_motion_filter()));
   }
+  absl::optional<proto::MotionFilterOptions>
+      overloaded_pose_graph_motion_filter_options;
+  if (trajectory_options.has_overloaded_pose_graph_motion_filter()) {
+    LOG(INFO) << "Using a motion filter for adding nodes to the pose graph "
+                 "while it is overloaded.";
+    overloaded_pose_graph_motion_filter_options =
+        trajectory_options.overloaded_pose_graph_motion_filter();
+  }
 
   if (options_.use_trajectory_builder_3d()) {
     std::unique_ptr<LocalTrajectoryBuilder3D> local_trajectory_builder;
@@ -126,7 +139,8 @@ int MapBuilder::AddTrajectoryBuilder(
         CreateGlobalTrajectoryBuilder3D(
             std::move(local_trajectory_builder), trajectory_id,
             static_cast<PoseGraph3D*>(pose_graph_.get()),
-            local_slam_result_callback, pose_graph_odometry_motion_filter)));
+            local_slam_result_callback, pose_graph_odometry_motion_filter,
+            overloaded_pose_graph_motion_filter_options)));
   } else {
     std::unique_ptr<LocalTrajectoryBuilder2D> local_trajectory_builder;
     if (trajectory_options.has_trajectory_builder_2d_options()) {
@@ -141,7 +155,8 @@ int MapBuilder::AddTrajectoryBuilder(
         CreateGlobalTrajectoryBuilder2D(
             std::move(local_trajectory_builder), trajectory_id,
             static_cast<PoseGraph2D*>(pose_graph_.get()),
-            local_slam_result_callback, pose_graph_odometry_motion_filter)));
+            local_slam_result_callback, pose_graph_odometry_motion_filter,
+            overloaded_pose_graph_motion_filter_options)));
   }
   MaybeAddPureLocalizationTrimmer(trajectory_id, trajectory_options,
                                   pose_graph_.get());
@@ -88,9 +88,11 @@ class MapBuilder : public MapBuilderInterface {
 
   std::unique_ptr<PoseGraph> pose_graph_;
 
-  std::unique_ptr<sensor::CollatorInterface> sensor_collator_;
   std::vector<std::unique_ptr<mapping::TrajectoryBuilderInterface>>
       trajectory_builders_;
+  // Declared after 'trajectory_builders_', so that it is destroyed first. A
+  // collator with threads calls into the trajectory builders until then.
+  std::unique_ptr<sensor::CollatorInterface> sensor_collator_;
   std::vector<proto::TrajectoryBuilderOptionsWithSensorIds>
       all_trajectory_builder_options_;
 };
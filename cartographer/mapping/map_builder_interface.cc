@@ -32,6 +32,14 @@ proto::MapBuilderOptions CreateMapBuilderOptions(
       parameter_dictionary->GetNonNegativeInt("num_background_threads"));
   options.set_collate_by_trajectory(
       parameter_dictionary->GetBool("collate_by_trajectory"));
+  options.set_collate_trajectories_in_parallel(
+      parameter_dictionary->HasKey("collate_trajectories_in_parallel")
+          ? parameter_dictionary->GetBool("collate_trajectories_in_parallel")
+          : false);
+  options.set_collation_queue_size(
+      parameter_dictionary->HasKey("collation_queue_size")
+          ? parameter_dictionary->GetNonNegativeInt("collation_queue_size")
+          : 0);
   *options.mutable_pose_graph_options() = CreatePoseGraphOptions(
       parameter_dictionary->GetDictionary("pose_graph").get());
   CHECK_NE(options.use_trajectory_builder_2d(),
@@ -0,0 +1,147 @@
+/*
+ * Copyright 2018 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "cartographer/common/internal/benchmark.h"
+#include "cartographer/common/time.h"
+#include "cartographer/mapping/flat_map_by_id.h"
+#include "cartographer/mapping/id.h"
+#include "cartographer/transform/rigid_transform.h"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+DEFINE_int32(num_nodes, 1000000, "Number of nodes in the map.");
+DEFINE_int32(num_trajectories, 4, "Number of trajectories the nodes are in.");
+DEFINE_double(trimmed_fraction, 0.1, "Fraction of nodes which are trimmed.");
+DEFINE_int32(num_iterations, 10, "Number of times each variant is run.");
+
+namespace cartographer {
+namespace mapping {
+namespace {
+
+// Roughly the size of a 'TrajectoryNodePose'.
+struct NodeData {
+  common::Time time;
+  transform::Rigid3d global_pose;
+  transform::Rigid3d local_pose;
+};
+
+template <typename Function>
+void Benchmark(const std::string& name, const int num_elements,
+               Function function) {
+  common::RunBenchmark(name, FLAGS_num_iterations, num_elements, "node",
+                       function);
+}
+
+template <typename MapType>
+void Fill(const std::vector<NodeId>& trimmed_ids, MapType* map_by_id) {
+  const int nodes_per_trajectory = FLAGS_num_nodes / FLAGS_num_trajectories;
+  for (int trajectory_id = 0; trajectory_id < FLAGS_num_trajectories;
+       ++trajectory_id) {
+    for (int i = 0; i < nodes_per_trajectory; ++i) {
+      map_by_id->Append(
+          trajectory_id,
+          NodeData{common::FromUniversal(i),
+                   transform::Rigid3d::Translation(
+                       Eigen::Vector3d(i, trajectory_id, 0.)),
+                   transform::Rigid3d::Identity()});
+    }
+  }
+  for (const NodeId& id : trimmed_ids) {
+    map_by_id->Trim(id);
+  }
+}
+
+template <typename MapType>
+void Run(const std::string& name, const std::vector<NodeId>& trimmed_ids,
+         const std::vector<NodeId>& lookup_ids) {
+  MapType map_by_id;
+  const auto start = std::chrono::steady_clock::now();
+  Fill(trimmed_ids, &map_by_id);
+  LOG(INFO) << name << " filled in " << common::SecondsSince(start) << " s.";
+  const int num_nodes = map_by_id.size();
+  Benchmark(name + " iteration", num_nodes, [&map_by_id](int) {
+    double sum = 0.;
+    for (const auto& id_data : map_by_id) {
+      sum += id_data.data.global_pose.translation().x();
+    }
+    return sum;
+  });
+  Benchmark(name + " iteration by trajectory", num_nodes, [&map_by_id](int) {
+    double sum = 0.;
+    for (const int trajectory_id : map_by_id.trajectory_ids()) {
+      for (const auto& id_data : map_by_id.trajectory(trajectory_id)) {
+        sum += id_data.data.global_pose.translation().y();
+      }
+    }
+    return sum;
+  });
+  Benchmark(name + " lookup", lookup_ids.size(), [&](int) {
+    double sum = 0.;
+    for (const NodeId& id : lookup_ids) {
+      if (map_by_id.Contains(id)) {
+        sum += map_by_id.at(id).global_pose.translation().x();
+      }
+    }
+    return sum;
+  });
+}
+
+void RunAll() {
+  std::mt19937 prng(42);
+  std::uniform_real_distribution<double> distribution(0., 1.);
+  const int nodes_per_trajectory = FLAGS_num_nodes / FLAGS_num_trajectories;
+  std::vector<NodeId> trimmed_ids;
+  std::vector<NodeId> lookup_ids;
+  for (int trajectory_id = 0; trajectory_id < FLAGS_num_trajectories;
+       ++trajectory_id) {
+    // Keeps the last node, so the trajectories keep their size.
+    for (int i = 0; i + 1 < nodes_per_trajectory; ++i) {
+      if (distribution(prng) < FLAGS_trimmed_fraction) {
+        trimmed_ids.emplace_back(trajectory_id, i);
+      }
+    }
+  }
+  std::uniform_int_distribution<int> trajectory_distribution(
+      0, FLAGS_num_trajectories - 1);
+  std::uniform_int_distribution<int> index_distribution(
+      0, nodes_per_trajectory - 1);
+  for (int i = 0; i < FLAGS_num_nodes; ++i) {
+    lookup_ids.emplace_back(trajectory_distribution(prng),
+                            index_distribution(prng));
+  }
+  Run<MapById<NodeId, NodeData>>("MapById", trimmed_ids, lookup_ids);
+  Run<FlatMapById<NodeId, NodeData>>("FlatMapById", trimmed_ids, lookup_ids);
+}
+
+}  // namespace
+}  // namespace mapping
+}  // namespace cartographer
+
+int main(int argc, char** argv) {
+  ::cartographer::common::InitBenchmark(
+      "Compares iterating over and looking up nodes in MapById and "
+      "FlatMapById.",
+      &argc, &argv);
+  CHECK_GT(FLAGS_num_trajectories, 0);
+  CHECK_GE(FLAGS_num_nodes, FLAGS_num_trajectories);
+  CHECK_GT(FLAGS_num_iterations, 0);
+  ::cartographer::mapping::RunAll();
+}
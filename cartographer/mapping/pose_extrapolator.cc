@@ -59,10 +59,7 @@ common::Time PoseExtrapolator::GetLastPoseTime() const {
 }
 
 common::Time PoseExtrapolator::GetLastExtrapolatedTime() const {
-  if (!extrapolation_imu_tracker_) {
-    return common::Time::min();
-  }
-  return extrapolation_imu_tracker_->time();
+  return last_extrapolated_time_;
 }
 
 void PoseExtrapolator::AddPose(const common::Time time,
@@ -84,8 +81,8 @@ void PoseExtrapolator::AddPose(const common::Time time,
   AdvanceImuTracker(time, imu_tracker_.get());
   TrimImuData();
   TrimOdometryData();
-  odometry_imu_tracker_ = absl::make_unique<ImuTracker>(*imu_tracker_);
-  extrapolation_imu_tracker_ = absl::make_unique<ImuTracker>(*imu_tracker_);
+  UpdateImuTrackerStates();
+  last_extrapolated_time_ = imu_tracker_->time();
 }
 
 void PoseExtrapolator::AddImuData(const sensor::ImuData& imu_data) {
@@ -93,6 +90,16 @@ void PoseExtrapolator::AddImuData(const sensor::ImuData& imu_data) {
         imu_data.time >= timed_pose_queue_.back().time);
   imu_data_.push_back(imu_data);
   TrimImuData();
+  if (imu_tracker_ != nullptr && imu_data.time >= imu_tracker_->time()) {
+    imu_tracker_states_.push_back(imu_tracker_states_.empty()
+                                      ? *imu_tracker_
+                                      : imu_tracker_states_.back());
+    ImuTracker& imu_tracker = imu_tracker_states_.back();
+    imu_tracker.Advance(imu_data.time);
+    imu_tracker.AddImuLinearAccelerationObservation(
+        imu_data.linear_acceleration);
+    imu_tracker.AddImuAngularVelocityObservation(imu_data.angular_velocity);
+  }
 }
 
 void PoseExtrapolator::AddOdometryData(
@@ -124,8 +131,7 @@ void PoseExtrapolator::AddOdometryData(
           odometry_pose_delta.translation() / odometry_time_delta;
   const Eigen::Quaterniond orientation_at_newest_odometry_time =
       timed_pose_queue_.back().pose.rotation() *
-      ExtrapolateRotation(odometry_data_newest.time,
-                          odometry_imu_tracker_.get());
+      ExtrapolateRotation(odometry_data_newest.time);
   linear_velocity_from_odometry_ =
       orientation_at_newest_odometry_time *
       linear_velocity_in_tracking_frame_at_newest_odometry_time;
@@ -134,12 +140,13 @@ void PoseExtrapolator::AddOdometryData(
 transform::Rigid3d PoseExtrapolator::ExtrapolatePose(const common::Time time) {
   const TimedPose& newest_timed_pose = timed_pose_queue_.back();
   CHECK_GE(time, newest_timed_pose.time);
+  CHECK_GE(time, last_extrapolated_time_);
+  last_extrapolated_time_ = time;
   if (cached_extrapolated_pose_.time != time) {
     const Eigen::Vector3d translation =
         ExtrapolateTranslation(time) + newest_timed_pose.pose.translation();
     const Eigen::Quaterniond rotation =
-        newest_timed_pose.pose.rotation() *
-        ExtrapolateRotation(time, extrapolation_imu_tracker_.get());
+        newest_timed_pose.pose.rotation() * ExtrapolateRotation(time);
     cached_extrapolated_pose_ =
         TimedPose{time, transform::Rigid3d{translation, rotation}};
   }
@@ -148,9 +155,7 @@ transform::Rigid3d PoseExtrapolator::ExtrapolatePose(const common::Time time) {
 
 Eigen::Quaterniond PoseExtrapolator::EstimateGravityOrientation(
     const common::Time time) {
-  ImuTracker imu_tracker = *imu_tracker_;
-  AdvanceImuTracker(time, &imu_tracker);
-  return imu_tracker.orientation();
+  return ImuTrackerAt(time).orientation();
 }
 
 void PoseExtrapolator::UpdateVelocitiesFromPoses() {
@@ -224,12 +229,46 @@ void PoseExtrapolator::AdvanceImuTracker(const common::Time time,
   imu_tracker->Advance(time);
 }
 
+void PoseExtrapolator::UpdateImuTrackerStates() {
+  imu_tracker_states_.clear();
+  auto it = std::lower_bound(
+      imu_data_.begin(), imu_data_.end(), imu_tracker_->time(),
+      [](const sensor::ImuData& imu_data, const common::Time& time) {
+        return imu_data.time < time;
+      });
+  for (; it != imu_data_.end(); ++it) {
+    imu_tracker_states_.push_back(imu_tracker_states_.empty()
+                                      ? *imu_tracker_
+                                      : imu_tracker_states_.back());
+    ImuTracker& imu_tracker = imu_tracker_states_.back();
+    imu_tracker.Advance(it->time);
+    imu_tracker.AddImuLinearAccelerationObservation(it->linear_acceleration);
+    imu_tracker.AddImuAngularVelocityObservation(it->angular_velocity);
+  }
+}
+
+ImuTracker PoseExtrapolator::ImuTrackerAt(const common::Time time) const {
+  CHECK_GE(time, imu_tracker_->time());
+  // The state after the last IMU sample before 'time', if any.
+  const auto it = std::lower_bound(
+      imu_tracker_states_.begin(), imu_tracker_states_.end(), time,
+      [](const ImuTracker& imu_tracker, const common::Time& time) {
+        return imu_tracker.time() < time;
+      });
+  if (it == imu_tracker_states_.begin()) {
+    ImuTracker imu_tracker = *imu_tracker_;
+    AdvanceImuTracker(time, &imu_tracker);
+    return imu_tracker;
+  }
+  ImuTracker imu_tracker = *std::prev(it);
+  imu_tracker.Advance(time);
+  return imu_tracker;
+}
+
 Eigen::Quaterniond PoseExtrapolator::ExtrapolateRotation(
-    const common::Time time, ImuTracker* const imu_tracker) const {
-  CHECK_GE(time, imu_tracker->time());
-  AdvanceImuTracker(time, imu_tracker);
+    const common::Time time) const {
   const Eigen::Quaterniond last_orientation = imu_tracker_->orientation();
-  return last_orientation.inverse() * imu_tracker->orientation();
+  return last_orientation.inverse() * ImuTrackerAt(time).orientation();
 }
 
 Eigen::Vector3d PoseExtrapolator::ExtrapolateTranslation(common::Time time) {
@@ -67,8 +67,12 @@ class PoseExtrapolator : public PoseExtrapolatorInterface {
   void TrimImuData();
   void TrimOdometryData();
   void AdvanceImuTracker(common::Time time, ImuTracker* imu_tracker) const;
-  Eigen::Quaterniond ExtrapolateRotation(common::Time time,
-                                         ImuTracker* imu_tracker) const;
+  // Recomputes 'imu_tracker_states_' from 'imu_tracker_'.
+  void UpdateImuTrackerStates();
+  // Returns 'imu_tracker_' advanced to 'time', which must not be before the
+  // last pose.
+  ImuTracker ImuTrackerAt(common::Time time) const;
+  Eigen::Quaterniond ExtrapolateRotation(common::Time time) const;
   Eigen::Vector3d ExtrapolateTranslation(common::Time time);
 
   const common::Duration pose_queue_duration_;
@@ -83,8 +87,10 @@ class PoseExtrapolator : public PoseExtrapolatorInterface {
   const double gravity_time_constant_;
   std::deque<sensor::ImuData> imu_data_;
   std::unique_ptr<ImuTracker> imu_tracker_;
-  std::unique_ptr<ImuTracker> odometry_imu_tracker_;
-  std::unique_ptr<ImuTracker> extrapolation_imu_tracker_;
+  // 'imu_tracker_' advanced through each IMU sample since the last pose, so
+  // that queries only need to advance from the last sample before them.
+  std::deque<ImuTracker> imu_tracker_states_;
+  common::Time last_extrapolated_time_ = common::Time::min();
   TimedPose cached_extrapolated_pose_;
 
   std::deque<sensor::OdometryData> odometry_data_;
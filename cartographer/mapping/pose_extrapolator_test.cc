@@ -92,6 +92,31 @@ TEST(PoseExtrapolatorTest, EstimateGravityOrientationWithIMU) {
               kPrecision);
 }
 
+TEST(PoseExtrapolatorTest, EstimateGravityOrientationBetweenImuSamples) {
+  const Eigen::Vector3d angular_velocity(0.3, -0.2, 0.5);
+  const common::Time start_time = common::FromUniversal(123);
+  const auto create_extrapolator = [&]() {
+    auto extrapolator = PoseExtrapolator::InitializeWithImu(
+        common::FromSeconds(kPoseQueueDuration), kGravityTimeConstant,
+        sensor::ImuData{start_time, Eigen::Vector3d(0.5, 0.2, 9.8),
+                        Eigen::Vector3d::Zero()});
+    for (int i = 1; i <= 100; ++i) {
+      extrapolator->AddImuData(sensor::ImuData{
+          start_time + common::FromSeconds(0.005 * i),
+          Eigen::Vector3d(0.5, 0.2 + 0.01 * i, 9.8), angular_velocity});
+    }
+    return extrapolator;
+  };
+  auto extrapolator = create_extrapolator();
+  // Queries in any order give the same result as a single query.
+  for (const double seconds : {0.4973, 0.0012, 0.25, 0.6, 0.1234}) {
+    const common::Time time = start_time + common::FromSeconds(seconds);
+    EXPECT_TRUE(extrapolator->EstimateGravityOrientation(time).isApprox(
+        create_extrapolator()->EstimateGravityOrientation(time), kPrecision))
+        << seconds;
+  }
+}
+
 TEST(PoseExtrapolatorTest, ExtrapolateWithPoses) {
   PoseExtrapolator extrapolator(common::FromSeconds(kPoseQueueDuration),
                                 kGravityTimeConstant);
@@ -110,6 +110,10 @@ proto::PoseGraphOptions CreatePoseGraphOptions(
   options.set_global_constraint_search_after_n_seconds(
       parameter_dictionary->GetDouble(
           "global_constraint_search_after_n_seconds"));
+  options.set_overloaded_work_queue_delay_seconds(
+      parameter_dictionary->GetDouble("overloaded_work_queue_delay_seconds"));
+  options.set_optimize_in_background(
+      parameter_dictionary->GetBool("optimize_in_background"));
   PopulateOverlappingSubmapsTrimmerOptions2D(&options, parameter_dictionary);
   return options;
 }
@@ -18,6 +18,9 @@
 #define CARTOGRAPHER_MAPPING_POSE_GRAPH_INTERFACE_H_
 
 #include <chrono>
+#include <map>
+#include <memory>
+#include <string>
 #include <vector>
 
 #include "absl/types/optional.h"
@@ -83,6 +86,18 @@ class PoseGraphInterface {
 
   enum class TrajectoryState { ACTIVE, FINISHED, FROZEN, DELETED };
 
+  // The optimized state of the pose graph as of the end of an optimization.
+  // Snapshots are immutable: a new one replaces the published one after each
+  // optimization, so readers can keep using theirs without any locking.
+  struct Snapshot {
+    MapById<NodeId, TrajectoryNodePose> trajectory_node_poses;
+    MapById<SubmapId, SubmapData> submap_data;
+    MapById<SubmapId, SubmapPose> submap_poses;
+    std::vector<Constraint> constraints;
+    std::map<std::string, transform::Rigid3d> landmark_poses;
+    std::map<int, TrajectoryState> trajectory_states;
+  };
+
   using GlobalSlamOptimizationCallback =
       std::function<void(const std::map<int /* trajectory_id */, SubmapId>&,
                          const std::map<int /* trajectory_id */, NodeId>&)>;
@@ -147,6 +162,11 @@ class PoseGraphInterface {
   // Returns the collection of constraints.
   virtual std::vector<Constraint> constraints() const = 0;
 
+  // Returns the last published snapshot in constant time. Unlike the getters
+  // above, this does not wait for the pose graph and does not copy, but nodes
+  // and submaps added since the last optimization are not included yet.
+  virtual std::shared_ptr<const Snapshot> GetSnapshot() const = 0;
+
   // Serializes the constraints and trajectories. If
   // 'include_unfinished_submaps' is set to 'true', unfinished submaps, i.e.
   // submaps that have not yet received all rangefinder data insertions, will
@@ -37,15 +37,9 @@ void PopulatePureLocalizationTrimmerOptions(
       options_dictionary->GetInt("max_submaps_to_keep"));
 }
 
-void PopulatePoseGraphOdometryMotionFilterOptions(
-    proto::TrajectoryBuilderOptions* const trajectory_builder_options,
-    common::LuaParameterDictionary* const parameter_dictionary) {
-  constexpr char kDictionaryKey[] = "pose_graph_odometry_motion_filter";
-  if (!parameter_dictionary->HasKey(kDictionaryKey)) return;
-
-  auto options_dictionary = parameter_dictionary->GetDictionary(kDictionaryKey);
-  auto* options =
-      trajectory_builder_options->mutable_pose_graph_odometry_motion_filter();
+void PopulateMotionFilterOptions(
+    common::LuaParameterDictionary* const options_dictionary,
+    proto::MotionFilterOptions* const options) {
   options->set_max_time_seconds(
       options_dictionary->GetDouble("max_time_seconds"));
   options->set_max_distance_meters(
@@ -54,6 +48,29 @@ void PopulatePoseGraphOdometryMotionFilterOptions(
       options_dictionary->GetDouble("max_angle_radians"));
 }
 
+void PopulatePoseGraphOdometryMotionFilterOptions(
+    proto::TrajectoryBuilderOptions* const trajectory_builder_options,
+    common::LuaParameterDictionary* const parameter_dictionary) {
+  constexpr char kDictionaryKey[] = "pose_graph_odometry_motion_filter";
+  if (!parameter_dictionary->HasKey(kDictionaryKey)) return;
+
+  PopulateMotionFilterOptions(
+      parameter_dictionary->GetDictionary(kDictionaryKey).get(),
+      trajectory_builder_options->mutable_pose_graph_odometry_motion_filter());
+}
+
+void PopulateOverloadedPoseGraphMotionFilterOptions(
+    proto::TrajectoryBuilderOptions* const trajectory_builder_options,
+    common::LuaParameterDictionary* const parameter_dictionary) {
+  constexpr char kDictionaryKey[] = "overloaded_pose_graph_motion_filter";
+  if (!parameter_dictionary->HasKey(kDictionaryKey)) return;
+
+  PopulateMotionFilterOptions(
+      parameter_dictionary->GetDictionary(kDictionaryKey).get(),
+      trajectory_builder_options
+          ->mutable_overloaded_pose_graph_motion_filter());
+}
+
 }  // namespace
 
 proto::TrajectoryBuilderOptions CreateTrajectoryBuilderOptions(
@@ -71,6 +88,8 @@ proto::TrajectoryBuilderOptions CreateTrajectoryBuilderOptions(
       parameter_dictionary->GetBool("collate_landmarks"));
   PopulatePureLocalizationTrimmerOptions(&options, parameter_dictionary);
   PopulatePoseGraphOdometryMotionFilterOptions(&options, parameter_dictionary);
+  PopulateOverloadedPoseGraphMotionFilterOptions(&options,
+                                                 parameter_dictionary);
   return options;
 }
 
@@ -31,6 +31,7 @@
 #include "cartographer/sensor/imu_data.h"
 #include "cartographer/sensor/landmark_data.h"
 #include "cartographer/sensor/odometry_data.h"
+#include "cartographer/sensor/organized_point_cloud.h"
 #include "cartographer/sensor/timed_point_cloud_data.h"
 
 namespace cartographer {
@@ -96,6 +97,12 @@ class TrajectoryBuilderInterface {
   virtual void AddSensorData(
       const std::string& sensor_id,
       const sensor::TimedPointCloudData& timed_point_cloud_data) = 0;
+  // Adds range data of a lidar which organizes its points by ring and azimuth.
+  // Local SLAM converts it into TimedPointCloudData in order of acquisition,
+  // filtering by range on the range image.
+  virtual void AddSensorData(
+      const std::string& sensor_id,
+      const sensor::OrganizedPointCloudData& organized_point_cloud_data) = 0;
   virtual void AddSensorData(const std::string& sensor_id,
                              const sensor::ImuData& imu_data) = 0;
   virtual void AddSensorData(const std::string& sensor_id,
@@ -16,6 +16,7 @@
 
 #include "cartographer/metrics/register.h"
 
+#include "cartographer/mapping/3d/submap_3d.h"
 #include "cartographer/mapping/internal/2d/local_trajectory_builder_2d.h"
 #include "cartographer/mapping/internal/2d/pose_graph_2d.h"
 #include "cartographer/mapping/internal/3d/local_trajectory_builder_3d.h"
@@ -23,6 +24,8 @@
 #include "cartographer/mapping/internal/constraints/constraint_builder_2d.h"
 #include "cartographer/mapping/internal/constraints/constraint_builder_3d.h"
 #include "cartographer/mapping/internal/global_trajectory_builder.h"
+#include "cartographer/mapping/internal/imu_based_pose_extrapolator.h"
+#include "cartographer/sensor/internal/parallel_trajectory_collator.h"
 #include "cartographer/sensor/internal/trajectory_collator.h"
 
 namespace cartographer {
@@ -32,10 +35,13 @@ void RegisterAllMetrics(FamilyFactory* registry) {
   mapping::constraints::ConstraintBuilder2D::RegisterMetrics(registry);
   mapping::constraints::ConstraintBuilder3D::RegisterMetrics(registry);
   mapping::GlobalTrajectoryBuilderRegisterMetrics(registry);
+  mapping::ImuBasedPoseExtrapolator::RegisterMetrics(registry);
   mapping::LocalTrajectoryBuilder2D::RegisterMetrics(registry);
   mapping::LocalTrajectoryBuilder3D::RegisterMetrics(registry);
   mapping::PoseGraph2D::RegisterMetrics(registry);
   mapping::PoseGraph3D::RegisterMetrics(registry);
+  mapping::Submap3D::RegisterMetrics(registry);
+  sensor::ParallelTrajectoryCollator::RegisterMetrics(registry);
   sensor::TrajectoryCollator::RegisterMetrics(registry);
 }
 
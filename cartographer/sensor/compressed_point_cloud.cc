@@ -16,10 +16,12 @@
 
 #include "cartographer/sensor/compressed_point_cloud.h"
 
+#include <cmath>
 #include <limits>
 
+#include "absl/container/flat_hash_map.h"
 #include "cartographer/common/math.h"
-#include "cartographer/mapping/3d/hybrid_grid.h"
+#include "cartographer/common/port.h"
 
 namespace cartographer {
 namespace sensor {
@@ -34,6 +36,42 @@ constexpr float kPrecision = 0.001f;  // in meters.
 constexpr int kBitsPerCoordinate = 10;
 constexpr int kCoordinateMask = (1 << kBitsPerCoordinate) - 1;
 constexpr int kMaxBitsPerDirection = 23;
+// Scaled coordinates up to this magnitude are converted to int32 before their
+// bounds are checked.
+constexpr float kMaxScaledCoordinate = 1 << kMaxBitsPerDirection;
+// Block coordinates are within +/- 2^'kBitsPerBlockCoordinate' and packed
+// into a 64-bit key during encoding.
+constexpr int kBitsPerBlockCoordinate =
+    kMaxBitsPerDirection - kBitsPerCoordinate;
+constexpr int kBlockKeyBits = kBitsPerBlockCoordinate + 1;
+
+uint64 ToBlockKey(const int32 raster_x, const int32 raster_y,
+                  const int32 raster_z) {
+  constexpr int32 kOffset = 1 << kBitsPerBlockCoordinate;
+  return (static_cast<uint64>((raster_z >> kBitsPerCoordinate) + kOffset)
+          << (2 * kBlockKeyBits)) |
+         (static_cast<uint64>((raster_y >> kBitsPerCoordinate) + kOffset)
+          << kBlockKeyBits) |
+         static_cast<uint64>((raster_x >> kBitsPerCoordinate) + kOffset);
+}
+
+// Decodes the block starting at 'input' into 'output'. Uses the same
+// arithmetic as ConstIterator, so the results are identical.
+void DecodeBlock(const int32* const input, RangefinderPoint* const output) {
+  const int32 num_points = input[0];
+  const int32 block_x = input[1] << kBitsPerCoordinate;
+  const int32 block_y = input[2] << kBitsPerCoordinate;
+  const int32 block_z = input[3] << kBitsPerCoordinate;
+  const int32* const points = input + 4;
+  for (int32 i = 0; i < num_points; ++i) {
+    const int32 point = points[i];
+    const int32 x = block_x + (point & kCoordinateMask);
+    const int32 y = block_y + ((point >> kBitsPerCoordinate) & kCoordinateMask);
+    const int32 z = block_z + (point >> (2 * kBitsPerCoordinate));
+    output[i].position = Eigen::Vector3f(x * kPrecision, y * kPrecision,
+                                         z * kPrecision);
+  }
+}
 
 }  // namespace
 
@@ -98,51 +136,101 @@ void CompressedPointCloud::ConstIterator::ReadNextPoint() {
 
 CompressedPointCloud::CompressedPointCloud(const PointCloud& point_cloud)
     : num_points_(point_cloud.size()) {
-  // Distribute points into blocks.
-  struct RasterPoint {
-    Eigen::Array3i point;
-    int index;
-  };
-  using Blocks = mapping::HybridGridBase<std::vector<RasterPoint>>;
-  Blocks blocks(kPrecision);
-  int num_blocks = 0;
-  CHECK_LE(point_cloud.size(), std::numeric_limits<int>::max());
-  for (int point_index = 0; point_index < static_cast<int>(point_cloud.size());
-       ++point_index) {
-    const RangefinderPoint& point = point_cloud[point_index];
-    CHECK_LT(point.position.cwiseAbs().maxCoeff() / kPrecision,
-             1 << kMaxBitsPerDirection)
-        << "Point out of bounds: " << point.position;
-    Eigen::Array3i raster_point;
-    Eigen::Array3i block_coordinate;
-    for (int i = 0; i < 3; ++i) {
-      raster_point[i] = common::RoundToInt(point.position[i] / kPrecision);
-      block_coordinate[i] = raster_point[i] >> kBitsPerCoordinate;
-      raster_point[i] &= kCoordinateMask;
+  CHECK_LE(point_cloud.size(), std::numeric_limits<int32>::max());
+  // Rasterize all points first. This loop has no data dependent branches and
+  // is vectorized by the compiler.
+  const size_t num_points = point_cloud.size();
+  std::vector<int32> raster_points(3 * num_points);
+  bool in_bounds = true;
+  for (size_t i = 0; i < num_points; ++i) {
+    const Eigen::Vector3f& position = point_cloud[i].position;
+    for (int j = 0; j < 3; ++j) {
+      const float scaled = position[j] / kPrecision;
+      // Converting NaN or values outside the int32 range is undefined, so
+      // those are replaced before rounding. The comparison is false for NaN.
+      const bool convertible = std::abs(scaled) <= kMaxScaledCoordinate;
+      const int32 raster_point =
+          common::FastRoundToInt32(convertible ? scaled : 0.f);
+      in_bounds &= convertible &
+                   (std::abs(raster_point) < (1 << kMaxBitsPerDirection));
+      raster_points[3 * i + j] = raster_point;
     }
-    auto* const block = blocks.mutable_value(block_coordinate);
-    num_blocks += block->empty();
-    block->push_back({raster_point, point_index});
-  }
-
-  // Encode blocks.
-  point_data_.reserve(4 * num_blocks + point_cloud.size());
-  for (Blocks::Iterator it(blocks); !it.Done(); it.Next(), --num_blocks) {
-    const auto& raster_points = it.GetValue();
-    CHECK_LE(raster_points.size(), std::numeric_limits<int32>::max());
-    point_data_.push_back(raster_points.size());
-    const Eigen::Array3i block_coordinate = it.GetCellIndex();
-    point_data_.push_back(block_coordinate.x());
-    point_data_.push_back(block_coordinate.y());
-    point_data_.push_back(block_coordinate.z());
-    for (const RasterPoint& raster_point : raster_points) {
-      point_data_.push_back((((raster_point.point.z() << kBitsPerCoordinate) +
-                              raster_point.point.y())
-                             << kBitsPerCoordinate) +
-                            raster_point.point.x());
+  }
+  if (!in_bounds) {
+    for (const RangefinderPoint& point : point_cloud) {
+      for (int j = 0; j < 3; ++j) {
+        const float scaled = point.position[j] / kPrecision;
+        CHECK(std::abs(scaled) <= kMaxScaledCoordinate &&
+              std::abs(common::FastRoundToInt32(scaled)) <
+                  (1 << kMaxBitsPerDirection))
+            << "Point out of bounds: " << point.position;
+      }
+    }
+  }
+
+  // Number blocks in the order in which they first occur. Consecutive points
+  // are usually in the same block, so the lookup is skipped for those.
+  std::vector<uint32> point_blocks(num_points);
+  std::vector<uint32> block_sizes;
+  std::vector<uint32> block_first_points;
+  absl::flat_hash_map<uint64, uint32> block_numbers;
+  uint64 previous_key = std::numeric_limits<uint64>::max();
+  uint32 block = 0;
+  for (size_t i = 0; i < num_points; ++i) {
+    const uint64 key =
+        ToBlockKey(raster_points[3 * i], raster_points[3 * i + 1],
+                   raster_points[3 * i + 2]);
+    if (key != previous_key) {
+      block = block_numbers.emplace(key, block_sizes.size()).first->second;
+      if (block == block_sizes.size()) {
+        block_sizes.push_back(0);
+        block_first_points.push_back(i);
+      }
+      previous_key = key;
+    }
+    point_blocks[i] = block;
+    ++block_sizes[block];
+  }
+
+  // Write the block headers, then scatter the points into their blocks.
+  const size_t num_blocks = block_sizes.size();
+  point_data_.resize(kBlockHeaderSize * num_blocks + num_points);
+  block_offsets_.resize(num_blocks + 1);
+  std::vector<uint32> write_offsets(num_blocks);
+  uint32 offset = 0;
+  for (size_t block = 0; block < num_blocks; ++block) {
+    const uint32 first_point = block_first_points[block];
+    block_offsets_[block] = offset;
+    point_data_[offset] = block_sizes[block];
+    for (int j = 0; j < 3; ++j) {
+      point_data_[offset + 1 + j] =
+          raster_points[3 * first_point + j] >> kBitsPerCoordinate;
     }
+    write_offsets[block] = offset + kBlockHeaderSize;
+    offset += kBlockHeaderSize + block_sizes[block];
+  }
+  block_offsets_[num_blocks] = offset;
+  CHECK_EQ(offset, point_data_.size());
+  // Attributes are stored in the order in which points are encoded.
+  const bool has_attributes = !point_cloud.attributes().empty();
+  std::vector<uint32> encoding_order;
+  if (has_attributes) {
+    encoding_order.resize(num_points);
+  }
+  for (size_t i = 0; i < num_points; ++i) {
+    const int32 x = raster_points[3 * i] & kCoordinateMask;
+    const int32 y = raster_points[3 * i + 1] & kCoordinateMask;
+    const int32 z = raster_points[3 * i + 2] & kCoordinateMask;
+    const uint32 output = write_offsets[point_blocks[i]]++;
+    point_data_[output] =
+        (((z << kBitsPerCoordinate) + y) << kBitsPerCoordinate) + x;
+    if (has_attributes) {
+      encoding_order[output - kBlockHeaderSize * (point_blocks[i] + 1)] = i;
+    }
+  }
+  if (has_attributes) {
+    attributes_ = point_cloud.attributes().Gather(encoding_order);
   }
-  CHECK_EQ(num_blocks, 0);
 }
 
 CompressedPointCloud::CompressedPointCloud(
@@ -150,10 +238,31 @@ CompressedPointCloud::CompressedPointCloud(
   num_points_ = proto.num_points();
   const int data_size = proto.point_data_size();
   point_data_.reserve(data_size);
-  // TODO(wohe): Verify that 'point_data_' does not contain malformed data.
   for (int i = 0; i != data_size; ++i) {
     point_data_.emplace_back(proto.point_data(i));
   }
+  BuildBlockIndex();
+  attributes_ = FromProto(proto.attributes());
+  CHECK(attributes_.empty() || attributes_.num_points() == num_points_);
+}
+
+void CompressedPointCloud::BuildBlockIndex() {
+  CHECK_LE(point_data_.size(), std::numeric_limits<uint32>::max());
+  block_offsets_.clear();
+  size_t offset = 0;
+  size_t num_points = 0;
+  while (offset < point_data_.size()) {
+    CHECK_LE(offset + kBlockHeaderSize, point_data_.size())
+        << "Truncated block header.";
+    const int32 block_size = point_data_[offset];
+    CHECK_GT(block_size, 0) << "Malformed block header.";
+    block_offsets_.push_back(offset);
+    offset += kBlockHeaderSize + block_size;
+    num_points += block_size;
+  }
+  CHECK_EQ(offset, point_data_.size()) << "Truncated block.";
+  CHECK_EQ(num_points, num_points_);
+  block_offsets_.push_back(offset);
 }
 
 bool CompressedPointCloud::empty() const { return num_points_ == 0; }
@@ -169,17 +278,34 @@ CompressedPointCloud::ConstIterator CompressedPointCloud::end() const {
 }
 
 PointCloud CompressedPointCloud::Decompress() const {
-  PointCloud decompressed;
-  for (const RangefinderPoint& point : *this) {
-    decompressed.push_back(point);
+  std::vector<RangefinderPoint> points;
+  Decompress(&points);
+  return PointCloud(std::move(points), {}, attributes_);
+}
+
+void CompressedPointCloud::Decompress(
+    std::vector<RangefinderPoint>* const points) const {
+  points->resize(num_points_);
+  DecompressBlocks(0, num_blocks(), points->data());
+}
+
+void CompressedPointCloud::DecompressBlocks(
+    const size_t begin_block, const size_t end_block,
+    RangefinderPoint* points) const {
+  CHECK_LE(begin_block, end_block);
+  CHECK_LE(end_block, num_blocks());
+  for (size_t block = begin_block; block != end_block; ++block) {
+    const int32* const input = point_data_.data() + block_offsets_[block];
+    DecodeBlock(input, points);
+    points += input[0];
   }
-  return decompressed;
 }
 
 bool CompressedPointCloud::operator==(
     const CompressedPointCloud& right_hand_container) const {
   return point_data_ == right_hand_container.point_data_ &&
-         num_points_ == right_hand_container.num_points_;
+         num_points_ == right_hand_container.num_points_ &&
+         attributes_ == right_hand_container.attributes_;
 }
 
 proto::CompressedPointCloud CompressedPointCloud::ToProto() const {
@@ -188,6 +314,9 @@ proto::CompressedPointCloud CompressedPointCloud::ToProto() const {
   for (const int32 data : point_data_) {
     result.add_point_data(data);
   }
+  if (!attributes_.empty()) {
+    *result.mutable_attributes() = sensor::ToProto(attributes_);
+  }
   return result;
 }
 
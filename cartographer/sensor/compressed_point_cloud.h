@@ -22,6 +22,7 @@
 
 #include "Eigen/Core"
 #include "cartographer/common/port.h"
+#include "cartographer/sensor/point_attributes.h"
 #include "cartographer/sensor/point_cloud.h"
 #include "cartographer/sensor/proto/sensor.pb.h"
 
@@ -32,18 +33,40 @@ namespace sensor {
 // points (Vector3f) without time information.
 // Internally, points are grouped by blocks. Each block encodes a bit of meta
 // data (number of points in block, coordinates of the block) and encodes each
-// point with a fixed bit rate in relation to the block.
+// point with a fixed bit rate in relation to the block. Attributes of the
+// points are kept losslessly, intensities are dropped.
+//
+// An index of the blocks allows decompressing blocks independently, e.g. in
+// parallel, directly into memory provided by the caller.
 class CompressedPointCloud {
  public:
   class ConstIterator;
 
-  CompressedPointCloud() : num_points_(0) {}
+  CompressedPointCloud() : num_points_(0), block_offsets_(1, 0) {}
   explicit CompressedPointCloud(const PointCloud& point_cloud);
   explicit CompressedPointCloud(const proto::CompressedPointCloud& proto);
 
   // Returns decompressed point cloud.
   PointCloud Decompress() const;
 
+  // Decompresses the points into 'points' in the order of iteration, reusing
+  // its memory.
+  void Decompress(std::vector<RangefinderPoint>* points) const;
+
+  size_t num_blocks() const { return block_offsets_.size() - 1; }
+
+  // Returns the index in the order of iteration of the first point of 'block',
+  // or size() for 'block' equal to num_blocks().
+  size_t block_begin(const size_t block) const {
+    return block_offsets_[block] - kBlockHeaderSize * block;
+  }
+
+  // Decompresses the points of the blocks ['begin_block', 'end_block') into
+  // 'points', which must have room for
+  // 'block_begin(end_block) - block_begin(begin_block)' points.
+  void DecompressBlocks(size_t begin_block, size_t end_block,
+                        RangefinderPoint* points) const;
+
   bool empty() const;
   size_t size() const;
   ConstIterator begin() const;
@@ -53,8 +76,18 @@ class CompressedPointCloud {
   proto::CompressedPointCloud ToProto() const;
 
  private:
+  // Number of points and block coordinates.
+  static constexpr size_t kBlockHeaderSize = 4;
+
+  // Fills 'block_offsets_' from 'point_data_' and checks its consistency.
+  void BuildBlockIndex();
+
   std::vector<int32> point_data_;
   size_t num_points_;
+  // Offsets of the blocks in 'point_data_', followed by its size.
+  std::vector<uint32> block_offsets_;
+  // Attributes of the points in the order in which they are encoded.
+  PointAttributes attributes_;
 };
 
 // Forward iterator for compressed point clouds.
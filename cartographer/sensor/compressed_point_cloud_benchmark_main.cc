@@ -0,0 +1,107 @@
+/*
+ * Copyright 2016 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "cartographer/common/internal/benchmark.h"
+#include "cartographer/sensor/compressed_point_cloud.h"
+#include "cartographer/sensor/point_cloud.h"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+DEFINE_int32(num_points, 100000, "Number of points in the point cloud.");
+DEFINE_int32(num_iterations, 100, "Number of times each variant is run.");
+
+namespace cartographer {
+namespace sensor {
+namespace {
+
+template <typename Function>
+void Benchmark(const std::string& name, Function function) {
+  common::RunBenchmark(name, FLAGS_num_iterations, FLAGS_num_points, "point",
+                       function);
+}
+
+void Run() {
+  // Points in the order of a spinning lidar with 64 rings, such that
+  // consecutive points are often in the same block.
+  constexpr int kNumRings = 64;
+  std::mt19937 prng(42);
+  std::uniform_real_distribution<float> range_distribution(1.f, 30.f);
+  std::vector<RangefinderPoint> points;
+  points.reserve(FLAGS_num_points);
+  for (int i = 0; i < FLAGS_num_points; ++i) {
+    const float azimuth = 2.f * M_PI * (i / kNumRings) /
+                          (FLAGS_num_points / kNumRings + 1);
+    const float inclination = -0.4f + 0.5f * (i % kNumRings) / kNumRings;
+    const float range = range_distribution(prng);
+    points.push_back({range * Eigen::Vector3f(
+                                  std::cos(inclination) * std::cos(azimuth),
+                                  std::cos(inclination) * std::sin(azimuth),
+                                  std::sin(inclination))});
+  }
+  const PointCloud point_cloud(std::move(points));
+  const CompressedPointCloud compressed(point_cloud);
+  LOG(INFO) << compressed.num_blocks() << " blocks.";
+
+  Benchmark("Compress", [&](int) {
+    return CompressedPointCloud(point_cloud).num_blocks();
+  });
+  Benchmark("Decompress", [&](int) {
+    return compressed.Decompress().points().back().position.x();
+  });
+  std::vector<RangefinderPoint> buffer;
+  Benchmark("Decompress into buffer", [&](int) {
+    compressed.Decompress(&buffer);
+    return buffer.back().position.x();
+  });
+  Benchmark("Iterate", [&](int) {
+    float sum = 0.f;
+    for (const RangefinderPoint& point : compressed) {
+      sum += point.position.x();
+    }
+    return sum;
+  });
+  // Decompresses the blocks in four independent parts, as done by workers
+  // decompressing in parallel.
+  Benchmark("DecompressBlocks in four parts", [&](int) {
+    buffer.resize(compressed.size());
+    const size_t num_blocks = compressed.num_blocks();
+    for (size_t part = 0; part < 4; ++part) {
+      const size_t begin_block = part * num_blocks / 4;
+      compressed.DecompressBlocks(
+          begin_block, (part + 1) * num_blocks / 4,
+          buffer.data() + compressed.block_begin(begin_block));
+    }
+    return buffer.back().position.x();
+  });
+}
+
+}  // namespace
+}  // namespace sensor
+}  // namespace cartographer
+
+int main(int argc, char** argv) {
+  ::cartographer::common::InitBenchmark(
+      "Measures the time needed to compress and decompress point clouds.",
+      &argc, &argv);
+  CHECK_GT(FLAGS_num_points, 0);
+  CHECK_GT(FLAGS_num_iterations, 0);
+  ::cartographer::sensor::Run();
+}
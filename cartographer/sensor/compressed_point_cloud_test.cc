@@ -16,6 +16,8 @@
 
 #include "cartographer/sensor/compressed_point_cloud.h"
 
+#include <limits>
+
 #include "gmock/gmock.h"
 
 namespace Eigen {
@@ -117,6 +119,92 @@ TEST(CompressPointCloudTest, CompressesNoGaps) {
   }
 }
 
+TEST(CompressPointCloudTest, KeepsAttributes) {
+  std::vector<RangefinderPoint> points;
+  std::vector<uint32> ranges;
+  // Points spread over several blocks, which are encoded in a different order.
+  for (int i = 0; i < 100; ++i) {
+    points.push_back({Eigen::Vector3f(0.5f * (i % 10), 0.1f * i, -0.3f * i)});
+    ranges.push_back(i);
+  }
+  PointAttributes attributes;
+  attributes.Set(kRangeAttribute, ranges);
+  attributes.Set(kRingAttribute, std::vector<uint8>(points.size(), 7));
+  const PointCloud point_cloud(points, {}, attributes);
+  const CompressedPointCloud compressed(point_cloud);
+  const PointCloud decompressed = compressed.Decompress();
+  ASSERT_EQ(decompressed.attributes().num_points(), points.size());
+  const std::vector<uint32>& decompressed_ranges =
+      *decompressed.attributes().Find<uint32>(kRangeAttribute);
+  for (size_t i = 0; i < decompressed.size(); ++i) {
+    EXPECT_THAT(decompressed[i],
+                ApproximatelyEquals(points[decompressed_ranges[i]].position));
+    EXPECT_EQ(decompressed.attributes().Find<uint8>(kRingAttribute)->at(i), 7);
+  }
+  EXPECT_TRUE(compressed == CompressedPointCloud(compressed.ToProto()));
+  EXPECT_FALSE(compressed == CompressedPointCloud(PointCloud(points)));
+}
+
+TEST(CompressPointCloudTest, DecompressesIntoBuffer) {
+  PointCloud point_cloud;
+  for (int i = 0; i < 1000; ++i) {
+    point_cloud.push_back(
+        {Eigen::Vector3f(0.01f * i, -0.03f * (i % 17), 0.5f * (i % 3))});
+  }
+  const CompressedPointCloud compressed(point_cloud);
+  const std::vector<RangefinderPoint> iterated(compressed.begin(),
+                                               compressed.end());
+  // The buffer is resized, whatever it held before.
+  std::vector<RangefinderPoint> points(3);
+  compressed.Decompress(&points);
+  EXPECT_EQ(points, iterated);
+  compressed.Decompress(&points);
+  EXPECT_EQ(points, iterated);
+  EXPECT_EQ(compressed.Decompress().points(), iterated);
+}
+
+TEST(CompressPointCloudTest, DecompressesBlocks) {
+  PointCloud point_cloud;
+  for (int i = 0; i < 500; ++i) {
+    point_cloud.push_back({Eigen::Vector3f(0.7f * (i % 5), 0.3f * (i % 11),
+                                           -0.01f * i)});
+  }
+  const CompressedPointCloud compressed(point_cloud);
+  ASSERT_GT(compressed.num_blocks(), 10);
+  EXPECT_EQ(compressed.block_begin(0), 0);
+  EXPECT_EQ(compressed.block_begin(compressed.num_blocks()), compressed.size());
+  const std::vector<RangefinderPoint> expected =
+      compressed.Decompress().points();
+  // Decompress the blocks in two independent parts in reverse order.
+  const size_t middle_block = compressed.num_blocks() / 2;
+  std::vector<RangefinderPoint> points(compressed.size());
+  compressed.DecompressBlocks(middle_block, compressed.num_blocks(),
+                              points.data() +
+                                  compressed.block_begin(middle_block));
+  compressed.DecompressBlocks(0, middle_block, points.data());
+  EXPECT_EQ(points, expected);
+
+  const CompressedPointCloud from_proto(compressed.ToProto());
+  EXPECT_TRUE(from_proto == compressed);
+  ASSERT_EQ(from_proto.num_blocks(), compressed.num_blocks());
+  for (size_t block = 0; block <= compressed.num_blocks(); ++block) {
+    EXPECT_EQ(from_proto.block_begin(block), compressed.block_begin(block));
+  }
+  EXPECT_EQ(CompressedPointCloud().num_blocks(), 0);
+}
+
+TEST(CompressPointCloudTest, ChecksBounds) {
+  EXPECT_DEATH(
+      CompressedPointCloud(PointCloud({{Eigen::Vector3f(8389.f, 0, 0)}})),
+      "out of bounds");
+  EXPECT_DEATH(
+      CompressedPointCloud(PointCloud({{Eigen::Vector3f(0, -1e20f, 0)}})),
+      "out of bounds");
+  EXPECT_DEATH(CompressedPointCloud(PointCloud({{Eigen::Vector3f(
+                   0, 0, std::numeric_limits<float>::quiet_NaN())}})),
+               "out of bounds");
+}
+
 }  // namespace
 }  // namespace sensor
 }  // namespace cartographer
@@ -30,7 +30,7 @@ namespace {
 
 // Number of items that can be queued up before we log which queues are waiting
 // for data.
-const int kMaxQueueSize = 500;
+const size_t kMaxQueueSize = 500;
 
 }  // namespace
 
@@ -38,45 +38,93 @@ inline std::ostream& operator<<(std::ostream& out, const QueueKey& key) {
   return out << '(' << key.trajectory_id << ", " << key.sensor_id << ')';
 }
 
+void OrderedMultiQueue::DataQueue::Push(std::unique_ptr<Data> data) {
+  if (size_ == buffer_.size()) {
+    std::vector<std::unique_ptr<Data>> new_buffer(
+        std::max<size_t>(16, 2 * buffer_.size()));
+    for (size_t i = 0; i != size_; ++i) {
+      new_buffer[i] = std::move(buffer_[(head_ + i) & (buffer_.size() - 1)]);
+    }
+    buffer_.swap(new_buffer);
+    head_ = 0;
+  }
+  buffer_[(head_ + size_) & (buffer_.size() - 1)] = std::move(data);
+  ++size_;
+}
+
+std::unique_ptr<Data> OrderedMultiQueue::DataQueue::Pop() {
+  CHECK(!empty());
+  std::unique_ptr<Data> data = std::move(buffer_[head_]);
+  head_ = (head_ + 1) & (buffer_.size() - 1);
+  --size_;
+  return data;
+}
+
 OrderedMultiQueue::OrderedMultiQueue() {}
 
 OrderedMultiQueue::~OrderedMultiQueue() {
-  for (auto& entry : queues_) {
-    CHECK(entry.second.finished);
+  for (const auto& queue : queues_) {
+    CHECK(queue->finished);
   }
 }
 
 void OrderedMultiQueue::AddQueue(const QueueKey& queue_key, Callback callback) {
-  CHECK_EQ(queues_.count(queue_key), 0);
-  queues_[queue_key].callback = std::move(callback);
+  CHECK_EQ(queues_by_key_.count(queue_key), 0);
+  auto queue = absl::make_unique<Queue>();
+  queue->key = queue_key;
+  queue->callback = std::move(callback);
+  queues_by_key_[queue_key] = queue.get();
+  const auto it = std::lower_bound(
+      queues_.begin(), queues_.end(), queue_key,
+      [](const std::unique_ptr<Queue>& queue, const QueueKey& queue_key) {
+        return queue->key < queue_key;
+      });
+  queues_.insert(it, std::move(queue));
+  UpdateRanks();
+  ++num_empty_unfinished_queues_;
 }
 
 void OrderedMultiQueue::MarkQueueAsFinished(const QueueKey& queue_key) {
-  auto it = queues_.find(queue_key);
-  CHECK(it != queues_.end()) << "Did not find '" << queue_key << "'.";
-  auto& queue = it->second;
-  CHECK(!queue.finished);
-  queue.finished = true;
+  auto it = queues_by_key_.find(queue_key);
+  CHECK(it != queues_by_key_.end()) << "Did not find '" << queue_key << "'.";
+  Queue* const queue = it->second;
+  CHECK(!queue->finished);
+  queue->finished = true;
+  if (queue->data.empty()) {
+    --num_empty_unfinished_queues_;
+    RemoveQueue(queue);
+  }
   Dispatch();
 }
 
 void OrderedMultiQueue::Add(const QueueKey& queue_key,
                             std::unique_ptr<Data> data) {
-  auto it = queues_.find(queue_key);
-  if (it == queues_.end()) {
+  auto it = queues_by_key_.find(queue_key);
+  if (it == queues_by_key_.end()) {
     LOG_EVERY_N(WARNING, 1000)
         << "Ignored data for queue: '" << queue_key << "'";
     return;
   }
-  it->second.queue.Push(std::move(data));
+  Queue* const queue = it->second;
+  if (queue->data.empty()) {
+    if (!queue->finished) {
+      --num_empty_unfinished_queues_;
+    }
+    heap_.push_back(HeapEntry{data->GetTime(), queue});
+    std::push_heap(heap_.begin(), heap_.end(), HeapCompare);
+  }
+  queue->data.Push(std::move(data));
+  if (queue->data.size() == kMaxQueueSize + 1) {
+    ++num_oversized_queues_;
+  }
   Dispatch();
 }
 
 void OrderedMultiQueue::Flush() {
   std::vector<QueueKey> unfinished_queues;
-  for (auto& entry : queues_) {
-    if (!entry.second.finished) {
-      unfinished_queues.push_back(entry.first);
+  for (const auto& queue : queues_) {
+    if (!queue->finished) {
+      unfinished_queues.push_back(queue->key);
     }
   }
   for (auto& unfinished_queue : unfinished_queues) {
@@ -91,70 +139,62 @@ QueueKey OrderedMultiQueue::GetBlocker() const {
 
 void OrderedMultiQueue::Dispatch() {
   while (true) {
-    const Data* next_data = nullptr;
-    Queue* next_queue = nullptr;
-    QueueKey next_queue_key;
-    for (auto it = queues_.begin(); it != queues_.end();) {
-      const auto* data = it->second.queue.Peek<Data>();
-      if (data == nullptr) {
-        if (it->second.finished) {
-          queues_.erase(it++);
-          continue;
+    if (num_empty_unfinished_queues_ > 0) {
+      for (const auto& queue : queues_) {
+        if (queue->data.empty() && !queue->finished) {
+          CannotMakeProgress(queue->key);
+          return;
         }
-        CannotMakeProgress(it->first);
-        return;
-      }
-      if (next_data == nullptr || data->GetTime() < next_data->GetTime()) {
-        next_data = data;
-        next_queue = &it->second;
-        next_queue_key = it->first;
       }
-      CHECK_LE(last_dispatched_time_, next_data->GetTime())
-          << "Non-sorted data added to queue: '" << it->first << "'";
-      ++it;
+      LOG(FATAL) << "Inconsistent number of empty queues.";
     }
-    if (next_data == nullptr) {
+    if (heap_.empty()) {
       CHECK(queues_.empty());
       return;
     }
 
+    Queue* const next_queue = heap_.front().queue;
+    const common::Time next_time = heap_.front().time;
+    CHECK_LE(last_dispatched_time_, next_time)
+        << "Non-sorted data added to queue: '" << next_queue->key << "'";
+
     // If we haven't dispatched any data for this trajectory yet, fast forward
     // all queues of this trajectory until a common start time has been reached.
     const common::Time common_start_time =
-        GetCommonStartTime(next_queue_key.trajectory_id);
+        GetCommonStartTime(next_queue->key.trajectory_id);
 
-    if (next_data->GetTime() >= common_start_time) {
+    if (next_time >= common_start_time) {
       // Happy case, we are beyond the 'common_start_time' already.
-      last_dispatched_time_ = next_data->GetTime();
-      next_queue->callback(next_queue->queue.Pop());
-    } else if (next_queue->queue.Size() < 2) {
+      last_dispatched_time_ = next_time;
+      next_queue->callback(Pop(next_queue));
+    } else if (next_queue->data.size() < 2) {
       if (!next_queue->finished) {
         // We cannot decide whether to drop or dispatch this yet.
-        CannotMakeProgress(next_queue_key);
+        CannotMakeProgress(next_queue->key);
         return;
       }
-      last_dispatched_time_ = next_data->GetTime();
-      next_queue->callback(next_queue->queue.Pop());
+      last_dispatched_time_ = next_time;
+      next_queue->callback(Pop(next_queue));
     } else {
       // We take a peek at the time after next data. If it also is not beyond
       // 'common_start_time' we drop 'next_data', otherwise we just found the
       // first packet to dispatch from this queue.
-      std::unique_ptr<Data> next_data_owner = next_queue->queue.Pop();
-      if (next_queue->queue.Peek<Data>()->GetTime() > common_start_time) {
-        last_dispatched_time_ = next_data->GetTime();
+      std::unique_ptr<Data> next_data_owner = Pop(next_queue);
+      if (next_queue->data.front().GetTime() > common_start_time) {
+        last_dispatched_time_ = next_time;
         next_queue->callback(std::move(next_data_owner));
       }
     }
+    if (next_queue->finished && next_queue->data.empty()) {
+      RemoveQueue(next_queue);
+    }
   }
 }
 
 void OrderedMultiQueue::CannotMakeProgress(const QueueKey& queue_key) {
   blocker_ = queue_key;
-  for (auto& entry : queues_) {
-    if (entry.second.queue.Size() > kMaxQueueSize) {
-      LOG_EVERY_N(WARNING, 60) << "Queue waiting for data: " << queue_key;
-      return;
-    }
+  if (num_oversized_queues_ > 0) {
+    LOG_EVERY_N(WARNING, 60) << "Queue waiting for data: " << queue_key;
   }
 }
 
@@ -163,10 +203,12 @@ common::Time OrderedMultiQueue::GetCommonStartTime(const int trajectory_id) {
       trajectory_id, common::Time::min());
   common::Time& common_start_time = emplace_result.first->second;
   if (emplace_result.second) {
-    for (auto& entry : queues_) {
-      if (entry.first.trajectory_id == trajectory_id) {
-        common_start_time = std::max(
-            common_start_time, entry.second.queue.Peek<Data>()->GetTime());
+    // All queues hold data at this point, since the empty ones either block
+    // or have been removed.
+    for (const auto& queue : queues_) {
+      if (queue->key.trajectory_id == trajectory_id) {
+        common_start_time =
+            std::max(common_start_time, queue->data.front().GetTime());
       }
     }
     LOG(INFO) << "All sensor data for trajectory " << trajectory_id
@@ -175,5 +217,39 @@ common::Time OrderedMultiQueue::GetCommonStartTime(const int trajectory_id) {
   return common_start_time;
 }
 
+std::unique_ptr<Data> OrderedMultiQueue::Pop(Queue* const queue) {
+  CHECK(!heap_.empty());
+  CHECK_EQ(heap_.front().queue, queue);
+  std::pop_heap(heap_.begin(), heap_.end(), HeapCompare);
+  heap_.pop_back();
+  if (queue->data.size() == kMaxQueueSize + 1) {
+    --num_oversized_queues_;
+  }
+  std::unique_ptr<Data> data = queue->data.Pop();
+  if (!queue->data.empty()) {
+    heap_.push_back(HeapEntry{queue->data.front().GetTime(), queue});
+    std::push_heap(heap_.begin(), heap_.end(), HeapCompare);
+  } else if (!queue->finished) {
+    ++num_empty_unfinished_queues_;
+  }
+  return data;
+}
+
+void OrderedMultiQueue::RemoveQueue(Queue* const queue) {
+  CHECK(queue->finished);
+  CHECK(queue->data.empty());
+  queues_by_key_.erase(queue->key);
+  queues_.erase(queues_.begin() + queue->rank);
+  UpdateRanks();
+}
+
+void OrderedMultiQueue::UpdateRanks() {
+  // Inserting or removing a queue does not change the relative order of the
+  // other queues, so the heap stays valid.
+  for (size_t i = 0; i != queues_.size(); ++i) {
+    queues_[i]->rank = i;
+  }
+}
+
 }  // namespace sensor
 }  // namespace cartographer
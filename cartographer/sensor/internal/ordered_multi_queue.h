@@ -18,12 +18,12 @@
 #define CARTOGRAPHER_SENSOR_INTERNAL_ORDERED_MULTI_QUEUE_H_
 
 #include <functional>
-#include <map>
 #include <memory>
 #include <string>
 #include <tuple>
+#include <vector>
 
-#include "cartographer/common/internal/blocking_queue.h"
+#include "absl/container/flat_hash_map.h"
 #include "cartographer/common/port.h"
 #include "cartographer/common/time.h"
 #include "cartographer/sensor/internal/dispatchable.h"
@@ -39,12 +39,26 @@ struct QueueKey {
     return std::forward_as_tuple(trajectory_id, sensor_id) <
            std::forward_as_tuple(other.trajectory_id, other.sensor_id);
   }
+
+  bool operator==(const QueueKey& other) const {
+    return trajectory_id == other.trajectory_id &&
+           sensor_id == other.sensor_id;
+  }
+
+  template <typename H>
+  friend H AbslHashValue(H hash_state, const QueueKey& key) {
+    return H::combine(std::move(hash_state), key.trajectory_id,
+                      key.sensor_id);
+  }
 };
 
 // Maintains multiple queues of sorted sensor data and dispatches it in merge
 // sorted order. It will wait to see at least one value for each unfinished
 // queue before dispatching the next time ordered value across all queues.
 //
+// Queue keys are only looked up when data is added. Dispatching merges the
+// queues using a heap ordered by the time of their oldest data.
+//
 // This class is thread-compatible.
 class OrderedMultiQueue {
  public:
@@ -77,21 +91,67 @@ class OrderedMultiQueue {
   QueueKey GetBlocker() const;
 
  private:
+  // A FIFO backed by a ring buffer which grows as needed.
+  class DataQueue {
+   public:
+    bool empty() const { return size_ == 0; }
+    size_t size() const { return size_; }
+    const Data& front() const { return *buffer_[head_]; }
+
+    void Push(std::unique_ptr<Data> data);
+    std::unique_ptr<Data> Pop();
+
+   private:
+    // The size of 'buffer_' is 0 or a power of 2.
+    std::vector<std::unique_ptr<Data>> buffer_;
+    size_t head_ = 0;
+    size_t size_ = 0;
+  };
+
   struct Queue {
-    common::BlockingQueue<std::unique_ptr<Data>> queue;
+    QueueKey key;
+    DataQueue data;
     Callback callback;
     bool finished = false;
+    // Index of this queue in 'queues_'.
+    int rank = 0;
+  };
+
+  // Entry of the heap of non-empty queues.
+  struct HeapEntry {
+    // Time of the oldest data in 'queue'.
+    common::Time time;
+    Queue* queue;
   };
 
+  // Orders the heap such that the oldest data is at its front.
+  static bool HeapCompare(const HeapEntry& lhs, const HeapEntry& rhs) {
+    if (lhs.time != rhs.time) {
+      return lhs.time > rhs.time;
+    }
+    return lhs.queue->rank > rhs.queue->rank;
+  }
+
   void Dispatch();
   void CannotMakeProgress(const QueueKey& queue_key);
   common::Time GetCommonStartTime(int trajectory_id);
+  // Removes the oldest data of 'queue', which must be at the top of the heap.
+  std::unique_ptr<Data> Pop(Queue* queue);
+  void RemoveQueue(Queue* queue);
+  void UpdateRanks();
 
   // Used to verify that values are dispatched in sorted order.
   common::Time last_dispatched_time_ = common::Time::min();
 
-  std::map<int, common::Time> common_start_time_per_trajectory_;
-  std::map<QueueKey, Queue> queues_;
+  absl::flat_hash_map<int, common::Time> common_start_time_per_trajectory_;
+  // All queues sorted by key.
+  std::vector<std::unique_ptr<Queue>> queues_;
+  absl::flat_hash_map<QueueKey, Queue*> queues_by_key_;
+  // Heap of the non-empty queues, the queue with the oldest data is at the
+  // front. Ties are broken by queue key.
+  std::vector<HeapEntry> heap_;
+  int num_empty_unfinished_queues_ = 0;
+  int num_oversized_queues_ = 0;
   QueueKey blocker_;
 };
 
@@ -111,6 +111,22 @@ TEST_F(OrderedMultiQueueTest, CommonStartTimePerTrajectory) {
   EXPECT_EQ(values_.size(), 4);
 }
 
+TEST_F(OrderedMultiQueueTest, GetBlocker) {
+  queue_.Add(kFirst, MakeImu(0));
+  queue_.Add(kThird, MakeImu(0));
+  EXPECT_EQ(kSecond.sensor_id, queue_.GetBlocker().sensor_id);
+  EXPECT_EQ(kSecond.trajectory_id, queue_.GetBlocker().trajectory_id);
+  queue_.Add(kSecond, MakeImu(1));
+  queue_.Add(kThird, MakeImu(2));
+  EXPECT_TRUE(values_.empty());
+  EXPECT_TRUE(queue_.GetBlocker() == kFirst);
+  queue_.MarkQueueAsFinished(kFirst);
+  EXPECT_EQ(3, values_.size());
+  EXPECT_TRUE(queue_.GetBlocker() == kSecond);
+  queue_.Flush();
+  EXPECT_EQ(4, values_.size());
+}
+
 }  // namespace
 }  // namespace sensor
 }  // namespace cartographer
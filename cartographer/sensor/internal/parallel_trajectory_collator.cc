@@ -0,0 +1,133 @@
+/*
+ * Copyright 2018 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/sensor/internal/parallel_trajectory_collator.h"
+
+#include <map>
+#include <string>
+
+#include "absl/memory/memory.h"
+#include "absl/strings/str_cat.h"
+
+namespace cartographer {
+namespace sensor {
+
+metrics::Family<metrics::Gauge>*
+    ParallelTrajectoryCollator::queue_length_metrics_family_ =
+        metrics::Family<metrics::Gauge>::Null();
+metrics::Family<metrics::Counter>*
+    ParallelTrajectoryCollator::blocked_metrics_family_ =
+        metrics::Family<metrics::Counter>::Null();
+
+ParallelTrajectoryCollator::ParallelTrajectoryCollator(const size_t queue_size)
+    : queue_size_(queue_size) {}
+
+ParallelTrajectoryCollator::~ParallelTrajectoryCollator() {
+  // Like the other collators, this may be destroyed while trajectories are
+  // unfinished. Their threads are stopped after dispatching the data which was
+  // already added.
+  Flush();
+}
+
+void ParallelTrajectoryCollator::AddTrajectory(
+    const int trajectory_id,
+    const absl::flat_hash_set<std::string>& expected_sensor_ids,
+    const Callback& callback) {
+  CHECK_EQ(trajectories_.count(trajectory_id), 0);
+  auto trajectory = absl::make_unique<Trajectory>(queue_size_);
+  trajectory->trajectory_id = trajectory_id;
+  for (const auto& sensor_id : expected_sensor_ids) {
+    const auto queue_key = QueueKey{trajectory_id, sensor_id};
+    trajectory->queue.AddQueue(
+        queue_key, [callback, sensor_id](std::unique_ptr<Data> data) {
+          callback(sensor_id, std::move(data));
+        });
+    trajectory->queue_keys.push_back(queue_key);
+  }
+  const std::map<std::string, std::string> labels = {
+      {"trajectory_id", absl::StrCat(trajectory_id)}};
+  trajectory->queue_length_metric = queue_length_metrics_family_->Add(labels);
+  trajectory->blocked_metric = blocked_metrics_family_->Add(labels);
+  trajectory->thread = std::thread(&ParallelTrajectoryCollator::Run,
+                                   trajectory.get());
+  trajectories_[trajectory_id] = std::move(trajectory);
+}
+
+void ParallelTrajectoryCollator::FinishTrajectory(const int trajectory_id) {
+  Trajectory* const trajectory = trajectories_.at(trajectory_id).get();
+  CHECK(!trajectory->finished);
+  trajectory->finished = true;
+  trajectory->incoming_data.Push(nullptr);
+  trajectory->thread.join();
+}
+
+void ParallelTrajectoryCollator::AddSensorData(const int trajectory_id,
+                                               std::unique_ptr<Data> data) {
+  Trajectory* const trajectory = trajectories_.at(trajectory_id).get();
+  if (trajectory->finished) {
+    LOG_EVERY_N(WARNING, 1000)
+        << "Ignored data for finished trajectory " << trajectory_id;
+    return;
+  }
+  if (queue_size_ != common::BlockingQueue<std::unique_ptr<Data>>::
+                         kInfiniteQueueSize &&
+      trajectory->incoming_data.Size() >= queue_size_) {
+    trajectory->blocked_metric->Increment();
+  }
+  trajectory->incoming_data.Push(std::move(data));
+  trajectory->queue_length_metric->Set(trajectory->incoming_data.Size());
+}
+
+void ParallelTrajectoryCollator::Flush() {
+  for (auto& entry : trajectories_) {
+    if (!entry.second->finished) {
+      FinishTrajectory(entry.first);
+    }
+  }
+}
+
+absl::optional<int> ParallelTrajectoryCollator::GetBlockingTrajectoryId()
+    const {
+  return absl::optional<int>();
+}
+
+void ParallelTrajectoryCollator::RegisterMetrics(
+    metrics::FamilyFactory* family_factory) {
+  queue_length_metrics_family_ = family_factory->NewGaugeFamily(
+      "collator_queue_length",
+      "Sensor data waiting to be collated per trajectory");
+  blocked_metrics_family_ = family_factory->NewCounterFamily(
+      "collator_blocked_total",
+      "Sensor data which had to wait for room in the queue of its trajectory");
+}
+
+void ParallelTrajectoryCollator::Run(Trajectory* const trajectory) {
+  while (true) {
+    std::unique_ptr<Data> data = trajectory->incoming_data.Pop();
+    trajectory->queue_length_metric->Set(trajectory->incoming_data.Size());
+    if (data == nullptr) {
+      break;
+    }
+    QueueKey queue_key{trajectory->trajectory_id, data->GetSensorId()};
+    trajectory->queue.Add(std::move(queue_key), std::move(data));
+  }
+  for (const auto& queue_key : trajectory->queue_keys) {
+    trajectory->queue.MarkQueueAsFinished(queue_key);
+  }
+}
+
+}  // namespace sensor
+}  // namespace cartographer
@@ -0,0 +1,102 @@
+/*
+ * Copyright 2018 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_SENSOR_INTERNAL_PARALLEL_TRAJECTORY_COLLATOR_H_
+#define CARTOGRAPHER_SENSOR_INTERNAL_PARALLEL_TRAJECTORY_COLLATOR_H_
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "cartographer/common/internal/blocking_queue.h"
+#include "cartographer/metrics/counter.h"
+#include "cartographer/metrics/family_factory.h"
+#include "cartographer/metrics/gauge.h"
+#include "cartographer/sensor/collator_interface.h"
+#include "cartographer/sensor/internal/ordered_multi_queue.h"
+
+namespace cartographer {
+namespace sensor {
+
+// Like 'TrajectoryCollator', but each trajectory has its own queue of incoming
+// sensor data and its own thread which collates the data and calls the
+// callback of the trajectory. Hence, the local SLAM of independent
+// trajectories runs in parallel and a slow trajectory does not delay the
+// others.
+//
+// AddSensorData() blocks while 'queue_size' data are waiting for the
+// trajectory, 0 meaning unbounded. The length of each queue and how often
+// adding data had to wait are exported as metrics.
+//
+// The methods of this class must be called from a single thread. Callbacks
+// are called from the thread of their trajectory, until the trajectory is
+// finished or the collator is destroyed.
+class ParallelTrajectoryCollator : public CollatorInterface {
+ public:
+  explicit ParallelTrajectoryCollator(size_t queue_size);
+  ~ParallelTrajectoryCollator() override;
+
+  ParallelTrajectoryCollator(const ParallelTrajectoryCollator&) = delete;
+  ParallelTrajectoryCollator& operator=(const ParallelTrajectoryCollator&) =
+      delete;
+
+  void AddTrajectory(
+      int trajectory_id,
+      const absl::flat_hash_set<std::string>& expected_sensor_ids,
+      const Callback& callback) override;
+
+  // Blocks until all data of the trajectory has been dispatched.
+  void FinishTrajectory(int trajectory_id) override;
+
+  void AddSensorData(int trajectory_id, std::unique_ptr<Data> data) override;
+
+  void Flush() override;
+
+  absl::optional<int> GetBlockingTrajectoryId() const override;
+
+  static void RegisterMetrics(metrics::FamilyFactory* family_factory);
+
+ private:
+  struct Trajectory {
+    explicit Trajectory(size_t queue_size) : incoming_data(queue_size) {}
+
+    int trajectory_id;
+    // Data waiting to be collated. 'nullptr' tells the thread to finish.
+    common::BlockingQueue<std::unique_ptr<Data>> incoming_data;
+    // Only used by 'thread'.
+    OrderedMultiQueue queue;
+    std::vector<QueueKey> queue_keys;
+    std::thread thread;
+    bool finished = false;
+    metrics::Gauge* queue_length_metric;
+    metrics::Counter* blocked_metric;
+  };
+
+  // Collates the data of 'trajectory' until it is finished.
+  static void Run(Trajectory* trajectory);
+
+  static metrics::Family<metrics::Gauge>* queue_length_metrics_family_;
+  static metrics::Family<metrics::Counter>* blocked_metrics_family_;
+
+  const size_t queue_size_;
+  absl::flat_hash_map<int, std::unique_ptr<Trajectory>> trajectories_;
+};
+
+}  // namespace sensor
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_SENSOR_INTERNAL_PARALLEL_TRAJECTORY_COLLATOR_H_
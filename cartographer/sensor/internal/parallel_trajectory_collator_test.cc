@@ -0,0 +1,140 @@
+/*
+ * Copyright 2018 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/sensor/internal/parallel_trajectory_collator.h"
+
+#include <array>
+#include <memory>
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
+#include "absl/synchronization/notification.h"
+#include "cartographer/sensor/internal/test_helpers.h"
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace sensor {
+namespace {
+
+using testing::CollatorInput;
+using testing::CollatorOutput;
+
+TEST(ParallelTrajectoryCollatorTest, SlowTrajectoryDoesNotBlockOthers) {
+  const int kSlowTrajectoryId = 2;
+  const int kFastTrajectoryId = 5;
+  const std::array<std::string, 2> kSensorId = {{"my_points", "some_imu"}};
+  const absl::flat_hash_set<std::string> expected_sensor_ids(kSensorId.begin(),
+                                                             kSensorId.end());
+  absl::Notification slow_trajectory_may_continue;
+  absl::Mutex mutex;
+  std::vector<CollatorOutput> received_slow;
+  std::vector<CollatorOutput> received_fast;
+
+  ParallelTrajectoryCollator collator(0 /* queue_size */);
+  collator.AddTrajectory(
+      kSlowTrajectoryId, expected_sensor_ids,
+      [&](const std::string& sensor_id, std::unique_ptr<Data> data) {
+        slow_trajectory_may_continue.WaitForNotification();
+        absl::MutexLock lock(&mutex);
+        received_slow.push_back(CollatorOutput(
+            kSlowTrajectoryId, data->GetSensorId(), data->GetTime()));
+      });
+  collator.AddTrajectory(
+      kFastTrajectoryId, expected_sensor_ids,
+      [&](const std::string& sensor_id, std::unique_ptr<Data> data) {
+        absl::MutexLock lock(&mutex);
+        received_fast.push_back(CollatorOutput(
+            kFastTrajectoryId, data->GetSensorId(), data->GetTime()));
+      });
+
+  std::vector<CollatorInput> input_data;
+  for (const int trajectory_id : {kSlowTrajectoryId, kFastTrajectoryId}) {
+    for (int time = 0; time < 100; time += 10) {
+      input_data.push_back(CollatorInput::CreateTimedPointCloudData(
+          trajectory_id, kSensorId[0], time));
+      input_data.push_back(
+          CollatorInput::CreateImuData(trajectory_id, kSensorId[1], time + 5));
+    }
+  }
+  for (auto& input : input_data) {
+    input.MoveToCollator(&collator);
+  }
+
+  // The fast trajectory makes progress while the slow one is stuck in its
+  // callback.
+  {
+    absl::MutexLock lock(&mutex);
+    mutex.Await(absl::Condition(
+        +[](std::vector<CollatorOutput>* received) {
+          return received->size() >= 19;
+        },
+        &received_fast));
+    EXPECT_TRUE(received_slow.empty());
+  }
+  slow_trajectory_may_continue.Notify();
+  collator.FinishTrajectory(kSlowTrajectoryId);
+  collator.FinishTrajectory(kFastTrajectoryId);
+  EXPECT_FALSE(collator.GetBlockingTrajectoryId().has_value());
+
+  absl::MutexLock lock(&mutex);
+  ASSERT_EQ(20, received_slow.size());
+  ASSERT_EQ(20, received_fast.size());
+  for (size_t i = 0; i < input_data.size() / 2; ++i) {
+    EXPECT_EQ(input_data[i].expected_output, received_slow[i]);
+    EXPECT_EQ(input_data[i + input_data.size() / 2].expected_output,
+              received_fast[i]);
+  }
+}
+
+TEST(ParallelTrajectoryCollatorTest, DestroysWithUnfinishedTrajectory) {
+  const int kTrajectoryId = 3;
+  const std::array<std::string, 2> kSensorId = {{"my_points", "some_imu"}};
+  const absl::flat_hash_set<std::string> expected_sensor_ids(kSensorId.begin(),
+                                                             kSensorId.end());
+  absl::Mutex mutex;
+  std::vector<CollatorOutput> received;
+  std::vector<CollatorInput> input_data;
+  {
+    ParallelTrajectoryCollator collator(0 /* queue_size */);
+    collator.AddTrajectory(
+        kTrajectoryId, expected_sensor_ids,
+        [&](const std::string& sensor_id, std::unique_ptr<Data> data) {
+          absl::MutexLock lock(&mutex);
+          received.push_back(CollatorOutput(kTrajectoryId, data->GetSensorId(),
+                                            data->GetTime()));
+        });
+    for (int time = 0; time < 100; time += 10) {
+      input_data.push_back(CollatorInput::CreateTimedPointCloudData(
+          kTrajectoryId, kSensorId[0], time));
+      input_data.push_back(
+          CollatorInput::CreateImuData(kTrajectoryId, kSensorId[1], time + 5));
+    }
+    for (auto& input : input_data) {
+      input.MoveToCollator(&collator);
+    }
+  }
+
+  // The destructor has stopped the thread after it dispatched all data.
+  absl::MutexLock lock(&mutex);
+  ASSERT_EQ(input_data.size(), received.size());
+  for (size_t i = 0; i < input_data.size(); ++i) {
+    EXPECT_EQ(input_data[i].expected_output, received[i]);
+  }
+}
+
+}  // namespace
+}  // namespace sensor
+}  // namespace cartographer
@@ -16,13 +16,14 @@
 
 #include "cartographer/sensor/internal/voxel_filter.h"
 
+#include <algorithm>
+#include <bitset>
 #include <cmath>
+#include <limits>
+#include <numeric>
 #include <random>
 #include <utility>
 
-#include "absl/container/flat_hash_map.h"
-#include "cartographer/common/math.h"
-
 namespace cartographer {
 namespace sensor {
 
@@ -35,35 +36,36 @@ PointCloud FilterByMaxRange(const PointCloud& point_cloud,
   });
 }
 
-PointCloud AdaptivelyVoxelFiltered(
-    const proto::AdaptiveVoxelFilterOptions& options,
-    const PointCloud& point_cloud) {
-  if (point_cloud.size() <= options.min_num_points()) {
-    // 'point_cloud' is already sparse enough.
-    return point_cloud;
-  }
-  PointCloud result = VoxelFilter(point_cloud, options.max_length());
-  if (result.size() >= options.min_num_points()) {
+// Returns the voxel edge length to use for 'voxel_filter' given 'options'.
+float FindAdaptiveVoxelLength(const proto::AdaptiveVoxelFilterOptions& options,
+                              MultiResolutionVoxelFilter* voxel_filter) {
+  const float max_range = options.max_range();
+  const auto is_dense_enough = [&options, max_range,
+                                voxel_filter](const float length) {
+    return voxel_filter->CountVoxels(length, max_range) >=
+           options.min_num_points();
+  };
+  if (is_dense_enough(options.max_length())) {
     // Filtering with 'max_length' resulted in a sufficiently dense point cloud.
-    return result;
+    return options.max_length();
   }
   // Search for a 'low_length' that is known to result in a sufficiently
-  // dense point cloud. We give up and use the full 'point_cloud' if reducing
-  // the edge length by a factor of 1e-2 is not enough.
+  // dense point cloud. We give up and use the smallest length tried if
+  // reducing the edge length by a factor of 1e-2 is not enough.
+  float result = options.max_length();
   for (float high_length = options.max_length();
        high_length > 1e-2f * options.max_length(); high_length /= 2.f) {
     float low_length = high_length / 2.f;
-    result = VoxelFilter(point_cloud, low_length);
-    if (result.size() >= options.min_num_points()) {
+    result = low_length;
+    if (is_dense_enough(low_length)) {
       // Binary search to find the right amount of filtering. 'low_length' gave
-      // a sufficiently dense 'result', 'high_length' did not. We stop when the
+      // a sufficiently dense result, 'high_length' did not. We stop when the
       // edge length is at most 10% off.
       while ((high_length - low_length) / low_length > 1e-1f) {
         const float mid_length = (low_length + high_length) / 2.f;
-        const PointCloud candidate = VoxelFilter(point_cloud, mid_length);
-        if (candidate.size() >= options.min_num_points()) {
+        if (is_dense_enough(mid_length)) {
           low_length = mid_length;
-          result = candidate;
+          result = mid_length;
         } else {
           high_length = mid_length;
         }
@@ -74,62 +76,304 @@ PointCloud AdaptivelyVoxelFiltered(
   return result;
 }
 
-using VoxelKeyType = uint64_t;
-
-VoxelKeyType GetVoxelCellIndex(const Eigen::Vector3f& point,
-                               const float resolution) {
-  const Eigen::Array3f index = point.array() / resolution;
-  const uint64_t x = common::RoundToInt(index.x());
-  const uint64_t y = common::RoundToInt(index.y());
-  const uint64_t z = common::RoundToInt(index.z());
-  return (x << 42) + (y << 21) + z;
+int BitWidth(uint64 value) {
+  int width = 0;
+  for (; value != 0; value >>= 1) {
+    ++width;
+  }
+  return width;
 }
 
-template <class T, class PointFunction>
-std::vector<bool> RandomizedVoxelFilterIndices(
-    const std::vector<T>& point_cloud, const float resolution,
-    PointFunction&& point_function) {
-  // According to https://en.wikipedia.org/wiki/Reservoir_sampling
-  std::minstd_rand0 generator;
-  absl::flat_hash_map<VoxelKeyType, std::pair<int, int>>
-      voxel_count_and_point_index;
-  for (size_t i = 0; i < point_cloud.size(); i++) {
-    auto& voxel = voxel_count_and_point_index[GetVoxelCellIndex(
-        point_function(point_cloud[i]), resolution)];
-    voxel.first++;
-    if (voxel.first == 1) {
-      voxel.second = i;
-    } else {
-      std::uniform_int_distribution<> distribution(1, voxel.first);
-      if (distribution(generator) == voxel.first) {
-        voxel.second = i;
-      }
+template <class T>
+std::vector<T> SelectedPoints(const std::vector<T>& points,
+                              const std::vector<bool>& selected) {
+  std::vector<T> results;
+  for (size_t i = 0; i < points.size(); i++) {
+    if (selected[i]) {
+      results.push_back(points[i]);
     }
   }
-  std::vector<bool> points_used(point_cloud.size(), false);
-  for (const auto& voxel_and_index : voxel_count_and_point_index) {
-    points_used[voxel_and_index.second.second] = true;
+  return results;
+}
+
+PointCloud SelectedPoints(const PointCloud& point_cloud,
+                          const std::vector<bool>& selected) {
+  std::vector<RangefinderPoint> filtered_points =
+      SelectedPoints(point_cloud.points(), selected);
+  std::vector<float> filtered_intensities;
+  CHECK_LE(point_cloud.intensities().size(), point_cloud.points().size());
+  for (size_t i = 0; i < point_cloud.intensities().size(); i++) {
+    if (selected[i]) {
+      filtered_intensities.push_back(point_cloud.intensities()[i]);
+    }
   }
-  return points_used;
+  return PointCloud(std::move(filtered_points),
+                    std::move(filtered_intensities),
+                    point_cloud.attributes().Select(selected));
 }
 
 template <class T, class PointFunction>
 std::vector<T> RandomizedVoxelFilter(const std::vector<T>& point_cloud,
                                      const float resolution,
                                      PointFunction&& point_function) {
-  const std::vector<bool> points_used =
-      RandomizedVoxelFilterIndices(point_cloud, resolution, point_function);
+  MultiResolutionVoxelFilter voxel_filter(point_cloud, point_function);
+  return SelectedPoints(
+      point_cloud, voxel_filter.SelectPoints(
+                       resolution, std::numeric_limits<float>::infinity()));
+}
 
-  std::vector<T> results;
-  for (size_t i = 0; i < point_cloud.size(); i++) {
-    if (points_used[i]) {
-      results.push_back(point_cloud[i]);
+}  // namespace
+
+MultiResolutionVoxelFilter::MultiResolutionVoxelFilter(
+    const PointCloud& point_cloud)
+    : MultiResolutionVoxelFilter(
+          point_cloud.points(),
+          [](const RangefinderPoint& point) { return point.position; }) {}
+
+size_t MultiResolutionVoxelFilter::CountPointsInRange(const float max_range) {
+  SelectPointsInRange(max_range);
+  return num_points_in_range_;
+}
+
+size_t MultiResolutionVoxelFilter::CountVoxels(const float resolution,
+                                               const float max_range) {
+  SelectPointsInRange(max_range);
+  ComputeVoxelKeys(resolution);
+  if (!keys_sorted_ && num_key_bits_ < 64 &&
+      (uint64{1} << num_key_bits_) <=
+          kMaxBitsPerPointForCounting * std::max<uint64>(keys_.size(), 1024)) {
+    // Few keys are possible, e.g. for the coarse resolutions of the adaptive
+    // voxel filter, so mark them in a bitmap instead of sorting.
+    occupied_voxels_.assign(((uint64{1} << num_key_bits_) + 63) / 64, 0);
+    for (const uint64 key : keys_) {
+      occupied_voxels_[key >> 6] |= uint64{1} << (key & 63);
     }
+    size_t num_voxels = 0;
+    for (const uint64 word : occupied_voxels_) {
+      num_voxels += std::bitset<64>(word).count();
+    }
+    return num_voxels;
   }
-  return results;
+  SortVoxelKeys();
+  size_t num_voxels = keys_.empty() ? 0 : 1;
+  for (size_t i = 1; i < keys_.size(); ++i) {
+    if (keys_[i] != keys_[i - 1]) {
+      ++num_voxels;
+    }
+  }
+  return num_voxels;
 }
 
-}  // namespace
+const std::vector<bool>& MultiResolutionVoxelFilter::SelectPoints(
+    const float resolution, const float max_range) {
+  SelectPointsInRange(max_range);
+  ComputeVoxelKeys(resolution);
+  selected_.assign(num_points(), false);
+  const auto select = [this](const uint32 index_in_range) {
+    selected_[indices_in_range_.empty() ? index_in_range
+                                        : indices_in_range_[index_in_range]] =
+        true;
+  };
+  std::minstd_rand0 generator;
+  if (!keys_sorted_ && num_key_bits_ < 64 &&
+      (uint64{1} << num_key_bits_) <= keys_.size()) {
+    // There are fewer possible keys than points, so instead of sorting, count
+    // the points of each voxel, draw which one to select, and select it in a
+    // second pass.
+    voxel_ranks_.assign(uint64{1} << num_key_bits_, 0);
+    for (const uint64 key : keys_) {
+      ++voxel_ranks_[key];
+    }
+    for (uint32& rank : voxel_ranks_) {
+      if (rank > 1) {
+        std::uniform_int_distribution<uint32> distribution(0, rank - 1);
+        rank = distribution(generator);
+      } else {
+        rank = 0;
+      }
+    }
+    for (size_t i = 0; i < keys_.size(); ++i) {
+      if (voxel_ranks_[keys_[i]]-- == 0) {
+        select(i);
+      }
+    }
+    return selected_;
+  }
+  SortVoxelKeys();
+  // Since the sort is stable, the points of each voxel are in their original
+  // order, so the selection only depends on the points and 'resolution'.
+  for (size_t begin = 0, end = 0; begin < keys_.size(); begin = end) {
+    for (end = begin + 1; end < keys_.size() && keys_[end] == keys_[begin];
+         ++end) {
+    }
+    size_t chosen = begin;
+    if (end - begin > 1) {
+      std::uniform_int_distribution<size_t> distribution(begin, end - 1);
+      chosen = distribution(generator);
+    }
+    select(order_[chosen]);
+  }
+  return selected_;
+}
+
+void MultiResolutionVoxelFilter::SelectPointsInRange(const float max_range) {
+  if (max_range == max_range_) {
+    return;
+  }
+  max_range_ = max_range;
+  keys_resolution_ = std::numeric_limits<float>::quiet_NaN();
+  CHECK_LE(num_points(), std::numeric_limits<uint32>::max());
+  indices_in_range_.clear();
+  if (max_range == std::numeric_limits<float>::infinity()) {
+    positions_in_range_ = {{xs_.data(), ys_.data(), zs_.data()}};
+    num_points_in_range_ = num_points();
+  } else {
+    if (ranges_.empty()) {
+      // Same as Eigen::Vector3f::norm(), but vectorizable.
+      ranges_.resize(num_points());
+      for (size_t i = 0; i < num_points(); ++i) {
+        ranges_[i] = std::sqrt(xs_[i] * xs_[i] + ys_[i] * ys_[i] +
+                               zs_[i] * zs_[i]);
+      }
+    }
+    indices_in_range_.resize(num_points());
+    for (std::vector<float>& values : values_in_range_) {
+      values.resize(num_points());
+    }
+    size_t num_points_in_range = 0;
+    for (size_t i = 0; i < num_points(); ++i) {
+      indices_in_range_[num_points_in_range] = i;
+      values_in_range_[0][num_points_in_range] = xs_[i];
+      values_in_range_[1][num_points_in_range] = ys_[i];
+      values_in_range_[2][num_points_in_range] = zs_[i];
+      num_points_in_range += ranges_[i] <= max_range;
+    }
+    indices_in_range_.resize(num_points_in_range);
+    for (int axis = 0; axis != 3; ++axis) {
+      positions_in_range_[axis] = values_in_range_[axis].data();
+    }
+    num_points_in_range_ = num_points_in_range;
+  }
+  if (num_points_in_range_ == 0) {
+    return;
+  }
+  for (int axis = 0; axis != 3; ++axis) {
+    const float* const values = positions_in_range_[axis];
+    const auto min_max =
+        std::minmax_element(values, values + num_points_in_range_);
+    min_position_in_range_[axis] = *min_max.first;
+    max_position_in_range_[axis] = *min_max.second;
+  }
+}
+
+void MultiResolutionVoxelFilter::ComputeVoxelKeys(const float resolution) {
+  if (resolution == keys_resolution_) {
+    return;
+  }
+  keys_resolution_ = resolution;
+  keys_sorted_ = false;
+  keys_.resize(num_points_in_range_);
+  num_key_bits_ = 0;
+  if (num_points_in_range_ == 0) {
+    return;
+  }
+  // Rounding is monotonic, so the cell indices are bounded by those of the
+  // minimum and maximum positions.
+  std::array<int32, 3> min_cell_index;
+  std::array<int, 3> num_bits;
+  for (int axis = 0; axis != 3; ++axis) {
+    min_cell_index[axis] =
+        common::FastRoundToInt32(min_position_in_range_[axis] / resolution);
+    const int32 max_cell_index =
+        common::FastRoundToInt32(max_position_in_range_[axis] / resolution);
+    num_bits[axis] = BitWidth(static_cast<uint64>(
+        static_cast<int64>(max_cell_index) - min_cell_index[axis]));
+  }
+
+  // Pack the cell indices relative to their minimum if they fit, which makes
+  // the keys short so that the radix sort needs few passes.
+  const int total_num_bits = num_bits[0] + num_bits[1] + num_bits[2];
+  const float* const xs = positions_in_range_[0];
+  const float* const ys = positions_in_range_[1];
+  const float* const zs = positions_in_range_[2];
+  uint64* const keys = keys_.data();
+  if (total_num_bits < 64) {
+    const uint32 min_x = min_cell_index[0];
+    const uint32 min_y = min_cell_index[1];
+    const uint32 min_z = min_cell_index[2];
+    const int y_shift = num_bits[2];
+    const int x_shift = num_bits[1] + num_bits[2];
+    for (size_t i = 0; i < num_points_in_range_; ++i) {
+      const uint32 x = common::FastRoundToInt32(xs[i] / resolution);
+      const uint32 y = common::FastRoundToInt32(ys[i] / resolution);
+      const uint32 z = common::FastRoundToInt32(zs[i] / resolution);
+      keys[i] = (uint64{x - min_x} << x_shift) |
+                (uint64{y - min_y} << y_shift) | uint64{z - min_z};
+    }
+    num_key_bits_ = total_num_bits;
+    return;
+  }
+  for (size_t i = 0; i < num_points_in_range_; ++i) {
+    const int32 x = common::FastRoundToInt32(xs[i] / resolution);
+    const int32 y = common::FastRoundToInt32(ys[i] / resolution);
+    const int32 z = common::FastRoundToInt32(zs[i] / resolution);
+    keys[i] = (static_cast<uint64>(x) << 42) + (static_cast<uint64>(y) << 21) +
+              static_cast<uint64>(z);
+  }
+  num_key_bits_ = 64;
+}
+
+void MultiResolutionVoxelFilter::SortVoxelKeys() {
+  if (keys_sorted_) {
+    return;
+  }
+  keys_sorted_ = true;
+  const size_t num_points_in_range = keys_.size();
+  order_.resize(num_points_in_range);
+  if (num_points_in_range == 0) {
+    return;
+  }
+
+  // Least significant digit radix sort, which is stable.
+  constexpr int kDigitBits = kRadixSortDigitBits;
+  constexpr int kNumBuckets = 1 << kDigitBits;
+  const int num_digits = (num_key_bits_ + kDigitBits - 1) / kDigitBits;
+  std::vector<std::array<uint32, kNumBuckets>>& histograms = histograms_;
+  histograms.resize(num_digits);
+  for (std::array<uint32, kNumBuckets>& histogram : histograms) {
+    histogram.fill(0);
+  }
+  for (const uint64 key : keys_) {
+    for (int digit = 0; digit != num_digits; ++digit) {
+      ++histograms[digit][(key >> (kDigitBits * digit)) & (kNumBuckets - 1)];
+    }
+  }
+  std::iota(order_.begin(), order_.end(), 0);
+  keys_buffer_.resize(num_points_in_range);
+  order_buffer_.resize(num_points_in_range);
+  for (int digit = 0; digit != num_digits; ++digit) {
+    const int shift = kDigitBits * digit;
+    std::array<uint32, kNumBuckets>& offsets = histograms[digit];
+    if (offsets[(keys_.front() >> shift) & (kNumBuckets - 1)] ==
+        num_points_in_range) {
+      // All keys have the same digit.
+      continue;
+    }
+    uint32 offset = 0;
+    for (uint32& count : offsets) {
+      const uint32 bucket_size = count;
+      count = offset;
+      offset += bucket_size;
+    }
+    for (size_t i = 0; i < num_points_in_range; ++i) {
+      const uint32 target = offsets[(keys_[i] >> shift) & (kNumBuckets - 1)]++;
+      keys_buffer_[target] = keys_[i];
+      order_buffer_[target] = order_[i];
+    }
+    keys_.swap(keys_buffer_);
+    order_.swap(order_buffer_);
+  }
+}
 
 std::vector<RangefinderPoint> VoxelFilter(
     const std::vector<RangefinderPoint>& points, const float resolution) {
@@ -139,25 +383,10 @@ std::vector<RangefinderPoint> VoxelFilter(
 }
 
 PointCloud VoxelFilter(const PointCloud& point_cloud, const float resolution) {
-  const std::vector<bool> points_used = RandomizedVoxelFilterIndices(
-      point_cloud.points(), resolution,
-      [](const RangefinderPoint& point) { return point.position; });
-
-  std::vector<RangefinderPoint> filtered_points;
-  for (size_t i = 0; i < point_cloud.size(); i++) {
-    if (points_used[i]) {
-      filtered_points.push_back(point_cloud[i]);
-    }
-  }
-  std::vector<float> filtered_intensities;
-  CHECK_LE(point_cloud.intensities().size(), point_cloud.points().size());
-  for (size_t i = 0; i < point_cloud.intensities().size(); i++) {
-    if (points_used[i]) {
-      filtered_intensities.push_back(point_cloud.intensities()[i]);
-    }
-  }
-  return PointCloud(std::move(filtered_points),
-                    std::move(filtered_intensities));
+  MultiResolutionVoxelFilter voxel_filter(point_cloud);
+  return SelectedPoints(
+      point_cloud, voxel_filter.SelectPoints(
+                       resolution, std::numeric_limits<float>::infinity()));
 }
 
 TimedPointCloud VoxelFilter(const TimedPointCloud& timed_point_cloud,
@@ -192,8 +421,24 @@ proto::AdaptiveVoxelFilterOptions CreateAdaptiveVoxelFilterOptions(
 PointCloud AdaptiveVoxelFilter(
     const PointCloud& point_cloud,
     const proto::AdaptiveVoxelFilterOptions& options) {
-  return AdaptivelyVoxelFiltered(
-      options, FilterByMaxRange(point_cloud, options.max_range()));
+  MultiResolutionVoxelFilter voxel_filter(point_cloud);
+  return AdaptiveVoxelFilter(point_cloud, options, &voxel_filter);
+}
+
+PointCloud AdaptiveVoxelFilter(
+    const PointCloud& point_cloud,
+    const proto::AdaptiveVoxelFilterOptions& options,
+    MultiResolutionVoxelFilter* const voxel_filter) {
+  CHECK_EQ(voxel_filter->num_points(), point_cloud.size());
+  if (voxel_filter->CountPointsInRange(options.max_range()) <=
+      options.min_num_points()) {
+    // 'point_cloud' is already sparse enough.
+    return FilterByMaxRange(point_cloud, options.max_range());
+  }
+  return SelectedPoints(
+      point_cloud,
+      voxel_filter->SelectPoints(FindAdaptiveVoxelLength(options, voxel_filter),
+                                 options.max_range()));
 }
 
 }  // namespace sensor
@@ -17,7 +17,10 @@
 #ifndef CARTOGRAPHER_SENSOR_INTERNAL_VOXEL_FILTER_H_
 #define CARTOGRAPHER_SENSOR_INTERNAL_VOXEL_FILTER_H_
 
+#include <array>
 #include <bitset>
+#include <limits>
+#include <vector>
 
 #include "cartographer/common/lua_parameter_dictionary.h"
 #include "cartographer/sensor/point_cloud.h"
@@ -37,6 +40,96 @@ std::vector<sensor::TimedPointCloudOriginData::RangeMeasurement> VoxelFilter(
         range_measurements,
     const float resolution);
 
+// Voxel filters the points of one point cloud at arbitrary resolutions.
+//
+// Instead of hashing, the voxel keys of all points are quantized in a
+// vectorizable loop and radix sorted, so that the points of a voxel are
+// adjacent. Keys are packed relative to the bounding box of the points, so
+// coarse resolutions are handled with direct-addressed tables instead. The
+// positions are copied once and the keys and buffers are reused between
+// queries, which makes the repeated queries of the adaptive voxel filter, and
+// filtering the same points with several options, cheap.
+class MultiResolutionVoxelFilter {
+ public:
+  template <class T, class PositionFunction>
+  MultiResolutionVoxelFilter(const std::vector<T>& points,
+                             PositionFunction&& position_function) {
+    xs_.reserve(points.size());
+    ys_.reserve(points.size());
+    zs_.reserve(points.size());
+    for (const T& point : points) {
+      const Eigen::Vector3f& position = position_function(point);
+      xs_.push_back(position.x());
+      ys_.push_back(position.y());
+      zs_.push_back(position.z());
+    }
+  }
+  explicit MultiResolutionVoxelFilter(const PointCloud& point_cloud);
+
+  MultiResolutionVoxelFilter(const MultiResolutionVoxelFilter&) = delete;
+  MultiResolutionVoxelFilter& operator=(const MultiResolutionVoxelFilter&) =
+      delete;
+
+  size_t num_points() const { return xs_.size(); }
+
+  // Returns the number of points at most 'max_range' from the origin.
+  size_t CountPointsInRange(float max_range);
+
+  // Returns the number of voxels with edge length 'resolution' containing at
+  // least one point at most 'max_range' from the origin.
+  size_t CountVoxels(float resolution, float max_range);
+
+  // Randomly selects one point at most 'max_range' from the origin in each
+  // voxel with edge length 'resolution'. The returned flags are indexed like
+  // the points and remain valid until the next call.
+  const std::vector<bool>& SelectPoints(float resolution, float max_range);
+
+ private:
+  // Digits of 11 bits keep the radix sort histograms in the L1 cache.
+  static constexpr int kRadixSortDigitBits = 11;
+  // Voxels are counted with a bitmap instead of sorting if it has at most
+  // this many bits per point.
+  static constexpr int kMaxBitsPerPointForCounting = 64;
+
+  // Restricts the following queries to the points within 'max_range'.
+  void SelectPointsInRange(float max_range);
+  // Computes the voxel keys of the points in range, unless already done.
+  void ComputeVoxelKeys(float resolution);
+  // Sorts the voxel keys, unless already done.
+  void SortVoxelKeys();
+
+  std::vector<float> xs_;
+  std::vector<float> ys_;
+  std::vector<float> zs_;
+  std::vector<float> ranges_;
+
+  // Points within 'max_range_' of the origin. If all points are in range,
+  // 'indices_in_range_' is empty and the positions are not copied.
+  float max_range_ = std::numeric_limits<float>::quiet_NaN();
+  size_t num_points_in_range_ = 0;
+  std::vector<uint32> indices_in_range_;
+  std::array<std::vector<float>, 3> values_in_range_;
+  std::array<const float*, 3> positions_in_range_;
+  Eigen::Array3f min_position_in_range_;
+  Eigen::Array3f max_position_in_range_;
+
+  // Voxel keys of the points in range for 'keys_resolution_' using the lowest
+  // 'num_key_bits_' bits. If sorted, 'order_' holds the indices into the
+  // points in range.
+  float keys_resolution_ = std::numeric_limits<float>::quiet_NaN();
+  int num_key_bits_ = 0;
+  bool keys_sorted_ = false;
+  std::vector<uint64> keys_;
+  std::vector<uint32> order_;
+  std::vector<uint64> keys_buffer_;
+  std::vector<uint32> order_buffer_;
+  std::vector<std::array<uint32, 1 << kRadixSortDigitBits>> histograms_;
+  std::vector<uint64> occupied_voxels_;
+  std::vector<uint32> voxel_ranks_;
+
+  std::vector<bool> selected_;
+};
+
 proto::AdaptiveVoxelFilterOptions CreateAdaptiveVoxelFilterOptions(
     common::LuaParameterDictionary* const parameter_dictionary);
 
@@ -44,6 +137,14 @@ PointCloud AdaptiveVoxelFilter(
     const PointCloud& point_cloud,
     const proto::AdaptiveVoxelFilterOptions& options);
 
+// Same as above, but uses 'voxel_filter' which must have been constructed
+// from 'point_cloud'. This allows to share work between several adaptive
+// voxel filters of the same point cloud.
+PointCloud AdaptiveVoxelFilter(
+    const PointCloud& point_cloud,
+    const proto::AdaptiveVoxelFilterOptions& options,
+    MultiResolutionVoxelFilter* voxel_filter);
+
 }  // namespace sensor
 }  // namespace cartographer
 
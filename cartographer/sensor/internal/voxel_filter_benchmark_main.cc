@@ -0,0 +1,105 @@
+/*
+ * Copyright 2016 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cmath>
+#include <random>
+#include <string>
+
+#include "cartographer/common/internal/benchmark.h"
+#include "cartographer/sensor/internal/voxel_filter.h"
+#include "cartographer/sensor/point_cloud.h"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+DEFINE_int32(num_iterations, 20, "Number of times each variant is run.");
+DEFINE_double(voxel_filter_size, 0.15,
+              "Edge length of the voxels for the plain voxel filter.");
+
+namespace cartographer {
+namespace sensor {
+namespace {
+
+template <typename Function>
+void Benchmark(const std::string& name, const int num_points,
+               Function function) {
+  common::RunBenchmark(std::to_string(num_points) + " points, " + name,
+                       FLAGS_num_iterations, num_points, "point", function);
+}
+
+// Returns points on random rays hitting surfaces between 1 and 60 m away,
+// which is denser close to the sensor like range data.
+PointCloud CreateScan(const int num_points) {
+  std::mt19937 prng(42);
+  std::uniform_real_distribution<float> angle_distribution(-M_PI, M_PI);
+  std::uniform_real_distribution<float> elevation_distribution(-0.4f, 0.4f);
+  std::uniform_real_distribution<float> range_distribution(1.f, 60.f);
+  PointCloud point_cloud;
+  for (int i = 0; i < num_points; ++i) {
+    const float angle = angle_distribution(prng);
+    const float elevation = elevation_distribution(prng);
+    const float range = range_distribution(prng);
+    point_cloud.push_back({range * Eigen::Vector3f(
+                                       std::cos(angle) * std::cos(elevation),
+                                       std::sin(angle) * std::cos(elevation),
+                                       std::sin(elevation))});
+  }
+  return point_cloud;
+}
+
+void Run(const int num_points) {
+  const PointCloud point_cloud = CreateScan(num_points);
+  // Same as the default 3D trajectory builder configuration.
+  proto::AdaptiveVoxelFilterOptions high_resolution_options;
+  high_resolution_options.set_max_length(2.);
+  high_resolution_options.set_min_num_points(150);
+  high_resolution_options.set_max_range(15.);
+  proto::AdaptiveVoxelFilterOptions low_resolution_options;
+  low_resolution_options.set_max_length(4.);
+  low_resolution_options.set_min_num_points(200);
+  low_resolution_options.set_max_range(60.);
+
+  Benchmark("VoxelFilter", num_points, [&](int) {
+    return VoxelFilter(point_cloud, FLAGS_voxel_filter_size).size();
+  });
+  Benchmark("Separate adaptive voxel filters", num_points, [&](int) {
+    return AdaptiveVoxelFilter(point_cloud, high_resolution_options).size() +
+           AdaptiveVoxelFilter(point_cloud, low_resolution_options).size();
+  });
+  Benchmark("Shared adaptive voxel filters", num_points, [&](int) {
+    MultiResolutionVoxelFilter voxel_filter(point_cloud);
+    return AdaptiveVoxelFilter(point_cloud, high_resolution_options,
+                               &voxel_filter)
+               .size() +
+           AdaptiveVoxelFilter(point_cloud, low_resolution_options,
+                               &voxel_filter)
+               .size();
+  });
+}
+
+}  // namespace
+}  // namespace sensor
+}  // namespace cartographer
+
+int main(int argc, char** argv) {
+  ::cartographer::common::InitBenchmark(
+      "Measures the time needed to voxel filter point clouds of 100k to 300k "
+      "points.",
+      &argc, &argv);
+  CHECK_GT(FLAGS_num_iterations, 0);
+  for (const int num_points : {100000, 200000, 300000}) {
+    ::cartographer::sensor::Run(num_points);
+  }
+}
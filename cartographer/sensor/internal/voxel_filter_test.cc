@@ -16,7 +16,10 @@
 
 #include "cartographer/sensor/internal/voxel_filter.h"
 
+#include <algorithm>
 #include <cmath>
+#include <limits>
+#include <random>
 
 #include "gmock/gmock.h"
 
@@ -81,6 +84,71 @@ TEST(VoxelFilterTest, IgnoresTime) {
   EXPECT_THAT(timed_point_cloud, Contains(result[0]));
 }
 
+PointCloud CreateRandomPointCloud(const int num_points) {
+  std::mt19937 prng(42);
+  std::uniform_real_distribution<float> distribution(-20.f, 20.f);
+  std::vector<RangefinderPoint> points;
+  std::vector<float> intensities;
+  std::vector<uint32> ranges;
+  for (int i = 0; i < num_points; ++i) {
+    points.push_back({{distribution(prng), distribution(prng),
+                       0.1f * distribution(prng)}});
+    intensities.push_back(i);
+    ranges.push_back(i);
+  }
+  PointAttributes attributes;
+  attributes.Set(kRangeAttribute, std::move(ranges));
+  return PointCloud(points, intensities, attributes);
+}
+
+TEST(MultiResolutionVoxelFilterTest, CountsVoxels) {
+  const PointCloud point_cloud = CreateRandomPointCloud(5000);
+  MultiResolutionVoxelFilter voxel_filter(point_cloud);
+  const float max_range = std::numeric_limits<float>::infinity();
+  for (const float resolution : {0.05f, 0.3f, 1.f, 7.f, 100.f}) {
+    const std::vector<bool>& selected =
+        voxel_filter.SelectPoints(resolution, max_range);
+    const size_t num_selected =
+        std::count(selected.begin(), selected.end(), true);
+    EXPECT_EQ(voxel_filter.CountVoxels(resolution, max_range), num_selected);
+    EXPECT_EQ(VoxelFilter(point_cloud, resolution).size(), num_selected);
+  }
+  EXPECT_EQ(voxel_filter.CountVoxels(100.f, max_range), 1);
+  EXPECT_EQ(voxel_filter.CountPointsInRange(max_range), point_cloud.size());
+  EXPECT_EQ(voxel_filter.CountVoxels(100.f, 0.f), 0);
+}
+
+TEST(MultiResolutionVoxelFilterTest, SharedAdaptiveVoxelFilter) {
+  const PointCloud point_cloud = CreateRandomPointCloud(5000);
+  proto::AdaptiveVoxelFilterOptions high_resolution_options;
+  high_resolution_options.set_max_length(2.f);
+  high_resolution_options.set_min_num_points(150);
+  high_resolution_options.set_max_range(15.f);
+  proto::AdaptiveVoxelFilterOptions low_resolution_options;
+  low_resolution_options.set_max_length(4.f);
+  low_resolution_options.set_min_num_points(200);
+  low_resolution_options.set_max_range(60.f);
+  MultiResolutionVoxelFilter voxel_filter(point_cloud);
+  for (const auto& options :
+       {high_resolution_options, low_resolution_options}) {
+    const PointCloud result =
+        AdaptiveVoxelFilter(point_cloud, options, &voxel_filter);
+    EXPECT_EQ(result.points(),
+              AdaptiveVoxelFilter(point_cloud, options).points());
+    EXPECT_GE(result.size(), options.min_num_points());
+    ASSERT_EQ(result.intensities().size(), result.size());
+    ASSERT_EQ(result.attributes().num_points(), result.size());
+    const std::vector<uint32>& ranges =
+        *result.attributes().Find<uint32>(kRangeAttribute);
+    for (size_t i = 0; i < result.size(); ++i) {
+      EXPECT_LE(result[i].position.norm(), options.max_range());
+      EXPECT_EQ(point_cloud[static_cast<size_t>(result.intensities()[i])],
+                result[i]);
+      EXPECT_EQ(ranges[i], result.intensities()[i]);
+    }
+  }
+}
+
 }  // namespace
 }  // namespace sensor
 }  // namespace cartographer
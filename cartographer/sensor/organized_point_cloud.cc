@@ -0,0 +1,160 @@
+/*
+ * Copyright 2018 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/sensor/organized_point_cloud.h"
+
+#include <limits>
+
+#include "cartographer/common/port.h"
+#include "glog/logging.h"
+
+namespace cartographer {
+namespace sensor {
+namespace {
+
+void CheckSizes(const OrganizedPointCloudData& data) {
+  CHECK_GE(data.num_rows, 0);
+  CHECK_GE(data.num_columns, 0);
+  const size_t num_cells =
+      static_cast<size_t>(data.num_rows) * data.num_columns;
+  CHECK_EQ(data.points.size(), num_cells);
+  CHECK(data.intensities.empty() || data.intensities.size() == num_cells);
+  CHECK(data.attributes.empty() || data.attributes.num_points() == num_cells);
+}
+
+// Returns the difference vector from the cell 'index' to the neighbouring
+// cells 'previous' and 'next' along one image axis. Uses the central
+// difference if both neighbours are usable, otherwise a one-sided difference.
+// Returns false if neither neighbour is usable.
+bool ComputeTangent(const OrganizedPointCloudData& data,
+                    const std::vector<float>& range_image, const size_t index,
+                    const int64 previous, const int64 next,
+                    const float max_neighbor_distance,
+                    Eigen::Vector3f* const tangent) {
+  const Eigen::Vector3f& position = data.points[index].position;
+  const auto is_usable = [&](const int64 neighbor) {
+    return neighbor >= 0 && range_image[neighbor] > 0.f &&
+           (data.points[neighbor].position - position).squaredNorm() <=
+               max_neighbor_distance * max_neighbor_distance;
+  };
+  const bool use_previous = is_usable(previous);
+  const bool use_next = is_usable(next);
+  if (!use_previous && !use_next) {
+    return false;
+  }
+  *tangent = (use_next ? data.points[next].position : position) -
+             (use_previous ? data.points[previous].position : position);
+  return true;
+}
+
+}  // namespace
+
+std::vector<float> ComputeRangeImage(const OrganizedPointCloudData& data) {
+  CheckSizes(data);
+  std::vector<float> range_image(data.points.size());
+  for (size_t i = 0; i < data.points.size(); ++i) {
+    range_image[i] = (data.points[i].position - data.origin).norm();
+  }
+  return range_image;
+}
+
+TimedPointCloudData ToTimedPointCloudData(const OrganizedPointCloudData& data,
+                                          const float min_range) {
+  const std::vector<float> range_image = ComputeRangeImage(data);
+  const bool add_rings = !data.attributes.Contains(kRingAttribute);
+  if (add_rings) {
+    CHECK_LE(data.num_rows, std::numeric_limits<uint8>::max() + 1);
+  }
+  TimedPointCloudData result{data.time, data.origin, {}, {}, {}};
+  std::vector<uint32> indices;
+  std::vector<uint8> rings;
+  result.ranges.reserve(data.points.size());
+  indices.reserve(data.points.size());
+  for (int column = 0; column < data.num_columns; ++column) {
+    for (int row = 0; row < data.num_rows; ++row) {
+      const size_t index = data.index(row, column);
+      // Also drops missing returns, which have a range of 0.
+      if (range_image[index] <= 0.f || range_image[index] < min_range) {
+        continue;
+      }
+      result.ranges.push_back(data.points[index]);
+      indices.push_back(index);
+      if (add_rings) {
+        rings.push_back(static_cast<uint8>(row));
+      }
+    }
+  }
+  if (!data.intensities.empty()) {
+    result.intensities.reserve(indices.size());
+    for (const uint32 index : indices) {
+      result.intensities.push_back(data.intensities[index]);
+    }
+  }
+  if (!data.attributes.empty()) {
+    result.attributes = data.attributes.Gather(indices);
+  }
+  if (add_rings) {
+    result.attributes.Set(kRingAttribute, std::move(rings));
+  }
+  return result;
+}
+
+std::vector<Eigen::Vector3f> EstimateNormals(
+    const OrganizedPointCloudData& data, const float max_neighbor_distance) {
+  const std::vector<float> range_image = ComputeRangeImage(data);
+  std::vector<Eigen::Vector3f> normals(data.points.size(),
+                                       Eigen::Vector3f::Zero());
+  for (int row = 0; row < data.num_rows; ++row) {
+    for (int column = 0; column < data.num_columns; ++column) {
+      const size_t index = data.index(row, column);
+      if (range_image[index] <= 0.f) {
+        continue;
+      }
+      const int previous_column =
+          column == 0 ? data.num_columns - 1 : column - 1;
+      const int next_column = column + 1 == data.num_columns ? 0 : column + 1;
+      Eigen::Vector3f horizontal;
+      Eigen::Vector3f vertical;
+      if (!ComputeTangent(data, range_image, index,
+                          data.index(row, previous_column),
+                          data.index(row, next_column), max_neighbor_distance,
+                          &horizontal) ||
+          !ComputeTangent(
+              data, range_image, index,
+              row == 0 ? -1 : static_cast<int64>(data.index(row - 1, column)),
+              row + 1 == data.num_rows
+                  ? -1
+                  : static_cast<int64>(data.index(row + 1, column)),
+              max_neighbor_distance, &vertical)) {
+        continue;
+      }
+      Eigen::Vector3f normal = horizontal.cross(vertical);
+      const float norm = normal.norm();
+      if (norm <= 0.f) {
+        continue;
+      }
+      normal /= norm;
+      if (normal.dot(data.origin - data.points[index].position) < 0.f) {
+        normal = -normal;
+      }
+      normals[index] = normal;
+    }
+  }
+  return normals;
+}
+
+}  // namespace sensor
+}  // namespace cartographer
@@ -0,0 +1,77 @@
+/*
+ * Copyright 2018 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_SENSOR_ORGANIZED_POINT_CLOUD_H_
+#define CARTOGRAPHER_SENSOR_ORGANIZED_POINT_CLOUD_H_
+
+#include <vector>
+
+#include "Eigen/Core"
+#include "cartographer/common/time.h"
+#include "cartographer/sensor/point_attributes.h"
+#include "cartographer/sensor/point_cloud.h"
+#include "cartographer/sensor/timed_point_cloud_data.h"
+
+namespace cartographer {
+namespace sensor {
+
+// A scan of a lidar which measures along 'num_rows' rings at 'num_columns'
+// azimuths, e.g. an Ouster or Velodyne sensor, stored as an image: the cell in
+// 'row' and 'column' is at index 'row * num_columns + column'. Columns are in
+// the order of acquisition, i.e. the relative times of the points of a column
+// are not after those of the next column. Cells without a return hold a point
+// at 'origin', i.e. with a range of 0, as reported by Ouster drivers.
+struct OrganizedPointCloudData {
+  size_t index(const int row, const int column) const {
+    return static_cast<size_t>(row) * num_columns + column;
+  }
+
+  common::Time time;
+  Eigen::Vector3f origin;
+  int num_rows;
+  int num_columns;
+  // Like 'TimedPointCloudData::ranges', 'num_rows * num_columns' cells.
+  TimedPointCloud points;
+  // 'intensities' has to be same size as 'points', or empty.
+  std::vector<float> intensities;
+  // Describes all cells, or is empty.
+  PointAttributes attributes;
+};
+
+// Returns the distances of the points of 'data' to its origin, laid out like
+// the points. Missing returns have a range of 0.
+std::vector<float> ComputeRangeImage(const OrganizedPointCloudData& data);
+
+// Converts 'data' into TimedPointCloudData column by column, so the points are
+// sorted by time. Missing returns and points closer than 'min_range' are
+// dropped. Unless 'data' has a kRingAttribute, the row of each point is added
+// as kRingAttribute.
+TimedPointCloudData ToTimedPointCloudData(const OrganizedPointCloudData& data,
+                                          float min_range);
+
+// Estimates the normal of each point of 'data' from the difference vectors to
+// its neighbours in the image, which are found in constant time. Columns wrap
+// around. Neighbours which are missing returns or further than
+// 'max_neighbor_distance' from the point are ignored. Normals point towards
+// the origin; points without suitable neighbours and missing returns get a
+// zero vector.
+std::vector<Eigen::Vector3f> EstimateNormals(
+    const OrganizedPointCloudData& data, float max_neighbor_distance);
+
+}  // namespace sensor
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_SENSOR_ORGANIZED_POINT_CLOUD_H_
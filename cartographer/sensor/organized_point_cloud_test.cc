@@ -0,0 +1,120 @@
+/*
+ * Copyright 2018 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/sensor/organized_point_cloud.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "gmock/gmock.h"
+
+namespace cartographer {
+namespace sensor {
+namespace {
+
+using ::testing::ElementsAre;
+
+constexpr int kNumRows = 4;
+constexpr int kNumColumns = 8;
+
+// Creates a scan of the floor 'height' below the sensor, with rings at
+// different inclinations and columns at evenly spaced azimuths. Cells in
+// 'missing_columns' have no returns.
+OrganizedPointCloudData CreateFloorScan(
+    const float height, const std::vector<int>& missing_columns) {
+  OrganizedPointCloudData data{common::FromUniversal(1000),
+                               Eigen::Vector3f::Zero(),
+                               kNumRows,
+                               kNumColumns,
+                               {},
+                               {},
+                               {}};
+  data.points.resize(kNumRows * kNumColumns);
+  std::vector<uint16> reflectivities(data.points.size());
+  for (int row = 0; row < kNumRows; ++row) {
+    const float distance = height * (1.f + row);
+    for (int column = 0; column < kNumColumns; ++column) {
+      const float azimuth = 2.f * M_PI * column / kNumColumns;
+      const size_t index = data.index(row, column);
+      const float time = -0.1f * (kNumColumns - 1 - column) / kNumColumns;
+      data.points[index] = {Eigen::Vector3f(distance * std::cos(azimuth),
+                                            distance * std::sin(azimuth),
+                                            -height),
+                            time};
+      if (std::count(missing_columns.begin(), missing_columns.end(), column)) {
+        data.points[index].position = data.origin;
+      }
+      reflectivities[index] = index;
+    }
+  }
+  data.attributes.Set(kReflectivityAttribute, std::move(reflectivities));
+  return data;
+}
+
+TEST(OrganizedPointCloudTest, ComputesRangeImage) {
+  const OrganizedPointCloudData data = CreateFloorScan(1.f, {2});
+  const std::vector<float> range_image = ComputeRangeImage(data);
+  ASSERT_EQ(range_image.size(), data.points.size());
+  EXPECT_NEAR(range_image[data.index(0, 0)], std::sqrt(2.f), 1e-5f);
+  EXPECT_EQ(range_image[data.index(1, 2)], 0.f);
+}
+
+TEST(OrganizedPointCloudTest, ConvertsColumnByColumn) {
+  const OrganizedPointCloudData data = CreateFloorScan(1.f, {2});
+  // The two innermost rings are closer than 3 m and dropped.
+  const TimedPointCloudData result = ToTimedPointCloudData(data, 3.f);
+  EXPECT_EQ(result.time, data.time);
+  ASSERT_EQ(result.ranges.size(), 2 * (kNumColumns - 1));
+  EXPECT_TRUE(result.intensities.empty());
+  EXPECT_TRUE(std::is_sorted(
+      result.ranges.begin(), result.ranges.end(),
+      [](const TimedRangefinderPoint& a, const TimedRangefinderPoint& b) {
+        return a.time < b.time;
+      }));
+  const std::vector<uint8>& rings =
+      *result.attributes.Find<uint8>(kRingAttribute);
+  const std::vector<uint16>& reflectivities =
+      *result.attributes.Find<uint16>(kReflectivityAttribute);
+  EXPECT_THAT(std::vector<uint8>(rings.begin(), rings.begin() + 4),
+              ElementsAre(2, 3, 2, 3));
+  for (size_t i = 0; i < result.ranges.size(); ++i) {
+    EXPECT_EQ(result.ranges[i].position,
+              data.points[reflectivities[i]].position);
+    EXPECT_EQ(reflectivities[i] / kNumColumns, rings[i]);
+  }
+}
+
+TEST(OrganizedPointCloudTest, EstimatesNormals) {
+  const OrganizedPointCloudData data = CreateFloorScan(1.f, {5});
+  const std::vector<Eigen::Vector3f> normals = EstimateNormals(data, 3.f);
+  ASSERT_EQ(normals.size(), data.points.size());
+  for (int row = 0; row < kNumRows; ++row) {
+    for (int column = 0; column < kNumColumns; ++column) {
+      const Eigen::Vector3f& normal = normals[data.index(row, column)];
+      if (column == 5 || row == kNumRows - 1) {
+        // Missing returns, or horizontal neighbours too far away.
+        EXPECT_TRUE(normal.isZero()) << row << " " << column;
+      } else {
+        EXPECT_TRUE(normal.isApprox(Eigen::Vector3f::UnitZ(), 1e-4f))
+            << row << " " << column << ": " << normal.transpose();
+      }
+    }
+  }
+}
+
+}  // namespace
+}  // namespace sensor
+}  // namespace cartographer
@@ -0,0 +1,258 @@
+/*
+ * Copyright 2016 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/sensor/point_attributes.h"
+
+#include <limits>
+
+namespace cartographer {
+namespace sensor {
+namespace {
+
+struct ColumnSizeVisitor {
+  template <typename T>
+  size_t operator()(const std::vector<T>& values) const {
+    return values.size();
+  }
+};
+
+struct SelectVisitor {
+  template <typename T>
+  PointAttributes::Column operator()(const std::vector<T>& values) const {
+    CHECK_EQ(values.size(), selected.size());
+    std::vector<T> result;
+    for (size_t i = 0; i < values.size(); ++i) {
+      if (selected[i]) {
+        result.push_back(values[i]);
+      }
+    }
+    return result;
+  }
+
+  const std::vector<bool>& selected;
+};
+
+struct GatherVisitor {
+  template <typename T>
+  PointAttributes::Column operator()(const std::vector<T>& values) const {
+    std::vector<T> result;
+    result.reserve(indices.size());
+    for (const uint32 index : indices) {
+      CHECK_LT(index, values.size());
+      result.push_back(values[index]);
+    }
+    return result;
+  }
+
+  const std::vector<uint32>& indices;
+};
+
+// Gathers the points of a column found in all sources. The column of the
+// first source determines the type.
+struct MultiSourceGatherVisitor {
+  template <typename T>
+  PointAttributes::Column operator()(const std::vector<T>&) const {
+    std::vector<const std::vector<T>*> source_values;
+    source_values.reserve(sources.size());
+    for (const PointAttributes* source : sources) {
+      source_values.push_back(source->Find<T>(name));
+      CHECK(source_values.back() != nullptr);
+    }
+    std::vector<T> result;
+    result.reserve(points.size());
+    for (const PointAttributes::SourcePoint& point : points) {
+      const std::vector<T>& values = *source_values.at(point.source);
+      CHECK_LT(point.point_index, values.size());
+      result.push_back(values[point.point_index]);
+    }
+    return result;
+  }
+
+  const std::string& name;
+  const std::vector<const PointAttributes*>& sources;
+  const std::vector<PointAttributes::SourcePoint>& points;
+};
+
+struct HasSameTypeVisitor {
+  template <typename T>
+  bool operator()(const std::vector<T>&) const {
+    return other.Find<T>(name) != nullptr;
+  }
+
+  const std::string& name;
+  const PointAttributes& other;
+};
+
+struct ToProtoVisitor {
+  void operator()(const std::vector<float>& values) const {
+    column->set_type(proto::PointAttributes::Column::FLOAT);
+    column->mutable_float_values()->Reserve(values.size());
+    for (const float value : values) {
+      column->add_float_values(value);
+    }
+  }
+
+  template <typename T>
+  void operator()(const std::vector<T>& values) const {
+    column->set_type(Type(T()));
+    column->mutable_uint_values()->Reserve(values.size());
+    for (const T value : values) {
+      column->add_uint_values(value);
+    }
+  }
+
+  static proto::PointAttributes::Column::Type Type(uint8) {
+    return proto::PointAttributes::Column::UINT8;
+  }
+  static proto::PointAttributes::Column::Type Type(uint16) {
+    return proto::PointAttributes::Column::UINT16;
+  }
+  static proto::PointAttributes::Column::Type Type(uint32) {
+    return proto::PointAttributes::Column::UINT32;
+  }
+
+  proto::PointAttributes::Column* column;
+};
+
+template <typename T>
+std::vector<T> FromUintValues(const proto::PointAttributes::Column& column) {
+  std::vector<T> values;
+  values.reserve(column.uint_values_size());
+  for (const uint32 value : column.uint_values()) {
+    CHECK_LE(value, std::numeric_limits<T>::max()) << column.name();
+    values.push_back(static_cast<T>(value));
+  }
+  return values;
+}
+
+}  // namespace
+
+size_t PointAttributes::ColumnSize(const Column& column) {
+  return absl::visit(ColumnSizeVisitor(), column);
+}
+
+size_t PointAttributes::num_points() const {
+  if (columns_.empty()) {
+    return 0;
+  }
+  return ColumnSize(*columns_.begin()->second);
+}
+
+std::vector<std::string> PointAttributes::names() const {
+  std::vector<std::string> result;
+  for (const auto& entry : columns_) {
+    result.push_back(entry.first);
+  }
+  return result;
+}
+
+PointAttributes PointAttributes::Select(
+    const std::vector<bool>& selected) const {
+  PointAttributes result;
+  for (const auto& entry : columns_) {
+    result.columns_[entry.first] = std::make_shared<const Column>(
+        absl::visit(SelectVisitor{selected}, *entry.second));
+  }
+  return result;
+}
+
+PointAttributes PointAttributes::Gather(
+    const std::vector<uint32>& indices) const {
+  PointAttributes result;
+  for (const auto& entry : columns_) {
+    result.columns_[entry.first] = std::make_shared<const Column>(
+        absl::visit(GatherVisitor{indices}, *entry.second));
+  }
+  return result;
+}
+
+PointAttributes PointAttributes::Gather(
+    const std::vector<const PointAttributes*>& sources,
+    const std::vector<SourcePoint>& points) {
+  PointAttributes result;
+  if (sources.empty()) {
+    return result;
+  }
+  for (const auto& entry : sources.front()->columns_) {
+    bool in_all_sources = true;
+    for (const PointAttributes* source : sources) {
+      if (!absl::visit(HasSameTypeVisitor{entry.first, *source},
+                       *entry.second)) {
+        in_all_sources = false;
+        break;
+      }
+    }
+    if (!in_all_sources) {
+      continue;
+    }
+    result.columns_[entry.first] = std::make_shared<const Column>(absl::visit(
+        MultiSourceGatherVisitor{entry.first, sources, points}, *entry.second));
+  }
+  return result;
+}
+
+bool PointAttributes::operator==(const PointAttributes& other) const {
+  if (columns_.size() != other.columns_.size()) {
+    return false;
+  }
+  for (auto it = columns_.begin(), other_it = other.columns_.begin();
+       it != columns_.end(); ++it, ++other_it) {
+    if (it->first != other_it->first ||
+        (it->second != other_it->second && *it->second != *other_it->second)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+proto::PointAttributes ToProto(const PointAttributes& point_attributes) {
+  proto::PointAttributes proto;
+  for (const std::string& name : point_attributes.names()) {
+    proto::PointAttributes::Column* const column = proto.add_columns();
+    column->set_name(name);
+    absl::visit(ToProtoVisitor{column}, *point_attributes.FindColumn(name));
+  }
+  return proto;
+}
+
+PointAttributes FromProto(const proto::PointAttributes& proto) {
+  PointAttributes point_attributes;
+  for (const auto& column : proto.columns()) {
+    switch (column.type()) {
+      case proto::PointAttributes::Column::FLOAT:
+        point_attributes.Set(column.name(),
+                             std::vector<float>(column.float_values().begin(),
+                                                column.float_values().end()));
+        break;
+      case proto::PointAttributes::Column::UINT8:
+        point_attributes.Set(column.name(), FromUintValues<uint8>(column));
+        break;
+      case proto::PointAttributes::Column::UINT16:
+        point_attributes.Set(column.name(), FromUintValues<uint16>(column));
+        break;
+      case proto::PointAttributes::Column::UINT32:
+        point_attributes.Set(column.name(), FromUintValues<uint32>(column));
+        break;
+      default:
+        LOG(FATAL) << "Unknown point attribute type " << column.type()
+                   << " of column " << column.name();
+    }
+  }
+  return point_attributes;
+}
+
+}  // namespace sensor
+}  // namespace cartographer
@@ -0,0 +1,127 @@
+/*
+ * Copyright 2016 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_SENSOR_POINT_ATTRIBUTES_H_
+#define CARTOGRAPHER_SENSOR_POINT_ATTRIBUTES_H_
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/types/variant.h"
+#include "cartographer/common/port.h"
+#include "cartographer/sensor/proto/sensor.pb.h"
+#include "glog/logging.h"
+
+namespace cartographer {
+namespace sensor {
+
+// Names of the per-point channels of Ouster sensors, see PointCloud_Ouster and
+// PointCloud_Ouster_WithRGBAClass, and the types of their columns.
+constexpr char kReflectivityAttribute[] = "reflectivity";      // uint16
+constexpr char kAmbientAttribute[] = "ambient";                // uint16
+constexpr char kRangeAttribute[] = "range";                    // uint32
+constexpr char kRingAttribute[] = "ring";                      // uint8
+constexpr char kColorRgbaAttribute[] = "color_rgba";           // uint32
+constexpr char kClassificationAttribute[] = "classification";  // uint32
+
+// Per-point channels of a point cloud beyond position and intensity, stored
+// column by column under a name.
+//
+// Columns are immutable and shared between copies, so copying attributes
+// along with the points they describe is cheap, and columns nobody reads are
+// never copied. Operations that subset the points create new columns.
+class PointAttributes {
+ public:
+  using Column = absl::variant<std::vector<float>, std::vector<uint8>,
+                               std::vector<uint16>, std::vector<uint32>>;
+
+  // Identifies point 'point_index' in the attributes 'source' of several.
+  struct SourcePoint {
+    uint32 source;
+    uint32 point_index;
+  };
+
+  PointAttributes() = default;
+
+  // Returns true if there are no columns.
+  bool empty() const { return columns_.empty(); }
+  // Returns the number of points described, 0 if there are no columns.
+  size_t num_points() const;
+  std::vector<std::string> names() const;
+  bool Contains(const std::string& name) const {
+    return columns_.count(name) != 0;
+  }
+
+  // Adds or replaces the column 'name'. All columns must have the same size.
+  template <typename T>
+  void Set(const std::string& name, std::vector<T> values) {
+    for (const auto& entry : columns_) {
+      if (entry.first != name) {
+        CHECK_EQ(values.size(), ColumnSize(*entry.second)) << name;
+        break;
+      }
+    }
+    columns_[name] = std::make_shared<const Column>(std::move(values));
+  }
+
+  // Returns the column 'name', or nullptr if there is no such column.
+  const Column* FindColumn(const std::string& name) const {
+    const auto it = columns_.find(name);
+    return it == columns_.end() ? nullptr : it->second.get();
+  }
+
+  // Returns the column 'name', or nullptr if there is no such column or it
+  // holds values of a different type.
+  template <typename T>
+  const std::vector<T>* Find(const std::string& name) const {
+    const Column* const column = FindColumn(name);
+    return column == nullptr ? nullptr : absl::get_if<std::vector<T>>(column);
+  }
+
+  void Erase(const std::string& name) { columns_.erase(name); }
+
+  // Returns the attributes of the points for which 'selected' is true.
+  PointAttributes Select(const std::vector<bool>& selected) const;
+
+  // Returns the attributes of the points 'indices', in this order.
+  PointAttributes Gather(const std::vector<uint32>& indices) const;
+
+  // Returns the attributes of 'points' taken from 'sources'. Only columns
+  // which all sources have with the same type are kept.
+  static PointAttributes Gather(
+      const std::vector<const PointAttributes*>& sources,
+      const std::vector<SourcePoint>& points);
+
+  bool operator==(const PointAttributes& other) const;
+  bool operator!=(const PointAttributes& other) const {
+    return !operator==(other);
+  }
+
+ private:
+  static size_t ColumnSize(const Column& column);
+
+  std::map<std::string, std::shared_ptr<const Column>> columns_;
+};
+
+proto::PointAttributes ToProto(const PointAttributes& point_attributes);
+PointAttributes FromProto(const proto::PointAttributes& proto);
+
+}  // namespace sensor
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_SENSOR_POINT_ATTRIBUTES_H_
@@ -0,0 +1,114 @@
+/*
+ * Copyright 2016 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/sensor/point_attributes.h"
+
+#include "cartographer/sensor/point_cloud.h"
+#include "gmock/gmock.h"
+
+namespace cartographer {
+namespace sensor {
+namespace {
+
+using ::testing::ElementsAre;
+
+PointAttributes CreateAttributes() {
+  PointAttributes attributes;
+  attributes.Set(kReflectivityAttribute, std::vector<uint16>{10, 20, 30, 40});
+  attributes.Set(kRingAttribute, std::vector<uint8>{0, 1, 2, 3});
+  attributes.Set("weight", std::vector<float>{0.5f, 1.f, 1.5f, 2.f});
+  return attributes;
+}
+
+TEST(PointAttributesTest, SetAndFind) {
+  const PointAttributes attributes = CreateAttributes();
+  EXPECT_FALSE(attributes.empty());
+  EXPECT_EQ(attributes.num_points(), 4);
+  EXPECT_THAT(attributes.names(),
+              ElementsAre(kReflectivityAttribute, kRingAttribute, "weight"));
+  ASSERT_NE(attributes.Find<uint16>(kReflectivityAttribute), nullptr);
+  EXPECT_THAT(*attributes.Find<uint16>(kReflectivityAttribute),
+              ElementsAre(10, 20, 30, 40));
+  EXPECT_EQ(attributes.Find<uint32>(kReflectivityAttribute), nullptr);
+  EXPECT_EQ(attributes.Find<uint16>(kAmbientAttribute), nullptr);
+  EXPECT_TRUE(PointAttributes().empty());
+  EXPECT_EQ(PointAttributes().num_points(), 0);
+}
+
+TEST(PointAttributesTest, CopiesShareColumns) {
+  const PointAttributes attributes = CreateAttributes();
+  PointAttributes copy = attributes;
+  EXPECT_EQ(copy.Find<uint8>(kRingAttribute),
+            attributes.Find<uint8>(kRingAttribute));
+  EXPECT_TRUE(copy == attributes);
+  copy.Set(kRingAttribute, std::vector<uint8>{3, 2, 1, 0});
+  EXPECT_THAT(*attributes.Find<uint8>(kRingAttribute), ElementsAre(0, 1, 2, 3));
+  EXPECT_TRUE(copy != attributes);
+  copy.Erase(kRingAttribute);
+  EXPECT_FALSE(copy.Contains(kRingAttribute));
+  EXPECT_EQ(copy.names().size(), 2);
+}
+
+TEST(PointAttributesTest, SelectAndGather) {
+  const PointAttributes attributes = CreateAttributes();
+  const PointAttributes selected =
+      attributes.Select({true, false, false, true});
+  EXPECT_EQ(selected.num_points(), 2);
+  EXPECT_THAT(*selected.Find<uint16>(kReflectivityAttribute),
+              ElementsAre(10, 40));
+  EXPECT_THAT(*selected.Find<float>("weight"), ElementsAre(0.5f, 2.f));
+  const PointAttributes gathered = attributes.Gather({2, 2, 0});
+  EXPECT_THAT(*gathered.Find<uint8>(kRingAttribute), ElementsAre(2, 2, 0));
+}
+
+TEST(PointAttributesTest, GathersFromSeveralSources) {
+  const PointAttributes first = CreateAttributes();
+  PointAttributes second;
+  second.Set(kReflectivityAttribute, std::vector<uint16>{50, 60});
+  second.Set(kRingAttribute, std::vector<uint32>{4, 5});
+  const PointAttributes gathered =
+      PointAttributes::Gather({&first, &second}, {{1, 1}, {0, 2}, {1, 0}});
+  // Only the reflectivity is in both sources with the same type.
+  EXPECT_THAT(gathered.names(), ElementsAre(kReflectivityAttribute));
+  EXPECT_THAT(*gathered.Find<uint16>(kReflectivityAttribute),
+              ElementsAre(60, 30, 50));
+}
+
+TEST(PointAttributesTest, ToAndFromProto) {
+  const PointAttributes attributes = CreateAttributes();
+  const PointAttributes actual = FromProto(ToProto(attributes));
+  EXPECT_TRUE(actual == attributes);
+  EXPECT_THAT(*actual.Find<uint8>(kRingAttribute), ElementsAre(0, 1, 2, 3));
+}
+
+TEST(PointAttributesTest, PointCloudKeepsAttributes) {
+  const PointCloud point_cloud({{Eigen::Vector3f(0.f, 0.f, 0.f)},
+                                {Eigen::Vector3f(0.f, 0.f, 1.f)},
+                                {Eigen::Vector3f(0.f, 0.f, 2.f)},
+                                {Eigen::Vector3f(0.f, 0.f, 3.f)}},
+                               {}, CreateAttributes());
+  const PointCloud cropped = CropPointCloud(point_cloud, 0.5f, 2.5f);
+  ASSERT_EQ(cropped.size(), 2);
+  EXPECT_THAT(*cropped.attributes().Find<uint8>(kRingAttribute),
+              ElementsAre(1, 2));
+  const PointCloud transformed = TransformPointCloud(
+      point_cloud, transform::Rigid3f::Translation(Eigen::Vector3f::UnitX()));
+  EXPECT_TRUE(transformed.attributes() == point_cloud.attributes());
+}
+
+}  // namespace
+}  // namespace sensor
+}  // namespace cartographer
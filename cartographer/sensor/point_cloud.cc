@@ -16,11 +16,71 @@
 
 #include "cartographer/sensor/point_cloud.h"
 
+#include <algorithm>
+#include <utility>
+
 #include "cartographer/sensor/proto/sensor.pb.h"
 #include "cartographer/transform/transform.h"
 
 namespace cartographer {
 namespace sensor {
+namespace {
+
+// Number of points processed per iteration of the vectorized loop.
+constexpr size_t kTransformBatchSize = 16;
+
+void CopyAttributes(const RangefinderPoint&, RangefinderPoint*) {}
+
+void CopyAttributes(const TimedRangefinderPoint& point,
+                    TimedRangefinderPoint* const transformed_point) {
+  transformed_point->time = point.time;
+}
+
+template <typename PointType>
+void TransformPointsImpl(const transform::Rigid3f& transform,
+                         const PointType* const points,
+                         const size_t num_points,
+                         PointType* const transformed_points) {
+  const Eigen::Matrix3f rotation = transform.rotation().toRotationMatrix();
+  const float r00 = rotation(0, 0), r01 = rotation(0, 1), r02 = rotation(0, 2);
+  const float r10 = rotation(1, 0), r11 = rotation(1, 1), r12 = rotation(1, 2);
+  const float r20 = rotation(2, 0), r21 = rotation(2, 1), r22 = rotation(2, 2);
+  const float t0 = transform.translation().x();
+  const float t1 = transform.translation().y();
+  const float t2 = transform.translation().z();
+  // The points are gathered into separate coordinate arrays per batch, so
+  // that the arithmetic runs on full SIMD registers despite the interleaved
+  // layout of the points. The arrays are zero-initialized so that the
+  // unused tail of a partial last batch never reads indeterminate values.
+  float x[kTransformBatchSize] = {};
+  float y[kTransformBatchSize] = {};
+  float z[kTransformBatchSize] = {};
+  for (size_t begin = 0; begin < num_points; begin += kTransformBatchSize) {
+    const size_t batch_size =
+        std::min(kTransformBatchSize, num_points - begin);
+    for (size_t i = 0; i < batch_size; ++i) {
+      const Eigen::Vector3f& position = points[begin + i].position;
+      x[i] = position.x();
+      y[i] = position.y();
+      z[i] = position.z();
+    }
+    float transformed_x[kTransformBatchSize];
+    float transformed_y[kTransformBatchSize];
+    float transformed_z[kTransformBatchSize];
+    for (size_t i = 0; i < kTransformBatchSize; ++i) {
+      transformed_x[i] = r00 * x[i] + r01 * y[i] + r02 * z[i] + t0;
+      transformed_y[i] = r10 * x[i] + r11 * y[i] + r12 * z[i] + t1;
+      transformed_z[i] = r20 * x[i] + r21 * y[i] + r22 * z[i] + t2;
+    }
+    for (size_t i = 0; i < batch_size; ++i) {
+      CopyAttributes(points[begin + i], &transformed_points[begin + i]);
+      transformed_points[begin + i].position =
+          Eigen::Vector3f(transformed_x[i], transformed_y[i], transformed_z[i]);
+    }
+  }
+}
+
+}  // namespace
 
 PointCloud::PointCloud() {}
 PointCloud::PointCloud(std::vector<PointCloud::PointType> points)
@@ -32,6 +92,19 @@ PointCloud::PointCloud(std::vector<PointType> points,
     CHECK_EQ(points_.size(), intensities_.size());
   }
 }
+PointCloud::PointCloud(std::vector<PointType> points,
+                       std::vector<float> intensities,
+                       PointAttributes attributes)
+    : points_(std::move(points)),
+      intensities_(std::move(intensities)),
+      attributes_(std::move(attributes)) {
+  if (!intensities_.empty()) {
+    CHECK_EQ(points_.size(), intensities_.size());
+  }
+  if (!attributes_.empty()) {
+    CHECK_EQ(points_.size(), attributes_.num_points());
+  }
+}
 
 size_t PointCloud::size() const { return points_.size(); }
 bool PointCloud::empty() const { return points_.empty(); }
@@ -42,6 +115,7 @@ const std::vector<PointCloud::PointType>& PointCloud::points() const {
 const std::vector<float>& PointCloud::intensities() const {
   return intensities_;
 }
+const PointAttributes& PointCloud::attributes() const { return attributes_; }
 const PointCloud::PointType& PointCloud::operator[](const size_t index) const {
   return points_[index];
 }
@@ -50,29 +124,55 @@ PointCloud::ConstIterator PointCloud::begin() const { return points_.begin(); }
 PointCloud::ConstIterator PointCloud::end() const { return points_.end(); }
 
 void PointCloud::push_back(PointCloud::PointType value) {
+  CHECK(attributes_.empty());
   points_.push_back(std::move(value));
 }
 
 PointCloud TransformPointCloud(const PointCloud& point_cloud,
                                const transform::Rigid3f& transform) {
   std::vector<RangefinderPoint> points;
-  points.reserve(point_cloud.size());
-  for (const RangefinderPoint& point : point_cloud.points()) {
-    points.emplace_back(transform * point);
-  }
-  return PointCloud(points, point_cloud.intensities());
+  TransformPointCloud(point_cloud, transform, &points);
+  return PointCloud(std::move(points), point_cloud.intensities(),
+                    point_cloud.attributes());
 }
 
 TimedPointCloud TransformTimedPointCloud(const TimedPointCloud& point_cloud,
                                          const transform::Rigid3f& transform) {
   TimedPointCloud result;
-  result.reserve(point_cloud.size());
-  for (const TimedRangefinderPoint& point : point_cloud) {
-    result.push_back(transform * point);
-  }
+  TransformTimedPointCloud(point_cloud, transform, &result);
   return result;
 }
 
+void TransformPoints(const transform::Rigid3f& transform,
+                     const RangefinderPoint* const points,
+                     const size_t num_points,
+                     RangefinderPoint* const transformed_points) {
+  TransformPointsImpl(transform, points, num_points, transformed_points);
+}
+
+void TransformPoints(const transform::Rigid3f& transform,
+                     const TimedRangefinderPoint* const points,
+                     const size_t num_points,
+                     TimedRangefinderPoint* const transformed_points) {
+  TransformPointsImpl(transform, points, num_points, transformed_points);
+}
+
+void TransformPointCloud(
+    const PointCloud& point_cloud, const transform::Rigid3f& transform,
+    std::vector<RangefinderPoint>* const transformed_points) {
+  transformed_points->resize(point_cloud.size());
+  TransformPoints(transform, point_cloud.points().data(), point_cloud.size(),
+                  transformed_points->data());
+}
+
+void TransformTimedPointCloud(const TimedPointCloud& point_cloud,
+                              const transform::Rigid3f& transform,
+                              TimedPointCloud* const transformed_point_cloud) {
+  transformed_point_cloud->resize(point_cloud.size());
+  TransformPoints(transform, point_cloud.data(), point_cloud.size(),
+                  transformed_point_cloud->data());
+}
+
 PointCloud CropPointCloud(const PointCloud& point_cloud, const float min_z,
                           const float max_z) {
   return point_cloud.copy_if([min_z, max_z](const RangefinderPoint& point) {
@@ -20,6 +20,7 @@
 #include <vector>
 
 #include "Eigen/Core"
+#include "cartographer/sensor/point_attributes.h"
 #include "cartographer/sensor/proto/sensor.pb.h"
 #include "cartographer/sensor/rangefinder_point.h"
 #include "cartographer/transform/rigid_transform.h"
@@ -30,7 +31,7 @@ namespace cartographer {
 namespace sensor {
 
 // Stores 3D positions of points together with some additional data, e.g.
-// intensities.
+// intensities and further per-point attributes.
 class PointCloud {
  public:
   using PointType = RangefinderPoint;
@@ -38,6 +39,8 @@ class PointCloud {
   PointCloud();
   explicit PointCloud(std::vector<PointType> points);
   PointCloud(std::vector<PointType> points, std::vector<float> intensities);
+  PointCloud(std::vector<PointType> points, std::vector<float> intensities,
+             PointAttributes attributes);
 
   // Returns the number of points in the point cloud.
   size_t size() const;
@@ -46,6 +49,7 @@ class PointCloud {
 
   const std::vector<PointType>& points() const;
   const std::vector<float>& intensities() const;
+  const PointAttributes& attributes() const;
   const PointType& operator[](const size_t index) const;
 
   // Iterator over the points in the point cloud.
@@ -53,15 +57,31 @@ class PointCloud {
   ConstIterator begin() const;
   ConstIterator end() const;
 
+  // Appends a point. Only allowed if there are no attributes.
   void push_back(PointType value);
 
   // Creates a PointCloud consisting of all the points for which `predicate`
-  // returns true, together with the corresponding intensities.
+  // returns true, together with the corresponding intensities and attributes.
   template <class UnaryPredicate>
   PointCloud copy_if(UnaryPredicate predicate) const {
     std::vector<PointType> points;
     std::vector<float> intensities;
 
+    if (!attributes_.empty()) {
+      std::vector<bool> selected(size());
+      for (size_t index = 0; index < size(); ++index) {
+        selected[index] = predicate(points_[index]);
+        if (selected[index]) {
+          points.push_back(points_[index]);
+          if (!intensities_.empty()) {
+            intensities.push_back(intensities_[index]);
+          }
+        }
+      }
+      return PointCloud(std::move(points), std::move(intensities),
+                        attributes_.Select(selected));
+    }
+
     // Note: benchmarks show that it is better to have this conditional outside
     // the loop.
     if (intensities_.empty()) {
@@ -90,6 +110,8 @@ class PointCloud {
   // Intensities are optional. If non-empty, they must have the same size as
   // points.
   std::vector<float> intensities_;
+  // Attributes are optional. If non-empty, they describe all points.
+  PointAttributes attributes_;
 };
 
 // Stores 3D positions of points with their relative measurement time in the
@@ -137,7 +159,8 @@ struct PointCloud_Ouster_WithRGBAClass {
   std::vector<uint32_t> classifications;
 };
 
-// Transforms 'point_cloud' according to 'transform'.
+// Transforms 'point_cloud' according to 'transform'. Intensities and
+// attributes are kept.
 PointCloud TransformPointCloud(const PointCloud& point_cloud,
                                const transform::Rigid3f& transform);
 
@@ -145,6 +168,30 @@ PointCloud TransformPointCloud(const PointCloud& point_cloud,
 TimedPointCloud TransformTimedPointCloud(const TimedPointCloud& point_cloud,
                                          const transform::Rigid3f& transform);
 
+// Transforms the 'num_points' points starting at 'points' according to
+// 'transform' and writes them to 'transformed_points', which must have room
+// for 'num_points' points. 'transformed_points' may be equal to 'points'.
+// The rotation is converted to a matrix once and points are processed in
+// batches which the compiler vectorizes.
+void TransformPoints(const transform::Rigid3f& transform,
+                     const RangefinderPoint* points, size_t num_points,
+                     RangefinderPoint* transformed_points);
+void TransformPoints(const transform::Rigid3f& transform,
+                     const TimedRangefinderPoint* points, size_t num_points,
+                     TimedRangefinderPoint* transformed_points);
+
+// Like TransformPointCloud(), but only transforms the points and writes them
+// to 'transformed_points', reusing its memory.
+void TransformPointCloud(const PointCloud& point_cloud,
+                         const transform::Rigid3f& transform,
+                         std::vector<RangefinderPoint>* transformed_points);
+
+// Like TransformTimedPointCloud(), but writes to 'transformed_point_cloud',
+// reusing its memory.
+void TransformTimedPointCloud(const TimedPointCloud& point_cloud,
+                              const transform::Rigid3f& transform,
+                              TimedPointCloud* transformed_point_cloud);
+
 // Returns a new point cloud without points that fall outside the region defined
 // by 'min_z' and 'max_z'.
 PointCloud CropPointCloud(const PointCloud& point_cloud, float min_z,
@@ -54,6 +54,33 @@ TEST(PointCloudTest, TransformTimedPointCloud) {
   EXPECT_NEAR(3.5f, transformed_point_cloud[1].position.y(), 1e-6);
 }
 
+TEST(PointCloudTest, TransformPointsMatchesPointwiseTransform) {
+  const transform::Rigid3f transform(
+      Eigen::Vector3f(1.f, -2.f, 3.f),
+      Eigen::AngleAxisf(0.7f, Eigen::Vector3f(1.f, 2.f, 3.f).normalized()));
+  // An odd number of points exercises the remainder of the last batch.
+  TimedPointCloud points;
+  for (int i = 0; i < 37; ++i) {
+    points.push_back({Eigen::Vector3f(0.1f * i, -0.3f * i, 2.f - 0.05f * i),
+                      0.01f * i});
+  }
+  TimedPointCloud transformed_points;
+  TransformTimedPointCloud(points, transform, &transformed_points);
+  TimedPointCloud transformed_in_place = points;
+  TransformPoints(transform, transformed_in_place.data(),
+                  transformed_in_place.size(), transformed_in_place.data());
+  ASSERT_EQ(points.size(), transformed_points.size());
+  for (size_t i = 0; i < points.size(); ++i) {
+    const TimedRangefinderPoint expected = transform * points[i];
+    EXPECT_TRUE(
+        expected.position.isApprox(transformed_points[i].position, 1e-5f));
+    EXPECT_TRUE(
+        expected.position.isApprox(transformed_in_place[i].position, 1e-5f));
+    EXPECT_EQ(expected.time, transformed_points[i].time);
+    EXPECT_EQ(expected.time, transformed_in_place[i].time);
+  }
+}
+
 TEST(PointCloudTest, CopyIf) {
   std::vector<RangefinderPoint> points = {
       {{0.f, 0.f, 0.f}}, {{1.f, 1.f, 1.f}}, {{2.f, 2.f, 2.f}}};
@@ -34,6 +34,9 @@ proto::TimedPointCloudData ToProto(
   for (const float intensity : timed_point_cloud_data.intensities) {
     proto.add_intensities(intensity);
   }
+  if (!timed_point_cloud_data.attributes.empty()) {
+    *proto.mutable_attributes() = ToProto(timed_point_cloud_data.attributes);
+  }
   return proto;
 }
 
@@ -53,11 +56,15 @@ TimedPointCloudData FromProto(const proto::TimedPointCloudData& proto) {
       timed_point_cloud.push_back({timed_point.head<3>(), timed_point[3]});
     }
   }
+  PointAttributes attributes = FromProto(proto.attributes());
+  CHECK(attributes.empty() ||
+        attributes.num_points() == timed_point_cloud.size());
   return TimedPointCloudData{common::FromUniversal(proto.timestamp()),
                              transform::ToEigen(proto.origin()),
                              timed_point_cloud,
                              std::vector<float>(proto.intensities().begin(),
-                                                proto.intensities().end())};
+                                                proto.intensities().end()),
+                             std::move(attributes)};
 }
 
 }  // namespace sensor
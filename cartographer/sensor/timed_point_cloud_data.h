@@ -18,7 +18,9 @@
 #define CARTOGRAPHER_SENSOR_TIMED_POINT_CLOUD_DATA_H_
 
 #include "Eigen/Core"
+#include "cartographer/common/port.h"
 #include "cartographer/common/time.h"
+#include "cartographer/sensor/point_attributes.h"
 #include "cartographer/sensor/point_cloud.h"
 
 namespace cartographer {
@@ -30,17 +32,25 @@ struct TimedPointCloudData {
   TimedPointCloud ranges;
   // 'intensities' has to be same size as 'ranges', or empty.
   std::vector<float> intensities;
+  // Further per-point channels, e.g. the reflectivity of Ouster sensors.
+  // Describes all of 'ranges', or is empty.
+  PointAttributes attributes;
 };
 
 struct TimedPointCloudOriginData {
   struct RangeMeasurement {
     TimedRangefinderPoint point_time;
     float intensity;
+    // Index of the point in the 'ranges' of its TimedPointCloudData, which
+    // addresses its attributes.
+    uint32 point_index;
     size_t origin_index;
   };
   common::Time time;
   std::vector<Eigen::Vector3f> origins;
   std::vector<RangeMeasurement> ranges;
+  // The attributes of the points of each origin, indexed by 'point_index'.
+  std::vector<PointAttributes> attributes;
 };
 
 // Converts 'timed_point_cloud_data' to a proto::TimedPointCloudData.
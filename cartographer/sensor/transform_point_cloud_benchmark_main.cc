@@ -0,0 +1,99 @@
+/*
+ * Copyright 2016 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "cartographer/common/internal/benchmark.h"
+#include "cartographer/sensor/point_cloud.h"
+#include "cartographer/transform/rigid_transform.h"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+DEFINE_int32(num_points, 100000, "Number of points in the point cloud.");
+DEFINE_int32(num_iterations, 100, "Number of times each variant is run.");
+
+namespace cartographer {
+namespace sensor {
+namespace {
+
+template <typename Function>
+void Benchmark(const std::string& name, Function function) {
+  common::RunBenchmark(name, FLAGS_num_iterations, FLAGS_num_points, "point",
+                       function);
+}
+
+void Run() {
+  std::mt19937 prng(42);
+  std::uniform_real_distribution<float> distribution(-50.f, 50.f);
+  TimedPointCloud timed_points;
+  timed_points.reserve(FLAGS_num_points);
+  for (int i = 0; i < FLAGS_num_points; ++i) {
+    timed_points.push_back({Eigen::Vector3f(distribution(prng),
+                                            distribution(prng),
+                                            distribution(prng)),
+                            0.f});
+  }
+  PointCloud point_cloud;
+  for (const TimedRangefinderPoint& point : timed_points) {
+    point_cloud.push_back({point.position});
+  }
+  const auto transform = [](const int iteration) {
+    return transform::Rigid3f(
+        Eigen::Vector3f(0.1f * iteration, 1.f, -2.f),
+        Eigen::AngleAxisf(0.01f * iteration, Eigen::Vector3f::UnitZ()));
+  };
+
+  Benchmark("Per point transform", [&](const int iteration) {
+    const transform::Rigid3f pose = transform(iteration);
+    std::vector<RangefinderPoint> result;
+    result.reserve(point_cloud.size());
+    for (const RangefinderPoint& point : point_cloud) {
+      result.push_back(pose * point);
+    }
+    return result.back().position.x();
+  });
+  Benchmark("TransformPointCloud", [&](const int iteration) {
+    return TransformPointCloud(point_cloud, transform(iteration))
+        .points()
+        .back()
+        .position.x();
+  });
+  std::vector<RangefinderPoint> buffer;
+  Benchmark("TransformPointCloud into buffer", [&](const int iteration) {
+    TransformPointCloud(point_cloud, transform(iteration), &buffer);
+    return buffer.back().position.x();
+  });
+  TimedPointCloud timed_buffer;
+  Benchmark("TransformTimedPointCloud into buffer", [&](const int iteration) {
+    TransformTimedPointCloud(timed_points, transform(iteration),
+                             &timed_buffer);
+    return timed_buffer.back().position.x();
+  });
+}
+
+}  // namespace
+}  // namespace sensor
+}  // namespace cartographer
+
+int main(int argc, char** argv) {
+  ::cartographer::common::InitBenchmark(
+      "Measures the time needed to transform point clouds.", &argc, &argv);
+  CHECK_GT(FLAGS_num_points, 0);
+  CHECK_GT(FLAGS_num_iterations, 0);
+  ::cartographer::sensor::Run();
+}
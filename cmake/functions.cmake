@@ -54,6 +54,16 @@ function(google_binary NAME)
   install(TARGETS "${NAME}" RUNTIME DESTINATION bin)
 endfunction()
 
+# Same as google_binary(), but for benchmarks used during development, which
+# are not installed.
+function(google_benchmark NAME)
+  _parse_arguments("${ARGN}")
+
+  add_executable(${NAME} ${ARG_SRCS})
+
+  _common_compile_stuff("PRIVATE")
+endfunction()
+
 # Create a variable 'VAR_NAME'='FLAG'. If VAR_NAME is already set, FLAG is
 # appended.
 function(google_add_flag VAR_NAME FLAG)
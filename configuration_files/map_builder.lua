@@ -20,4 +20,6 @@ MAP_BUILDER = {
   num_background_threads = 4,
   pose_graph = POSE_GRAPH,
   collate_by_trajectory = false,
+  collate_trajectories_in_parallel = false,
+  collation_queue_size = 1000,
 }
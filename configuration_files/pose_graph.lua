@@ -16,11 +16,18 @@ POSE_GRAPH = {
   optimize_every_n_nodes = 90,
   constraint_builder = {
     sampling_ratio = 0.3,
+    adaptive_sampling = {
+      use_adaptive_sampling = false,
+      closure_staleness_seconds = 30.,
+      closure_uncertainty_meters = 10.,
+      cpu_budget = 0.,
+    },
     max_constraint_distance = 15.,
     min_score = 0.55,
     global_localization_min_score = 0.6,
     loop_closure_translation_weight = 1.1e4,
     loop_closure_rotation_weight = 1e5,
+    share_rotated_scans_in_2d = false,
     log_matches = true,
     fast_correlative_scan_matcher = {
       linear_search_window = 7.,
@@ -45,6 +52,8 @@ POSE_GRAPH = {
       linear_xy_search_window = 5.,
       linear_z_search_window = 1.,
       angular_search_window = math.rad(15.),
+      num_precomputation_threads = 1,
+      serialize_precomputation_grids = false,
     },
     ceres_scan_matcher_3d = {
       occupied_space_weight_0 = 5.,
@@ -77,6 +86,9 @@ POSE_GRAPH = {
     log_solver_summary = false,
     use_online_imu_extrinsics_in_3d = true,
     fix_z_in_3d = false,
+    use_persistent_problem_in_2d = false,
+    use_submap_level_optimization = false,
+    refine_nodes_after_submap_level_optimization = false,
     ceres_solver_options = {
       use_nonmonotonic_steps = false,
       max_num_iterations = 50,
@@ -87,6 +99,8 @@ POSE_GRAPH = {
   global_sampling_ratio = 0.003,
   log_residual_histograms = true,
   global_constraint_search_after_n_seconds = 10.,
+  overloaded_work_queue_delay_seconds = 5.,
+  optimize_in_background = false,
   --  overlapping_submaps_trimmer_2d = {
   --    fresh_submaps_count = 1,
   --    min_covered_area = 2,
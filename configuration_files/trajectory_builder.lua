@@ -20,6 +20,11 @@ TRAJECTORY_BUILDER = {
   trajectory_builder_3d = TRAJECTORY_BUILDER_3D,
 --  pure_localization_trimmer = {
 --    max_submaps_to_keep = 3,
+--  },
+--  overloaded_pose_graph_motion_filter = {
+--    max_time_seconds = 5.,
+--    max_distance_meters = 0.5,
+--    max_angle_radians = math.rad(5.),
 --  },
   collate_fixed_frame = true,
   collate_landmarks = false,
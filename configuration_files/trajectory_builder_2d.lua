@@ -20,6 +20,7 @@ TRAJECTORY_BUILDER_2D = {
   max_z = 2.,
   missing_data_ray_length = 5.,
   num_accumulated_range_data = 1,
+  max_unwarping_pose_interval = 0.005,
   voxel_filter_size = 0.025,
 
   adaptive_voxel_filter = {
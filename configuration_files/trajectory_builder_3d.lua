@@ -19,6 +19,7 @@ TRAJECTORY_BUILDER_3D = {
   min_range = 1.,
   max_range = MAX_3D_RANGE,
   num_accumulated_range_data = 1,
+  max_unwarping_pose_interval = 0.005,
   voxel_filter_size = 0.15,
 
   high_resolution_adaptive_voxel_filter = {
@@ -98,6 +99,7 @@ TRAJECTORY_BUILDER_3D = {
     high_resolution_max_range = 20.,
     low_resolution = 0.45,
     num_range_data = 160,
+    num_insertion_threads = 1,
     range_data_inserter = {
       hit_probability = 0.55,
       miss_probability = 0.49,